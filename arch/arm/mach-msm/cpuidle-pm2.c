@@ -0,0 +1,212 @@
+/*
+ *  arch/arm/mach-msm/cpuidle-pm2.c
+ *
+ *  cpuidle driver for the pm2 low power modes (7x27a, 8x25)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Each idle supported mode of a cpu becomes a cpuidle state, deepest
+ * last.  msm_pm_idle_prepare() flags the states that the next timer,
+ * pm_qos, wake locks and the modem rule out; the governor picks among
+ * the rest.  On top of the usage and time kept by cpuidle, count aborted
+ * entries, wakeups before the target residency, and the exit latency
+ * seen whenever the expected timer is what woke us.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/cpu.h>
+#include <linux/cpuidle.h>
+#include <linux/ktime.h>
+#include <linux/sysdev.h>
+#include <linux/sysfs.h>
+#include <linux/tick.h>
+
+#include "pm.h"
+
+struct msm_cpuidle_stats {
+	u32 aborts;		/* Mode refused or failed to enter */
+	u32 early;		/* Woke before the target residency */
+	u32 lat_samples;
+	u32 lat_avg_us;		/* Running average, 1/8 weight */
+	u32 lat_max_us;
+};
+
+static const struct {
+	enum msm_pm_sleep_mode mode;
+	const char *name;
+	const char *desc;
+} msm_cpuidle_modes[] = {
+	{ MSM_PM_SLEEP_MODE_WAIT_FOR_INTERRUPT,
+		"C0", "wfi" },
+	{ MSM_PM_SLEEP_MODE_RAMP_DOWN_AND_WAIT_FOR_INTERRUPT,
+		"C1", "ramp_down_and_wfi" },
+	{ MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE,
+		"C2", "standalone_power_collapse" },
+	{ MSM_PM_SLEEP_MODE_POWER_COLLAPSE_NO_XO_SHUTDOWN,
+		"C3", "power_collapse_no_xo_shutdown" },
+	{ MSM_PM_SLEEP_MODE_POWER_COLLAPSE,
+		"C4", "power_collapse" },
+};
+
+static DEFINE_PER_CPU_SHARED_ALIGNED(struct cpuidle_device, msm_cpuidle_devs);
+static DEFINE_PER_CPU(struct msm_cpuidle_stats,
+		      msm_cpuidle_stats[CPUIDLE_STATE_MAX]);
+
+static struct cpuidle_driver msm_cpuidle_driver = {
+	.name = "msm_idle",
+	.owner = THIS_MODULE,
+};
+
+static int msm_cpuidle_enter(struct cpuidle_device *dev,
+			     struct cpuidle_state *state)
+{
+	struct msm_cpuidle_stats *stats;
+	enum msm_pm_sleep_mode mode;
+	ktime_t start, expected;
+	s64 residency_us, lat_us;
+	int ret;
+
+	mode = (enum msm_pm_sleep_mode)state->driver_data;
+	/* Governor had nothing left to choose from */
+	if (state->flags & CPUIDLE_FLAG_IGNORE)
+		mode = MSM_PM_SLEEP_MODE_NR;
+
+	expected = tick_nohz_get_sleep_length();
+	start = ktime_get();
+	ret = msm_pm_idle_enter(mode);
+	residency_us = ktime_to_us(ktime_sub(ktime_get(), start));
+	local_irq_enable();
+
+	stats = &__get_cpu_var(msm_cpuidle_stats)[state - dev->states];
+	if (ret) {
+		stats->aborts++;
+		return (int)residency_us;
+	}
+
+	if (residency_us < state->target_residency)
+		stats->early++;
+
+	lat_us = residency_us - ktime_to_us(expected);
+	if (lat_us >= 0) {
+		if (stats->lat_samples++)
+			stats->lat_avg_us += ((s32)lat_us -
+					      (s32)stats->lat_avg_us) / 8;
+		else
+			stats->lat_avg_us = lat_us;
+		if (lat_us > stats->lat_max_us)
+			stats->lat_max_us = lat_us;
+	}
+
+	return (int)residency_us;
+}
+
+static ssize_t show_msm_stats(struct sysdev_class *class,
+			      struct sysdev_class_attribute *attr, char *buf)
+{
+	struct cpuidle_device *dev;
+	struct msm_cpuidle_stats *stats;
+	ssize_t i = 0;
+	int cpu, n;
+
+	i += scnprintf(buf + i, PAGE_SIZE - i,
+		"cpu state      usage     time_us  aborts   early "
+		"latency lat_avg lat_max\n");
+
+	for_each_possible_cpu(cpu) {
+		dev = &per_cpu(msm_cpuidle_devs, cpu);
+		for (n = 0; n < dev->state_count; n++) {
+			stats = &per_cpu(msm_cpuidle_stats, cpu)[n];
+			i += scnprintf(buf + i, PAGE_SIZE - i,
+				"%3d %-5s %10llu %11llu %7u %7u "
+				"%7u %7u %7u\n", cpu, dev->states[n].name,
+				dev->states[n].usage, dev->states[n].time,
+				stats->aborts, stats->early,
+				dev->states[n].exit_latency,
+				stats->lat_avg_us, stats->lat_max_us);
+		}
+	}
+
+	return i;
+}
+
+static ssize_t store_msm_stats(struct sysdev_class *class,
+			       struct sysdev_class_attribute *attr,
+			       const char *buf, size_t count)
+{
+	int cpu;
+
+	/* Any write clears the counters kept here, not cpuidle's own */
+	for_each_possible_cpu(cpu)
+		memset(per_cpu(msm_cpuidle_stats, cpu), 0,
+		       sizeof(per_cpu(msm_cpuidle_stats, cpu)));
+
+	return count;
+}
+
+static SYSDEV_CLASS_ATTR(msm_stats, 0644, show_msm_stats, store_msm_stats);
+
+static void __init msm_cpuidle_set_states(struct cpuidle_device *dev,
+					  struct msm_pm_platform_data *modes)
+{
+	struct msm_pm_platform_data *data;
+	struct cpuidle_state *state;
+	int i;
+
+	dev->state_count = 0;
+	for (i = 0; i < ARRAY_SIZE(msm_cpuidle_modes); i++) {
+		data = &modes[MSM_PM_MODE(dev->cpu, msm_cpuidle_modes[i].mode)];
+		if (!data->idle_supported)
+			continue;
+
+		state = &dev->states[dev->state_count++];
+		snprintf(state->name, CPUIDLE_NAME_LEN, "%s",
+			 msm_cpuidle_modes[i].name);
+		snprintf(state->desc, CPUIDLE_DESC_LEN, "%s",
+			 msm_cpuidle_modes[i].desc);
+		state->driver_data = (void *)msm_cpuidle_modes[i].mode;
+		state->exit_latency = data->latency;
+		state->target_residency = data->residency;
+		state->flags = CPUIDLE_FLAG_TIME_VALID;
+		state->enter = msm_cpuidle_enter;
+	}
+}
+
+int __init msm_pm_cpuidle_init(struct msm_pm_platform_data *modes)
+{
+	struct cpuidle_device *dev;
+	unsigned int cpu;
+	int ret;
+
+	ret = cpuidle_register_driver(&msm_cpuidle_driver);
+	if (ret) {
+		pr_err("%s: failed to register cpuidle driver: %d\n",
+			__func__, ret);
+		return ret;
+	}
+
+	for_each_possible_cpu(cpu) {
+		dev = &per_cpu(msm_cpuidle_devs, cpu);
+		dev->cpu = cpu;
+		dev->prepare = msm_pm_idle_prepare;
+		msm_cpuidle_set_states(dev, modes);
+		if (!dev->state_count)
+			continue;
+
+		ret = cpuidle_register_device(dev);
+		if (ret)
+			pr_err("%s: failed to register cpuidle device for "
+				"cpu%u: %d\n", __func__, cpu, ret);
+	}
+
+	/* /sys/devices/system/cpu/cpuidle/msm_stats */
+	ret = sysfs_add_file_to_group(&cpu_sysdev_class.kset.kobj,
+				      &attr_msm_stats.attr, "cpuidle");
+	if (ret)
+		pr_err("%s: failed to add msm_stats: %d\n", __func__, ret);
+
+	return 0;
+}
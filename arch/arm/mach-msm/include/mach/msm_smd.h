@@ -19,6 +19,7 @@
 #define __ASM_ARCH_MSM_SMD_H
 
 #include <linux/io.h>
+#include <linux/uio.h>
 #include <mach/msm_smsm.h>
 
 typedef struct smd_channel smd_channel_t;
@@ -154,7 +155,13 @@ struct smd_platform {
 };
 
 #ifdef CONFIG_MSM_SMD
-/* warning: notify() may be called before open returns */
+/* warning: notify() may be called before open returns
+ *
+ * SMD_EVENT_DATA and SMD_EVENT_STATUS are delivered with interrupts off but
+ * without the smd lock, and may call the regular read/write functions.
+ * The *_from_cb() variants are only for the other events, which are still
+ * delivered with the lock held.
+ */
 int smd_open(const char *name, smd_channel_t **ch, void *priv,
 	     void (*notify)(void *priv, unsigned event));
 
@@ -266,6 +273,34 @@ int smd_write_segment(smd_channel_t *ch, void *data, int len, int user_buf);
  */
 int smd_write_end(smd_channel_t *ch);
 
+/* Gathers @iovcnt buffers into the channel with a single notification of
+ * the other side.  Packet channels take all of it as one packet or nothing
+ * (-ENOMEM), and fail with -EIO if the packet is cut short after its
+ * header went out; stream channels may do a partial write.
+ *
+ * Returns the number of bytes written or a negative error.
+ */
+int smd_writev(smd_channel_t *ch, const struct kvec *iov, int iovcnt);
+
+/* Zero-copy access to the ring buffer.
+ *
+ * smd_write_reserve() sets @ptr to the next contiguous free space and
+ * returns its size; fill some of it, then publish @len bytes with
+ * smd_write_commit().  On packet channels this is only allowed between
+ * smd_write_start() and smd_write_end() and counts against the packet.
+ *
+ * smd_read_peek() sets @ptr to the next contiguous readable bytes (of the
+ * current packet on packet channels) and returns how many there are; the
+ * data stays valid until smd_read_consume() hands @len of them back.
+ *
+ * A wrapped ring takes two rounds.  There must be a single writer and a
+ * single reader per channel, as for the copying calls.
+ */
+int smd_write_reserve(smd_channel_t *ch, void **ptr);
+int smd_write_commit(smd_channel_t *ch, int len);
+int smd_read_peek(smd_channel_t *ch, void **ptr);
+int smd_read_consume(smd_channel_t *ch, int len);
+
 /*
  * Returns a pointer to the subsystem name or NULL if no
  * subsystem name is available.
@@ -405,6 +440,32 @@ static inline int smd_write_end(smd_channel_t *ch)
 	return -ENODEV;
 }
 
+static inline int
+smd_writev(smd_channel_t *ch, const struct kvec *iov, int iovcnt)
+{
+	return -ENODEV;
+}
+
+static inline int smd_write_reserve(smd_channel_t *ch, void **ptr)
+{
+	return -ENODEV;
+}
+
+static inline int smd_write_commit(smd_channel_t *ch, int len)
+{
+	return -ENODEV;
+}
+
+static inline int smd_read_peek(smd_channel_t *ch, void **ptr)
+{
+	return -ENODEV;
+}
+
+static inline int smd_read_consume(smd_channel_t *ch, int len)
+{
+	return -ENODEV;
+}
+
 static inline const char *smd_edge_to_subsystem(uint32_t type)
 {
 	return NULL;
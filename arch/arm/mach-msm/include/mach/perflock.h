@@ -20,6 +20,9 @@
 #define __ARCH_ARM_MACH_PERF_LOCK_H
 
 #include <linux/list.h>
+#include <linux/plist.h>
+#include <linux/timer.h>
+#include <linux/ktime.h>
 #include <linux/cpufreq.h>
 
 /*
@@ -47,12 +50,23 @@ enum {
 	CEILING_LEVEL_INVALID,
 };
 
+struct perf_lock_stats {
+	unsigned int count;		/* Times activated */
+	unsigned int expire_count;	/* Times released by its timeout */
+	ktime_t total_time;		/* Time spent active */
+	ktime_t max_time;
+	ktime_t last_time;		/* Last activation */
+};
+
 struct perf_lock {
-	struct list_head link;
+	struct list_head link;		/* On the list of all perf locks */
+	struct plist_node node;		/* On the active list, by level */
+	struct timer_list timer;	/* Expires a timed lock */
 	unsigned int flags;
 	unsigned int level;
 	const char *name;
 	unsigned int type;
+	struct perf_lock_stats stat;
 };
 
 struct perflock_platform_data {
@@ -77,7 +91,11 @@ static inline void perf_lock_init(struct perf_lock *lock,
 static inline void perf_lock_init_v2(struct perf_lock *lock,
 	unsigned int level, const char *name) { return; }
 static inline void perf_lock(struct perf_lock *lock) { return; }
+static inline void perf_lock_timeout(struct perf_lock *lock,
+	long timeout) { return; }
 static inline void perf_unlock(struct perf_lock *lock) { return; }
+static inline void perf_unlock_if_active(struct perf_lock *lock) { return; }
+static inline long perf_lock_time_left(struct perf_lock *lock) { return -1; }
 static inline int is_perf_lock_active(struct perf_lock *lock) { return 0; }
 static inline int is_perf_locked(void) { return 0; }
 static inline void perflock_scaling_max_freq(unsigned int freq, unsigned int cpu) { return; }
@@ -93,7 +111,10 @@ extern void perf_lock_init(struct perf_lock *lock,
 extern void perf_lock_init_v2(struct perf_lock *lock,
 	unsigned int level, const char *name);
 extern void perf_lock(struct perf_lock *lock);
+extern void perf_lock_timeout(struct perf_lock *lock, long timeout);
 extern void perf_unlock(struct perf_lock *lock);
+extern void perf_unlock_if_active(struct perf_lock *lock);
+extern long perf_lock_time_left(struct perf_lock *lock);
 extern int is_perf_lock_active(struct perf_lock *lock);
 extern int is_perf_locked(void);
 extern void perflock_scaling_max_freq(unsigned int freq, unsigned int cpu);
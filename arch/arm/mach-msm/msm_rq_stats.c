@@ -26,11 +26,32 @@
 #include <linux/sched.h>
 #include <linux/spinlock.h>
 #include <linux/rq_stats.h>
+#include <linux/ktime.h>
 #include <asm/smp_plat.h>
 
 #define MAX_LONG_SIZE 24
 #define DEFAULT_RQ_POLL_JIFFIES 1
 #define DEFAULT_DEF_TIMER_JIFFIES 5
+#define DEFAULT_AVG_SHIFT 2
+#define DEFAULT_UP_THRESH 20
+#define DEFAULT_DOWN_THRESH 12
+#define DEFAULT_UP_DELAY_MS 40
+#define DEFAULT_DOWN_DELAY_MS 200
+
+struct rq_hotplug_stats {
+	unsigned int count;
+	unsigned int fail;
+	unsigned int last_us;		/* Decision to core on or off */
+	unsigned int max_us;
+	u64 total_us;
+};
+
+static struct rq_hotplug_stats rq_up_stats, rq_down_stats;
+static DEFINE_MUTEX(rq_hotplug_lock);
+
+/* Time each core has spent online, as an energy proxy */
+static int64_t cpu_online_since[NR_CPUS];
+static int64_t cpu_online_ns[NR_CPUS];
 
 static void def_work_fn(struct work_struct *work)
 {
@@ -44,6 +65,90 @@ static void def_work_fn(struct work_struct *work)
 	sysfs_notify(rq_info.kobj, NULL, "def_timer_ms");
 }
 
+#ifdef CONFIG_HOTPLUG_CPU
+static void rq_hotplug_account(struct rq_hotplug_stats *st, int ret)
+{
+	int64_t diff;
+
+	if (ret) {
+		st->fail++;
+		return;
+	}
+
+	diff = ktime_to_ns(ktime_get()) - rq_info.state_time;
+	do_div(diff, 1000);
+	st->count++;
+	st->last_us = (unsigned int) diff;
+	st->total_us += st->last_us;
+	if (st->last_us > st->max_us)
+		st->max_us = st->last_us;
+}
+
+/* Bring a core up while the run queue is high, the last one down after */
+static void rq_hotplug(int state)
+{
+	int cpu;
+	int ret;
+
+	mutex_lock(&rq_hotplug_lock);
+
+	if (state) {
+		for_each_present_cpu(cpu) {
+			if (cpu_online(cpu))
+				continue;
+			ret = cpu_up(cpu);
+			rq_hotplug_account(&rq_up_stats, ret);
+			break;
+		}
+	} else if (num_online_cpus() > 1) {
+		for (cpu = nr_cpu_ids - 1; cpu > 0; cpu--) {
+			if (!cpu_online(cpu))
+				continue;
+			ret = cpu_down(cpu);
+			rq_hotplug_account(&rq_down_stats, ret);
+			break;
+		}
+	}
+
+	mutex_unlock(&rq_hotplug_lock);
+}
+#else
+static void rq_hotplug(int state) { }
+#endif
+
+static void rq_state_work_fn(struct work_struct *work)
+{
+	int state = rq_info.state;
+
+	/* Notify polling threads on change of value */
+	sysfs_notify(rq_info.kobj, NULL, "run_queue_state");
+
+	if (rq_info.hotplug_enabled)
+		rq_hotplug(state);
+}
+
+static int __cpuinit rq_cpu_callback(struct notifier_block *nb,
+				     unsigned long action, void *hcpu)
+{
+	unsigned int cpu = (unsigned long)hcpu;
+	int64_t now = ktime_to_ns(ktime_get());
+
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_ONLINE:
+		cpu_online_since[cpu] = now;
+		break;
+	case CPU_DEAD:
+		cpu_online_ns[cpu] += now - cpu_online_since[cpu];
+		break;
+	}
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block __refdata rq_cpu_notifier = {
+	.notifier_call = rq_cpu_callback,
+};
+
 static ssize_t show_run_queue_avg(struct kobject *kobj,
 		struct kobj_attribute *attr, char *buf)
 {
@@ -111,6 +216,146 @@ static ssize_t store_def_timer_ms(struct kobject *kobj,
 	return count;
 }
 
+static ssize_t show_cpu_run_queue_avg(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	unsigned int val;
+	int cpu;
+	int ret = 0;
+
+	for_each_possible_cpu(cpu) {
+		val = 0;
+		if (cpu_online(cpu))
+			val = (rq_cpu_avg_read(cpu) * 10) >> RQ_AVG_FSHIFT;
+		ret += snprintf(buf + ret, PAGE_SIZE - ret, "%u.%u ",
+				val/10, val%10);
+	}
+	buf[ret - 1] = '\n';
+
+	return ret;
+}
+
+static ssize_t show_run_queue_decay_shift(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return snprintf(buf, MAX_LONG_SIZE, "%u\n", rq_info.avg_shift);
+}
+
+static ssize_t store_run_queue_decay_shift(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	unsigned int val = 0;
+
+	sscanf(buf, "%u", &val);
+	rq_info.avg_shift = min_t(unsigned int, val, RQ_AVG_SHIFT_MAX);
+
+	return count;
+}
+
+static ssize_t show_run_queue_state(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	unsigned int val = rq_info.total_avg;
+
+	return snprintf(buf, MAX_LONG_SIZE, "%d %u.%u\n", rq_info.state,
+			val/10, val%10);
+}
+
+#define MSM_RQ_STATS_UINT_ATTR(att, field)				\
+static ssize_t show_##att(struct kobject *kobj,				\
+		struct kobj_attribute *attr, char *buf)			\
+{									\
+	return snprintf(buf, MAX_LONG_SIZE, "%u\n", rq_info.field);	\
+}									\
+static ssize_t store_##att(struct kobject *kobj,			\
+		struct kobj_attribute *attr, const char *buf, size_t count) \
+{									\
+	unsigned int val = 0;						\
+									\
+	sscanf(buf, "%u", &val);					\
+	rq_info.field = val;						\
+	return count;							\
+}
+
+MSM_RQ_STATS_UINT_ATTR(run_queue_up_thresh, up_thresh)
+MSM_RQ_STATS_UINT_ATTR(run_queue_down_thresh, down_thresh)
+MSM_RQ_STATS_UINT_ATTR(hotplug_enable, hotplug_enabled)
+
+static ssize_t show_run_queue_up_delay_ms(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return snprintf(buf, MAX_LONG_SIZE, "%u\n",
+			jiffies_to_msecs(rq_info.up_delay_jiffies));
+}
+
+static ssize_t store_run_queue_up_delay_ms(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	unsigned int val = 0;
+
+	sscanf(buf, "%u", &val);
+	rq_info.up_delay_jiffies = msecs_to_jiffies(val);
+
+	return count;
+}
+
+static ssize_t show_run_queue_down_delay_ms(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return snprintf(buf, MAX_LONG_SIZE, "%u\n",
+			jiffies_to_msecs(rq_info.down_delay_jiffies));
+}
+
+static ssize_t store_run_queue_down_delay_ms(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	unsigned int val = 0;
+
+	sscanf(buf, "%u", &val);
+	rq_info.down_delay_jiffies = msecs_to_jiffies(val);
+
+	return count;
+}
+
+static ssize_t show_hotplug_stats(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	struct rq_hotplug_stats *st[] = { &rq_up_stats, &rq_down_stats };
+	static const char * const name[] = { "up", "down" };
+	int64_t now = ktime_to_ns(ktime_get());
+	int64_t online;
+	u64 avg;
+	int ret = 0;
+	int i;
+	int cpu;
+
+	mutex_lock(&rq_hotplug_lock);
+	for (i = 0; i < ARRAY_SIZE(st); i++) {
+		avg = st[i]->total_us;
+		if (st[i]->count)
+			do_div(avg, st[i]->count);
+		ret += snprintf(buf + ret, PAGE_SIZE - ret,
+				"%s: count %u fail %u last_us %u max_us %u "
+				"avg_us %llu\n", name[i], st[i]->count,
+				st[i]->fail, st[i]->last_us, st[i]->max_us,
+				avg);
+	}
+	mutex_unlock(&rq_hotplug_lock);
+
+	get_online_cpus();
+	for_each_possible_cpu(cpu) {
+		online = cpu_online_ns[cpu];
+		if (cpu_online(cpu))
+			online += now - cpu_online_since[cpu];
+		do_div(online, NSEC_PER_MSEC);
+		ret += snprintf(buf + ret, PAGE_SIZE - ret,
+				"cpu%d online_ms %lld\n", cpu, online);
+	}
+	put_online_cpus();
+
+	return ret;
+}
+
 #define MSM_RQ_STATS_RO_ATTRIB(att) ({ \
 		struct attribute *attrib = NULL; \
 		struct kobj_attribute *ptr = NULL; \
@@ -141,7 +386,7 @@ static int init_rq_attribs(void)
 {
 	int i;
 	int err = 0;
-	const int attr_count = 4;
+	const int attr_count = 13;
 
 	struct attribute **attribs =
 		kzalloc(sizeof(struct attribute *) * attr_count, GFP_KERNEL);
@@ -154,7 +399,16 @@ static int init_rq_attribs(void)
 	attribs[0] = MSM_RQ_STATS_RW_ATTRIB(def_timer_ms);
 	attribs[1] = MSM_RQ_STATS_RO_ATTRIB(run_queue_avg);
 	attribs[2] = MSM_RQ_STATS_RW_ATTRIB(run_queue_poll_ms);
-	attribs[3] = NULL;
+	attribs[3] = MSM_RQ_STATS_RO_ATTRIB(cpu_run_queue_avg);
+	attribs[4] = MSM_RQ_STATS_RW_ATTRIB(run_queue_decay_shift);
+	attribs[5] = MSM_RQ_STATS_RW_ATTRIB(run_queue_up_thresh);
+	attribs[6] = MSM_RQ_STATS_RW_ATTRIB(run_queue_down_thresh);
+	attribs[7] = MSM_RQ_STATS_RW_ATTRIB(run_queue_up_delay_ms);
+	attribs[8] = MSM_RQ_STATS_RW_ATTRIB(run_queue_down_delay_ms);
+	attribs[9] = MSM_RQ_STATS_RO_ATTRIB(run_queue_state);
+	attribs[10] = MSM_RQ_STATS_RW_ATTRIB(hotplug_enable);
+	attribs[11] = MSM_RQ_STATS_RO_ATTRIB(hotplug_stats);
+	attribs[12] = NULL;
 
 	for (i = 0; i < attr_count - 1 ; i++) {
 		if (!attribs[i])
@@ -197,6 +451,7 @@ rel:
 static int __init msm_rq_stats_init(void)
 {
 	int ret;
+	int cpu;
 
 	/* Bail out if this is not an SMP Target */
 	if (!is_smp()) {
@@ -207,13 +462,26 @@ static int __init msm_rq_stats_init(void)
 	rq_wq = create_singlethread_workqueue("rq_stats");
 	BUG_ON(!rq_wq);
 	INIT_WORK(&rq_info.def_timer_work, def_work_fn);
+	INIT_WORK(&rq_info.state_work, rq_state_work_fn);
 	spin_lock_init(&rq_lock);
 	rq_info.rq_poll_jiffies = DEFAULT_RQ_POLL_JIFFIES;
 	rq_info.def_timer_jiffies = DEFAULT_DEF_TIMER_JIFFIES;
 	rq_info.rq_poll_last_jiffy = 0;
 	rq_info.def_timer_last_jiffy = 0;
+	rq_info.avg_shift = DEFAULT_AVG_SHIFT;
+	rq_info.up_thresh = DEFAULT_UP_THRESH;
+	rq_info.down_thresh = DEFAULT_DOWN_THRESH;
+	rq_info.up_delay_jiffies = msecs_to_jiffies(DEFAULT_UP_DELAY_MS);
+	rq_info.down_delay_jiffies = msecs_to_jiffies(DEFAULT_DOWN_DELAY_MS);
+	rq_info.state_jiffy = jiffies;
 	ret = init_rq_attribs();
 
+	get_online_cpus();
+	for_each_online_cpu(cpu)
+		cpu_online_since[cpu] = ktime_to_ns(ktime_get());
+	register_hotcpu_notifier(&rq_cpu_notifier);
+	put_online_cpus();
+
 	rq_info.init = 1;
 	return ret;
 }
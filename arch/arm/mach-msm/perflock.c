@@ -19,6 +19,7 @@
 #include <linux/device.h>
 #include <linux/clk.h>
 #include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/earlysuspend.h>
 #include <linux/cpufreq.h>
 #include <linux/timer.h>
@@ -28,6 +29,7 @@
 
 #define PERF_LOCK_INITIALIZED	(1U << 0)
 #define PERF_LOCK_ACTIVE	(1U << 1)
+#define PERF_LOCK_AUTO_EXPIRE	(1U << 2)
 
 enum {
 	PERF_LOCK_DEBUG = 1U << 0,
@@ -37,10 +39,15 @@ enum {
 	PERF_SCREEN_ON_POLICY_DEBUG = 1U << 4,
 };
 
-static LIST_HEAD(active_perf_locks);
-static LIST_HEAD(inactive_perf_locks);
-static LIST_HEAD(active_cpufreq_ceiling_locks);
-static LIST_HEAD(inactive_cpufreq_ceiling_locks);
+/*
+ * Active locks are kept sorted by level, so the level in force is always
+ * the last node of each list.
+ */
+static LIST_HEAD(perf_locks);
+static struct plist_head active_perf_locks =
+	PLIST_HEAD_INIT(active_perf_locks);
+static struct plist_head active_cpufreq_ceiling_locks =
+	PLIST_HEAD_INIT(active_cpufreq_ceiling_locks);
 static DEFINE_SPINLOCK(list_lock);
 static DEFINE_SPINLOCK(policy_update_lock);
 static int initialized;
@@ -281,44 +288,42 @@ void perflock_scaling_min_freq(unsigned int freq, unsigned int cpu)
 	per_cpu(stored_policy_min, cpu) = freq;
 }
 
+static struct plist_head *perf_lock_head(struct perf_lock *lock)
+{
+	if (lock->type == TYPE_CPUFREQ_CEILING)
+		return &active_cpufreq_ceiling_locks;
+	return &active_perf_locks;
+}
+
 static unsigned int get_perflock_speed(void)
 {
 	unsigned long irqflags;
-	struct perf_lock *lock;
-	unsigned int perf_level = 0;
+	unsigned int speed = 0;
 
 	/* Get the maxmimum perf level. */
-	if (list_empty(&active_perf_locks))
-		return 0;
-
 	spin_lock_irqsave(&list_lock, irqflags);
-	list_for_each_entry(lock, &active_perf_locks, link) {
-		if (lock->level > perf_level)
-			perf_level = lock->level;
-	}
+	if (!plist_head_empty(&active_perf_locks))
+		speed = perf_acpu_table[plist_last(&active_perf_locks)->prio];
 	spin_unlock_irqrestore(&list_lock, irqflags);
 
-	return perf_acpu_table[perf_level];
+	return speed;
 }
 
 static unsigned int get_cpufreq_ceiling_speed(void)
 {
 	unsigned long irqflags;
-	struct perf_lock *lock;
-	unsigned int perf_level = 0;
+	unsigned int speed = 0;
+	int level;
 
 	/* Get the maxmimum perf level. */
-	if (list_empty(&active_cpufreq_ceiling_locks))
-		return 0;
-
 	spin_lock_irqsave(&list_lock, irqflags);
-	list_for_each_entry(lock, &active_cpufreq_ceiling_locks, link) {
-		if (lock->level > perf_level)
-			perf_level = lock->level;
+	if (!plist_head_empty(&active_cpufreq_ceiling_locks)) {
+		level = plist_last(&active_cpufreq_ceiling_locks)->prio;
+		speed = cpufreq_ceiling_acpu_table[level];
 	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
 
-	return cpufreq_ceiling_acpu_table[perf_level];
+	return speed;
 }
 
 static void print_active_locks(void)
@@ -327,10 +332,10 @@ static void print_active_locks(void)
 	struct perf_lock *lock;
 
 	spin_lock_irqsave(&list_lock, irqflags);
-	list_for_each_entry(lock, &active_perf_locks, link) {
+	plist_for_each_entry(lock, &active_perf_locks, node) {
 		pr_info("active perf lock '%s'\n", lock->name);
 	}
-	list_for_each_entry(lock, &active_cpufreq_ceiling_locks, link) {
+	plist_for_each_entry(lock, &active_cpufreq_ceiling_locks, node) {
 		pr_info("active cpufreq_ceiling_locks '%s'\n", lock->name);
 	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
@@ -342,16 +347,17 @@ void htc_print_active_perf_locks(void)
 	struct perf_lock *lock;
 
 	spin_lock_irqsave(&list_lock, irqflags);
-	if (!list_empty(&active_perf_locks)) {
+	if (!plist_head_empty(&active_perf_locks)) {
 		pr_info("perf_lock:");
-		list_for_each_entry(lock, &active_perf_locks, link) {
+		plist_for_each_entry(lock, &active_perf_locks, node) {
 			pr_info(" '%s' ", lock->name);
 		}
 		pr_info("\n");
 	}
-	if (!list_empty(&active_cpufreq_ceiling_locks)) {
+	if (!plist_head_empty(&active_cpufreq_ceiling_locks)) {
 		printk(KERN_WARNING"perf_lock:");
-		list_for_each_entry(lock, &active_cpufreq_ceiling_locks, link) {
+		plist_for_each_entry(lock, &active_cpufreq_ceiling_locks,
+				     node) {
 			printk(KERN_WARNING" '%s' ", lock->name);
 		}
 		pr_info("\n");
@@ -359,6 +365,38 @@ void htc_print_active_perf_locks(void)
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
 
+/* Drop @lock from its active list and account the time it was held */
+static void perf_unlock_locked(struct perf_lock *lock)
+{
+	ktime_t active;
+
+	lock->flags &= ~(PERF_LOCK_ACTIVE | PERF_LOCK_AUTO_EXPIRE);
+	plist_del(&lock->node, perf_lock_head(lock));
+	del_timer(&lock->timer);
+
+	active = ktime_sub(ktime_get(), lock->stat.last_time);
+	lock->stat.total_time = ktime_add(lock->stat.total_time, active);
+	if (ktime_to_ns(active) > ktime_to_ns(lock->stat.max_time))
+		lock->stat.max_time = active;
+}
+
+static void perf_lock_expire(unsigned long data)
+{
+	struct perf_lock *lock = (struct perf_lock *)data;
+	unsigned long irqflags;
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	/* Skip if released or re-armed while we waited for the lock */
+	if ((lock->flags & PERF_LOCK_AUTO_EXPIRE) &&
+	    !timer_pending(&lock->timer)) {
+		if (debug_mask & PERF_EXPIRE_DEBUG)
+			pr_info("%s: '%s'\n", __func__, lock->name);
+		lock->stat.expire_count++;
+		perf_unlock_locked(lock);
+	}
+	spin_unlock_irqrestore(&list_lock, irqflags);
+}
+
 /**
  * perf_lock_init_v2 - acquire a cpufreq_ceiling perf lock
  * @lock: cpufreq_ceiling perf lock to acquire
@@ -400,13 +438,13 @@ void perf_lock_init(struct perf_lock *lock,
 	lock->name = name;
 	lock->flags = PERF_LOCK_INITIALIZED;
 	lock->level = level;
+	memset(&lock->stat, 0, sizeof(lock->stat));
+	plist_node_init(&lock->node, level);
+	setup_timer(&lock->timer, perf_lock_expire, (unsigned long)lock);
 
 	INIT_LIST_HEAD(&lock->link);
 	spin_lock_irqsave(&list_lock, irqflags);
-	if (lock->type == TYPE_PERF_LOCK)
-		list_add(&lock->link, &inactive_perf_locks);
-	if (lock->type == TYPE_CPUFREQ_CEILING)
-		list_add(&lock->link, &inactive_cpufreq_ceiling_locks);
+	list_add(&lock->link, &perf_locks);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
 EXPORT_SYMBOL(perf_lock_init);
@@ -430,13 +468,13 @@ static void do_set_rate_fn(struct work_struct *work)
 }
 
 static DECLARE_WORK(do_setrate_work, do_set_rate_fn);
-void perf_lock(struct perf_lock *lock)
+static void perf_lock_activate(struct perf_lock *lock, long timeout)
 {
 	unsigned long irqflags;
 	int cpu;
 
 	WARN_ON((lock->flags & PERF_LOCK_INITIALIZED) == 0);
-	WARN_ON(lock->flags & PERF_LOCK_ACTIVE);
+	WARN_ON(!timeout && (lock->flags & PERF_LOCK_ACTIVE));
 	if (lock->type == TYPE_PERF_LOCK) {
 		WARN_ON(!initialized);
 		if (!initialized) {
@@ -458,24 +496,53 @@ void perf_lock(struct perf_lock *lock)
 		pr_info("%s: '%s', flags %d level %d type %u\n",
 			__func__, lock->name, lock->flags, lock->level, lock->type);
 	if (lock->flags & PERF_LOCK_ACTIVE) {
-		pr_err("%s:type(%u) over-locked\n", __func__, lock->type);
+		if (timeout) {
+			/* Already in force, just move the expiry */
+			lock->flags |= PERF_LOCK_AUTO_EXPIRE;
+			mod_timer(&lock->timer, jiffies + timeout);
+		} else {
+			pr_err("%s:type(%u) over-locked\n", __func__,
+			       lock->type);
+		}
 		spin_unlock_irqrestore(&list_lock, irqflags);
 		return;
 	}
 	lock->flags |= PERF_LOCK_ACTIVE;
-	list_del(&lock->link);
-	if (lock->type == TYPE_PERF_LOCK)
-		list_add(&lock->link, &active_perf_locks);
-	else if (lock->type == TYPE_CPUFREQ_CEILING)
-		list_add(&lock->link, &active_cpufreq_ceiling_locks);
+	plist_node_init(&lock->node, lock->level);
+	plist_add(&lock->node, perf_lock_head(lock));
+	lock->stat.count++;
+	lock->stat.last_time = ktime_get();
+	if (timeout) {
+		lock->flags |= PERF_LOCK_AUTO_EXPIRE;
+		mod_timer(&lock->timer, jiffies + timeout);
+	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
 
 	for_each_online_cpu(cpu) {
 		queue_work_on(cpu, perflock_setrate_workqueue, &do_setrate_work);
 	}
 }
+
+void perf_lock(struct perf_lock *lock)
+{
+	perf_lock_activate(lock, 0);
+}
 EXPORT_SYMBOL(perf_lock);
 
+/**
+ * perf_lock_timeout - activate a perf lock that releases itself
+ * @lock: perf lock to activate
+ * @timeout: jiffies until @lock is released
+ *
+ * Activate @lock, or push the expiry of an active @lock out to @timeout
+ * from now.  perf_unlock() may still release it early.
+ */
+void perf_lock_timeout(struct perf_lock *lock, long timeout)
+{
+	perf_lock_activate(lock, timeout > 0 ? timeout : 1);
+}
+EXPORT_SYMBOL(perf_lock_timeout);
+
 /**
  * perf_unlock - de-activate a perf lock
  * @lock: perf lock to de-activate
@@ -514,17 +581,50 @@ void perf_unlock(struct perf_lock *lock)
 		spin_unlock_irqrestore(&list_lock, irqflags);
 		return;
 	}
-	lock->flags &= ~PERF_LOCK_ACTIVE;
-	list_del(&lock->link);
-	if (lock->type == TYPE_PERF_LOCK)
-		list_add(&lock->link, &inactive_perf_locks);
-	else if (lock->type == TYPE_CPUFREQ_CEILING)
-		list_add(&lock->link, &inactive_cpufreq_ceiling_locks);
-
+	perf_unlock_locked(lock);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
 EXPORT_SYMBOL(perf_unlock);
 
+/**
+ * perf_unlock_if_active - de-activate a perf lock unless it is not active
+ * @lock: perf lock to de-activate
+ *
+ * Like perf_unlock(), but checks and releases @lock atomically, so a timed
+ * @lock expiring meanwhile is not reported as under-locked.
+ */
+void perf_unlock_if_active(struct perf_lock *lock)
+{
+	unsigned long irqflags;
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	if (lock->flags & PERF_LOCK_ACTIVE)
+		perf_unlock_locked(lock);
+	spin_unlock_irqrestore(&list_lock, irqflags);
+}
+EXPORT_SYMBOL(perf_unlock_if_active);
+
+/**
+ * perf_lock_time_left - query how long a timed perf lock stays active
+ * @lock: target perf lock
+ * RETURN: jiffies until @lock expires, 0 if it expires by now,
+ *	   -1 if it is not active or not timed
+ */
+long perf_lock_time_left(struct perf_lock *lock)
+{
+	unsigned long irqflags;
+	long left = -1;
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	if ((lock->flags & PERF_LOCK_ACTIVE) &&
+	    (lock->flags & PERF_LOCK_AUTO_EXPIRE))
+		left = max_t(long, (long)(lock->timer.expires - jiffies), 0);
+	spin_unlock_irqrestore(&list_lock, irqflags);
+
+	return left;
+}
+EXPORT_SYMBOL(perf_lock_time_left);
+
 /**
  * is_perf_lock_active - query if a perf_lock is active or not
  * @lock: target perf lock
@@ -544,7 +644,7 @@ EXPORT_SYMBOL(is_perf_lock_active);
  */
 int is_perf_locked(void)
 {
-	return (!list_empty(&active_perf_locks));
+	return (!plist_head_empty(&active_perf_locks));
 }
 EXPORT_SYMBOL(is_perf_locked);
 
@@ -682,3 +782,54 @@ invalid_config:
 	pr_err("[K] %s: invalid configuration data, %p %d %d\n", __func__,
 		cpufreq_ceiling_acpu_table, table_size, PERF_LOCK_INVALID);
 }
+
+#ifdef CONFIG_DEBUG_FS
+static int perflock_stats_show(struct seq_file *m, void *unused)
+{
+	unsigned long irqflags;
+	struct perf_lock *lock;
+	ktime_t now = ktime_get();
+	ktime_t total;
+
+	seq_puts(m, "name\ttype\tlevel\tactive\tcount\texpire_count\t"
+		 "total_ms\tmax_ms\n");
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	list_for_each_entry(lock, &perf_locks, link) {
+		total = lock->stat.total_time;
+		if (lock->flags & PERF_LOCK_ACTIVE)
+			total = ktime_add(total,
+					  ktime_sub(now, lock->stat.last_time));
+
+		seq_printf(m, "\"%s\"\t%u\t%u\t%d\t%u\t%u\t%lld\t%lld\n",
+			   lock->name, lock->type, lock->level,
+			   !!(lock->flags & PERF_LOCK_ACTIVE),
+			   lock->stat.count, lock->stat.expire_count,
+			   ktime_to_ms(total),
+			   ktime_to_ms(lock->stat.max_time));
+	}
+	spin_unlock_irqrestore(&list_lock, irqflags);
+
+	return 0;
+}
+
+static int perflock_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, perflock_stats_show, NULL);
+}
+
+static const struct file_operations perflock_stats_fops = {
+	.open = perflock_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init perflock_debugfs_init(void)
+{
+	debugfs_create_file("perflock", S_IRUGO, NULL, NULL,
+			    &perflock_stats_fops);
+	return 0;
+}
+late_initcall(perflock_debugfs_init);
+#endif
@@ -81,6 +81,14 @@ void msm_pm_set_platform_data(struct msm_pm_platform_data *data, int count);
 void msm_pm_set_irq_extns(struct msm_pm_irq_calls *irq_calls);
 int msm_pm_idle_prepare(struct cpuidle_device *dev);
 int msm_pm_idle_enter(enum msm_pm_sleep_mode sleep_mode);
+#if defined(CONFIG_CPU_IDLE) && defined(CONFIG_MSM_PM2)
+int msm_pm_cpuidle_init(struct msm_pm_platform_data *modes);
+#else
+static inline int msm_pm_cpuidle_init(struct msm_pm_platform_data *modes)
+{
+	return 0;
+}
+#endif
 void msm_pm_cpu_enter_lowpower(unsigned int cpu);
 
 void __init msm_pm_init_sleep_status_data(
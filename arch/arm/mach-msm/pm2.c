@@ -1381,37 +1381,19 @@ static int64_t msm_pm_timer_exit_suspend(int64_t time, int64_t period)
  *****************************************************************************/
 
 /*
- * Put CPU in low power mode.
+ * Work out which low power modes the coming idle period allows on @cpu.
  */
-void arch_idle(void)
+static void msm_pm_idle_allow(unsigned int cpu, bool *allow)
 {
-	bool allow[MSM_PM_SLEEP_MODE_NR];
-	uint32_t sleep_limit = SLEEP_LIMIT_NONE;
-	enum msm_pm_sleep_mode sleep_mode = MSM_PM_SLEEP_MODE_NR;
-
 	int64_t timer_expiration;
 	int latency_qos;
-	int ret;
 	int i;
-	unsigned int cpu;
-	int64_t t1;
-	static DEFINE_PER_CPU(int64_t, t2);
-	int exit_stat;
 
-	if (!atomic_read(&msm_pm_init_done))
-		return;
-
-	cpu = smp_processor_id();
 	latency_qos = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
 	/* get the next timer expiration */
 	timer_expiration = ktime_to_ns(tick_nohz_get_sleep_length());
 
-	t1 = ktime_to_ns(ktime_get());
-	msm_pm_add_stat(MSM_PM_STAT_NOT_IDLE, t1 - __get_cpu_var(t2));
-	msm_pm_add_stat(MSM_PM_STAT_REQUESTED_IDLE, timer_expiration);
-	exit_stat = MSM_PM_STAT_IDLE_SPIN;
-
-	for (i = 0; i < ARRAY_SIZE(allow); i++)
+	for (i = 0; i < MSM_PM_SLEEP_MODE_NR; i++)
 		allow[i] = true;
 
 	if (num_online_cpus() > 1 ||
@@ -1425,7 +1407,7 @@ void arch_idle(void)
 		allow[MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE] = false;
 	}
 
-	for (i = 0; i < ARRAY_SIZE(allow); i++) {
+	for (i = 0; i < MSM_PM_SLEEP_MODE_NR; i++) {
 		struct msm_pm_platform_data *mode =
 					&msm_pm_modes[MSM_PM_MODE(cpu, i)];
 		if (!mode->idle_supported || !mode->idle_enabled ||
@@ -1455,16 +1437,74 @@ void arch_idle(void)
 	}
 
 	MSM_PM_DPRINTK(MSM_PM_DEBUG_IDLE, KERN_INFO,
-		"%s(): latency qos %d, next timer %lld, sleep limit %u\n",
-		__func__, latency_qos, timer_expiration, sleep_limit);
+		"%s(): latency qos %d, next timer %lld\n",
+		__func__, latency_qos, timer_expiration);
 
-	for (i = 0; i < ARRAY_SIZE(allow); i++)
+	for (i = 0; i < MSM_PM_SLEEP_MODE_NR; i++)
 		MSM_PM_DPRINTK(MSM_PM_DEBUG_IDLE, KERN_INFO,
 			"%s(): allow %s: %d\n", __func__,
 			msm_pm_sleep_mode_labels[i], (int)allow[i]);
+}
 
-	if (allow[MSM_PM_SLEEP_MODE_POWER_COLLAPSE] ||
-		allow[MSM_PM_SLEEP_MODE_POWER_COLLAPSE_NO_XO_SHUTDOWN]) {
+/*
+ * Flag the cpuidle states the coming idle period does not allow, so the
+ * governor only picks among the others.
+ */
+int msm_pm_idle_prepare(struct cpuidle_device *dev)
+{
+	bool allow[MSM_PM_SLEEP_MODE_NR];
+	int i;
+
+	if (!atomic_read(&msm_pm_init_done))
+		return -EAGAIN;
+
+	msm_pm_idle_allow(dev->cpu, allow);
+
+	for (i = 0; i < dev->state_count; i++) {
+		struct cpuidle_state *state = &dev->states[i];
+		enum msm_pm_sleep_mode mode =
+			(enum msm_pm_sleep_mode)state->driver_data;
+
+		if (allow[mode])
+			state->flags &= ~CPUIDLE_FLAG_IGNORE;
+		else
+			state->flags |= CPUIDLE_FLAG_IGNORE;
+	}
+
+	return 0;
+}
+
+/*
+ * Enter @sleep_mode, or spin until an interrupt is pending when it is
+ * MSM_PM_SLEEP_MODE_NR.  Called with interrupts disabled.
+ *
+ * Return value:
+ *      -EAGAIN: pm2 is not initialized yet
+ *      other negative values: the mode was aborted
+ *      0: success
+ */
+int msm_pm_idle_enter(enum msm_pm_sleep_mode sleep_mode)
+{
+	uint32_t sleep_limit = SLEEP_LIMIT_NONE;
+	int64_t t1;
+	static DEFINE_PER_CPU(int64_t, t2);
+	int exit_stat;
+	int ret = 0;
+
+	if (!atomic_read(&msm_pm_init_done))
+		return -EAGAIN;
+
+	t1 = ktime_to_ns(ktime_get());
+	msm_pm_add_stat(MSM_PM_STAT_NOT_IDLE, t1 - __get_cpu_var(t2));
+	msm_pm_add_stat(MSM_PM_STAT_REQUESTED_IDLE,
+			ktime_to_ns(tick_nohz_get_sleep_length()));
+
+	switch (sleep_mode) {
+	case MSM_PM_SLEEP_MODE_POWER_COLLAPSE_NO_XO_SHUTDOWN:
+		sleep_limit = SLEEP_LIMIT_NO_TCXO_SHUTDOWN;
+		sleep_mode = MSM_PM_SLEEP_MODE_POWER_COLLAPSE;
+		/* fall through */
+	case MSM_PM_SLEEP_MODE_POWER_COLLAPSE: {
 		/* Sync the timer with SCLK, it is needed only for modem
 		 * assissted pollapse case.
 		 */
@@ -1472,16 +1512,12 @@ void arch_idle(void)
 		uint32_t sleep_delay;
 		bool low_power = false;
 
-		sleep_mode = MSM_PM_SLEEP_MODE_POWER_COLLAPSE;
 		sleep_delay = (uint32_t) msm_pm_convert_and_cap_time(
 			next_timer_exp, MSM_PM_SLEEP_TICK_LIMIT);
 
 		if (sleep_delay == 0) /* 0 would mean infinite time */
 			sleep_delay = 1;
 
-		if (!allow[MSM_PM_SLEEP_MODE_POWER_COLLAPSE])
-			sleep_limit = SLEEP_LIMIT_NO_TCXO_SHUTDOWN;
-
 #if defined(CONFIG_MSM_MEMORY_LOW_POWER_MODE_IDLE_ACTIVE)
 		sleep_limit |= SLEEP_RESOURCE_MEMORY_BIT1;
 #elif defined(CONFIG_MSM_MEMORY_LOW_POWER_MODE_IDLE_RETENTION)
@@ -1498,40 +1534,67 @@ void arch_idle(void)
 			exit_stat = MSM_PM_STAT_IDLE_POWER_COLLAPSE;
 			msm_pm_sleep_limit = sleep_limit;
 		}
-	} else if (allow[MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE]) {
-		sleep_mode = MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE;
+		break;
+	}
+	case MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE:
 		ret = msm_pm_power_collapse_standalone(true);
 		exit_stat = ret ?
 			MSM_PM_STAT_IDLE_FAILED_STANDALONE_POWER_COLLAPSE :
 			MSM_PM_STAT_IDLE_STANDALONE_POWER_COLLAPSE;
-	} else if (allow[MSM_PM_SLEEP_MODE_RAMP_DOWN_AND_WAIT_FOR_INTERRUPT]) {
-		sleep_mode = MSM_PM_SLEEP_MODE_RAMP_DOWN_AND_WAIT_FOR_INTERRUPT;
+		break;
+	case MSM_PM_SLEEP_MODE_RAMP_DOWN_AND_WAIT_FOR_INTERRUPT:
 		ret = msm_pm_swfi(true, true);
 		if (ret)
 			while (!msm_pm_irq_extns->irq_pending())
 				udelay(1);
 
 		exit_stat = ret ? MSM_PM_STAT_IDLE_SPIN : MSM_PM_STAT_IDLE_WFI;
-
-	} else if (allow[MSM_PM_SLEEP_MODE_WAIT_FOR_INTERRUPT]) {
-		sleep_mode = MSM_PM_SLEEP_MODE_WAIT_FOR_INTERRUPT;
+		break;
+	case MSM_PM_SLEEP_MODE_WAIT_FOR_INTERRUPT:
 		msm_pm_swfi(true, false);
 
 		exit_stat = MSM_PM_STAT_IDLE_WFI;
-
-	} else {
+		break;
+	default:
 		while (!msm_pm_irq_extns->irq_pending())
 			udelay(1);
 
 		exit_stat = MSM_PM_STAT_IDLE_SPIN;
-
+		break;
 	}
 
-
 	__get_cpu_var(t2) = ktime_to_ns(ktime_get());
 	msm_pm_add_stat(exit_stat, __get_cpu_var(t2) - t1);
-	htc_idle_stat_add(sleep_mode, (u32)(t2 - t1)/1000);
+	htc_idle_stat_add(sleep_mode, (u32)(__get_cpu_var(t2) - t1)/1000);
+
+	return ret;
+}
+
+/*
+ * Put CPU in low power mode.
+ */
+void arch_idle(void)
+{
+	bool allow[MSM_PM_SLEEP_MODE_NR];
+	enum msm_pm_sleep_mode sleep_mode = MSM_PM_SLEEP_MODE_NR;
+
+	if (!atomic_read(&msm_pm_init_done))
+		return;
+
+	msm_pm_idle_allow(smp_processor_id(), allow);
+
+	if (allow[MSM_PM_SLEEP_MODE_POWER_COLLAPSE])
+		sleep_mode = MSM_PM_SLEEP_MODE_POWER_COLLAPSE;
+	else if (allow[MSM_PM_SLEEP_MODE_POWER_COLLAPSE_NO_XO_SHUTDOWN])
+		sleep_mode = MSM_PM_SLEEP_MODE_POWER_COLLAPSE_NO_XO_SHUTDOWN;
+	else if (allow[MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE])
+		sleep_mode = MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE;
+	else if (allow[MSM_PM_SLEEP_MODE_RAMP_DOWN_AND_WAIT_FOR_INTERRUPT])
+		sleep_mode = MSM_PM_SLEEP_MODE_RAMP_DOWN_AND_WAIT_FOR_INTERRUPT;
+	else if (allow[MSM_PM_SLEEP_MODE_WAIT_FOR_INTERRUPT])
+		sleep_mode = MSM_PM_SLEEP_MODE_WAIT_FOR_INTERRUPT;
 
+	msm_pm_idle_enter(sleep_mode);
 }
 
 /*
@@ -1984,6 +2047,7 @@ static int __init msm_pm_init(void)
 	msm_pm_add_stats(enable_stats, ARRAY_SIZE(enable_stats));
 
 	atomic_set(&msm_pm_init_done, 1);
+	msm_pm_cpuidle_init(msm_pm_modes);
 	boot_lock_nohalt();
 	return 0;
 }
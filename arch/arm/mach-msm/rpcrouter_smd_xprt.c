@@ -257,7 +257,7 @@ static int rpcrouter_smd_loopback_probe(struct platform_device *pdev)
 	if (rc < 0)
 		return rc;
 
-	smd_disable_read_intr(smd_remote_xprt.channel);
+	smd_disable_read_intr(smd_loopback_xprt.channel);
 	return 0;
 }
 
@@ -354,6 +354,7 @@ static remote_spinlock_t remote_spinlock;
 
 static LIST_HEAD(smd_ch_list_loopback);
 static void smd_fake_irq_handler(unsigned long arg);
+static void notify_loopback_smd(void);
 static void smsm_cb_snapshot(uint32_t use_wakelock);
 
 static struct workqueue_struct *smsm_cb_wq;
@@ -653,6 +654,11 @@ struct smd_channel {
 	unsigned fifo_mask;
 	struct list_head ch_list;
 
+	/* DATA/STATUS events found by the irq scan, under smd_lock */
+	struct list_head pending_list;
+	unsigned pending;
+	int notify_cpu;		/* cpu delivering them, or -1 */
+
 	unsigned current_packet;
 	unsigned n;
 	void *priv;
@@ -1147,6 +1153,46 @@ static void ch_write_done(struct smd_channel *ch, unsigned count)
 	ch->half_ch->set_fHEAD(ch->send, 1);
 }
 
+/* basic write interface to ch_write_{buffer,done} used by
+ * smd_stream_write() and smd_writev(); the caller signals the other side
+ */
+static int ch_write(struct smd_channel *ch, const void *_data, int len,
+		    int user_buf)
+{
+	void *ptr;
+	const unsigned char *buf = _data;
+	unsigned xfer;
+	int orig_len = len;
+	int r = 0;
+
+	while ((xfer = ch_write_buffer(ch, &ptr)) != 0) {
+		if (!ch_is_open(ch)) {
+			len = orig_len;
+			break;
+		}
+		if (xfer > len)
+			xfer = len;
+		if (user_buf) {
+			r = copy_from_user(ptr, buf, xfer);
+			if (r > 0) {
+				pr_err("[SMD] %s: "
+					"copy_from_user could not copy %i "
+					"bytes.\n",
+					__func__,
+					r);
+			}
+		} else
+			memcpy(ptr, buf, xfer);
+		ch_write_done(ch, xfer);
+		len -= xfer;
+		buf += xfer;
+		if (len == 0)
+			break;
+	}
+
+	return orig_len - len;
+}
+
 static void ch_set_state(struct smd_channel *ch, unsigned n)
 {
 	if (n == SMD_SS_OPENED) {
@@ -1236,6 +1282,24 @@ static void handle_smd_irq_closing_list(void)
 	spin_unlock_irqrestore(&smd_lock, flags);
 }
 
+#define SMD_PENDING_DATA	1
+#define SMD_PENDING_STATUS	2
+
+static void smd_queue_pending(struct smd_channel *ch, unsigned pending,
+			      struct list_head *dispatch)
+{
+	ch->pending |= pending;
+	/* already queued, or whoever is delivering it will requeue it */
+	if (list_empty(&ch->pending_list) && ch->notify_cpu < 0)
+		list_add_tail(&ch->pending_list, dispatch);
+}
+
+/*
+ * The fifo flags are read and cleared under smd_lock, but the DATA and
+ * STATUS notifies of the channels found signalled run once it is dropped
+ * (interrupts stay off).  A channel is only delivered by one cpu at a time;
+ * events raised while its notify runs are picked up by that same pass.
+ */
 static void handle_smd_irq(struct list_head *list, void (*notify)(void))
 {
 	unsigned long flags;
@@ -1243,11 +1307,14 @@ static void handle_smd_irq(struct list_head *list, void (*notify)(void))
 	unsigned ch_flags;
 	unsigned tmp;
 	unsigned char state_change;
+	unsigned pending;
+	LIST_HEAD(dispatch);
 
 	spin_lock_irqsave(&smd_lock, flags);
 	list_for_each_entry(ch, list, ch_list) {
 		state_change = 0;
 		ch_flags = 0;
+		pending = 0;
 		if (ch_is_open(ch)) {
 			if (ch->half_ch->get_fHEAD(ch->recv)) {
 				ch->half_ch->set_fHEAD(ch->recv, 0);
@@ -1275,18 +1342,61 @@ static void handle_smd_irq(struct list_head *list, void (*notify)(void))
 					ch->n, ch->name,
 					ch->read_avail(ch),
 					ch->fifo_size - ch->write_avail(ch));
-			ch->notify(ch->priv, SMD_EVENT_DATA);
+			pending |= SMD_PENDING_DATA;
 		}
 		if (ch_flags & 0x4 && !state_change) {
 			SMx_POWER_INFO("SMD ch%d '%s' State update\n",
 					ch->n, ch->name);
-			ch->notify(ch->priv, SMD_EVENT_STATUS);
+			pending |= SMD_PENDING_STATUS;
 		}
+		if (pending)
+			smd_queue_pending(ch, pending, &dispatch);
+	}
+
+	while (!list_empty(&dispatch)) {
+		ch = list_first_entry(&dispatch, struct smd_channel,
+				      pending_list);
+		list_del_init(&ch->pending_list);
+		pending = ch->pending;
+		ch->pending = 0;
+		ch->notify_cpu = smp_processor_id();
+		spin_unlock(&smd_lock);
+
+		if (pending & SMD_PENDING_DATA)
+			ch->notify(ch->priv, SMD_EVENT_DATA);
+		if (pending & SMD_PENDING_STATUS)
+			ch->notify(ch->priv, SMD_EVENT_STATUS);
+
+		spin_lock(&smd_lock);
+		ch->notify_cpu = -1;
+		if (ch->pending)
+			list_add_tail(&ch->pending_list, &dispatch);
 	}
 	spin_unlock_irqrestore(&smd_lock, flags);
 	do_smd_probe();
 }
 
+/*
+ * Wait for a notify of @ch running on another cpu to return.  @ch must
+ * already be off the edge lists so that no new one can start; a notify
+ * closing its own channel does not wait for itself.
+ */
+static void smd_notify_sync(struct smd_channel *ch)
+{
+	unsigned long flags;
+	int busy;
+
+	for (;;) {
+		spin_lock_irqsave(&smd_lock, flags);
+		busy = ch->notify_cpu >= 0 &&
+			ch->notify_cpu != smp_processor_id();
+		spin_unlock_irqrestore(&smd_lock, flags);
+		if (!busy)
+			break;
+		cpu_relax();
+	}
+}
+
 static irqreturn_t smd_modem_irq_handler(int irq, void *data)
 {
 	SMx_POWER_INFO("SMD Int Modem->Apps\n");
@@ -1339,6 +1449,7 @@ static void smd_fake_irq_handler(unsigned long arg)
 	handle_smd_irq(&smd_ch_list_dsps, notify_dsps_smd);
 	handle_smd_irq(&smd_ch_list_wcnss, notify_wcnss_smd);
 	handle_smd_irq(&smd_ch_list_rpm, notify_rpm_smd);
+	handle_smd_irq(&smd_ch_list_loopback, notify_loopback_smd);
 	handle_smd_irq_closing_list();
 }
 
@@ -1422,11 +1533,7 @@ static int smd_is_packet(struct smd_alloc_elm *alloc_elm)
 static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 				int user_buf)
 {
-	void *ptr;
-	const unsigned char *buf = _data;
-	unsigned xfer;
-	int orig_len = len;
-	int r = 0;
+	int r;
 
 	SMD_DBG("smd_stream_write() %d -> ch%d\n", len, ch->n);
 	if (len < 0)
@@ -1434,35 +1541,11 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 	else if (len == 0)
 		return 0;
 
-	while ((xfer = ch_write_buffer(ch, &ptr)) != 0) {
-		if (!ch_is_open(ch)) {
-			len = orig_len;
-			break;
-		}
-		if (xfer > len)
-			xfer = len;
-		if (user_buf) {
-			r = copy_from_user(ptr, buf, xfer);
-			if (r > 0) {
-				pr_err("[SMD] %s: "
-					"copy_from_user could not copy %i "
-					"bytes.\n",
-					__func__,
-					r);
-			}
-		} else
-			memcpy(ptr, buf, xfer);
-		ch_write_done(ch, xfer);
-		len -= xfer;
-		buf += xfer;
-		if (len == 0)
-			break;
-	}
-
-	if (orig_len - len)
+	r = ch_write(ch, _data, len, user_buf);
+	if (r)
 		ch->notify_other_cpu();
 
-	return orig_len - len;
+	return r;
 }
 
 static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
@@ -1652,6 +1735,8 @@ static int smd_alloc_channel(struct smd_alloc_elm *alloc_elm)
 	}
 	ch->n = alloc_elm->cid;
 	ch->type = SMD_CHANNEL_TYPE(alloc_elm->type);
+	INIT_LIST_HEAD(&ch->pending_list);
+	ch->notify_cpu = -1;
 
 	if (smd_alloc_v2(ch) && smd_alloc_v1(ch)) {
 		kfree(ch);
@@ -1713,16 +1798,10 @@ static int smd_alloc_channel(struct smd_alloc_elm *alloc_elm)
 	return 0;
 }
 
-static inline void notify_loopback_smd(void)
+/* the other end is us: run the irq scan over the loopback list */
+static void notify_loopback_smd(void)
 {
-	unsigned long flags;
-	struct smd_channel *ch;
-
-	spin_lock_irqsave(&smd_lock, flags);
-	list_for_each_entry(ch, &smd_ch_list_loopback, ch_list) {
-		ch->notify(ch->priv, SMD_EVENT_DATA);
-	}
-	spin_unlock_irqrestore(&smd_lock, flags);
+	handle_smd_irq(&smd_ch_list_loopback, notify_loopback_smd);
 }
 
 static int smd_alloc_loopback_channel(void)
@@ -1746,7 +1825,10 @@ static int smd_alloc_loopback_channel(void)
 
 	ch->fifo_mask = ch->fifo_size - 1;
 	ch->type = SMD_LOOPBACK_TYPE;
+	ch->half_ch = get_half_ch_funcs(ch->type);
 	ch->notify_other_cpu = notify_loopback_smd;
+	INIT_LIST_HEAD(&ch->pending_list);
+	ch->notify_cpu = -1;
 
 	ch->read = smd_stream_read;
 	ch->write = smd_stream_write;
@@ -1920,6 +2002,8 @@ int smd_close(smd_channel_t *ch)
 
 	spin_lock_irqsave(&smd_lock, flags);
 	list_del(&ch->ch_list);
+	list_del_init(&ch->pending_list);
+	ch->pending = 0;
 	if (ch->n == SMD_LOOPBACK_CID) {
 		ch->half_ch->set_fDSR(ch->send, 0);
 		ch->half_ch->set_fCTS(ch->send, 0);
@@ -1931,8 +2015,10 @@ int smd_close(smd_channel_t *ch)
 	if (ch->half_ch->get_state(ch->recv) == SMD_SS_OPENED) {
 		list_add(&ch->ch_list, &smd_ch_closing_list);
 		spin_unlock_irqrestore(&smd_lock, flags);
+		smd_notify_sync(ch);
 	} else {
 		spin_unlock_irqrestore(&smd_lock, flags);
+		smd_notify_sync(ch);
 		ch->notify = do_nothing_notify;
 		mutex_lock(&smd_creation_mutex);
 		list_add(&ch->ch_list, &smd_ch_closed_list);
@@ -2035,6 +2121,154 @@ int smd_write_end(smd_channel_t *ch)
 }
 EXPORT_SYMBOL(smd_write_end);
 
+int smd_writev(smd_channel_t *ch, const struct kvec *iov, int iovcnt)
+{
+	unsigned hdr[5];
+	int len = 0;
+	int r = 0;
+	int n, i;
+
+	if (!ch) {
+		pr_err("[SMD] %s: Invalid channel specified\n", __func__);
+		return -ENODEV;
+	}
+	if (ch->pending_pkt_sz)
+		return -EBUSY;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+	if (len == 0)
+		return 0;
+
+	/* all of it as one packet, or nothing */
+	if (ch->is_pkt_ch) {
+		if (smd_stream_write_avail(ch) < (len + SMD_HEADER_SIZE))
+			return -ENOMEM;
+
+		hdr[0] = len;
+		hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
+		if (ch_write(ch, hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+			SMD_DBG("%s failed to write pkt header\n", __func__);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < iovcnt; i++) {
+		n = ch_write(ch, iov[i].iov_base, iov[i].iov_len, 0);
+		r += n;
+		if (n != iov[i].iov_len)
+			break;
+	}
+
+	if (r || ch->is_pkt_ch)
+		ch->notify_other_cpu();
+
+	/* the header promised len bytes, the framing is lost */
+	if (ch->is_pkt_ch && r != len) {
+		pr_err("[SMD] %s: packet cut short, %d of %d bytes\n",
+			__func__, r, len);
+		return -EIO;
+	}
+
+	return r;
+}
+EXPORT_SYMBOL(smd_writev);
+
+int smd_write_reserve(smd_channel_t *ch, void **ptr)
+{
+	int n;
+
+	if (!ch) {
+		pr_err("[SMD] %s: Invalid channel specified\n", __func__);
+		return -ENODEV;
+	}
+	if (ch->is_pkt_ch && !ch->pending_pkt_sz) {
+		pr_err("[SMD] %s: no transaction in progress\n", __func__);
+		return -ENOEXEC;
+	}
+	if (!ch_is_open(ch))
+		return 0;
+
+	n = ch_write_buffer(ch, ptr);
+	if (ch->is_pkt_ch && n > ch->pending_pkt_sz)
+		n = ch->pending_pkt_sz;
+
+	return n;
+}
+EXPORT_SYMBOL(smd_write_reserve);
+
+int smd_write_commit(smd_channel_t *ch, int len)
+{
+	void *ptr;
+
+	if (!ch) {
+		pr_err("[SMD] %s: Invalid channel specified\n", __func__);
+		return -ENODEV;
+	}
+	if (len < 0 || len > ch_write_buffer(ch, &ptr) ||
+	    (ch->is_pkt_ch && len > ch->pending_pkt_sz)) {
+		pr_err("[SMD] %s: invalid length: %d\n", __func__, len);
+		return -EINVAL;
+	}
+	if (len == 0)
+		return 0;
+
+	ch_write_done(ch, len);
+	if (ch->is_pkt_ch)
+		ch->pending_pkt_sz -= len;
+	ch->notify_other_cpu();
+
+	return len;
+}
+EXPORT_SYMBOL(smd_write_commit);
+
+int smd_read_peek(smd_channel_t *ch, void **ptr)
+{
+	int n;
+
+	if (!ch) {
+		pr_err("%s: Invalid channel specified\n", __func__);
+		return -ENODEV;
+	}
+
+	n = ch_read_buffer(ch, ptr);
+	if (ch->is_pkt_ch && n > ch->current_packet)
+		n = ch->current_packet;
+
+	return n;
+}
+EXPORT_SYMBOL(smd_read_peek);
+
+int smd_read_consume(smd_channel_t *ch, int len)
+{
+	unsigned long flags;
+
+	if (!ch) {
+		pr_err("%s: Invalid channel specified\n", __func__);
+		return -ENODEV;
+	}
+	if (len < 0 || len > ch->read_avail(ch)) {
+		pr_err("%s: invalid length: %d\n", __func__, len);
+		return -EINVAL;
+	}
+	if (len == 0)
+		return 0;
+
+	ch_read_done(ch, len);
+	if (!read_intr_blocked(ch))
+		ch->notify_other_cpu();
+
+	if (ch->is_pkt_ch) {
+		spin_lock_irqsave(&smd_lock, flags);
+		ch->current_packet -= len;
+		update_packet_state(ch);
+		spin_unlock_irqrestore(&smd_lock, flags);
+	}
+
+	return len;
+}
+EXPORT_SYMBOL(smd_read_consume);
+
 int smd_read(smd_channel_t *ch, void *data, int len)
 {
 	if (!ch) {
@@ -23,6 +23,8 @@
 #include <linux/suspend.h>
 #include <linux/ctype.h>
 #include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
 
 #include <mach/msm_iomap.h>
 
@@ -307,6 +309,151 @@ static int debug_int_stats_reset(char *buf, int max)
 	return i;
 }
 
+/*
+ * Throughput of the local loopback channel, through the copying calls and
+ * through the zero-copy ones.  Both move the whole payload through the
+ * ring: copy from and to a kernel buffer, zcopy fills the reserved space
+ * and reads back the peeked bytes in place.  Every write and every read
+ * raises the loopback "interrupt", so this times the irq scan and notify
+ * dispatch as much as the copies.  It all runs on the reading cpu, so
+ * ns/KB is also the cpu cost per KB.  A short write or read leaves the
+ * ring out of step with the next transfer, so the run stops there.
+ */
+#define LOOPBACK_BENCH_BYTES	(1024 * 1024)
+
+struct loopback_bench {
+	unsigned data_events;
+	unsigned other_events;
+};
+
+static void loopback_bench_notify(void *priv, unsigned event)
+{
+	struct loopback_bench *bench = priv;
+
+	if (event == SMD_EVENT_DATA)
+		bench->data_events++;
+	else
+		bench->other_events++;
+}
+
+static int loopback_bench_copy(smd_channel_t *ch, void *data, int size)
+{
+	if (smd_write(ch, data, size) != size)
+		return -EIO;
+	if (smd_read(ch, data, size) != size)
+		return -EIO;
+	return 0;
+}
+
+/*
+ * Build the payload straight in the ring and look at every byte of it
+ * there, as a client skipping its own buffer would.  The sum ends up in
+ * the data buffer so the reads aren't optimised away.
+ */
+static int loopback_bench_zero_copy(smd_channel_t *ch, void *data, int size)
+{
+	const u8 *p;
+	void *ptr;
+	u32 sum = 0;
+	int left, n, k;
+
+	for (left = size; left; left -= n) {
+		n = smd_write_reserve(ch, &ptr);
+		if (n <= 0)
+			return -EIO;
+		n = min(n, left);
+		memset(ptr, size - left, n);
+		smd_write_commit(ch, n);
+	}
+
+	for (left = size; left; left -= n) {
+		n = smd_read_peek(ch, &ptr);
+		if (n <= 0)
+			return -EIO;
+		n = min(n, left);
+		for (p = ptr, k = 0; k < n; k++)
+			sum += p[k];
+		smd_read_consume(ch, n);
+	}
+
+	*(u32 *)data += sum;
+	return 0;
+}
+
+static int debug_loopback_bench(char *buf, int max)
+{
+	static const int sizes[] = { 32, 256, 1024, 4096 };
+	static const struct {
+		const char *name;
+		int (*xfer)(smd_channel_t *ch, void *data, int size);
+	} modes[] = {
+		{ "copy", loopback_bench_copy },
+		{ "zcopy", loopback_bench_zero_copy },
+	};
+	struct loopback_bench bench;
+	smd_channel_t *ch;
+	void *data;
+	ktime_t start;
+	s64 us;
+	int m, n, done, ret;
+	int i = 0;
+
+	data = kzalloc(sizes[ARRAY_SIZE(sizes) - 1], GFP_KERNEL);
+	if (!data)
+		return scnprintf(buf, max, "out of memory\n");
+
+	memset(&bench, 0, sizeof(bench));
+	ret = smd_named_open_on_edge("local_loopback", SMD_LOOPBACK_TYPE,
+				     &ch, &bench, loopback_bench_notify);
+	if (ret) {
+		kfree(data);
+		return scnprintf(buf, max, "open local_loopback failed: %d\n",
+				 ret);
+	}
+
+	i += scnprintf(buf + i, max - i,
+		"mode    size      bytes       us     KB/s    ns/KB"
+		"  events/xfer\n");
+
+	for (m = 0; m < ARRAY_SIZE(modes); m++) {
+		for (n = 0; n < ARRAY_SIZE(sizes); n++) {
+			bench.data_events = 0;
+			ret = 0;
+			start = ktime_get();
+			for (done = 0; done < LOOPBACK_BENCH_BYTES;
+			     done += sizes[n]) {
+				ret = modes[m].xfer(ch, data, sizes[n]);
+				if (ret)
+					break;
+			}
+			us = ktime_to_us(ktime_sub(ktime_get(), start));
+			if (ret) {
+				i += scnprintf(buf + i, max - i,
+					"%-5s %6d  failed after %d bytes\n",
+					modes[m].name, sizes[n], done);
+				goto out;
+			}
+
+			i += scnprintf(buf + i, max - i,
+				"%-5s %6d %10d %8lld %8llu %8llu %12u\n",
+				modes[m].name, sizes[n], done, us,
+				us ? div64_u64((u64)done * USEC_PER_SEC,
+					       us * 1024) : 0,
+				div64_u64((u64)us * NSEC_PER_USEC * 1024, done),
+				bench.data_events / (done / sizes[n]));
+		}
+	}
+
+out:
+	if (bench.other_events)
+		i += scnprintf(buf + i, max - i, "unexpected events: %u\n",
+			       bench.other_events);
+
+	smd_close(ch);
+	kfree(data);
+	return i;
+}
+
 static int debug_diag(char *buf, int max)
 {
 	int i = 0;
@@ -1074,6 +1221,7 @@ static int __init smd_debugfs_init(void)
 	debug_create("print_f3", 0444, dent, debug_f3);
 	debug_create("int_stats", 0444, dent, debug_int_stats);
 	debug_create("int_stats_reset", 0444, dent, debug_int_stats_reset);
+	debug_create("loopback_bench", 0444, dent, debug_loopback_bench);
 
 	/* NNV: this is google only stuff */
 	debug_create("build", 0444, dent, debug_read_build_id);
@@ -18,7 +18,6 @@
 /* TODO: handle cases where smd_write() will tempfail due to full fifo */
 /* TODO: thread priority? schedule a work to bump it? */
 /* TODO: maybe make server_list_lock a mutex */
-/* TODO: pool fragments to avoid kmalloc/kfree churn */
 
 #include <linux/slab.h>
 #include <linux/module.h>
@@ -35,6 +34,8 @@
 #include <linux/sched.h>
 #include <linux/poll.h>
 #include <linux/wakelock.h>
+#include <linux/hash.h>
+#include <linux/math64.h>
 #include <asm/uaccess.h>
 #include <asm/byteorder.h>
 #include <linux/platform_device.h>
@@ -147,6 +148,37 @@ static DEFINE_SPINLOCK(local_endpoints_lock);
 static DEFINE_SPINLOCK(remote_endpoints_lock);
 static DEFINE_SPINLOCK(server_list_lock);
 
+/* Lookup tables, under the lock of the matching list */
+static struct hlist_head local_endpoints_hash[1 << RPCROUTER_HASH_BITS];
+static struct hlist_head remote_endpoints_hash[1 << RPCROUTER_HASH_BITS];
+static struct hlist_head server_hash[1 << RPCROUTER_HASH_BITS];
+
+/* Free fragments, so the receive path mostly avoids kmalloc */
+static struct rr_fragment *rr_frag_pool;
+static int rr_frag_pool_count;
+static DEFINE_SPINLOCK(rr_frag_pool_lock);
+
+static struct {
+	atomic_t rx_ctrl;		/* Control messages */
+	atomic_t rx_frags;		/* Data fragments */
+	atomic_t rx_msgs;		/* Complete packets queued */
+	atomic_t rx_drops;		/* Fragments without ept or memory */
+	atomic_t pool_hits;
+	atomic_t pool_misses;
+
+	/* Queueing delay, read_q to reader, under lock */
+	spinlock_t lock;
+	u64 qdelay_total_us;
+	u32 qdelay_max_us;
+	u32 qdelay_count;
+
+	/* For the rate between two reads of the stats */
+	ktime_t last_read;
+	u32 last_msgs;
+} rr_stats = {
+	.lock = __SPIN_LOCK_UNLOCKED(rr_stats.lock),
+};
+
 static LIST_HEAD(rpc_board_dev_list);
 static DEFINE_SPINLOCK(rpc_board_dev_list_lock);
 
@@ -204,6 +236,7 @@ struct rpcrouter_xprt_info {
 	struct work_struct read_data;
 	struct workqueue_struct *workqueue;
 	int abort_data_read;
+	struct rr_packet *spare_pkt;	/* For the next new mid */
 	unsigned char r2r_buf[RPCROUTER_MSGSIZE_MAX];
 };
 
@@ -213,6 +246,65 @@ static DEFINE_MUTEX(xprt_info_list_lock);
 DECLARE_COMPLETION(rpc_remote_router_up);
 static atomic_t pending_close_count = ATOMIC_INIT(0);
 
+static inline struct hlist_head *local_ept_bucket(uint32_t cid)
+{
+	return &local_endpoints_hash[hash_32(cid, RPCROUTER_HASH_BITS)];
+}
+
+static inline struct hlist_head *remote_ept_bucket(uint32_t pid, uint32_t cid)
+{
+	return &remote_endpoints_hash[hash_32(pid ^ cid, RPCROUTER_HASH_BITS)];
+}
+
+static inline struct hlist_head *server_bucket(uint32_t prog)
+{
+	return &server_hash[hash_32(prog, RPCROUTER_HASH_BITS)];
+}
+
+static struct rr_fragment *rr_frag_alloc(void)
+{
+	struct rr_fragment *frag;
+
+	spin_lock(&rr_frag_pool_lock);
+	frag = rr_frag_pool;
+	if (frag) {
+		rr_frag_pool = frag->next;
+		rr_frag_pool_count--;
+	}
+	spin_unlock(&rr_frag_pool_lock);
+
+	if (frag) {
+		atomic_inc(&rr_stats.pool_hits);
+		return frag;
+	}
+
+	atomic_inc(&rr_stats.pool_misses);
+	return kmalloc(sizeof(*frag), GFP_KERNEL);
+}
+
+/*
+ * Fragments are plain kmalloc() memory: a single fragment message is
+ * handed out by msm_rpc_read() for the caller to kfree().
+ */
+void msm_rpcrouter_free_frags(struct rr_fragment *frag)
+{
+	struct rr_fragment *next;
+
+	while (frag) {
+		next = frag->next;
+		spin_lock(&rr_frag_pool_lock);
+		if (rr_frag_pool_count < RPCROUTER_FRAG_POOL_MAX) {
+			frag->next = rr_frag_pool;
+			rr_frag_pool = frag;
+			rr_frag_pool_count++;
+			frag = NULL;
+		}
+		spin_unlock(&rr_frag_pool_lock);
+		kfree(frag);
+		frag = next;
+	}
+}
+
 /*
  * Search for transport (xprt) that matches the provided PID.
  *
@@ -282,7 +374,6 @@ static void modem_reset_cleanup(struct rpcrouter_xprt_info *xprt_info)
 	struct msm_rpc_endpoint *ept;
 	struct rr_remote_endpoint *r_ept;
 	struct rr_packet *pkt, *tmp_pkt;
-	struct rr_fragment *frag, *next;
 	struct msm_rpc_reply *reply, *reply_tmp;
 	unsigned long flags;
 
@@ -329,12 +420,7 @@ static void modem_reset_cleanup(struct rpcrouter_xprt_info *xprt_info)
 		list_for_each_entry_safe(pkt, tmp_pkt,
 					 &ept->incomplete, list) {
 			list_del(&pkt->list);
-			frag = pkt->first;
-			while (frag != NULL) {
-				next = frag->next;
-				kfree(frag);
-				frag = next;
-			}
+			msm_rpcrouter_free_frags(pkt->first);
 			kfree(pkt);
 		}
 		spin_unlock(&ept->incomplete_lock);
@@ -344,12 +430,7 @@ static void modem_reset_cleanup(struct rpcrouter_xprt_info *xprt_info)
 		list_for_each_entry_safe(pkt, tmp_pkt, &ept->read_q,
 					 list) {
 			list_del(&pkt->list);
-			frag = pkt->first;
-			while (frag != NULL) {
-				next = frag->next;
-				kfree(frag);
-				frag = next;
-			}
+			msm_rpcrouter_free_frags(pkt->first);
 			kfree(pkt);
 		}
 		spin_unlock(&ept->read_q_lock);
@@ -445,6 +526,8 @@ static struct rr_server *rpcrouter_create_server(uint32_t pid,
 							uint32_t ver)
 {
 	struct rr_server *server;
+	struct hlist_head *head;
+	struct hlist_node *node, *last;
 	unsigned long flags;
 	int rc;
 
@@ -460,6 +543,15 @@ static struct rr_server *rpcrouter_create_server(uint32_t pid,
 
 	spin_lock_irqsave(&server_list_lock, flags);
 	list_add_tail(&server->list, &server_list);
+	/* Registration order within a prog, the first one still wins */
+	head = server_bucket(prog);
+	last = NULL;
+	hlist_for_each(node, head)
+		last = node;
+	if (last)
+		hlist_add_after(last, &server->hash);
+	else
+		hlist_add_head(&server->hash, head);
 	spin_unlock_irqrestore(&server_list_lock, flags);
 
 	rc = msm_rpcrouter_create_server_cdev(server);
@@ -470,6 +562,7 @@ static struct rr_server *rpcrouter_create_server(uint32_t pid,
 out_fail:
 	spin_lock_irqsave(&server_list_lock, flags);
 	list_del(&server->list);
+	hlist_del(&server->hash);
 	spin_unlock_irqrestore(&server_list_lock, flags);
 	kfree(server);
 	return ERR_PTR(rc);
@@ -481,6 +574,7 @@ static void rpcrouter_destroy_server(struct rr_server *server)
 
 	spin_lock_irqsave(&server_list_lock, flags);
 	list_del(&server->list);
+	hlist_del(&server->hash);
 	spin_unlock_irqrestore(&server_list_lock, flags);
 	device_destroy(msm_rpcrouter_class, server->device_number);
 	kfree(server);
@@ -536,10 +630,11 @@ static void rpcrouter_register_board_dev(struct rr_server *server)
 static struct rr_server *rpcrouter_lookup_server(uint32_t prog, uint32_t ver)
 {
 	struct rr_server *server;
+	struct hlist_node *node;
 	unsigned long flags;
 
 	spin_lock_irqsave(&server_list_lock, flags);
-	list_for_each_entry(server, &server_list, list) {
+	hlist_for_each_entry(server, node, server_bucket(prog), hash) {
 		if (server->prog == prog
 		 && server->vers == ver) {
 			spin_unlock_irqrestore(&server_list_lock, flags);
@@ -615,6 +710,7 @@ struct msm_rpc_endpoint *msm_rpcrouter_create_local_endpoint(dev_t dev)
 
 	spin_lock_irqsave(&local_endpoints_lock, flags);
 	list_add_tail(&ept->list, &local_endpoints);
+	hlist_add_head(&ept->hash, local_ept_bucket(ept->cid));
 	spin_unlock_irqrestore(&local_endpoints_lock, flags);
 	return ept;
 }
@@ -632,6 +728,7 @@ int msm_rpcrouter_destroy_local_endpoint(struct msm_rpc_endpoint *ept)
 	** destroying it.*/
 	spin_lock_irqsave(&local_endpoints_lock, flags);
 	list_del(&ept->list);
+	hlist_del(&ept->hash);
 	spin_unlock_irqrestore(&local_endpoints_lock, flags);
 	if (ept->dst_pid != 0xffffffff) {
 		msg.cmd = RPCROUTER_CTRL_CMD_REMOVE_CLIENT;
@@ -685,16 +782,19 @@ static int rpcrouter_create_remote_endpoint(uint32_t pid, uint32_t cid)
 
 	spin_lock_irqsave(&remote_endpoints_lock, flags);
 	list_add_tail(&new_c->list, &remote_endpoints);
+	hlist_add_head(&new_c->hash, remote_ept_bucket(pid, cid));
 	new_c->quota_restart_state = RESTART_NORMAL;
 	spin_unlock_irqrestore(&remote_endpoints_lock, flags);
 	return 0;
 }
 
+/* Called with local_endpoints_lock held */
 static struct msm_rpc_endpoint *rpcrouter_lookup_local_endpoint(uint32_t cid)
 {
 	struct msm_rpc_endpoint *ept;
+	struct hlist_node *node;
 
-	list_for_each_entry(ept, &local_endpoints, list) {
+	hlist_for_each_entry(ept, node, local_ept_bucket(cid), hash) {
 		if (ept->cid == cid)
 			return ept;
 	}
@@ -705,10 +805,11 @@ static struct rr_remote_endpoint *rpcrouter_lookup_remote_endpoint(uint32_t pid,
 								   uint32_t cid)
 {
 	struct rr_remote_endpoint *ept;
+	struct hlist_node *node;
 	unsigned long flags;
 
 	spin_lock_irqsave(&remote_endpoints_lock, flags);
-	list_for_each_entry(ept, &remote_endpoints, list) {
+	hlist_for_each_entry(ept, node, remote_ept_bucket(pid, cid), hash) {
 		if ((ept->pid == pid) && (ept->cid == cid)) {
 			spin_unlock_irqrestore(&remote_endpoints_lock, flags);
 			return ept;
@@ -896,6 +997,7 @@ static int process_control_msg(struct rpcrouter_xprt_info *xprt_info,
 		if (r_ept) {
 			spin_lock_irqsave(&remote_endpoints_lock, flags);
 			list_del(&r_ept->list);
+			hlist_del(&r_ept->hash);
 			spin_unlock_irqrestore(&remote_endpoints_lock, flags);
 			kfree(r_ept);
 		}
@@ -947,20 +1049,6 @@ static void do_create_pdevs(struct work_struct *work)
 	spin_unlock_irqrestore(&server_list_lock, flags);
 }
 
-static void *rr_malloc(unsigned sz)
-{
-	void *ptr = kmalloc(sz, GFP_KERNEL);
-	if (ptr)
-		return ptr;
-
-	printk(KERN_ERR "[K] rpcrouter: kmalloc of %d failed, retrying...\n", sz);
-	do {
-		ptr = kmalloc(sz, GFP_KERNEL);
-	} while (!ptr);
-
-	return ptr;
-}
-
 static int rr_read(struct rpcrouter_xprt_info *xprt_info,
 		   void *data, uint32_t len)
 {
@@ -1014,9 +1102,20 @@ static char *type_to_str(int i)
 }
 #endif
 
+/*
+ * Every message carries at least one word after its header, the pacmark
+ * of a data message or the cmd of a control message: take it in the same
+ * read as the header.
+ */
+struct rr_header_word {
+	struct rr_header hdr;
+	uint32_t word;
+};
+
 static void do_read_data(struct work_struct *work)
 {
-	struct rr_header hdr;
+	struct rr_header_word hw;
+	struct rr_header *hdr = &hw.hdr;
 	struct rr_packet *pkt;
 	struct rr_fragment *frag;
 	struct msm_rpc_endpoint *ept;
@@ -1031,58 +1130,68 @@ static void do_read_data(struct work_struct *work)
 			     struct rpcrouter_xprt_info,
 			     read_data);
 
-	if (rr_read(xprt_info, &hdr, sizeof(hdr)))
+	if (rr_read(xprt_info, &hw, sizeof(hw)))
 		goto fail_io;
 
 	RR("- ver=%d type=%d src=%d:%08x crx=%d siz=%d dst=%d:%08x\n",
-	   hdr.version, hdr.type, hdr.src_pid, hdr.src_cid,
-	   hdr.confirm_rx, hdr.size, hdr.dst_pid, hdr.dst_cid);
+	   hdr->version, hdr->type, hdr->src_pid, hdr->src_cid,
+	   hdr->confirm_rx, hdr->size, hdr->dst_pid, hdr->dst_cid);
 	RAW_HDR("[r rr_h] "
 	    "ver=%i,type=%s,src_pid=%08x,src_cid=%08x,"
 	    "confirm_rx=%i,size=%3i,dst_pid=%08x,dst_cid=%08x\n",
-	    hdr.version, type_to_str(hdr.type), hdr.src_pid, hdr.src_cid,
-	    hdr.confirm_rx, hdr.size, hdr.dst_pid, hdr.dst_cid);
+	    hdr->version, type_to_str(hdr->type), hdr->src_pid, hdr->src_cid,
+	    hdr->confirm_rx, hdr->size, hdr->dst_pid, hdr->dst_cid);
 
-	if (hdr.version != RPCROUTER_VERSION) {
-		DIAG("version %d != %d\n", hdr.version, RPCROUTER_VERSION);
+	if (hdr->version != RPCROUTER_VERSION) {
+		DIAG("version %d != %d\n", hdr->version, RPCROUTER_VERSION);
 		goto fail_data;
 	}
-	if (hdr.size > RPCROUTER_MSGSIZE_MAX) {
-		DIAG("msg size %d > max %d\n", hdr.size, RPCROUTER_MSGSIZE_MAX);
+	if (hdr->size > RPCROUTER_MSGSIZE_MAX) {
+		DIAG("msg size %d > max %d\n", hdr->size, RPCROUTER_MSGSIZE_MAX);
+		goto fail_data;
+	}
+	if (hdr->size < sizeof(hw.word)) {
+		DIAG("runt packet (no pacmark)\n");
 		goto fail_data;
 	}
 
-	if (hdr.dst_cid == RPCROUTER_ROUTER_ADDRESS) {
+	if (hdr->dst_cid == RPCROUTER_ROUTER_ADDRESS) {
 		if (xprt_info->remote_pid == -1) {
-			xprt_info->remote_pid = hdr.src_pid;
+			xprt_info->remote_pid = hdr->src_pid;
 
 			/* do restart notification */
 			modem_reset_startup(xprt_info);
 		}
 
-		if (rr_read(xprt_info, xprt_info->r2r_buf, hdr.size))
+		memcpy(xprt_info->r2r_buf, &hw.word, sizeof(hw.word));
+		if (rr_read(xprt_info, xprt_info->r2r_buf + sizeof(hw.word),
+			    hdr->size - sizeof(hw.word)))
 			goto fail_io;
+		atomic_inc(&rr_stats.rx_ctrl);
 		process_control_msg(xprt_info,
-				    (void *) xprt_info->r2r_buf, hdr.size);
+				    (void *) xprt_info->r2r_buf, hdr->size);
 		goto done;
 	}
 
-	if (hdr.size < sizeof(pm)) {
-		DIAG("runt packet (no pacmark)\n");
-		goto fail_data;
-	}
-	if (rr_read(xprt_info, &pm, sizeof(pm)))
-		goto fail_io;
+	pm = hw.word;
+	hdr->size -= sizeof(pm);
 
-	hdr.size -= sizeof(pm);
-
-	frag = rr_malloc(sizeof(*frag));
+	frag = rr_frag_alloc();
+	if (!frag) {
+		/* Keep the stream in sync, drop the fragment */
+		if (rr_read(xprt_info, xprt_info->r2r_buf, hdr->size))
+			goto fail_io;
+		DIAG("no memory for fragment to cid %08x\n", hdr->dst_cid);
+		atomic_inc(&rr_stats.rx_drops);
+		goto done;
+	}
 	frag->next = NULL;
-	frag->length = hdr.size;
-	if (rr_read(xprt_info, frag->data, hdr.size)) {
-		kfree(frag);
+	frag->length = hdr->size;
+	if (rr_read(xprt_info, frag->data, hdr->size)) {
+		msm_rpcrouter_free_frags(frag);
 		goto fail_io;
 	}
+	atomic_inc(&rr_stats.rx_frags);
 
 #if defined(CONFIG_MSM_ONCRPCROUTER_DEBUG)
 	if ((smd_rpcrouter_debug_mask & RAW_PMR) &&
@@ -1099,7 +1208,7 @@ static void do_read_data(struct work_struct *work)
 				       pm >> 30 & 0x1,
 				       pm >> 31 & 0x1,
 				       pm >> 16 & 0xFF,
-				       pm & 0xFFFF, hdr.dst_cid);
+				       pm & 0xFFFF, hdr->dst_cid);
 	}
 
 	if (smd_rpcrouter_debug_mask & SMEM_LOG) {
@@ -1108,23 +1217,29 @@ static void do_read_data(struct work_struct *work)
 			smem_log_event(SMEM_LOG_PROC_ID_APPS |
 				       RPC_ROUTER_LOG_EVENT_MID_READ,
 				       PACMARK_MID(pm),
-				       hdr.dst_cid,
-				       hdr.src_cid);
+				       hdr->dst_cid,
+				       hdr->src_cid);
 		else
 			smem_log_event(SMEM_LOG_PROC_ID_APPS |
 				       RPC_ROUTER_LOG_EVENT_MSG_READ,
 				       ntohl(rq->xid),
-				       hdr.dst_cid,
-				       hdr.src_cid);
+				       hdr->dst_cid,
+				       hdr->src_cid);
 	}
 #endif
 
+	/* Whatever the fragment turns out to be, don't allocate under lock */
+	if (!xprt_info->spare_pkt)
+		xprt_info->spare_pkt = kmalloc(sizeof(struct rr_packet),
+					       GFP_KERNEL);
+
 	spin_lock_irqsave(&local_endpoints_lock, flags);
-	ept = rpcrouter_lookup_local_endpoint(hdr.dst_cid);
+	ept = rpcrouter_lookup_local_endpoint(hdr->dst_cid);
 	if (!ept) {
 		spin_unlock_irqrestore(&local_endpoints_lock, flags);
-		DIAG("no local ept for cid %08x\n", hdr.dst_cid);
-		kfree(frag);
+		DIAG("no local ept for cid %08x\n", hdr->dst_cid);
+		msm_rpcrouter_free_frags(frag);
+		atomic_inc(&rr_stats.rx_drops);
 		goto done;
 	}
 
@@ -1148,37 +1263,37 @@ static void do_read_data(struct work_struct *work)
 			goto done;
 		}
 	}
-	spin_unlock(&ept->incomplete_lock);
-	spin_unlock_irqrestore(&local_endpoints_lock, flags);
+
 	/* This mid is new -- create a packet for it, and put it on
 	 * the incomplete list if this fragment is not a last fragment,
 	 * otherwise put it on the read queue.
 	 */
-	pkt = rr_malloc(sizeof(struct rr_packet));
+	pkt = xprt_info->spare_pkt;
+	if (!pkt) {
+		spin_unlock(&ept->incomplete_lock);
+		spin_unlock_irqrestore(&local_endpoints_lock, flags);
+		DIAG("no memory for packet to cid %08x\n", hdr->dst_cid);
+		msm_rpcrouter_free_frags(frag);
+		atomic_inc(&rr_stats.rx_drops);
+		goto done;
+	}
+	xprt_info->spare_pkt = NULL;
 	pkt->first = frag;
 	pkt->last = frag;
-	memcpy(&pkt->hdr, &hdr, sizeof(hdr));
+	pkt->hdr = *hdr;
 	pkt->mid = mid;
 	pkt->length = frag->length;
 
-	spin_lock_irqsave(&local_endpoints_lock, flags);
-	ept = rpcrouter_lookup_local_endpoint(hdr.dst_cid);
-	if (!ept) {
-		spin_unlock_irqrestore(&local_endpoints_lock, flags);
-		DIAG("no local ept for cid %08x\n", hdr.dst_cid);
-		kfree(frag);
-		kfree(pkt);
-		goto done;
-	}
 	if (!PACMARK_LAST(pm)) {
-		spin_lock(&ept->incomplete_lock);
 		list_add_tail(&pkt->list, &ept->incomplete);
 		spin_unlock(&ept->incomplete_lock);
 		spin_unlock_irqrestore(&local_endpoints_lock, flags);
 		goto done;
 	}
+	spin_unlock(&ept->incomplete_lock);
 
 packet_complete:
+	pkt->qtime = ktime_get();
 	spin_lock(&ept->read_q_lock);
 	D("%s: take read lock on ept %p\n", __func__, ept);
 	wake_lock(&ept->read_q_wake_lock);
@@ -1186,14 +1301,15 @@ packet_complete:
 	wake_up(&ept->wait_q);
 	spin_unlock(&ept->read_q_lock);
 	spin_unlock_irqrestore(&local_endpoints_lock, flags);
+	atomic_inc(&rr_stats.rx_msgs);
 done:
 
-	if (hdr.confirm_rx) {
+	if (hdr->confirm_rx) {
 		union rr_control_msg msg;
 
 		msg.cmd = RPCROUTER_CTRL_CMD_RESUME_TX;
-		msg.cli.pid = hdr.dst_pid;
-		msg.cli.cid = hdr.dst_cid;
+		msg.cli.pid = hdr->dst_pid;
+		msg.cli.cid = hdr->dst_cid;
 
 		RR("x RESUME_TX id=%d:%08x\n", msg.cli.pid, msg.cli.cid);
 		rpcrouter_send_control_msg(xprt_info, &msg);
@@ -1203,8 +1319,8 @@ done:
 			smem_log_event(SMEM_LOG_PROC_ID_APPS |
 				       RPC_ROUTER_LOG_EVENT_MSG_CFM_SNT,
 				       RPCROUTER_PID_LOCAL,
-				       hdr.dst_cid,
-				       hdr.src_cid);
+				       hdr->dst_cid,
+				       hdr->src_cid);
 #endif
 
 	}
@@ -1547,6 +1663,7 @@ int msm_rpc_write(struct msm_rpc_endpoint *ept, void *buffer, int count)
 	int first_pkt = 1;
 	uint32_t mid;
 	unsigned long flags;
+	ktime_t sent = msm_rpc_trace_stamp();
 
 	/* snoop the RPC packet and enforce permissions */
 
@@ -1643,6 +1760,8 @@ int msm_rpc_write(struct msm_rpc_endpoint *ept, void *buffer, int count)
 		}
 		first_pkt = 0;
 	}
+	if (rq->type == 0)
+		msm_rpc_trace_call(rq, count, sent);
 
  write_release_lock:
 	/* if reply, release wakelock after writing to the transport */
@@ -1672,7 +1791,7 @@ EXPORT_SYMBOL(msm_rpc_write);
 int msm_rpc_read(struct msm_rpc_endpoint *ept, void **buffer,
 		 unsigned user_len, long timeout)
 {
-	struct rr_fragment *frag, *next;
+	struct rr_fragment *frag, *first;
 	char *buf;
 	int rc;
 
@@ -1691,16 +1810,18 @@ int msm_rpc_read(struct msm_rpc_endpoint *ept, void **buffer,
 	/* multi-fragment messages, we have to do it the
 	 * hard way, which is rather disgusting right now
 	 */
-	buf = rr_malloc(rc);
+	buf = kmalloc(rc, GFP_KERNEL);
+	if (!buf) {
+		msm_rpcrouter_free_frags(frag);
+		return -ENOMEM;
+	}
 	*buffer = buf;
 
-	while (frag != NULL) {
+	for (first = frag; frag != NULL; frag = frag->next) {
 		memcpy(buf, frag->data, frag->length);
-		next = frag->next;
 		buf += frag->length;
-		kfree(frag);
-		frag = next;
 	}
+	msm_rpcrouter_free_frags(first);
 
 	return rc;
 }
@@ -1788,6 +1909,19 @@ int msm_rpc_call_reply(struct msm_rpc_endpoint *ept, uint32_t proc,
 EXPORT_SYMBOL(msm_rpc_call_reply);
 
 
+static void rr_account_qdelay(struct rr_packet *pkt)
+{
+	u32 us = ktime_to_us(ktime_sub(ktime_get(), pkt->qtime));
+	unsigned long flags;
+
+	spin_lock_irqsave(&rr_stats.lock, flags);
+	rr_stats.qdelay_total_us += us;
+	rr_stats.qdelay_count++;
+	if (us > rr_stats.qdelay_max_us)
+		rr_stats.qdelay_max_us = us;
+	spin_unlock_irqrestore(&rr_stats.lock, flags);
+}
+
 static inline int ept_packet_available(struct msm_rpc_endpoint *ept)
 {
 	unsigned long flags;
@@ -1874,6 +2008,8 @@ int __msm_rpc_read(struct msm_rpc_endpoint *ept,
 	list_del(&pkt->list);
 	spin_unlock_irqrestore(&ept->read_q_lock, flags);
 
+	rr_account_qdelay(pkt);
+	msm_rpc_trace_reply(pkt);
 	rc = pkt->length;
 
 	*frag_ret = pkt->first;
@@ -1933,6 +2069,7 @@ static struct rr_server *msm_rpc_get_server(uint32_t prog, uint32_t vers,
 					    uint32_t *found_prog)
 {
 	struct rr_server *server;
+	struct hlist_node *node;
 	unsigned long     flags;
 
 	if (found_prog == NULL)
@@ -1940,7 +2077,7 @@ static struct rr_server *msm_rpc_get_server(uint32_t prog, uint32_t vers,
 
 	*found_prog = 0;
 	spin_lock_irqsave(&server_list_lock, flags);
-	list_for_each_entry(server, &server_list, list) {
+	hlist_for_each_entry(server, node, server_bucket(prog), hash) {
 		if (server->prog == prog) {
 			*found_prog = 1;
 			spin_unlock_irqrestore(&server_list_lock, flags);
@@ -2146,6 +2283,7 @@ int msm_rpcrouter_close(void)
 		flush_workqueue(xprt_info->workqueue);
 		destroy_workqueue(xprt_info->workqueue);
 		wake_lock_destroy(&xprt_info->wakelock);
+		kfree(xprt_info->spare_pkt);
 		kfree(xprt_info);
 
 		mutex_lock(&xprt_info_list_lock);
@@ -2257,6 +2395,47 @@ static int dump_msm_rpc_endpoint(char *buf, int max)
 	return i;
 }
 
+static int dump_stats(char *buf, int max)
+{
+	unsigned long flags;
+	ktime_t now = ktime_get();
+	u32 msgs = atomic_read(&rr_stats.rx_msgs);
+	u32 count, max_us, rate = 0;
+	u64 avg_us;
+	s64 ms;
+	int i = 0;
+
+	ms = ktime_to_ms(ktime_sub(now, rr_stats.last_read));
+	if (ms > 0)
+		rate = div64_u64((u64)(msgs - rr_stats.last_msgs) * MSEC_PER_SEC,
+				 ms);
+	rr_stats.last_read = now;
+	rr_stats.last_msgs = msgs;
+
+	spin_lock_irqsave(&rr_stats.lock, flags);
+	count = rr_stats.qdelay_count;
+	max_us = rr_stats.qdelay_max_us;
+	avg_us = count ? div_u64(rr_stats.qdelay_total_us, count) : 0;
+	spin_unlock_irqrestore(&rr_stats.lock, flags);
+
+	i += scnprintf(buf + i, max - i, "rx_msgs: %u\n", msgs);
+	i += scnprintf(buf + i, max - i, "rx_msgs_per_sec: %u\n", rate);
+	i += scnprintf(buf + i, max - i, "rx_frags: %u\n",
+		       atomic_read(&rr_stats.rx_frags));
+	i += scnprintf(buf + i, max - i, "rx_ctrl: %u\n",
+		       atomic_read(&rr_stats.rx_ctrl));
+	i += scnprintf(buf + i, max - i, "rx_drops: %u\n",
+		       atomic_read(&rr_stats.rx_drops));
+	i += scnprintf(buf + i, max - i, "frag_pool: %d hits %u misses %u\n",
+		       rr_frag_pool_count, atomic_read(&rr_stats.pool_hits),
+		       atomic_read(&rr_stats.pool_misses));
+	i += scnprintf(buf + i, max - i,
+		       "queue_delay_us: avg %llu max %u (%u reads)\n",
+		       avg_us, max_us, count);
+
+	return i;
+}
+
 #define DEBUG_BUFMAX 4096
 static char debug_buffer[DEBUG_BUFMAX];
 
@@ -2300,6 +2479,7 @@ static void debugfs_init(void)
 		     dump_remote_endpoints);
 	debug_create("dump_servers", 0444, dent,
 		     dump_servers);
+	debug_create("stats", 0444, dent, dump_stats);
 
 }
 
@@ -2326,6 +2506,7 @@ static int msm_rpcrouter_add_xprt(struct rpcrouter_xprt *xprt)
 		       WAKE_LOCK_SUSPEND, xprt->name);
 	xprt_info->need_len = 0;
 	xprt_info->abort_data_read = 0;
+	xprt_info->spare_pkt = NULL;
 	INIT_WORK(&xprt_info->read_data, do_read_data);
 	INIT_LIST_HEAD(&xprt_info->list);
 
@@ -2386,6 +2567,7 @@ static void msm_rpcrouter_remove_xprt(struct rpcrouter_xprt *xprt)
 
 		/* free memory */
 		xprt->priv = 0;
+		kfree(xprt_info->spare_pkt);
 		kfree(xprt_info);
 	}
 }
@@ -20,6 +20,7 @@
 
 #include <linux/types.h>
 #include <linux/list.h>
+#include <linux/ktime.h>
 #include <linux/cdev.h>
 #include <linux/platform_device.h>
 #include <linux/msm_rpcrouter.h>
@@ -34,6 +35,8 @@
 #define RPCROUTER_PROCESSORS_MAX		4
 #define RPCROUTER_MSGSIZE_MAX			512
 #define RPCROUTER_PEND_REPLIES_MAX		32
+#define RPCROUTER_FRAG_POOL_MAX			16
+#define RPCROUTER_HASH_BITS			5
 
 #define RPCROUTER_CLIENT_BCAST_ID		0xffffffff
 #define RPCROUTER_ROUTER_ADDRESS		0xfffffffe
@@ -116,6 +119,7 @@ struct rr_packet {
 	struct rr_header hdr;
 	uint32_t mid;
 	uint32_t length;
+	ktime_t qtime;		/* Queued to the read_q */
 };
 
 #define PACMARK_LAST(n) ((n) & 0x80000000)
@@ -133,6 +137,7 @@ static inline uint32_t PACMARK(uint32_t len, uint32_t mid, uint32_t first,
 
 struct rr_server {
 	struct list_head list;
+	struct hlist_node hash;	/* By prog */
 
 	uint32_t pid;
 	uint32_t cid;
@@ -156,6 +161,7 @@ struct rr_remote_endpoint {
 	wait_queue_head_t quota_wait;
 
 	struct list_head list;
+	struct hlist_node hash;	/* By pid and cid */
 };
 
 struct msm_rpc_reply {
@@ -169,6 +175,7 @@ struct msm_rpc_reply {
 
 struct msm_rpc_endpoint {
 	struct list_head list;
+	struct hlist_node hash;	/* By cid */
 
 	/* incomplete packets waiting for assembly */
 	struct list_head incomplete;
@@ -239,6 +246,7 @@ void msm_rpcrouter_xprt_notify(struct rpcrouter_xprt *xprt, unsigned event);
 int __msm_rpc_read(struct msm_rpc_endpoint *ept,
 		   struct rr_fragment **frag,
 		   unsigned len, long timeout);
+void msm_rpcrouter_free_frags(struct rr_fragment *frag);
 
 int msm_rpcrouter_close(void);
 struct msm_rpc_endpoint *msm_rpcrouter_create_local_endpoint(dev_t dev);
@@ -263,4 +271,21 @@ void xdr_init_output(struct msm_rpc_xdr *xdr, void *buf, uint32_t size);
 void xdr_clean_input(struct msm_rpc_xdr *xdr);
 void xdr_clean_output(struct msm_rpc_xdr *xdr);
 uint32_t xdr_read_avail(struct msm_rpc_xdr *xdr);
+
+#if defined(CONFIG_MSM_RPC_TRACE)
+void msm_rpc_trace_call(struct rpc_request_hdr *rq, int len, ktime_t sent);
+void msm_rpc_trace_reply(struct rr_packet *pkt);
+static inline ktime_t msm_rpc_trace_stamp(void)
+{
+	return ktime_get();
+}
+#else
+static inline void msm_rpc_trace_call(struct rpc_request_hdr *rq, int len,
+				      ktime_t sent) { }
+static inline void msm_rpc_trace_reply(struct rr_packet *pkt) { }
+static inline ktime_t msm_rpc_trace_stamp(void)
+{
+	return ktime_set(0, 0);
+}
+#endif
 #endif
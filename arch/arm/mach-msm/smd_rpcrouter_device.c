@@ -156,7 +156,7 @@ static ssize_t rpcrouter_read(struct file *filp, char __user *buf,
 {
 	struct rpcrouter_file_info *file_info = filp->private_data;
 	struct msm_rpc_endpoint *ept;
-	struct rr_fragment *frag, *next;
+	struct rr_fragment *frag, *first;
 	int rc;
 
 	ept = (struct msm_rpc_endpoint *) file_info->ept;
@@ -167,17 +167,15 @@ static ssize_t rpcrouter_read(struct file *filp, char __user *buf,
 
 	count = rc;
 
-	while (frag != NULL) {		
+	for (first = frag; frag != NULL; frag = frag->next) {
 		if (copy_to_user(buf, frag->data, frag->length)) {
 			printk(KERN_ERR
 			       "[K] rpcrouter: could not copy all read data to user!\n");
 			rc = -EFAULT;
 		}
 		buf += frag->length;
-		next = frag->next;
-		kfree(frag);
-		frag = next;
 	}
+	msm_rpcrouter_free_frags(first);
 
 	return rc;
 }
@@ -0,0 +1,624 @@
+/* arch/arm/mach-msm/smd_rpcrouter_trace.c
+ *
+ * RPC call latency tracing and replay
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * Every CALL written through msm_rpc_write() takes the slot of its xid in
+ * a small table, stamped when written and when the router has handed the
+ * last fragment to the transport.  The REPLY with that xid is stamped by
+ * the router when queued to the caller's endpoint, and when the caller
+ * reads it.  Per prog/vers/proc this gives the average time spent
+ *
+ *   write	writing the call (quota and fifo full waits)
+ *   remote	from the transport to the reply (the remote server)
+ *   wakeup	from the reply to the caller reading it
+ *
+ * and a log2 histogram of the total.
+ *
+ * While recording, the calls are also logged with their sizes and the
+ * time since the previous call.  A log written back to "replay" is played
+ * against a local server over the loopback transport, so router changes
+ * can be measured without a modem.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/err.h>
+#include <linux/hash.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
+#include <linux/math64.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#include <mach/msm_rpcrouter.h>
+
+#include "smd_rpcrouter.h"
+
+#define RPC_TRACE_PENDING	32	/* Calls in flight, power of two */
+#define RPC_TRACE_HASH_BITS	6
+#define RPC_TRACE_ENTRIES	(1 << RPC_TRACE_HASH_BITS)
+#define RPC_TRACE_BUCKETS	16	/* <64us, <128us, ... >=1s */
+#define RPC_TRACE_RECS		1024
+
+/* Replay server, the recorded prog/vers/proc are kept for the report */
+#define RPC_REPLAY_PROG		0x3000fffe
+#define RPC_REPLAY_VERS		0x00010001
+#define RPC_REPLAY_MSG_MAX	2048
+#define RPC_REPLAY_TIMEOUT	(5 * HZ)
+
+struct rpc_trace_call {
+	uint32_t xid;			/* be32, 0 when free */
+	uint32_t prog;
+	uint32_t vers;
+	uint32_t proc;
+	int rec;			/* Record to complete, or -1 */
+	ktime_t sent;
+	ktime_t queued;
+};
+
+struct rpc_trace_entry {
+	uint32_t prog;
+	uint32_t vers;
+	uint32_t proc;
+	u32 count;
+	u32 max_us;
+	u64 total_us;
+	u64 write_us;
+	u64 remote_us;
+	u64 wakeup_us;
+	u32 hist[RPC_TRACE_BUCKETS];
+};
+
+struct rpc_trace_table {
+	struct rpc_trace_entry entries[RPC_TRACE_ENTRIES];
+	u32 dropped;			/* No room for the prog/vers/proc */
+};
+
+/* Recorded call, as read from "record" and written to "replay" */
+struct rpc_trace_rec {
+	u32 delay_us;			/* Since the previous call */
+	uint32_t prog;
+	uint32_t vers;
+	uint32_t proc;
+	u16 req_len;
+	u16 reply_len;
+};
+
+static struct rpc_trace_call pending[RPC_TRACE_PENDING];
+static struct rpc_trace_table live;
+static struct rpc_trace_rec *recs;
+static int nrecs;
+static bool recording;
+static ktime_t last_sent;
+static DEFINE_SPINLOCK(trace_lock);
+static DEFINE_MUTEX(record_lock);
+
+static struct {
+	struct mutex lock;		/* Input buffer and running */
+	bool running;
+	struct rpc_trace_rec *recs;
+	int nrecs;
+	int done;
+	int errors;
+	struct rpc_trace_table results;
+
+	/* Loopback server */
+	struct msm_rpc_endpoint *ept;
+	struct completion server_exited;
+	int server_stop;
+} replay = {
+	.lock = __MUTEX_INITIALIZER(replay.lock),
+};
+
+static int trace_bucket(u32 us)
+{
+	return min(fls(us >> 6), RPC_TRACE_BUCKETS - 1);
+}
+
+static struct rpc_trace_entry *trace_entry(struct rpc_trace_table *t,
+					   uint32_t prog, uint32_t vers,
+					   uint32_t proc)
+{
+	struct rpc_trace_entry *e;
+	unsigned i, n;
+
+	i = hash_32(prog ^ (vers << 8) ^ proc, RPC_TRACE_HASH_BITS);
+	for (n = 0; n < RPC_TRACE_ENTRIES; n++) {
+		e = &t->entries[(i + n) & (RPC_TRACE_ENTRIES - 1)];
+		if (!e->count) {
+			e->prog = prog;
+			e->vers = vers;
+			e->proc = proc;
+			return e;
+		}
+		if (e->prog == prog && e->vers == vers && e->proc == proc)
+			return e;
+	}
+
+	t->dropped++;
+	return NULL;
+}
+
+static void trace_account(struct rpc_trace_table *t, uint32_t prog,
+			  uint32_t vers, uint32_t proc, u32 total_us,
+			  u32 write_us, u32 remote_us, u32 wakeup_us)
+{
+	struct rpc_trace_entry *e = trace_entry(t, prog, vers, proc);
+
+	if (!e)
+		return;
+
+	e->count++;
+	e->total_us += total_us;
+	e->write_us += write_us;
+	e->remote_us += remote_us;
+	e->wakeup_us += wakeup_us;
+	if (total_us > e->max_us)
+		e->max_us = total_us;
+	e->hist[trace_bucket(total_us)]++;
+}
+
+/* From msm_rpc_write(), once a CALL is on the transport */
+void msm_rpc_trace_call(struct rpc_request_hdr *rq, int len, ktime_t sent)
+{
+	struct rpc_trace_call *c;
+	struct rpc_trace_rec *r;
+	unsigned long flags;
+
+	c = &pending[be32_to_cpu(rq->xid) & (RPC_TRACE_PENDING - 1)];
+
+	spin_lock_irqsave(&trace_lock, flags);
+	c->xid = rq->xid;
+	c->prog = be32_to_cpu(rq->prog);
+	c->vers = be32_to_cpu(rq->vers);
+	c->proc = be32_to_cpu(rq->procedure);
+	c->sent = sent;
+	c->queued = ktime_get();
+	c->rec = -1;
+
+	if (recording && nrecs < RPC_TRACE_RECS) {
+		r = &recs[nrecs];
+		r->delay_us = nrecs ?
+			ktime_to_us(ktime_sub(sent, last_sent)) : 0;
+		r->prog = c->prog;
+		r->vers = c->vers;
+		r->proc = c->proc;
+		r->req_len = min(len, 0xffff);
+		r->reply_len = 0;
+		c->rec = nrecs++;
+		last_sent = sent;
+	}
+	spin_unlock_irqrestore(&trace_lock, flags);
+}
+
+/* From __msm_rpc_read(), as the caller takes @pkt */
+void msm_rpc_trace_reply(struct rr_packet *pkt)
+{
+	struct rpc_reply_hdr *reply = (void *)pkt->first->data;
+	struct rpc_trace_call *c;
+	unsigned long flags;
+	ktime_t now;
+
+	if (pkt->length < 3 * sizeof(uint32_t) || reply->type == 0)
+		return;
+
+	now = ktime_get();
+	c = &pending[be32_to_cpu(reply->xid) & (RPC_TRACE_PENDING - 1)];
+
+	spin_lock_irqsave(&trace_lock, flags);
+	if (!c->xid || c->xid != reply->xid) {
+		spin_unlock_irqrestore(&trace_lock, flags);
+		return;
+	}
+	c->xid = 0;
+
+	trace_account(&live, c->prog, c->vers, c->proc,
+		      ktime_to_us(ktime_sub(now, c->sent)),
+		      ktime_to_us(ktime_sub(c->queued, c->sent)),
+		      ktime_to_us(ktime_sub(pkt->qtime, c->queued)),
+		      ktime_to_us(ktime_sub(now, pkt->qtime)));
+
+	if (c->rec >= 0 && c->rec < nrecs)
+		recs[c->rec].reply_len = min_t(u32, pkt->length, 0xffff);
+	spin_unlock_irqrestore(&trace_lock, flags);
+}
+
+static void trace_show_table(struct seq_file *m, struct rpc_trace_table *t)
+{
+	struct rpc_trace_entry *e;
+	int i, b;
+
+	seq_printf(m, "%-8s %-8s %4s %7s %7s %7s %7s %7s %7s  us <",
+		   "prog", "vers", "proc", "count", "avg", "max",
+		   "write", "remote", "wakeup");
+	for (b = 0; b < RPC_TRACE_BUCKETS - 1; b++)
+		seq_printf(m, " %6u", 64 << b);
+	seq_printf(m, " %6s\n", "inf");
+
+	for (i = 0; i < RPC_TRACE_ENTRIES; i++) {
+		e = &t->entries[i];
+		if (!e->count)
+			continue;
+
+		seq_printf(m, "%08x %08x %4u %7u %7llu %7u %7llu %7llu %7llu     ",
+			   e->prog, e->vers, e->proc, e->count,
+			   div_u64(e->total_us, e->count), e->max_us,
+			   div_u64(e->write_us, e->count),
+			   div_u64(e->remote_us, e->count),
+			   div_u64(e->wakeup_us, e->count));
+		for (b = 0; b < RPC_TRACE_BUCKETS; b++)
+			seq_printf(m, " %6u", e->hist[b]);
+		seq_putc(m, '\n');
+	}
+
+	if (t->dropped)
+		seq_printf(m, "dropped: %u\n", t->dropped);
+}
+
+/* Shown from a copy, seq_file may sleep */
+static int latency_show(struct seq_file *m, void *unused)
+{
+	struct rpc_trace_table *t;
+
+	t = vmalloc(sizeof(*t));
+	if (!t)
+		return -ENOMEM;
+
+	spin_lock_irq(&trace_lock);
+	memcpy(t, &live, sizeof(*t));
+	spin_unlock_irq(&trace_lock);
+
+	trace_show_table(m, t);
+	vfree(t);
+	return 0;
+}
+
+static int latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, latency_show, NULL);
+}
+
+/* Any write clears the histograms */
+static ssize_t latency_write(struct file *file, const char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	spin_lock_irq(&trace_lock);
+	memset(&live, 0, sizeof(live));
+	spin_unlock_irq(&trace_lock);
+	return count;
+}
+
+static const struct file_operations latency_fops = {
+	.open = latency_open,
+	.read = seq_read,
+	.write = latency_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static ssize_t record_read(struct file *file, char __user *buf,
+			   size_t count, loff_t *ppos)
+{
+	ssize_t rc = 0;
+
+	mutex_lock(&record_lock);
+	if (recording)
+		rc = -EBUSY;
+	else if (recs)
+		rc = simple_read_from_buffer(buf, count, ppos, recs,
+					     nrecs * sizeof(*recs));
+	mutex_unlock(&record_lock);
+	return rc;
+}
+
+/* "1" starts a new recording, "0" stops it */
+static ssize_t record_write(struct file *file, const char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	struct rpc_trace_rec *new = NULL, *old;
+	char c;
+
+	if (!count || get_user(c, buf))
+		return -EFAULT;
+
+	if (c == '1') {
+		new = vmalloc(RPC_TRACE_RECS * sizeof(*new));
+		if (!new)
+			return -ENOMEM;
+	} else if (c != '0') {
+		return -EINVAL;
+	}
+
+	mutex_lock(&record_lock);
+	spin_lock_irq(&trace_lock);
+	old = NULL;
+	if (new) {
+		old = recs;
+		recs = new;
+		nrecs = 0;
+	}
+	recording = new != NULL;
+	spin_unlock_irq(&trace_lock);
+	mutex_unlock(&record_lock);
+
+	vfree(old);
+	return count;
+}
+
+static const struct file_operations record_fops = {
+	.read = record_read,
+	.write = record_write,
+};
+
+static int replay_server(void *data)
+{
+	struct msm_rpc_endpoint *ept = replay.ept;
+	struct rpc_request_hdr *rq;
+	struct rpc_reply_hdr *reply;
+	void *buf;
+	u32 len;
+	int rc;
+
+	reply = kzalloc(RPC_REPLAY_MSG_MAX, GFP_KERNEL);
+	if (!reply)
+		goto out;
+
+	while (!replay.server_stop) {
+		rc = msm_rpc_read(ept, &buf, -1, -1);
+		/* 0 is msm_rpc_read_wakeup(), anything but -EAGAIN is fatal */
+		if (rc == 0 || rc == -EAGAIN)
+			continue;
+		if (rc < 0) {
+			pr_err("%s: read failed %d\n", __func__, rc);
+			replay.server_stop = 1;
+			break;
+		}
+
+		rq = buf;
+		if (rc < sizeof(*rq) + sizeof(u32) || rq->type != 0) {
+			kfree(buf);
+			continue;
+		}
+
+		/* The call says how long a reply it wants */
+		len = be32_to_cpu(*(uint32_t *)(rq + 1));
+		len = clamp_t(u32, len, sizeof(*reply), RPC_REPLAY_MSG_MAX);
+
+		reply->xid = rq->xid;
+		reply->type = cpu_to_be32(1);
+		reply->reply_stat = cpu_to_be32(RPCMSG_REPLYSTAT_ACCEPTED);
+		reply->data.acc_hdr.accept_stat =
+			cpu_to_be32(RPC_ACCEPTSTAT_SUCCESS);
+		kfree(buf);
+
+		rc = msm_rpc_write(ept, reply, len);
+		if (rc < 0)
+			pr_err("%s: reply failed %d\n", __func__, rc);
+	}
+
+	kfree(reply);
+out:
+	complete(&replay.server_exited);
+	return 0;
+}
+
+static void replay_calls(struct msm_rpc_endpoint *ept)
+{
+	struct rpc_request_hdr *req;
+	struct rpc_trace_rec *r;
+	void *reply;
+	ktime_t start;
+	u32 len;
+	int i, rc;
+
+	req = kzalloc(RPC_REPLAY_MSG_MAX, GFP_KERNEL);
+	reply = kmalloc(RPC_REPLAY_MSG_MAX, GFP_KERNEL);
+	if (!req || !reply)
+		goto out;
+
+	/* Don't wait out the timeout on every call once the server died */
+	for (i = 0; i < replay.nrecs && !replay.server_stop; i++) {
+		r = &replay.recs[i];
+
+		if (r->delay_us >= 20 * USEC_PER_MSEC)
+			msleep(r->delay_us / USEC_PER_MSEC);
+		else if (r->delay_us)
+			usleep_range(r->delay_us, r->delay_us + 100);
+
+		len = clamp_t(u32, r->req_len, sizeof(*req) + sizeof(u32),
+			      RPC_REPLAY_MSG_MAX);
+		*(uint32_t *)(req + 1) = cpu_to_be32(r->reply_len);
+
+		start = ktime_get();
+		rc = msm_rpc_call_reply(ept, r->proc, req, len,
+					reply, RPC_REPLAY_MSG_MAX,
+					RPC_REPLAY_TIMEOUT);
+		if (rc < 0) {
+			replay.errors++;
+			continue;
+		}
+
+		mutex_lock(&replay.lock);
+		trace_account(&replay.results, r->prog, r->vers, r->proc,
+			      ktime_to_us(ktime_sub(ktime_get(), start)),
+			      0, 0, 0);
+		replay.done++;
+		mutex_unlock(&replay.lock);
+	}
+out:
+	kfree(reply);
+	kfree(req);
+}
+
+static int replay_thread(void *data)
+{
+	struct msm_rpc_endpoint *ept;
+	struct task_struct *server;
+	int rc;
+
+	replay.ept = msm_rpc_open();
+	if (IS_ERR(replay.ept)) {
+		pr_err("%s: no server endpoint\n", __func__);
+		goto out;
+	}
+
+	rc = msm_rpc_register_server(replay.ept, RPC_REPLAY_PROG,
+				     RPC_REPLAY_VERS);
+	if (rc < 0) {
+		pr_err("%s: server registration failed %d\n", __func__, rc);
+		goto out_close;
+	}
+
+	replay.server_stop = 0;
+	init_completion(&replay.server_exited);
+	server = kthread_run(replay_server, NULL, "krpcreplayd");
+	if (IS_ERR(server))
+		goto out_unregister;
+
+	/* Over the loopback transport: fails without one */
+	ept = msm_rpc_connect(RPC_REPLAY_PROG, RPC_REPLAY_VERS,
+			      MSM_RPC_UNINTERRUPTIBLE);
+	if (IS_ERR(ept)) {
+		pr_err("%s: connect failed %ld\n", __func__, PTR_ERR(ept));
+	} else {
+		replay_calls(ept);
+		msm_rpc_close(ept);
+	}
+
+	replay.server_stop = 1;
+	msm_rpc_read_wakeup(replay.ept);
+	wait_for_completion(&replay.server_exited);
+out_unregister:
+	msm_rpc_unregister_server(replay.ept, RPC_REPLAY_PROG,
+				  RPC_REPLAY_VERS);
+out_close:
+	msm_rpc_close(replay.ept);
+out:
+	mutex_lock(&replay.lock);
+	vfree(replay.recs);
+	replay.recs = NULL;
+	replay.running = false;
+	mutex_unlock(&replay.lock);
+	return 0;
+}
+
+static int replay_show(struct seq_file *m, void *unused)
+{
+	mutex_lock(&replay.lock);
+	seq_printf(m, "%s: %d of %d calls, %d errors\n",
+		   replay.running ? "running" : "idle",
+		   replay.done, replay.nrecs, replay.errors);
+	trace_show_table(m, &replay.results);
+	mutex_unlock(&replay.lock);
+	return 0;
+}
+
+static int replay_open(struct inode *inode, struct file *file)
+{
+	int rc;
+
+	if (!(file->f_mode & FMODE_WRITE))
+		return single_open(file, replay_show, NULL);
+	if (file->f_mode & FMODE_READ)
+		return -EINVAL;
+
+	/* A new log replaces the results of the previous replay */
+	mutex_lock(&replay.lock);
+	if (replay.running) {
+		mutex_unlock(&replay.lock);
+		return -EBUSY;
+	}
+	replay.recs = vmalloc(RPC_TRACE_RECS * sizeof(*replay.recs));
+	if (!replay.recs) {
+		rc = -ENOMEM;
+	} else {
+		replay.running = true;
+		replay.nrecs = 0;
+		replay.done = 0;
+		replay.errors = 0;
+		memset(&replay.results, 0, sizeof(replay.results));
+		rc = 0;
+	}
+	mutex_unlock(&replay.lock);
+
+	return rc;
+}
+
+static ssize_t replay_write(struct file *file, const char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	ssize_t rc;
+
+	rc = simple_write_to_buffer(replay.recs,
+				    RPC_TRACE_RECS * sizeof(*replay.recs),
+				    ppos, buf, count);
+	if (rc > 0)
+		replay.nrecs = *ppos / sizeof(*replay.recs);
+	return rc;
+}
+
+/* Closing the log written to "replay" plays it */
+static int replay_release(struct inode *inode, struct file *file)
+{
+	struct task_struct *task;
+
+	if (!(file->f_mode & FMODE_WRITE))
+		return single_release(inode, file);
+
+	if (replay.nrecs) {
+		task = kthread_run(replay_thread, NULL, "krpcreplay");
+		if (!IS_ERR(task))
+			return 0;
+	}
+
+	mutex_lock(&replay.lock);
+	vfree(replay.recs);
+	replay.recs = NULL;
+	replay.running = false;
+	mutex_unlock(&replay.lock);
+	return 0;
+}
+
+static const struct file_operations replay_fops = {
+	.open = replay_open,
+	.read = seq_read,
+	.write = replay_write,
+	.llseek = seq_lseek,
+	.release = replay_release,
+};
+
+static int __init rpc_trace_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("smd_rpcrouter_trace", NULL);
+	if (IS_ERR_OR_NULL(dir))
+		return 0;
+
+	debugfs_create_file("latency", S_IRUGO | S_IWUSR, dir, NULL,
+			    &latency_fops);
+	debugfs_create_file("record", S_IRUSR | S_IWUSR, dir, NULL,
+			    &record_fops);
+	debugfs_create_file("replay", S_IRUGO | S_IWUSR, dir, NULL,
+			    &replay_fops);
+	return 0;
+}
+module_init(rpc_trace_init);
@@ -465,12 +465,16 @@ void dpm_resume_noirq(pm_message_t state)
 	while (!list_empty(&dpm_noirq_list)) {
 		struct device *dev = to_device(dpm_noirq_list.next);
 		int error;
+		ktime_t calltime;
 
 		get_device(dev);
 		list_move_tail(&dev->power.entry, &dpm_suspended_list);
 		mutex_unlock(&dpm_list_mtx);
 
+		calltime = ktime_get();
 		error = device_resume_noirq(dev, state);
+		suspend_prof_device(dev, SUSPEND_PROF_DPM_RESUME_NOIRQ,
+				    calltime);
 		if (error)
 			pm_dev_err(dev, state, " early", error);
 
@@ -513,11 +517,13 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 {
 	int error = 0;
 	bool put = false;
+	ktime_t calltime;
 
 	TRACE_DEVICE(dev);
 	TRACE_RESUME(0);
 
 	dpm_wait(dev->parent, async);
+	calltime = ktime_get();
 	device_lock(dev);
 
 	/*
@@ -568,6 +574,7 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 
  End:
 	dev->power.is_suspended = false;
+	suspend_prof_device(dev, SUSPEND_PROF_DPM_RESUME, calltime);
 
  Unlock:
 	device_unlock(dev);
@@ -824,11 +831,15 @@ int dpm_suspend_noirq(pm_message_t state)
 	mutex_lock(&dpm_list_mtx);
 	while (!list_empty(&dpm_suspended_list)) {
 		struct device *dev = to_device(dpm_suspended_list.prev);
+		ktime_t calltime;
 
 		get_device(dev);
 		mutex_unlock(&dpm_list_mtx);
 
+		calltime = ktime_get();
 		error = device_suspend_noirq(dev, state);
+		suspend_prof_device(dev, SUSPEND_PROF_DPM_SUSPEND_NOIRQ,
+				    calltime);
 
 		mutex_lock(&dpm_list_mtx);
 		if (error) {
@@ -882,6 +893,7 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 	int error = 0;
 	struct timer_list timer;
 	struct dpm_drv_wd_data data;
+	ktime_t calltime;
 
 	dpm_wait_for_children(dev, async);
 
@@ -906,6 +918,7 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 	timer.data = (unsigned long)&data;
 	add_timer(&timer);
 
+	calltime = ktime_get();
 	device_lock(dev);
 
 	if (dev->pwr_domain) {
@@ -944,6 +957,7 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 
  End:
 	dev->power.is_suspended = !error;
+	suspend_prof_device(dev, SUSPEND_PROF_DPM_SUSPEND, calltime);
 
 	device_unlock(dev);
 
@@ -27,6 +27,11 @@
 #include <linux/workqueue.h>
 #include <linux/kthread.h>
 #include <linux/mutex.h>
+#include <linux/input.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/cputime.h>
 
@@ -44,6 +49,7 @@ struct cpufreq_interactive_cpuinfo {
 	struct cpufreq_policy *policy;
 	struct cpufreq_frequency_table *freq_table;
 	unsigned int target_freq;
+	unsigned int last_load;
 	int governor_enabled;
 };
 
@@ -78,6 +84,64 @@ static unsigned long min_sample_time;
 #define DEFAULT_TIMER_RATE 20 * USEC_PER_MSEC
 static unsigned long timer_rate;
 
+/*
+ * Target load for each frequency range, as "load freq:load freq:load ...":
+ * the first load applies below the first frequency and so on.  The speed
+ * is chosen so the load at the new speed comes out at the target.
+ */
+#define DEFAULT_TARGET_LOAD 90
+static unsigned int default_target_loads[] = {DEFAULT_TARGET_LOAD};
+static spinlock_t target_loads_lock;
+static unsigned int *target_loads = default_target_loads;
+static int ntarget_loads = ARRAY_SIZE(default_target_loads);
+
+/*
+ * Boost: while boost is set, or until boostpulse_endtime, the speed does
+ * not drop below hispeed_freq.  Pulses come from the boostpulse file,
+ * from input events (input_boost) and from synchronous binder calls into
+ * foreground processes (binder_boost).
+ */
+static int boost_val;
+static int input_boost;
+static int binder_boost;
+#define DEFAULT_BOOSTPULSE_DURATION 80 * USEC_PER_MSEC
+static unsigned long boostpulse_duration = DEFAULT_BOOSTPULSE_DURATION;
+static u64 boostpulse_endtime;
+static DEFINE_SPINLOCK(boostpulse_lock);	/* A u64 tears on 32 bit */
+
+/* Decisions are logged to a ring readable from debugfs */
+enum {
+	INTERACTIVE_TRACE_UP,
+	INTERACTIVE_TRACE_DOWN,
+	INTERACTIVE_TRACE_SAME,
+	INTERACTIVE_TRACE_HOLD,		/* Down held off by min_sample_time */
+	INTERACTIVE_TRACE_BOOST,
+	INTERACTIVE_TRACE_BOOSTPULSE,
+	INTERACTIVE_TRACE_INPUT,
+	INTERACTIVE_TRACE_BINDER,
+};
+
+static const char * const interactive_trace_names[] = {
+	"up", "down", "same", "hold", "boost", "boostpulse", "input",
+	"binder",
+};
+
+struct interactive_trace {
+	u64 time;			/* us */
+	u8 cpu;
+	u8 event;
+	u8 load;
+	u8 boosted;
+	unsigned int cur;
+	unsigned int target;
+	unsigned int new_freq;
+};
+
+#define INTERACTIVE_TRACE_SIZE 512	/* Power of two */
+static struct interactive_trace trace_ring[INTERACTIVE_TRACE_SIZE];
+static unsigned int trace_next;
+static DEFINE_SPINLOCK(trace_lock);
+
 static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		unsigned int event);
 
@@ -91,6 +155,56 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 	.owner = THIS_MODULE,
 };
 
+static void interactive_trace(int cpu, int event, unsigned int load,
+	unsigned int cur, unsigned int target, unsigned int new_freq,
+	int boosted)
+{
+	struct interactive_trace *t;
+	unsigned long flags;
+
+	spin_lock_irqsave(&trace_lock, flags);
+	t = &trace_ring[trace_next++ & (INTERACTIVE_TRACE_SIZE - 1)];
+	t->time = ktime_to_us(ktime_get());
+	t->cpu = cpu;
+	t->event = event;
+	t->load = load;
+	t->boosted = boosted;
+	t->cur = cur;
+	t->target = target;
+	t->new_freq = new_freq;
+	spin_unlock_irqrestore(&trace_lock, flags);
+}
+
+static unsigned int freq_to_targetload(unsigned int freq)
+{
+	int i;
+	unsigned int ret;
+	unsigned long flags;
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+
+	for (i = 0; i < ntarget_loads - 1 && freq >= target_loads[i+1]; i += 2)
+		;
+
+	ret = target_loads[i];
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+	return ret;
+}
+
+static int cpufreq_interactive_boosted(u64 now)
+{
+	unsigned long flags;
+	u64 endtime;
+
+	if (boost_val)
+		return 1;
+
+	spin_lock_irqsave(&boostpulse_lock, flags);
+	endtime = boostpulse_endtime;
+	spin_unlock_irqrestore(&boostpulse_lock, flags);
+	return now < endtime;
+}
+
 static void cpufreq_interactive_timer(unsigned long data)
 {
 	unsigned int delta_idle;
@@ -105,6 +219,7 @@ static void cpufreq_interactive_timer(unsigned long data)
 	unsigned int new_freq;
 	unsigned int index;
 	unsigned long flags;
+	int boosted;
 
 	smp_rmb();
 
@@ -163,15 +278,23 @@ static void cpufreq_interactive_timer(unsigned long data)
 	if (load_since_change > cpu_load)
 		cpu_load = load_since_change;
 
-	if (cpu_load >= go_hispeed_load) {
-		if (pcpu->policy->cur == pcpu->policy->min)
+	pcpu->last_load = cpu_load;
+	boosted = cpufreq_interactive_boosted(pcpu->timer_run_time);
+
+	new_freq = pcpu->policy->cur * cpu_load /
+		freq_to_targetload(pcpu->policy->cur);
+
+	if (cpu_load >= go_hispeed_load || boosted) {
+		if (new_freq < hispeed_freq)
 			new_freq = hispeed_freq;
-		else
-			new_freq = pcpu->policy->max * cpu_load / 100;
-	} else {
-		new_freq = pcpu->policy->cur * cpu_load / 100;
 	}
 
+	/* Above hispeed a heavy load still heads straight for the top */
+	if (cpu_load >= go_hispeed_load &&
+	    pcpu->policy->cur >= hispeed_freq &&
+	    new_freq < pcpu->policy->max * cpu_load / 100)
+		new_freq = pcpu->policy->max * cpu_load / 100;
+
 	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
 					   new_freq, CPUFREQ_RELATION_H,
 					   &index)) {
@@ -182,8 +305,12 @@ static void cpufreq_interactive_timer(unsigned long data)
 
 	new_freq = pcpu->freq_table[index].frequency;
 
-	if (pcpu->target_freq == new_freq)
+	if (pcpu->target_freq == new_freq) {
+		interactive_trace(data, INTERACTIVE_TRACE_SAME, cpu_load,
+			pcpu->policy->cur, pcpu->target_freq, new_freq,
+			boosted);
 		goto rearm_if_notmax;
+	}
 
 	/*
 	 * Do not scale down unless we have been at this frequency for the
@@ -191,10 +318,18 @@ static void cpufreq_interactive_timer(unsigned long data)
 	 */
 	if (new_freq < pcpu->target_freq) {
 		if (cputime64_sub(pcpu->timer_run_time, pcpu->freq_change_time)
-		    < min_sample_time)
+		    < min_sample_time) {
+			interactive_trace(data, INTERACTIVE_TRACE_HOLD,
+				cpu_load, pcpu->policy->cur,
+				pcpu->target_freq, new_freq, boosted);
 			goto rearm;
+		}
 	}
 
+	interactive_trace(data, new_freq < pcpu->target_freq ?
+		INTERACTIVE_TRACE_DOWN : INTERACTIVE_TRACE_UP, cpu_load,
+		pcpu->policy->cur, pcpu->target_freq, new_freq, boosted);
+
 	if (new_freq < pcpu->target_freq) {
 		pcpu->target_freq = new_freq;
 		spin_lock_irqsave(&down_cpumask_lock, flags);
@@ -431,6 +566,147 @@ static void cpufreq_interactive_freq_down(struct work_struct *work)
 	}
 }
 
+/* Raise every CPU below hispeed_freq to it straight away */
+static void cpufreq_interactive_boost(int event)
+{
+	int i;
+	int anyboost = 0;
+	unsigned long flags;
+	struct cpufreq_interactive_cpuinfo *pcpu;
+
+	spin_lock_irqsave(&up_cpumask_lock, flags);
+
+	for_each_online_cpu(i) {
+		pcpu = &per_cpu(cpuinfo, i);
+
+		if (!pcpu->governor_enabled)
+			continue;
+
+		if (pcpu->target_freq < hispeed_freq) {
+			interactive_trace(i, event, pcpu->last_load,
+				pcpu->policy->cur, pcpu->target_freq,
+				hispeed_freq, 1);
+			pcpu->target_freq = hispeed_freq;
+			cpumask_set_cpu(i, &up_cpumask);
+			anyboost = 1;
+		}
+	}
+
+	spin_unlock_irqrestore(&up_cpumask_lock, flags);
+
+	if (anyboost)
+		wake_up_process(up_task);
+}
+
+static void cpufreq_interactive_boostpulse(int event)
+{
+	u64 now = ktime_to_us(ktime_get());
+	unsigned long flags;
+
+	/* Back to back events only extend a pulse that is running out */
+	spin_lock_irqsave(&boostpulse_lock, flags);
+	if (event != INTERACTIVE_TRACE_BOOSTPULSE &&
+	    now + boostpulse_duration / 2 < boostpulse_endtime) {
+		spin_unlock_irqrestore(&boostpulse_lock, flags);
+		return;
+	}
+
+	boostpulse_endtime = now + boostpulse_duration;
+	spin_unlock_irqrestore(&boostpulse_lock, flags);
+	cpufreq_interactive_boost(event);
+}
+
+/*
+ * cpufreq_interactive_binder_boost - a synchronous binder call is on its
+ * way to @task.  Foreground processes (nice <= 0) get a boost pulse.
+ */
+void cpufreq_interactive_binder_boost(struct task_struct *task)
+{
+	if (!binder_boost || !atomic_read(&active_count))
+		return;
+
+	if (task && task_nice(task) <= 0)
+		cpufreq_interactive_boostpulse(INTERACTIVE_TRACE_BINDER);
+}
+
+static void interactive_input_event(struct input_handle *handle,
+	unsigned int type, unsigned int code, int value)
+{
+	if (input_boost && atomic_read(&active_count) &&
+	    type == EV_SYN && code == SYN_REPORT)
+		cpufreq_interactive_boostpulse(INTERACTIVE_TRACE_INPUT);
+}
+
+static int interactive_input_connect(struct input_handler *handler,
+	struct input_dev *dev, const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_interactive";
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_register;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_open;
+
+	return 0;
+
+err_open:
+	input_unregister_handle(handle);
+err_register:
+	kfree(handle);
+	return error;
+}
+
+static void interactive_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+/* Touchscreens and keys */
+static const struct input_device_id interactive_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+			    BIT_MASK(ABS_MT_POSITION_X) |
+			    BIT_MASK(ABS_MT_POSITION_Y) },
+	},
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_KEYBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+		.absbit = { [BIT_WORD(ABS_X)] =
+			    BIT_MASK(ABS_X) | BIT_MASK(ABS_Y) },
+	},
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT,
+		.evbit = { BIT_MASK(EV_KEY) },
+	},
+	{ },
+};
+
+static struct input_handler interactive_input_handler = {
+	.event = interactive_input_event,
+	.connect = interactive_input_connect,
+	.disconnect = interactive_input_disconnect,
+	.name = "cpufreq_interactive",
+	.id_table = interactive_ids,
+};
+
 static ssize_t show_hispeed_freq(struct kobject *kobj,
 				 struct attribute *attr, char *buf)
 {
@@ -521,11 +797,210 @@ static ssize_t store_timer_rate(struct kobject *kobj,
 static struct global_attr timer_rate_attr = __ATTR(timer_rate, 0644,
 		show_timer_rate, store_timer_rate);
 
+static ssize_t show_target_loads(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	int i;
+	ssize_t ret = 0;
+	unsigned long flags;
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+
+	for (i = 0; i < ntarget_loads; i++)
+		ret += sprintf(buf + ret, "%u%s", target_loads[i],
+			       i & 0x1 ? ":" : " ");
+
+	ret += sprintf(buf + ret - 1, "\n") - 1;
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+	return ret;
+}
+
+static ssize_t store_target_loads(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	const char *cp;
+	unsigned int *new_target_loads = NULL;
+	int ntokens = 1;
+	int i;
+	unsigned long flags;
+
+	cp = buf;
+	while ((cp = strpbrk(cp + 1, " :")))
+		ntokens++;
+
+	/* A load, then any number of frequency and load pairs */
+	if (!(ntokens & 0x1))
+		return -EINVAL;
+
+	new_target_loads = kmalloc(ntokens * sizeof(unsigned int), GFP_KERNEL);
+	if (!new_target_loads)
+		return -ENOMEM;
+
+	cp = buf;
+	i = 0;
+	while (i < ntokens) {
+		if (sscanf(cp, "%u", &new_target_loads[i++]) != 1) {
+			ret = -EINVAL;
+			goto err;
+		}
+
+		cp = strpbrk(cp, " :");
+		if (!cp)
+			break;
+		cp++;
+	}
+
+	if (i != ntokens) {
+		ret = -EINVAL;
+		goto err;
+	}
+
+	for (i = 0; i < ntokens; i += 2) {
+		if (new_target_loads[i] == 0 || new_target_loads[i] > 100) {
+			ret = -EINVAL;
+			goto err;
+		}
+	}
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+	if (target_loads != default_target_loads)
+		kfree(target_loads);
+	target_loads = new_target_loads;
+	ntarget_loads = ntokens;
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+	return count;
+
+err:
+	kfree(new_target_loads);
+	return ret;
+}
+
+static struct global_attr target_loads_attr = __ATTR(target_loads, 0644,
+		show_target_loads, store_target_loads);
+
+static ssize_t show_boost(struct kobject *kobj, struct attribute *attr,
+			  char *buf)
+{
+	return sprintf(buf, "%d\n", boost_val);
+}
+
+static ssize_t store_boost(struct kobject *kobj, struct attribute *attr,
+			   const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+
+	boost_val = val;
+
+	if (boost_val)
+		cpufreq_interactive_boost(INTERACTIVE_TRACE_BOOST);
+
+	return count;
+}
+
+static struct global_attr boost_attr = __ATTR(boost, 0644,
+		show_boost, store_boost);
+
+static ssize_t store_boostpulse(struct kobject *kobj, struct attribute *attr,
+				const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+
+	cpufreq_interactive_boostpulse(INTERACTIVE_TRACE_BOOSTPULSE);
+	return count;
+}
+
+static struct global_attr boostpulse_attr = __ATTR(boostpulse, 0200,
+		NULL, store_boostpulse);
+
+static ssize_t show_boostpulse_duration(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", boostpulse_duration);
+}
+
+static ssize_t store_boostpulse_duration(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	boostpulse_duration = val;
+	return count;
+}
+
+static struct global_attr boostpulse_duration_attr =
+	__ATTR(boostpulse_duration, 0644, show_boostpulse_duration,
+	       store_boostpulse_duration);
+
+static ssize_t show_input_boost(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", input_boost);
+}
+
+static ssize_t store_input_boost(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	input_boost = !!val;
+	return count;
+}
+
+static struct global_attr input_boost_attr = __ATTR(input_boost, 0644,
+		show_input_boost, store_input_boost);
+
+static ssize_t show_binder_boost(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", binder_boost);
+}
+
+static ssize_t store_binder_boost(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	binder_boost = !!val;
+	return count;
+}
+
+static struct global_attr binder_boost_attr = __ATTR(binder_boost, 0644,
+		show_binder_boost, store_binder_boost);
+
 static struct attribute *interactive_attributes[] = {
 	&hispeed_freq_attr.attr,
 	&go_hispeed_load_attr.attr,
 	&min_sample_time_attr.attr,
 	&timer_rate_attr.attr,
+	&target_loads_attr.attr,
+	&boost_attr.attr,
+	&boostpulse_attr.attr,
+	&boostpulse_duration_attr.attr,
+	&input_boost_attr.attr,
+	&binder_boost_attr.attr,
 	NULL,
 };
 
@@ -636,6 +1111,72 @@ static struct notifier_block cpufreq_interactive_idle_nb = {
 	.notifier_call = cpufreq_interactive_idle_notifier,
 };
 
+#ifdef CONFIG_DEBUG_FS
+/*
+ * One decision per line, oldest first: time (us), cpu, event, load, speed
+ * at the time, target before and target after the decision, boosted.
+ */
+static int interactive_trace_show(struct seq_file *s, void *unused)
+{
+	struct interactive_trace *ring, *t;
+	unsigned int next, n, i;
+	unsigned long flags;
+
+	ring = kmalloc(sizeof(trace_ring), GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&trace_lock, flags);
+	memcpy(ring, trace_ring, sizeof(trace_ring));
+	next = trace_next;
+	spin_unlock_irqrestore(&trace_lock, flags);
+
+	n = min_t(unsigned int, next, INTERACTIVE_TRACE_SIZE);
+
+	for (i = next - n; i != next; i++) {
+		t = &ring[i & (INTERACTIVE_TRACE_SIZE - 1)];
+		seq_printf(s, "%llu %u %s %u %u %u %u %u\n", t->time, t->cpu,
+			   interactive_trace_names[t->event], t->load, t->cur,
+			   t->target, t->new_freq, t->boosted);
+	}
+
+	kfree(ring);
+	return 0;
+}
+
+static int interactive_trace_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, interactive_trace_show, NULL);
+}
+
+static const struct file_operations interactive_trace_fops = {
+	.open = interactive_trace_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static struct dentry *interactive_debugfs;
+
+static void cpufreq_interactive_debugfs_init(void)
+{
+	interactive_debugfs = debugfs_create_dir("cpufreq_interactive", NULL);
+	if (IS_ERR_OR_NULL(interactive_debugfs))
+		return;
+
+	debugfs_create_file("trace", 0444, interactive_debugfs, NULL,
+			    &interactive_trace_fops);
+}
+
+static void cpufreq_interactive_debugfs_exit(void)
+{
+	debugfs_remove_recursive(interactive_debugfs);
+}
+#else
+static void cpufreq_interactive_debugfs_init(void) { }
+static void cpufreq_interactive_debugfs_exit(void) { }
+#endif
+
 static int __init cpufreq_interactive_init(void)
 {
 	unsigned int i;
@@ -674,10 +1215,16 @@ static int __init cpufreq_interactive_init(void)
 
 	spin_lock_init(&up_cpumask_lock);
 	spin_lock_init(&down_cpumask_lock);
+	spin_lock_init(&target_loads_lock);
 	mutex_init(&set_speed_lock);
 
 	idle_notifier_register(&cpufreq_interactive_idle_nb);
 
+	if (input_register_handler(&interactive_input_handler))
+		pr_warn("%s: failed to register input handler\n", __func__);
+
+	cpufreq_interactive_debugfs_init();
+
 	return cpufreq_register_governor(&cpufreq_gov_interactive);
 
 err_freeuptask:
@@ -694,6 +1241,8 @@ module_init(cpufreq_interactive_init);
 static void __exit cpufreq_interactive_exit(void)
 {
 	cpufreq_unregister_governor(&cpufreq_gov_interactive);
+	input_unregister_handler(&interactive_input_handler);
+	cpufreq_interactive_debugfs_exit();
 	kthread_stop(up_task);
 	put_task_struct(up_task);
 	destroy_workqueue(down_wq);
@@ -0,0 +1,313 @@
+/*
+ *  drivers/cpufreq/cpufreq_times.c
+ *
+ *  Per task and per uid cpu time at each frequency
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Each cpu remembers its current frequency index and when its running
+ * task was last charged.  The outgoing task is charged at every context
+ * switch, and the running task at every frequency transition made on the
+ * cpu itself, all from the local cpu with interrupts off: no locks.
+ *
+ * Live tasks are summed per uid when the summary is read; exiting tasks
+ * fold their times into the uid table from release_task().
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpufreq.h>
+#include <linux/cpufreq_times.h>
+#include <linux/cred.h>
+#include <linux/hash.h>
+#include <linux/init.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+#define UID_HASH_BITS	6
+
+struct uid_entry {
+	uid_t uid;
+	struct hlist_node hash;
+	u64 dead_time[CPUFREQ_TIMES_MAX_STATES];	/* Exited tasks */
+	u64 live_time[CPUFREQ_TIMES_MAX_STATES];	/* Scratch for reads */
+};
+
+struct cpufreq_times_cpu {
+	u64 last;		/* sched_clock() when current was last charged */
+	unsigned int index;
+};
+
+static DEFINE_PER_CPU(struct cpufreq_times_cpu, cpufreq_times_cpu);
+
+static unsigned int freq_table[CPUFREQ_TIMES_MAX_STATES];
+static unsigned int freq_count;
+static bool ready;
+
+static struct hlist_head uid_hash[1 << UID_HASH_BITS];
+static DEFINE_MUTEX(uid_lock);
+
+static unsigned int freq_to_index(unsigned int freq)
+{
+	unsigned int i;
+
+	for (i = 1; i < freq_count; i++)
+		if (freq < freq_table[i])
+			break;
+	return i - 1;
+}
+
+/* Interrupts off, on the cpu @p runs on */
+static void charge(struct task_struct *p, struct cpufreq_times_cpu *c)
+{
+	u64 now = sched_clock();
+
+	p->time_in_state[c->index] += now - c->last;
+	c->last = now;
+}
+
+void cpufreq_task_times_switch(struct task_struct *prev)
+{
+	if (!ready)
+		return;
+	charge(prev, &__get_cpu_var(cpufreq_times_cpu));
+}
+
+static int cpufreq_times_transition(struct notifier_block *nb,
+				    unsigned long val, void *data)
+{
+	struct cpufreq_freqs *freqs = data;
+	struct cpufreq_times_cpu *c;
+	unsigned long flags;
+
+	if (val != CPUFREQ_POSTCHANGE || !ready)
+		return 0;
+
+	c = &per_cpu(cpufreq_times_cpu, freqs->cpu);
+
+	/*
+	 * A transition for another cpu only moves the index, the slice its
+	 * task is running is charged at the new frequency.
+	 */
+	local_irq_save(flags);
+	if (freqs->cpu == smp_processor_id())
+		charge(current, c);
+	c->index = freq_to_index(freqs->new);
+	local_irq_restore(flags);
+
+	return 0;
+}
+
+static struct notifier_block cpufreq_times_nb = {
+	.notifier_call = cpufreq_times_transition,
+};
+
+static struct uid_entry *find_uid_entry(uid_t uid, gfp_t gfp)
+{
+	struct hlist_head *head = &uid_hash[hash_32(uid, UID_HASH_BITS)];
+	struct hlist_node *node;
+	struct uid_entry *e;
+
+	hlist_for_each_entry(e, node, head, hash)
+		if (e->uid == uid)
+			return e;
+
+	e = kzalloc(sizeof(*e), gfp);
+	if (!e)
+		return NULL;
+	e->uid = uid;
+	hlist_add_head(&e->hash, head);
+	return e;
+}
+
+void cpufreq_task_times_exit(struct task_struct *p)
+{
+	struct uid_entry *e;
+	unsigned int i;
+
+	if (!ready)
+		return;
+
+	mutex_lock(&uid_lock);
+	e = find_uid_entry(task_uid(p), GFP_KERNEL);
+	if (e)
+		for (i = 0; i < freq_count; i++)
+			e->dead_time[i] += p->time_in_state[i];
+	mutex_unlock(&uid_lock);
+}
+
+static void seq_put_freqs(struct seq_file *m)
+{
+	unsigned int i;
+
+	for (i = 0; i < freq_count; i++)
+		seq_printf(m, " %u", freq_table[i]);
+	seq_putc(m, '\n');
+}
+
+/* Same units as cpufreq_stats time_in_state */
+static void seq_put_times(struct seq_file *m, const u64 *a, const u64 *b)
+{
+	unsigned int i;
+
+	for (i = 0; i < freq_count; i++)
+		seq_printf(m, " %llu", (unsigned long long)
+			   nsec_to_clock_t(a[i] + (b ? b[i] : 0)));
+	seq_putc(m, '\n');
+}
+
+static void seq_put_task_times(struct seq_file *m, const u64 *times)
+{
+	seq_puts(m, "freq:");
+	seq_put_freqs(m);
+	seq_puts(m, "time:");
+	seq_put_times(m, times, NULL);
+}
+
+/* /proc/<pid>/task/<tid>/time_in_state */
+int proc_time_in_state_show(struct seq_file *m, struct pid_namespace *ns,
+			    struct pid *pid, struct task_struct *p)
+{
+	if (ready)
+		seq_put_task_times(m, p->time_in_state);
+	return 0;
+}
+
+/* /proc/<pid>/time_in_state, summed over the live threads */
+int proc_tgid_time_in_state_show(struct seq_file *m,
+				 struct pid_namespace *ns, struct pid *pid,
+				 struct task_struct *p)
+{
+	u64 times[CPUFREQ_TIMES_MAX_STATES];
+	struct task_struct *t;
+	unsigned int i;
+
+	if (!ready)
+		return 0;
+
+	memset(times, 0, sizeof(times));
+	rcu_read_lock();
+	t = p;
+	do {
+		for (i = 0; i < freq_count; i++)
+			times[i] += t->time_in_state[i];
+	} while_each_thread(p, t);
+	rcu_read_unlock();
+
+	seq_put_task_times(m, times);
+	return 0;
+}
+
+static int uid_time_in_state_show(struct seq_file *m, void *v)
+{
+	struct uid_entry *e;
+	struct hlist_node *node;
+	struct task_struct *g, *t;
+	unsigned int i, b;
+
+	if (!ready)
+		return 0;
+
+	seq_puts(m, "uid:");
+	seq_put_freqs(m);
+
+	mutex_lock(&uid_lock);
+	for (b = 0; b < ARRAY_SIZE(uid_hash); b++)
+		hlist_for_each_entry(e, node, &uid_hash[b], hash)
+			memset(e->live_time, 0, sizeof(e->live_time));
+
+	rcu_read_lock();
+	do_each_thread(g, t) {
+		e = find_uid_entry(task_uid(t), GFP_ATOMIC);
+		if (!e)
+			continue;
+		for (i = 0; i < freq_count; i++)
+			e->live_time[i] += t->time_in_state[i];
+	} while_each_thread(g, t);
+	rcu_read_unlock();
+
+	for (b = 0; b < ARRAY_SIZE(uid_hash); b++) {
+		hlist_for_each_entry(e, node, &uid_hash[b], hash) {
+			seq_printf(m, "%u:", e->uid);
+			seq_put_times(m, e->dead_time, e->live_time);
+		}
+	}
+	mutex_unlock(&uid_lock);
+
+	return 0;
+}
+
+static int uid_time_in_state_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, uid_time_in_state_show, NULL);
+}
+
+static const struct file_operations uid_time_in_state_fops = {
+	.open = uid_time_in_state_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/*
+ * Frequencies come from cpu0's table, sorted; all cpus of the targets
+ * this is used on share it.
+ */
+static int __init cpufreq_times_init(void)
+{
+	struct cpufreq_frequency_table *table;
+	struct cpufreq_times_cpu *c;
+	unsigned int i, j, freq, cpu;
+	u64 now;
+
+	table = cpufreq_frequency_get_table(0);
+	if (!table)
+		return -ENODEV;
+
+	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++) {
+		freq = table[i].frequency;
+		if (freq == CPUFREQ_ENTRY_INVALID)
+			continue;
+		for (j = 0; j < freq_count && freq_table[j] < freq; j++)
+			;
+		if (j < freq_count && freq_table[j] == freq)
+			continue;
+		if (freq_count == CPUFREQ_TIMES_MAX_STATES) {
+			pr_warn("%s: more than %d frequencies\n", __func__,
+				CPUFREQ_TIMES_MAX_STATES);
+			break;
+		}
+		memmove(&freq_table[j + 1], &freq_table[j],
+			(freq_count - j) * sizeof(freq_table[0]));
+		freq_table[j] = freq;
+		freq_count++;
+	}
+
+	if (!freq_count)
+		return -ENODEV;
+
+	now = sched_clock();
+	for_each_possible_cpu(cpu) {
+		c = &per_cpu(cpufreq_times_cpu, cpu);
+		c->index = freq_to_index(cpufreq_quick_get(cpu));
+		c->last = now;
+	}
+
+	cpufreq_register_notifier(&cpufreq_times_nb,
+				  CPUFREQ_TRANSITION_NOTIFIER);
+	proc_create("uid_time_in_state", S_IRUGO, NULL,
+		    &uid_time_in_state_fops);
+
+	smp_wmb();
+	ready = true;
+	return 0;
+}
+late_initcall_sync(cpufreq_times_init);
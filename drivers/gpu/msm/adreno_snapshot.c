@@ -677,13 +677,15 @@ static int snapshot_rb(struct kgsl_device *device, void *snapshot,
 			/*
 			 * The IB from CP_IB1_BASE and the IBs for legacy
 			 * context switch go into the snapshot all
-			 * others get marked at GPU objects
+			 * others get marked at GPU objects.  If the user
+			 * only wants the hung IB chain then skip the others
+			 * entirely so they don't get frozen.
 			 */
 
 			if (ibaddr == ibbase || memdesc != NULL)
 				push_object(device, SNAPSHOT_OBJ_TYPE_IB,
 					ptbase, ibaddr, ibsize);
-			else
+			else if (!device->snapshot_hung_ib_only)
 				ib_add_gpu_object(device, ptbase, ibaddr,
 					ibsize);
 		}
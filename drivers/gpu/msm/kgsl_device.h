@@ -176,7 +176,27 @@ struct kgsl_device {
 	int snapshot_frozen;	/* 1 if the snapshot output is frozen until
 				   it gets read by the user.  This avoids
 				   losing the output on multiple hangs  */
+	int snapshot_hung_ib_only; /* 1 to only freeze the objects referenced
+				      by the hung IB chain */
+	s64 snapshot_gen_us;	/* Time taken to build the last snapshot */
+	int snapshot_raw_size;	/* Size of the sections before compression */
 	struct kobject snapshot_kobj;
+#ifdef CONFIG_MSM_KGSL_SNAPSHOT_COMPRESS
+	int snapshot_compress;	/* 1 if sections are compressed as they are
+				   generated */
+	int snapshot_compressed; /* 1 if the last snapshot was compressed */
+	void *snapshot_lzo;	/* Scratch buffer for one compressed chunk */
+	int snapshot_lzo_size;	/* End of the compressed sections while a
+				   snapshot is being built, else 0 */
+	int snapshot_lzo_in;	/* Start of the raw data not yet compressed */
+	void *snapshot_lzo_wrkmem; /* LZO compressor work memory */
+	s64 snapshot_lzo_us;	/* Compressing sections, objects excluded */
+	/* The object chunk held in the scratch buffer, for sequential reads */
+	void *snapshot_lzo_obj;
+	unsigned int snapshot_lzo_index;
+	unsigned int snapshot_lzo_pos;
+	unsigned int snapshot_lzo_len;
+#endif
 
 	/*
 	 * List of GPU buffers that have been frozen in memory until they can be
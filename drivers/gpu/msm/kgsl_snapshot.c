@@ -15,6 +15,8 @@
 #include <linux/utsname.h>
 #include <linux/sched.h>
 #include <linux/idr.h>
+#include <linux/vmalloc.h>
+#include <linux/lzo.h>
 
 #include "kgsl.h"
 #include "kgsl_log.h"
@@ -32,6 +34,7 @@ struct kgsl_snapshot_object {
 	int type;
 	struct kgsl_mem_entry *entry;
 	struct list_head node;
+	int lzo_size;	/* Compressed size in the dump, 0 if not known yet */
 };
 
 /* idr_for_each function to count the number of contexts */
@@ -184,18 +187,14 @@ static int kgsl_snapshot_dump_indexed_regs(struct kgsl_device *device,
 #define GPU_OBJ_SECTION_SIZE(_o) \
 	(GPU_OBJ_HEADER_SZ + ((_o)->size))
 
-static int kgsl_snapshot_dump_object(struct kgsl_device *device,
-		struct kgsl_snapshot_object *obj, void *buf,
-		unsigned int off, unsigned int count)
+/* Construct a local copy of the headers for a GPU object section */
+static void kgsl_snapshot_object_headers(struct kgsl_snapshot_object *obj,
+		unsigned char *headers)
 {
-	unsigned char headers[GPU_OBJ_HEADER_SZ];
 	struct kgsl_snapshot_section_header *sect =
 		(struct kgsl_snapshot_section_header *) headers;
 	struct kgsl_snapshot_gpu_object *header =
 		(struct kgsl_snapshot_gpu_object *) (headers + sizeof(*sect));
-	int ret = 0;
-
-	/* Construct a local copy of the headers */
 
 	sect->magic = SNAPSHOT_SECTION_MAGIC;
 	sect->id = KGSL_SNAPSHOT_SECTION_GPU_OBJECT;
@@ -207,6 +206,16 @@ static int kgsl_snapshot_dump_object(struct kgsl_device *device,
 	header->size = obj->size >> 2;
 	header->gpuaddr = obj->gpuaddr;
 	header->ptbase = obj->ptbase;
+}
+
+static int kgsl_snapshot_dump_object(struct kgsl_device *device,
+		struct kgsl_snapshot_object *obj, void *buf,
+		unsigned int off, unsigned int count)
+{
+	unsigned char headers[GPU_OBJ_HEADER_SZ];
+	int ret = 0;
+
+	kgsl_snapshot_object_headers(obj, headers);
 
 	/* Copy out any part of the header block that is needed */
 
@@ -261,6 +270,11 @@ static void kgsl_snapshot_put_object(struct kgsl_device *device,
 {
 	list_del(&obj->node);
 
+#ifdef CONFIG_MSM_KGSL_SNAPSHOT_COMPRESS
+	if (device->snapshot_lzo_obj == obj)
+		device->snapshot_lzo_obj = NULL;
+#endif
+
 	obj->entry->flags &= ~KGSL_MEM_ENTRY_FROZEN;
 	kgsl_mem_entry_put(obj->entry);
 
@@ -328,8 +342,10 @@ int kgsl_snapshot_get_object(struct kgsl_device *device, unsigned int ptbase,
 	list_for_each_entry(obj, &device->snapshot_obj_list, node) {
 		if (obj->gpuaddr == gpuaddr && obj->ptbase == ptbase) {
 			/* If the size is different, use the new size */
-			if (obj->size != size)
+			if (obj->size != size) {
 				obj->size = size;
+				obj->lzo_size = 0;
+			}
 
 			return 0;
 		}
@@ -448,6 +464,322 @@ void *kgsl_snapshot_indexed_registers(struct kgsl_device *device,
 }
 EXPORT_SYMBOL(kgsl_snapshot_indexed_registers);
 
+#ifdef CONFIG_MSM_KGSL_SNAPSHOT_COMPRESS
+
+#define LZO_SECTION_HEADER_SZ \
+	(sizeof(struct kgsl_snapshot_section_header) + \
+	 sizeof(struct kgsl_snapshot_lzo))
+
+/* Sections are compressed in chunks of this many bytes */
+#define LZO_CHUNK 32768
+
+/*
+ * Sections are compressed in place: the raw sections are generated this
+ * far past the header, so that a chunk stored uncompressed (which grows by
+ * the LZO section header) never overwrites raw data not yet compressed
+ */
+#define LZO_SLACK \
+	((KGSL_SNAPSHOT_MEMSIZE / LZO_CHUNK + 1) * LZO_SECTION_HEADER_SZ)
+
+/*
+ * kgsl_snapshot_lzo_chunk - compress a chunk into the scratch buffer
+ * @device - the device being snapshotted
+ * @src - the data to compress
+ * @len - the size of the data, at most LZO_CHUNK
+ *
+ * Wrap up to LZO_CHUNK bytes of the raw stream in a
+ * KGSL_SNAPSHOT_SECTION_LZO section in the scratch buffer and return the
+ * size of the section.  Data that doesn't shrink is stored as is.
+ */
+static int kgsl_snapshot_lzo_chunk(struct kgsl_device *device,
+	const void *src, int len)
+{
+	struct kgsl_snapshot_section_header *sect = device->snapshot_lzo;
+	struct kgsl_snapshot_lzo *header = (void *) sect + sizeof(*sect);
+	unsigned char *data = (unsigned char *) header + sizeof(*header);
+	size_t out;
+	int ret;
+
+	ret = lzo1x_1_compress(src, len, data, &out,
+		device->snapshot_lzo_wrkmem);
+
+	if (ret != LZO_E_OK || out >= len) {
+		memcpy(data, src, len);
+		out = len;
+	}
+
+	sect->magic = SNAPSHOT_SECTION_MAGIC;
+	sect->id = KGSL_SNAPSHOT_SECTION_LZO;
+	sect->size = out + LZO_SECTION_HEADER_SZ;
+	header->size = len;
+
+	return sect->size;
+}
+
+/*
+ * Compress the raw sections up to @end in place, @all to include a tail.
+ * Only this counts towards snapshot_lzo_us; GPU objects are compressed
+ * later, as they are read.
+ */
+static void kgsl_snapshot_lzo_flush(struct kgsl_device *device, void *end,
+	int all)
+{
+	void *in = device->snapshot + device->snapshot_lzo_in;
+	ktime_t start = ktime_get();
+	int len, size;
+
+	while (end - in >= LZO_CHUNK || (all && end > in)) {
+		len = min_t(int, end - in, LZO_CHUNK);
+		size = kgsl_snapshot_lzo_chunk(device, in, len);
+
+		memcpy(device->snapshot + device->snapshot_lzo_size,
+			device->snapshot_lzo, size);
+
+		device->snapshot_lzo_size += size;
+		in += len;
+	}
+
+	device->snapshot_lzo_in = in - device->snapshot;
+	device->snapshot_lzo_us += ktime_us_delta(ktime_get(), start);
+}
+
+/*
+ * kgsl_snapshot_section_done - compress the sections generated so far
+ * @device - the device being snapshotted
+ * @section - pointer to the section header of the finished section
+ *
+ * Called by kgsl_snapshot_add_section after each section is filled in.
+ * Every full chunk of raw data up to the end of the section is compressed
+ * and moved down to the end of the compressed stream.
+ */
+void kgsl_snapshot_section_done(struct kgsl_device *device, void *section)
+{
+	struct kgsl_snapshot_section_header *src = section;
+
+	/* Only while a compressed snapshot is being built */
+	if (device->snapshot_lzo_size == 0)
+		return;
+
+	kgsl_snapshot_lzo_flush(device, section + src->size, 0);
+}
+EXPORT_SYMBOL(kgsl_snapshot_section_done);
+
+/*
+ * Start a new snapshot.  Returns how far past the header the raw sections
+ * should start, 0 if they aren't compressed.
+ */
+static int kgsl_snapshot_lzo_start(struct kgsl_device *device)
+{
+	device->snapshot_lzo_size = 0;
+	device->snapshot_lzo_us = 0;
+	device->snapshot_compressed = 0;
+	device->snapshot_lzo_obj = NULL;
+
+	if (!device->snapshot_compress || device->snapshot_lzo == NULL)
+		return 0;
+
+	device->snapshot_lzo_size = sizeof(struct kgsl_snapshot_header);
+	device->snapshot_lzo_in = sizeof(struct kgsl_snapshot_header) +
+		LZO_SLACK;
+
+	return LZO_SLACK;
+}
+
+/* Compress what is left and return the size of the snapshot region */
+static int kgsl_snapshot_lzo_finish(struct kgsl_device *device, void *end)
+{
+	int size;
+
+	if (device->snapshot_lzo_size == 0)
+		return (int) (end - device->snapshot);
+
+	kgsl_snapshot_lzo_flush(device, end, 1);
+
+	size = device->snapshot_lzo_size;
+	device->snapshot_lzo_size = 0;
+	device->snapshot_compressed = 1;
+
+	return size;
+}
+
+/*
+ * Fill the scratch buffer with chunk @index of a GPU object - the headers
+ * are chunk 0 and the data follows in LZO_CHUNK pieces.  Returns the size
+ * of the chunk's section, 0 past the end of the object.
+ */
+static int kgsl_snapshot_lzo_obj_chunk(struct kgsl_device *device,
+	struct kgsl_snapshot_object *obj, int index)
+{
+	unsigned char headers[GPU_OBJ_HEADER_SZ];
+	unsigned int start;
+
+	if (index == 0) {
+		kgsl_snapshot_object_headers(obj, headers);
+		return kgsl_snapshot_lzo_chunk(device, headers,
+			GPU_OBJ_HEADER_SZ);
+	}
+
+	start = (index - 1) * LZO_CHUNK;
+	if (start >= obj->size)
+		return 0;
+
+	return kgsl_snapshot_lzo_chunk(device,
+		obj->entry->memdesc.hostptr + obj->offset + start,
+		min_t(unsigned int, obj->size - start, LZO_CHUNK));
+}
+
+/* Size of an object in the dump, compressing it once to find out */
+static int kgsl_snapshot_obj_size(struct kgsl_device *device,
+	struct kgsl_snapshot_object *obj)
+{
+	int index, len;
+
+	if (!device->snapshot_compressed)
+		return GPU_OBJ_SECTION_SIZE(obj);
+
+	if (obj->lzo_size == 0) {
+		for (index = 0;
+			(len = kgsl_snapshot_lzo_obj_chunk(device, obj, index));
+			index++)
+			obj->lzo_size += len;
+
+		/* The scratch buffer no longer holds the cached chunk */
+		device->snapshot_lzo_obj = NULL;
+	}
+
+	return obj->lzo_size;
+}
+
+/*
+ * Copy out part of an object, compressed if the snapshot is.  The object
+ * is compressed a chunk at a time into the scratch buffer; the last chunk
+ * is remembered so that sequential reads don't start over from the
+ * beginning of the object.
+ */
+static int kgsl_snapshot_dump_any_object(struct kgsl_device *device,
+	struct kgsl_snapshot_object *obj, void *buf,
+	unsigned int off, unsigned int count)
+{
+	unsigned int index = 0, pos = 0, len = 0, skip, size;
+	int ret = 0;
+	int cached = 0;
+
+	if (!device->snapshot_compressed)
+		return kgsl_snapshot_dump_object(device, obj, buf, off, count);
+
+	if (device->snapshot_lzo_obj == obj &&
+		off >= device->snapshot_lzo_pos) {
+		index = device->snapshot_lzo_index;
+		pos = device->snapshot_lzo_pos;
+		len = device->snapshot_lzo_len;
+		cached = 1;
+	}
+
+	while (count) {
+		if (!cached) {
+			len = kgsl_snapshot_lzo_obj_chunk(device, obj, index);
+			if (len == 0)
+				break;
+
+			device->snapshot_lzo_obj = obj;
+			device->snapshot_lzo_index = index;
+			device->snapshot_lzo_pos = pos;
+			device->snapshot_lzo_len = len;
+		}
+		cached = 0;
+
+		if (off < pos + len) {
+			skip = off > pos ? off - pos : 0;
+			size = min(count, len - skip);
+
+			memcpy(buf + ret, device->snapshot_lzo + skip, size);
+
+			ret += size;
+			count -= size;
+			off += size;
+		}
+
+		pos += len;
+		index++;
+	}
+
+	return ret;
+}
+
+static int kgsl_snapshot_lzo_init(struct kgsl_device *device)
+{
+	/* Scratch for one chunk, section headers included */
+	int size = LZO_SECTION_HEADER_SZ + lzo1x_worst_compress(LZO_CHUNK);
+
+	device->snapshot_lzo = vmalloc(size);
+	device->snapshot_lzo_wrkmem = vmalloc(LZO1X_1_MEM_COMPRESS);
+
+	if (device->snapshot_lzo == NULL ||
+		device->snapshot_lzo_wrkmem == NULL) {
+		vfree(device->snapshot_lzo);
+		vfree(device->snapshot_lzo_wrkmem);
+		device->snapshot_lzo = NULL;
+		device->snapshot_lzo_wrkmem = NULL;
+		return -ENOMEM;
+	}
+
+	device->snapshot_lzo_size = 0;
+	device->snapshot_compressed = 0;
+	device->snapshot_compress = 1;
+
+	return 0;
+}
+
+static void kgsl_snapshot_lzo_close(struct kgsl_device *device)
+{
+	vfree(device->snapshot_lzo);
+	vfree(device->snapshot_lzo_wrkmem);
+
+	device->snapshot_lzo = NULL;
+	device->snapshot_lzo_wrkmem = NULL;
+	device->snapshot_lzo_size = 0;
+	device->snapshot_lzo_obj = NULL;
+	device->snapshot_compressed = 0;
+	device->snapshot_compress = 0;
+}
+
+#else
+
+static inline int kgsl_snapshot_lzo_start(struct kgsl_device *device)
+{
+	return 0;
+}
+
+static inline int kgsl_snapshot_lzo_finish(struct kgsl_device *device,
+	void *end)
+{
+	return (int) (end - device->snapshot);
+}
+
+static inline int kgsl_snapshot_obj_size(struct kgsl_device *device,
+	struct kgsl_snapshot_object *obj)
+{
+	return GPU_OBJ_SECTION_SIZE(obj);
+}
+
+static inline int kgsl_snapshot_dump_any_object(struct kgsl_device *device,
+	struct kgsl_snapshot_object *obj, void *buf,
+	unsigned int off, unsigned int count)
+{
+	return kgsl_snapshot_dump_object(device, obj, buf, off, count);
+}
+
+static inline int kgsl_snapshot_lzo_init(struct kgsl_device *device)
+{
+	return 0;
+}
+
+static inline void kgsl_snapshot_lzo_close(struct kgsl_device *device)
+{
+}
+
+#endif
+
 /*
  * kgsl_snapshot - construct a device snapshot
  * @device - device to snapshot
@@ -460,6 +792,8 @@ int kgsl_device_snapshot(struct kgsl_device *device, int hang)
 	struct kgsl_snapshot_header *header = device->snapshot;
 	int remain = device->snapshot_maxsize - sizeof(*header);
 	void *snapshot;
+	ktime_t start;
+	int slack;
 
 	/*
 	 * The first hang is always the one we are interested in. To
@@ -485,12 +819,21 @@ int kgsl_device_snapshot(struct kgsl_device *device, int hang)
 		return -ENOMEM;
 	}
 
+	start = ktime_get();
+
 	header->magic = SNAPSHOT_MAGIC;
 
 	header->gpuid = kgsl_gpuid(device);
 
+	/*
+	 * Sections are compressed in place as they are added from here on,
+	 * so the raw ones start a little further along
+	 */
+	slack = kgsl_snapshot_lzo_start(device);
+	remain -= slack;
+
 	/* Get a pointer to the first section (right after the header) */
-	snapshot = ((void *) device->snapshot) + sizeof(*header);
+	snapshot = ((void *) device->snapshot) + sizeof(*header) + slack;
 
 	/* Build the Linux specific header */
 	snapshot = kgsl_snapshot_add_section(device, KGSL_SNAPSHOT_SECTION_OS,
@@ -502,15 +845,19 @@ int kgsl_device_snapshot(struct kgsl_device *device, int hang)
 			hang);
 
 	device->snapshot_timestamp = get_seconds();
-	device->snapshot_size = (int) (snapshot - device->snapshot);
+	device->snapshot_raw_size = (int) (snapshot - device->snapshot) - slack;
+	device->snapshot_size = kgsl_snapshot_lzo_finish(device, snapshot);
 
 	/* Freeze the snapshot on a hang until it gets read */
 	device->snapshot_frozen = (hang) ? 1 : 0;
 
+	device->snapshot_gen_us = ktime_us_delta(ktime_get(), start);
+
 	/* log buffer info to aid in ramdump recovery */
-	KGSL_DRV_ERR(device, "snapshot created at va %p pa %lx size %d\n",
-			device->snapshot, __pa(device->snapshot),
-			device->snapshot_size);
+	KGSL_DRV_ERR(device, "snapshot created at va %p pa %lx size %d "
+			"in %lld us\n", device->snapshot,
+			__pa(device->snapshot), device->snapshot_size,
+			device->snapshot_gen_us);
 	if (hang)
 		sysfs_notify(&device->snapshot_kobj, NULL, "timestamp");
 	return 0;
@@ -567,7 +914,7 @@ static ssize_t snapshot_show(struct file *filep, struct kobject *kobj,
 
 	list_for_each_entry(obj, &device->snapshot_obj_list, node) {
 
-		int objsize = GPU_OBJ_SECTION_SIZE(obj);
+		int objsize = kgsl_snapshot_obj_size(device, obj);
 		int offset;
 
 		/* If the offset is beyond this object, then move on */
@@ -580,7 +927,7 @@ static ssize_t snapshot_show(struct file *filep, struct kobject *kobj,
 		/* Adjust the offset to be relative to the object */
 		offset = (off >= src) ? (off - src) : 0;
 
-		size = kgsl_snapshot_dump_object(device, obj, buf + dst,
+		size = kgsl_snapshot_dump_any_object(device, obj, buf + dst,
 			offset, count);
 
 		count -= size;
@@ -659,8 +1006,93 @@ struct kgsl_snapshot_attribute attr_##_name = { \
 	.store = _store, \
 }
 
+/* Show how long the last snapshot took to generate and how big it is */
+static ssize_t timing_show(struct kgsl_device *device, char *buf)
+{
+	struct kgsl_snapshot_object *obj;
+	int objcount = 0, objsize = 0;
+	s64 lzo_us = 0;
+
+	mutex_lock(&device->mutex);
+
+	list_for_each_entry(obj, &device->snapshot_obj_list, node) {
+		objcount++;
+		objsize += obj->size;
+	}
+
+#ifdef CONFIG_MSM_KGSL_SNAPSHOT_COMPRESS
+	lzo_us = device->snapshot_lzo_us;
+#endif
+
+	mutex_unlock(&device->mutex);
+
+	return snprintf(buf, PAGE_SIZE,
+		"generate_us: %lld\ncompress_us: %lld\nraw_size: %d\n"
+		"dump_size: %d\nobjects: %d\nobject_size: %d\n",
+		device->snapshot_gen_us, lzo_us, device->snapshot_raw_size,
+		device->snapshot_size, objcount, objsize);
+}
+
+/* Only freeze the buffers referenced by the hung IB chain */
+static ssize_t hung_ib_only_show(struct kgsl_device *device, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%d\n",
+		device->snapshot_hung_ib_only);
+}
+
+static ssize_t hung_ib_only_store(struct kgsl_device *device,
+	const char *buf, size_t count)
+{
+	unsigned long val;
+	int ret;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&device->mutex);
+	device->snapshot_hung_ib_only = val ? 1 : 0;
+	mutex_unlock(&device->mutex);
+
+	return count;
+}
+
+#ifdef CONFIG_MSM_KGSL_SNAPSHOT_COMPRESS
+/* Enable or disable compression of the snapshot sections */
+static ssize_t compress_show(struct kgsl_device *device, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%d\n", device->snapshot_compress);
+}
+
+static ssize_t compress_store(struct kgsl_device *device,
+	const char *buf, size_t count)
+{
+	unsigned long val;
+	int ret;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	/* Can't compress if the buffers couldn't be allocated */
+	if (val && device->snapshot_lzo == NULL)
+		return -ENOMEM;
+
+	mutex_lock(&device->mutex);
+	device->snapshot_compress = val ? 1 : 0;
+	mutex_unlock(&device->mutex);
+
+	return count;
+}
+#endif
+
 SNAPSHOT_ATTR(trigger, 0600, NULL, trigger_store);
 SNAPSHOT_ATTR(timestamp, 0444, timestamp_show, NULL);
+SNAPSHOT_ATTR(timing, 0444, timing_show, NULL);
+SNAPSHOT_ATTR(hung_ib_only, 0644, hung_ib_only_show, hung_ib_only_store);
+#ifdef CONFIG_MSM_KGSL_SNAPSHOT_COMPRESS
+SNAPSHOT_ATTR(compress, 0644, compress_show, compress_store);
+#endif
 
 static void snapshot_sysfs_release(struct kobject *kobj)
 {
@@ -726,6 +1158,12 @@ int kgsl_device_snapshot_init(struct kgsl_device *device)
 
 	device->snapshot_maxsize = KGSL_SNAPSHOT_MEMSIZE;
 	device->snapshot_timestamp = 0;
+	device->snapshot_hung_ib_only = 0;
+
+	/* Compression is optional - carry on with raw dumps if this fails */
+	if (kgsl_snapshot_lzo_init(device))
+		KGSL_DRV_ERR(device,
+			"snapshot: Unable to allocate compression memory\n");
 
 	INIT_LIST_HEAD(&device->snapshot_obj_list);
 
@@ -743,6 +1181,22 @@ int kgsl_device_snapshot_init(struct kgsl_device *device)
 		goto done;
 
 	ret  = sysfs_create_file(&device->snapshot_kobj, &attr_timestamp.attr);
+	if (ret)
+		goto done;
+
+	ret  = sysfs_create_file(&device->snapshot_kobj, &attr_timing.attr);
+	if (ret)
+		goto done;
+
+	ret  = sysfs_create_file(&device->snapshot_kobj,
+		&attr_hung_ib_only.attr);
+
+#ifdef CONFIG_MSM_KGSL_SNAPSHOT_COMPRESS
+	if (ret)
+		goto done;
+
+	ret  = sysfs_create_file(&device->snapshot_kobj, &attr_compress.attr);
+#endif
 
 done:
 	return ret;
@@ -761,9 +1215,16 @@ void kgsl_device_snapshot_close(struct kgsl_device *device)
 	sysfs_remove_bin_file(&device->snapshot_kobj, &snapshot_attr);
 	sysfs_remove_file(&device->snapshot_kobj, &attr_trigger.attr);
 	sysfs_remove_file(&device->snapshot_kobj, &attr_timestamp.attr);
+	sysfs_remove_file(&device->snapshot_kobj, &attr_timing.attr);
+	sysfs_remove_file(&device->snapshot_kobj, &attr_hung_ib_only.attr);
+#ifdef CONFIG_MSM_KGSL_SNAPSHOT_COMPRESS
+	sysfs_remove_file(&device->snapshot_kobj, &attr_compress.attr);
+#endif
 
 	kobject_put(&device->snapshot_kobj);
 
+	kgsl_snapshot_lzo_close(device);
+
 	kfree(device->snapshot);
 
 	device->snapshot = NULL;
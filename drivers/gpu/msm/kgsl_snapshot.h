@@ -49,6 +49,7 @@ struct kgsl_snapshot_section_header {
 #define KGSL_SNAPSHOT_SECTION_DEBUG        0x0901
 #define KGSL_SNAPSHOT_SECTION_DEBUGBUS     0x0A01
 #define KGSL_SNAPSHOT_SECTION_GPU_OBJECT   0x0B01
+#define KGSL_SNAPSHOT_SECTION_LZO          0x0C01
 
 #define KGSL_SNAPSHOT_SECTION_END          0xFFFF
 
@@ -162,6 +163,18 @@ struct kgsl_snapshot_gpu_object {
 	int size;    /* Size of the object (in dwords) */
 };
 
+/*
+ * LZO sub-section header.  When snapshot compression is enabled the sections
+ * and the GPU objects are cut into chunks, each run through the LZO1X
+ * compressor and wrapped in a KGSL_SNAPSHOT_SECTION_LZO section.  Unpacking
+ * consecutive LZO sections in order yields the original sections, headers
+ * included.  A chunk that didn't shrink is stored as is: its data is then
+ * exactly size bytes long.
+ */
+struct kgsl_snapshot_lzo {
+	__u32 size;	/* Size of the uncompressed section in bytes */
+} __packed;
+
 #ifdef __KERNEL__
 
 /* Allocate 512K for each device snapshot */
@@ -178,6 +191,15 @@ struct kgsl_device;
 	KGSL_DRV_ERR((_d), \
 	"snapshot: not enough snapshot memory for section %s\n", (_s))
 
+#ifdef CONFIG_MSM_KGSL_SNAPSHOT_COMPRESS
+void kgsl_snapshot_section_done(struct kgsl_device *device, void *section);
+#else
+static inline void kgsl_snapshot_section_done(struct kgsl_device *device,
+	void *section)
+{
+}
+#endif
+
 /*
  * kgsl_snapshot_add_section - Add a new section to the GPU snapshot
  * @device - the KGSL device being snapshotted
@@ -227,6 +249,9 @@ static inline void *kgsl_snapshot_add_section(struct kgsl_device *device,
 	header->id = id;
 	header->size = ret + sizeof(*header);
 
+	/* Feed the finished section to the compressor (if enabled) */
+	kgsl_snapshot_section_done(device, header);
+
 	/* Decrement the room left in the snapshot region */
 	*remain -= header->size;
 	/* Advance the pointer to the end of the next function */
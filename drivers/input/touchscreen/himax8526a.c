@@ -1563,6 +1563,8 @@ static int himax8526a_probe(struct i2c_client *client, const struct i2c_device_i
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
 	ts->early_suspend.level = EARLY_SUSPEND_LEVEL_STOP_DRAWING + 1;
+	/* Touch power sequencing does not depend on the panel */
+	ts->early_suspend.flags = EARLY_SUSPEND_ASYNC;
 	ts->early_suspend.suspend = himax_ts_early_suspend;
 	ts->early_suspend.resume = himax_ts_late_resume;
 	register_early_suspend(&ts->early_suspend);
@@ -6085,7 +6085,7 @@ static void __exit msmsdcc_exit(void)
 #endif
 }
 
-module_init(msmsdcc_init);
+device_initcall_async(msmsdcc_init);
 module_exit(msmsdcc_exit);
 
 MODULE_DESCRIPTION("Qualcomm Multimedia Card Interface driver");
@@ -30,6 +30,7 @@
 #include <linux/wakelock.h>
 #include <linux/platform_device.h>
 #include <linux/if_arp.h>
+#include <linux/hrtimer.h>
 #include <linux/msm_rmnet.h>
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
@@ -77,6 +78,22 @@ static const char *ch_name[RMNET_DEVICE_COUNT] = {
 
 #define HEADROOM_FOR_QOS    8
 
+#define RMNET_NAPI_WEIGHT	64
+
+/*
+ * Receive headroom: enough to align the IP header in Ethernet mode, and in
+ * IP mode to put a zeroed pseudo link header in front of it.  GRO compares
+ * link headers before anything else; without one it would compare the
+ * first bytes of unrelated IP headers and never merge.
+ */
+#define RMNET_RX_HEADROOM(mode) \
+	(RMNET_IS_MODE_IP(mode) ? ALIGN(ETH_HLEN, 4) : NET_IP_ALIGN)
+
+/* Aggregated frames stay well within the 8k fifo of the DATA channels */
+#define RMNET_AGGR_MAX_PACKETS	32
+#define RMNET_AGGR_MAX_BYTES	4096
+#define RMNET_AGGR_HIST		6	/* 1, 2, <=4, ... <=32 per frame */
+
 static struct completion *port_complete[RMNET_DEVICE_COUNT];
 
 struct rmnet_private
@@ -94,6 +111,26 @@ struct rmnet_private
 	struct sk_buff *skb;
 	spinlock_t lock;
 	struct tasklet_struct tsklt;
+	struct napi_struct napi;
+	int loopback;			/* On the local loopback channel */
+	u32 rx_len;			/* Loopback: length of next packet */
+#ifdef CONFIG_MSM_RMNET_DEBUG
+	unsigned long rx_polls;
+#endif
+
+	/* Transmit aggregation, under the tx lock */
+	struct sk_buff_head tx_aggr;
+	int tx_aggr_bytes;
+	int tx_aggr_blocked;		/* Room awaited, under p->lock */
+	struct hrtimer tx_aggr_timer;
+	struct RMNET_AGGR_HDR_S tx_aggr_hdr[RMNET_AGGR_MAX_PACKETS];
+	struct QMI_QOS_HDR_S tx_aggr_qos[RMNET_AGGR_MAX_PACKETS];
+	struct kvec tx_aggr_iov[1 + 3 * RMNET_AGGR_MAX_PACKETS];
+	unsigned long tx_aggr_frames;
+	unsigned long tx_aggr_timeouts;
+	unsigned long tx_aggr_hist[RMNET_AGGR_HIST];
+	unsigned long rx_aggr_frames;
+
 	u32 operation_mode;    /* IOCTL specified mode (protocol, QoS header) */
 	struct platform_driver pdrv;
 	struct completion complete;
@@ -105,6 +142,29 @@ static uint msm_rmnet_modem_wait;
 module_param_named(modem_wait, msm_rmnet_modem_wait,
 		   uint, S_IRUGO | S_IWUSR | S_IWGRP);
 
+/*
+ * Stand-in for the modem: rmnet0 runs over the local SMD loopback channel,
+ * so whatever is sent on it comes straight back through the receive path.
+ * That channel is a stream, each packet goes with a u32 length in front.
+ */
+static uint msm_rmnet_loopback;
+module_param_named(loopback, msm_rmnet_loopback, uint, S_IRUGO);
+
+/*
+ * Aggregation mode (RMNET_IOCTL_SET_AGGR_ENABLE) sends up to this many
+ * packets or bytes in one SMD packet, or whatever is queued after
+ * aggr_flush_us.  The modem must have been set up for the same framing.
+ */
+static uint msm_rmnet_aggr_packets = 16;
+module_param_named(aggr_max_packets, msm_rmnet_aggr_packets,
+		   uint, S_IRUGO | S_IWUSR | S_IWGRP);
+static uint msm_rmnet_aggr_bytes = RMNET_AGGR_MAX_BYTES;
+module_param_named(aggr_max_bytes, msm_rmnet_aggr_bytes,
+		   uint, S_IRUGO | S_IWUSR | S_IWGRP);
+static uint msm_rmnet_aggr_flush_us = 1000;
+module_param_named(aggr_flush_us, msm_rmnet_aggr_flush_us,
+		   uint, S_IRUGO | S_IWUSR | S_IWGRP);
+
 /* Forward declaration */
 static int rmnet_ioctl(struct net_device *dev, struct ifreq *ifr, int cmd);
 
@@ -209,6 +269,15 @@ static ssize_t wakeups_rcv_show(struct device *d, struct device_attribute *attr,
 
 DEVICE_ATTR(wakeups_rcv, 0444, wakeups_rcv_show, NULL);
 
+static ssize_t rx_polls_show(struct device *d, struct device_attribute *attr,
+		char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	return sprintf(buf, "%lu\n", p->rx_polls);
+}
+
+DEVICE_ATTR(rx_polls, 0444, rx_polls_show, NULL);
+
 /* Set timeout in us. */
 static ssize_t timeout_store(struct device *d, struct device_attribute *attr,
 		const char *buf, size_t n)
@@ -234,6 +303,29 @@ static ssize_t timeout_show(struct device *d, struct device_attribute *attr,
 DEVICE_ATTR(timeout, 0664, timeout_show, timeout_store);
 #endif
 
+static ssize_t aggr_stats_show(struct device *d,
+			       struct device_attribute *attr, char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	ssize_t i = 0;
+	int n;
+
+	i += scnprintf(buf + i, PAGE_SIZE - i, "tx_frames %lu\n",
+		       p->tx_aggr_frames);
+	i += scnprintf(buf + i, PAGE_SIZE - i, "tx_timer_flushes %lu\n",
+		       p->tx_aggr_timeouts);
+	i += scnprintf(buf + i, PAGE_SIZE - i, "tx_per_frame");
+	for (n = 0; n < RMNET_AGGR_HIST; n++)
+		i += scnprintf(buf + i, PAGE_SIZE - i, " %d:%lu",
+			       1 << n, p->tx_aggr_hist[n]);
+	i += scnprintf(buf + i, PAGE_SIZE - i, "\nrx_frames %lu\n",
+		       p->rx_aggr_frames);
+
+	return i;
+}
+
+static DEVICE_ATTR(aggr_stats, 0444, aggr_stats_show, NULL);
+
 static __be16 rmnet_ip_type_trans(struct sk_buff *skb, struct net_device *dev)
 {
 	__be16 protocol = 0;
@@ -256,80 +348,176 @@ static __be16 rmnet_ip_type_trans(struct sk_buff *skb, struct net_device *dev)
 	return protocol;
 }
 
-static void smd_net_data_handler(unsigned long arg);
-static DECLARE_TASKLET(smd_net_data_tasklet, smd_net_data_handler, 0);
+/* A whole packet is waiting in the channel */
+static int rmnet_rx_ready(struct rmnet_private *p)
+{
+	int sz;
+
+	if (p->loopback)
+		sz = p->rx_len ? p->rx_len : sizeof(p->rx_len);
+	else
+		sz = smd_cur_packet_size(p->ch);
+
+	return sz && smd_read_avail(p->ch) >= sz;
+}
 
-/* Called in soft-irq context */
-static void smd_net_data_handler(unsigned long arg)
+/* smd_read() keeping count of the loopback frame */
+static int rmnet_rx_read(struct rmnet_private *p, void *data, int len)
+{
+	int r = smd_read(p->ch, data, len);
+
+	if (p->loopback && r > 0)
+		p->rx_len -= r;
+	return r;
+}
+
+/*
+ * Take the header of the next packet of an aggregated frame of @frame
+ * bytes, return the length of that packet or -1 if the frame is bad.
+ */
+static int rmnet_rx_aggr_hdr(struct rmnet_private *p, int frame)
+{
+	struct RMNET_AGGR_HDR_S hdr;
+	int len = -1;
+
+	if (frame >= (int)sizeof(hdr) &&
+	    rmnet_rx_read(p, &hdr, sizeof(hdr)) == sizeof(hdr)) {
+		len = le16_to_cpu(hdr.len);
+		frame -= sizeof(hdr);
+		if (len == 0 || len > frame)
+			len = -1;
+	}
+
+	if (len < 0) {
+		/* Framing is lost, drop the rest of the frame */
+		rmnet_rx_read(p, NULL, frame);
+		p->stats.rx_errors++;
+		p->stats.rx_frame_errors++;
+	}
+
+	return len;
+}
+
+static struct sk_buff *rmnet_alloc_rx_skb(struct net_device *dev,
+					  int sz, u32 opmode)
 {
-	struct net_device *dev = (struct net_device *) arg;
-	struct rmnet_private *p = netdev_priv(dev);
 	struct sk_buff *skb;
-	void *ptr = 0;
-	int sz;
-	u32 opmode = p->operation_mode;
+	int headroom = RMNET_RX_HEADROOM(opmode);
+
+	skb = netdev_alloc_skb(dev, headroom + sz);
+	if (skb)
+		skb_reserve(skb, headroom);
+
+	return skb;
+}
+
+static void rmnet_rx_skb(struct net_device *dev, struct rmnet_private *p,
+			 struct sk_buff *skb, u32 opmode)
+{
+	void *ptr = skb->data;
+
+	if (RMNET_IS_MODE_IP(opmode)) {
+		/* Driver in IP mode */
+		skb_set_mac_header(skb, -ETH_HLEN);
+		memset(skb_mac_header(skb), 0, ETH_HLEN);
+		skb->protocol = rmnet_ip_type_trans(skb, dev);
+	} else {
+		/* Driver in Ethernet mode */
+		skb->protocol = eth_type_trans(skb, dev);
+	}
+	if (RMNET_IS_MODE_IP(opmode) || count_this_packet(ptr, skb->len)) {
+#ifdef CONFIG_MSM_RMNET_DEBUG
+		p->wakeups_rcv += rmnet_cause_wakeup(p);
+#endif
+		p->stats.rx_packets++;
+		p->stats.rx_bytes += skb->len;
+	}
+	DBG1("[%s] Rx packet #%lu len=%d\n",
+		dev->name, p->stats.rx_packets, skb->len);
+
+	/* Deliver to network stack */
+	napi_gro_receive(&p->napi, skb);
+}
+
+static int rmnet_poll(struct napi_struct *napi, int budget)
+{
+	struct rmnet_private *p = container_of(napi, struct rmnet_private,
+					       napi);
+	struct net_device *dev = napi->dev;
+	struct sk_buff *skb;
 	unsigned long flags;
+	u32 opmode;
+	int work = 0;
+	int frame;
+	int sz;
 
-	for (;;) {
-		sz = smd_cur_packet_size(p->ch);
-		if (sz == 0) break;
-		if (smd_read_avail(p->ch) < sz) break;
+	if (!p->ch) {
+		napi_complete(napi);
+		return 0;
+	}
+
+	/* Only changed by ioctl, once per batch is enough */
+	spin_lock_irqsave(&p->lock, flags);
+	opmode = p->operation_mode;
+	spin_unlock_irqrestore(&p->lock, flags);
+
+	while (work < budget && rmnet_rx_ready(p)) {
+		if (p->loopback && !p->rx_len) {
+			smd_read(p->ch, &p->rx_len, sizeof(p->rx_len));
+			continue;
+		}
+		frame = p->loopback ? p->rx_len : smd_cur_packet_size(p->ch);
+
+		sz = frame;
+		if (RMNET_IS_MODE_AGGR(opmode)) {
+			sz = rmnet_rx_aggr_hdr(p, frame);
+			if (sz < 0)
+				continue;
+			frame -= sizeof(struct RMNET_AGGR_HDR_S);
+			if (frame == sz)
+				p->rx_aggr_frames++;
+		}
 
-		skb = dev_alloc_skb(sz + NET_IP_ALIGN);
+		skb = rmnet_alloc_rx_skb(dev, sz, opmode);
 		if (skb == NULL) {
 			pr_err("[%s] rmnet_recv() cannot allocate skb\n",
 			       dev->name);
-			/* out of memory, reschedule a later attempt */
-			smd_net_data_tasklet.data = (unsigned long)dev;
-			tasklet_schedule(&smd_net_data_tasklet);
-			break;
-		} else {
-			skb->dev = dev;
-			skb_reserve(skb, NET_IP_ALIGN);
-			ptr = skb_put(skb, sz);
-			wake_lock_timeout(&p->wake_lock, HZ / 2);
-			if (smd_read(p->ch, ptr, sz) != sz) {
-				pr_err("[%s] rmnet_recv() smd lied about avail?!",
-					dev->name);
-				ptr = 0;
-				dev_kfree_skb_irq(skb);
-			} else {
-				/* Handle Rx frame format */
-				spin_lock_irqsave(&p->lock, flags);
-				opmode = p->operation_mode;
-				spin_unlock_irqrestore(&p->lock, flags);
-
-				if (RMNET_IS_MODE_IP(opmode)) {
-					/* Driver in IP mode */
-					skb->protocol =
-					  rmnet_ip_type_trans(skb, dev);
-				} else {
-					/* Driver in Ethernet mode */
-					skb->protocol =
-					  eth_type_trans(skb, dev);
-				}
-				if (RMNET_IS_MODE_IP(opmode) ||
-				    count_this_packet(ptr, skb->len)) {
-#ifdef CONFIG_MSM_RMNET_DEBUG
-					p->wakeups_rcv +=
-					rmnet_cause_wakeup(p);
-#endif
-					p->stats.rx_packets++;
-					p->stats.rx_bytes += skb->len;
-				}
-				DBG1("[%s] Rx packet #%lu len=%d\n",
-					dev->name, p->stats.rx_packets,
-					skb->len);
-
-				/* Deliver to network stack */
-				netif_rx(skb);
+			if (RMNET_IS_MODE_AGGR(opmode)) {
+				/* its header is gone, can't come back to it */
+				rmnet_rx_read(p, NULL, sz);
+				p->stats.rx_dropped++;
+				continue;
 			}
-			continue;
+			/* out of memory, stay scheduled for a later attempt */
+			work = budget;
+			break;
 		}
-		if (smd_read(p->ch, ptr, sz) != sz)
+
+		if (rmnet_rx_read(p, skb_put(skb, sz), sz) != sz) {
 			pr_err("[%s] rmnet_recv() smd lied about avail?!",
 				dev->name);
+			dev_kfree_skb(skb);
+			continue;
+		}
+
+		rmnet_rx_skb(dev, p, skb, opmode);
+		work++;
+	}
+
+	if (work)
+		wake_lock_timeout(&p->wake_lock, HZ / 2);
+#ifdef CONFIG_MSM_RMNET_DEBUG
+	p->rx_polls++;
+#endif
+
+	if (work < budget) {
+		napi_complete(napi);
+		/* A packet completed since the last check saw us scheduled */
+		if (rmnet_rx_ready(p))
+			napi_schedule(napi);
 	}
+
+	return work;
 }
 
 static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
@@ -337,7 +525,11 @@ static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 	struct rmnet_private *p = netdev_priv(dev);
 	smd_channel_t *ch = p->ch;
 	int smd_ret;
-	struct QMI_QOS_HDR_S *qmih;
+	struct QMI_QOS_HDR_S qmih;
+	struct kvec iov[3];
+	int iovcnt = 0;
+	u32 frame_len;
+	int len = 0;
 	u32 opmode;
 	unsigned long flags;
 
@@ -346,17 +538,30 @@ static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 	opmode = p->operation_mode;
 	spin_unlock_irqrestore(&p->lock, flags);
 
+	if (p->loopback) {
+		iov[iovcnt].iov_base = &frame_len;
+		iov[iovcnt++].iov_len = sizeof(frame_len);
+	}
+
 	if (RMNET_IS_MODE_QOS(opmode)) {
-		qmih = (struct QMI_QOS_HDR_S *)
-			skb_push(skb, sizeof(struct QMI_QOS_HDR_S));
-		qmih->version = 1;
-		qmih->flags = 0;
-		qmih->flow_id = skb->mark;
+		qmih.version = 1;
+		qmih.flags = 0;
+		qmih.flow_id = skb->mark;
+		iov[iovcnt].iov_base = &qmih;
+		iov[iovcnt++].iov_len = sizeof(qmih);
+		len += sizeof(qmih);
 	}
+	iov[iovcnt].iov_base = skb->data;
+	iov[iovcnt++].iov_len = skb->len;
+	len += skb->len;
+
+	frame_len = len;
+	if (p->loopback)
+		len += sizeof(frame_len);
 
 	dev->trans_start = jiffies;
-	smd_ret = smd_write(ch, skb->data, skb->len);
-	if (smd_ret != skb->len) {
+	smd_ret = smd_writev(ch, iov, iovcnt);
+	if (smd_ret != len) {
 		pr_err("[%s] %s: smd_write returned error %d",
 			dev->name, __func__, smd_ret);
 		p->stats.tx_errors++;
@@ -366,13 +571,13 @@ static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 	if (RMNET_IS_MODE_IP(opmode) ||
 	    count_this_packet(skb->data, skb->len)) {
 		p->stats.tx_packets++;
-		p->stats.tx_bytes += skb->len;
+		p->stats.tx_bytes += frame_len;
 #ifdef CONFIG_MSM_RMNET_DEBUG
 		p->wakeups_xmit += rmnet_cause_wakeup(p);
 #endif
 	}
 	DBG1("[%s] Tx packet #%lu len=%d mark=0x%x\n",
-	    dev->name, p->stats.tx_packets, skb->len, skb->mark);
+	    dev->name, p->stats.tx_packets, frame_len, skb->mark);
 
 xmit_out:
 	/* data xmited, safe to release skb */
@@ -380,6 +585,165 @@ xmit_out:
 	return 0;
 }
 
+/*
+ * Send the packets queued for aggregation as one SMD packet, with the tx
+ * lock held.  Returns -EAGAIN, with the queue stopped, if the channel has
+ * no room for them yet, else the number of packets sent.
+ */
+static int rmnet_aggr_flush(struct net_device *dev, struct rmnet_private *p)
+{
+	struct kvec *iov = p->tx_aggr_iov;
+	struct RMNET_AGGR_HDR_S *hdr;
+	struct QMI_QOS_HDR_S *qmih;
+	struct sk_buff *skb;
+	unsigned long flags;
+	u32 frame_len = p->tx_aggr_bytes;
+	u32 opmode;
+	int len = frame_len;
+	int bytes = 0;
+	int iovcnt = 0;
+	int n = 0;
+	int smd_ret;
+
+	if (skb_queue_empty(&p->tx_aggr) || !p->ch)
+		return 0;
+
+	if (p->loopback)
+		len += sizeof(frame_len);
+
+	spin_lock_irqsave(&p->lock, flags);
+	opmode = p->operation_mode;
+	smd_enable_read_intr(p->ch);
+	if (smd_write_avail(p->ch) < len) {
+		p->tx_aggr_blocked = len;
+		spin_unlock_irqrestore(&p->lock, flags);
+		netif_stop_queue(dev);
+		return -EAGAIN;
+	}
+	p->tx_aggr_blocked = 0;
+	smd_disable_read_intr(p->ch);
+	spin_unlock_irqrestore(&p->lock, flags);
+
+	if (p->loopback) {
+		iov[iovcnt].iov_base = &frame_len;
+		iov[iovcnt++].iov_len = sizeof(frame_len);
+	}
+
+	skb_queue_walk(&p->tx_aggr, skb) {
+		hdr = &p->tx_aggr_hdr[n];
+		hdr->len = cpu_to_le16(skb->len);
+		hdr->reserved = 0;
+		iov[iovcnt].iov_base = hdr;
+		iov[iovcnt++].iov_len = sizeof(*hdr);
+
+		if (RMNET_IS_MODE_QOS(opmode)) {
+			qmih = &p->tx_aggr_qos[n];
+			qmih->version = 1;
+			qmih->flags = 0;
+			qmih->flow_id = skb->mark;
+			hdr->len = cpu_to_le16(skb->len + sizeof(*qmih));
+			iov[iovcnt].iov_base = qmih;
+			iov[iovcnt++].iov_len = sizeof(*qmih);
+		}
+
+		iov[iovcnt].iov_base = skb->data;
+		iov[iovcnt++].iov_len = skb->len;
+		bytes += skb->len;
+		n++;
+	}
+
+	dev->trans_start = jiffies;
+	smd_ret = smd_writev(p->ch, iov, iovcnt);
+	if (smd_ret != len) {
+		pr_err("[%s] %s: smd_write returned error %d",
+			dev->name, __func__, smd_ret);
+		p->stats.tx_errors += n;
+	} else {
+		p->stats.tx_packets += n;
+		p->stats.tx_bytes += bytes;
+		p->tx_aggr_frames++;
+		p->tx_aggr_hist[fls(n - 1)]++;
+#ifdef CONFIG_MSM_RMNET_DEBUG
+		p->wakeups_xmit += rmnet_cause_wakeup(p);
+#endif
+	}
+	DBG1("[%s] Tx frame #%lu packets=%d len=%d\n",
+	    dev->name, p->tx_aggr_frames, n, len);
+
+	while ((skb = __skb_dequeue(&p->tx_aggr)))
+		dev_kfree_skb_irq(skb);
+	p->tx_aggr_bytes = 0;
+
+	return n;
+}
+
+/* Room @skb takes in an aggregated frame */
+static int rmnet_aggr_size(struct rmnet_private *p, struct sk_buff *skb)
+{
+	int len = sizeof(struct RMNET_AGGR_HDR_S) + skb->len;
+
+	if (RMNET_IS_MODE_QOS(p->operation_mode))
+		len += sizeof(struct QMI_QOS_HDR_S);
+
+	return len;
+}
+
+/*
+ * Queue @skb for the next aggregated frame, with the tx lock held.  A frame
+ * held back by flow control may go one packet over aggr_max_bytes.
+ */
+static int rmnet_aggr_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+	struct rmnet_private *p = netdev_priv(dev);
+	int max_packets = min_t(uint, msm_rmnet_aggr_packets,
+				RMNET_AGGR_MAX_PACKETS);
+	int max_bytes = min_t(uint, msm_rmnet_aggr_bytes,
+			      RMNET_AGGR_MAX_BYTES);
+	int len = rmnet_aggr_size(p, skb);
+
+	if (p->tx_aggr_bytes + len > max_bytes)
+		rmnet_aggr_flush(dev, p);
+
+	__skb_queue_tail(&p->tx_aggr, skb);
+	p->tx_aggr_bytes += len;
+
+	if (skb_queue_len(&p->tx_aggr) >= max_packets ||
+	    p->tx_aggr_bytes >= max_bytes) {
+		hrtimer_try_to_cancel(&p->tx_aggr_timer);
+		rmnet_aggr_flush(dev, p);
+	} else if (!hrtimer_active(&p->tx_aggr_timer)) {
+		hrtimer_start(&p->tx_aggr_timer,
+			ns_to_ktime(msm_rmnet_aggr_flush_us * NSEC_PER_USEC),
+			HRTIMER_MODE_REL);
+	}
+
+	return 0;
+}
+
+static enum hrtimer_restart rmnet_aggr_timer(struct hrtimer *timer)
+{
+	struct rmnet_private *p = container_of(timer, struct rmnet_private,
+					       tx_aggr_timer);
+
+	/* Flush from the tx tasklet, under the tx lock */
+	p->tx_aggr_timeouts++;
+	tasklet_hi_schedule(&p->tsklt);
+	return HRTIMER_NORESTART;
+}
+
+/* Room needed in the channel to send @skb, with p->lock held */
+static int rmnet_tx_size(struct rmnet_private *p, struct sk_buff *skb)
+{
+	int len = skb->len;
+
+	if (RMNET_IS_MODE_QOS(p->operation_mode))
+		len += sizeof(struct QMI_QOS_HDR_S);
+	if (p->loopback)
+		len += sizeof(u32);
+
+	return len;
+}
+
 static void _rmnet_resume_flow(unsigned long param)
 {
 	struct net_device *dev = (struct net_device *)param;
@@ -390,7 +754,7 @@ static void _rmnet_resume_flow(unsigned long param)
 	/* xmit and enable the flow only once even if
 	   multiple tasklets were scheduled by smd_net_notify */
 	spin_lock_irqsave(&p->lock, flags);
-	if (p->skb && (smd_write_avail(p->ch) >= p->skb->len)) {
+	if (p->skb && (smd_write_avail(p->ch) >= rmnet_tx_size(p, p->skb))) {
 		skb = p->skb;
 		p->skb = NULL;
 		spin_unlock_irqrestore(&p->lock, flags);
@@ -398,6 +762,12 @@ static void _rmnet_resume_flow(unsigned long param)
 		netif_wake_queue(dev);
 	} else
 		spin_unlock_irqrestore(&p->lock, flags);
+
+	/* Flush timer expired, or room for a held back frame */
+	netif_tx_lock(dev);
+	if (rmnet_aggr_flush(dev, p) > 0)
+		netif_wake_queue(dev);
+	netif_tx_unlock(dev);
 }
 
 static void msm_rmnet_unload_modem(void *pil)
@@ -440,18 +810,21 @@ static void smd_net_notify(void *_dev, unsigned event)
 	switch (event) {
 	case SMD_EVENT_DATA:
 		spin_lock(&p->lock);
-		if (p->skb && (smd_write_avail(p->ch) >= p->skb->len)) {
+		if (p->skb &&
+		    (smd_write_avail(p->ch) >= rmnet_tx_size(p, p->skb))) {
+			smd_disable_read_intr(p->ch);
+			tasklet_hi_schedule(&p->tsklt);
+		}
+		if (p->tx_aggr_blocked &&
+		    smd_write_avail(p->ch) >= p->tx_aggr_blocked) {
 			smd_disable_read_intr(p->ch);
 			tasklet_hi_schedule(&p->tsklt);
 		}
 
 		spin_unlock(&p->lock);
 
-		if (smd_read_avail(p->ch) &&
-			(smd_read_avail(p->ch) >= smd_cur_packet_size(p->ch))) {
-			smd_net_data_tasklet.data = (unsigned long) _dev;
-			tasklet_schedule(&smd_net_data_tasklet);
-		}
+		if (rmnet_rx_ready(p))
+			napi_schedule(&p->napi);
 		break;
 
 	case SMD_EVENT_OPEN:
@@ -477,7 +850,7 @@ static int __rmnet_open(struct net_device *dev)
 	struct rmnet_private *p = netdev_priv(dev);
 
 	mutex_lock(&p->pil_lock);
-	if (!p->pil) {
+	if (!p->pil && !p->loopback) {
 		pil = msm_rmnet_load_modem(dev);
 		if (IS_ERR(pil)) {
 			mutex_unlock(&p->pil_lock);
@@ -488,7 +861,13 @@ static int __rmnet_open(struct net_device *dev)
 	mutex_unlock(&p->pil_lock);
 
 	if (!p->ch) {
-		r = smd_open(p->chname, &p->ch, dev, smd_net_notify);
+		p->rx_len = 0;
+		if (p->loopback)
+			r = smd_named_open_on_edge("local_loopback",
+						   SMD_LOOPBACK_TYPE, &p->ch,
+						   dev, smd_net_notify);
+		else
+			r = smd_open(p->chname, &p->ch, dev, smd_net_notify);
 
 		if (r < 0)
 			return -ENODEV;
@@ -516,13 +895,16 @@ static int __rmnet_close(struct net_device *dev)
 
 static int rmnet_open(struct net_device *dev)
 {
+	struct rmnet_private *p = netdev_priv(dev);
 	int rc = 0;
 
 	DBG0("[%s] rmnet_open()\n", dev->name);
 
 	rc = __rmnet_open(dev);
-	if (rc == 0)
+	if (rc == 0) {
+		napi_enable(&p->napi);
 		netif_start_queue(dev);
+	}
 
 	return rc;
 }
@@ -534,7 +916,12 @@ static int rmnet_stop(struct net_device *dev)
 	DBG0("[%s] rmnet_stop()\n", dev->name);
 
 	netif_stop_queue(dev);
+	hrtimer_cancel(&p->tx_aggr_timer);
 	tasklet_kill(&p->tsklt);
+	napi_disable(&p->napi);
+	skb_queue_purge(&p->tx_aggr);
+	p->tx_aggr_bytes = 0;
+	p->tx_aggr_blocked = 0;
 
 	/* TODO: unload modem safely,
 	   currently, this causes unnecessary unloads */
@@ -572,9 +959,12 @@ static int rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 		return 0;
 	}
 
+	if (RMNET_IS_MODE_AGGR(p->operation_mode))
+		return rmnet_aggr_xmit(skb, dev);
+
 	spin_lock_irqsave(&p->lock, flags);
 	smd_enable_read_intr(ch);
-	if (smd_write_avail(ch) < skb->len) {
+	if (smd_write_avail(ch) < rmnet_tx_size(p, skb)) {
 		netif_stop_queue(dev);
 		p->skb = skb;
 		spin_unlock_irqrestore(&p->lock, flags);
@@ -708,6 +1098,42 @@ static int rmnet_ioctl(struct net_device *dev, struct ifreq *ifr, int cmd)
 			(void *)(p->operation_mode & RMNET_MODE_QOS);
 		break;
 
+	case RMNET_IOCTL_SET_AGGR_ENABLE:   /* Set aggregation enabled */
+		spin_lock_irqsave(&p->lock, flags);
+		p->operation_mode |= RMNET_MODE_AGGR;
+		spin_unlock_irqrestore(&p->lock, flags);
+		DBG0("[%s] rmnet_ioctl(): set aggregation enable\n",
+			dev->name);
+		break;
+
+	case RMNET_IOCTL_SET_AGGR_DISABLE:  /* Set aggregation disabled */
+		/*
+		 * Send what was queued under the old framing first.  What
+		 * the channel has no room for cannot go out as plain
+		 * packets later, so drop it.
+		 */
+		netif_tx_lock_bh(dev);
+		hrtimer_cancel(&p->tx_aggr_timer);
+		if (rmnet_aggr_flush(dev, p) == -EAGAIN) {
+			p->stats.tx_dropped += skb_queue_len(&p->tx_aggr);
+			skb_queue_purge(&p->tx_aggr);
+			p->tx_aggr_bytes = 0;
+			netif_wake_queue(dev);
+		}
+		spin_lock_irqsave(&p->lock, flags);
+		p->tx_aggr_blocked = 0;
+		p->operation_mode &= ~RMNET_MODE_AGGR;
+		spin_unlock_irqrestore(&p->lock, flags);
+		netif_tx_unlock_bh(dev);
+		DBG0("[%s] rmnet_ioctl(): set aggregation disable\n",
+			dev->name);
+		break;
+
+	case RMNET_IOCTL_GET_AGGR:          /* Get aggregation state   */
+		ifr->ifr_ifru.ifru_data =
+			(void *)(p->operation_mode & RMNET_MODE_AGGR);
+		break;
+
 	case RMNET_IOCTL_GET_OPMODE:        /* Get operation mode      */
 		ifr->ifr_ifru.ifru_data = (void *)p->operation_mode;
 		break;
@@ -745,6 +1171,7 @@ static void __init rmnet_setup(struct net_device *dev)
 	/* set this after calling ether_setup */
 	dev->mtu = RMNET_DATA_LEN;
 	dev->needed_headroom = HEADROOM_FOR_QOS;
+	dev->features |= NETIF_F_GRO;
 
 	random_ether_addr(dev->dev_addr);
 
@@ -797,6 +1224,12 @@ static int __init rmnet_init(void)
 		spin_lock_init(&p->lock);
 		tasklet_init(&p->tsklt, _rmnet_resume_flow,
 				(unsigned long)dev);
+		netif_napi_add(dev, &p->napi, rmnet_poll, RMNET_NAPI_WEIGHT);
+		skb_queue_head_init(&p->tx_aggr);
+		hrtimer_init(&p->tx_aggr_timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_REL);
+		p->tx_aggr_timer.function = rmnet_aggr_timer;
+		p->loopback = msm_rmnet_loopback && n == 0;
 		wake_lock_init(&p->wake_lock, WAKE_LOCK_SUSPEND, ch_name[n]);
 #ifdef CONFIG_MSM_RMNET_DEBUG
 		p->timeout_us = timeout_us;
@@ -822,6 +1255,8 @@ static int __init rmnet_init(void)
 			return ret;
 		}
 
+		if (device_create_file(d, &dev_attr_aggr_stats))
+			continue;
 
 #ifdef CONFIG_MSM_RMNET_DEBUG
 		if (device_create_file(d, &dev_attr_timeout))
@@ -830,6 +1265,8 @@ static int __init rmnet_init(void)
 			continue;
 		if (device_create_file(d, &dev_attr_wakeups_rcv))
 			continue;
+		if (device_create_file(d, &dev_attr_rx_polls))
+			continue;
 #ifdef CONFIG_HAS_EARLYSUSPEND
 		if (device_create_file(d, &dev_attr_timeout_suspend))
 			continue;
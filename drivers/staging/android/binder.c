@@ -17,6 +17,7 @@
  */
 
 #include <asm/cacheflush.h>
+#include <linux/cpufreq.h>
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/fs.h>
@@ -1765,6 +1766,7 @@ static void binder_transaction(struct binder_proc *proc,
 		t->need_reply = 1;
 		t->from_parent = thread->transaction_stack;
 		thread->transaction_stack = t;
+		cpufreq_interactive_binder_boost(target_proc->tsk);
 	} else {
 		BUG_ON(target_node == NULL);
 		BUG_ON(t->buffer->async_transaction != 1);
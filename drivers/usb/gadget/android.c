@@ -853,11 +853,99 @@ static int adb_function_bind_config(struct android_usb_function *f, struct usb_c
 	return adb_bind_config(c);
 }
 
+/* queue depths take effect the next time the function is bound */
+static ssize_t adb_tx_reqs_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", _adb_dev->tx_reqs);
+}
+
+static ssize_t adb_tx_reqs_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	unsigned value;
+
+	if (sscanf(buf, "%u", &value) == 1 && value &&
+	    value <= ADB_TX_REQ_MAX) {
+		_adb_dev->tx_reqs = value;
+		return size;
+	}
+	return -EINVAL;
+}
+
+static struct device_attribute dev_attr_adb_tx_reqs =
+					__ATTR(tx_reqs, S_IRUGO | S_IWUSR,
+						adb_tx_reqs_show,
+						adb_tx_reqs_store);
+
+static ssize_t adb_rx_reqs_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", _adb_dev->rx_reqs);
+}
+
+static ssize_t adb_rx_reqs_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	unsigned value;
+
+	if (sscanf(buf, "%u", &value) == 1 && value &&
+	    value <= ADB_RX_REQ_MAX) {
+		_adb_dev->rx_reqs = value;
+		return size;
+	}
+	return -EINVAL;
+}
+
+static struct device_attribute dev_attr_adb_rx_reqs =
+					__ATTR(rx_reqs, S_IRUGO | S_IWUSR,
+						adb_rx_reqs_show,
+						adb_rx_reqs_store);
+
+static ssize_t adb_xfer_stats_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct adb_xfer_stats st;
+
+	spin_lock_irq(&_adb_dev->lock);
+	st = _adb_dev->stats;
+	spin_unlock_irq(&_adb_dev->lock);
+
+	return snprintf(buf, PAGE_SIZE,
+			"read: %lu calls %llu bytes %lu requests\n"
+			"write: %lu calls %llu bytes %lu requests %lu waits\n",
+			st.reads, st.read_bytes, st.rx_reqs,
+			st.writes, st.write_bytes, st.tx_reqs, st.tx_waits);
+}
+
+/* Any write clears the totals */
+static ssize_t adb_xfer_stats_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	spin_lock_irq(&_adb_dev->lock);
+	memset(&_adb_dev->stats, 0, sizeof(_adb_dev->stats));
+	spin_unlock_irq(&_adb_dev->lock);
+	return size;
+}
+
+static struct device_attribute dev_attr_adb_xfer_stats =
+					__ATTR(xfer_stats, S_IRUGO | S_IWUSR,
+						adb_xfer_stats_show,
+						adb_xfer_stats_store);
+
+static struct device_attribute *adb_function_attributes[] = {
+	&dev_attr_adb_tx_reqs,
+	&dev_attr_adb_rx_reqs,
+	&dev_attr_adb_xfer_stats,
+	NULL
+};
+
 static struct android_usb_function adb_function = {
 	.name		= "adb",
 	.init		= adb_function_init,
 	.cleanup	= adb_function_cleanup,
 	.bind_config	= adb_function_bind_config,
+	.attributes	= adb_function_attributes,
 };
 
 /* CCID */
@@ -923,12 +1011,101 @@ static int mtp_function_ctrlrequest(struct android_usb_function *f,
 	return mtp_ctrlrequest(cdev, c);
 }
 
+/* queue depths take effect the next time the function is bound */
+static ssize_t mtp_tx_reqs_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", _mtp_dev->tx_reqs);
+}
+
+static ssize_t mtp_tx_reqs_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	unsigned value;
+
+	if (sscanf(buf, "%u", &value) == 1 && value && value <= TX_REQ_MAX) {
+		_mtp_dev->tx_reqs = value;
+		return size;
+	}
+	return -EINVAL;
+}
+
+static DEVICE_ATTR(tx_reqs, S_IRUGO | S_IWUSR, mtp_tx_reqs_show,
+					       mtp_tx_reqs_store);
+
+static ssize_t mtp_rx_reqs_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", _mtp_dev->rx_reqs);
+}
+
+static ssize_t mtp_rx_reqs_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	unsigned value;
+
+	if (sscanf(buf, "%u", &value) == 1 && value && value <= RX_REQ_MAX) {
+		_mtp_dev->rx_reqs = value;
+		return size;
+	}
+	return -EINVAL;
+}
+
+static DEVICE_ATTR(rx_reqs, S_IRUGO | S_IWUSR, mtp_rx_reqs_show,
+					       mtp_rx_reqs_store);
+
+static int mtp_xfer_stats_print(char *buf, int size, const char *name,
+				struct mtp_xfer_stats *st)
+{
+	return scnprintf(buf, size, "%s: %u files %llu bytes %llu us %llu kB/s\n",
+			 name, st->files, st->bytes, st->time_us,
+			 div64_u64(st->bytes * 1000, st->time_us ?: 1));
+}
+
+static ssize_t mtp_xfer_stats_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct mtp_xfer_stats send, receive;
+	int i;
+
+	spin_lock_irq(&_mtp_dev->lock);
+	send = _mtp_dev->send_stats;
+	receive = _mtp_dev->receive_stats;
+	spin_unlock_irq(&_mtp_dev->lock);
+
+	i = mtp_xfer_stats_print(buf, PAGE_SIZE, "send", &send);
+	i += mtp_xfer_stats_print(buf + i, PAGE_SIZE - i, "receive", &receive);
+	return i;
+}
+
+/* Any write clears the totals */
+static ssize_t mtp_xfer_stats_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	spin_lock_irq(&_mtp_dev->lock);
+	memset(&_mtp_dev->send_stats, 0, sizeof(_mtp_dev->send_stats));
+	memset(&_mtp_dev->receive_stats, 0, sizeof(_mtp_dev->receive_stats));
+	spin_unlock_irq(&_mtp_dev->lock);
+	return size;
+}
+
+static DEVICE_ATTR(xfer_stats, S_IRUGO | S_IWUSR, mtp_xfer_stats_show,
+						  mtp_xfer_stats_store);
+
+static struct device_attribute *mtp_function_attributes[] = {
+	&dev_attr_tx_reqs,
+	&dev_attr_rx_reqs,
+	&dev_attr_xfer_stats,
+	NULL
+};
+
 static struct android_usb_function mtp_function = {
 	.name		= "mtp",
 	.init		= mtp_function_init,
 	.cleanup	= mtp_function_cleanup,
 	.bind_config	= mtp_function_bind_config,
 	.ctrlrequest	= mtp_function_ctrlrequest,
+	.attributes	= mtp_function_attributes,
 };
 
 /* PTP function is same as MTP with slightly different interface descriptor */
@@ -937,6 +1114,7 @@ static struct android_usb_function ptp_function = {
 	.init		= ptp_function_init,
 	.cleanup	= ptp_function_cleanup,
 	.bind_config	= ptp_function_bind_config,
+	.attributes	= mtp_function_attributes,
 };
 
 /* ECM */
@@ -1039,8 +1217,14 @@ struct rndis_function_config {
 	u32     vendorID;
 	char	manufacturer[256];
 	bool	wceis;
+	/* packets per transfer, host to device and back */
+	u32	ul_max_pkts;
+	u32	dl_max_pkts;
 };
 
+/* ten full frames stay under the 16K a UDC request may carry */
+#define RNDIS_MAX_PKTS_PER_XFER	10
+
 static int rndis_function_init(struct android_usb_function *f, struct usb_composite_dev *cdev)
 {
 	struct rndis_function_config *rndis;
@@ -1054,6 +1238,8 @@ static int rndis_function_init(struct android_usb_function *f, struct usb_compos
 
 	strncpy(rndis->manufacturer, dev->pdata->manufacturer_name, sizeof(rndis->manufacturer));
 	rndis->vendorID = dev->pdata->vendor_id;
+	rndis->ul_max_pkts = 1;
+	rndis->dl_max_pkts = 1;
 
 	return 0;
 }
@@ -1097,8 +1283,9 @@ static int rndis_function_bind_config(struct android_usb_function *f,
 		rndis_control_intf.bInterfaceProtocol =	 0x03;
 	}
 
-	return rndis_bind_config(c, rndis->ethaddr, rndis->vendorID,
-				    rndis->manufacturer);
+	return rndis_bind_config_multi(c, rndis->ethaddr, rndis->vendorID,
+				    rndis->manufacturer, rndis->ul_max_pkts,
+				    rndis->dl_max_pkts);
 }
 
 static void rndis_function_unbind_config(struct android_usb_function *f,
@@ -1208,11 +1395,84 @@ static ssize_t rndis_vendorID_store(struct device *dev,
 static DEVICE_ATTR(vendorID, S_IRUGO | S_IWUSR, rndis_vendorID_show,
 						rndis_vendorID_store);
 
+static ssize_t rndis_ul_max_pkts_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct android_usb_function *f = dev_get_drvdata(dev);
+	struct rndis_function_config *config = f->config;
+	return snprintf(buf, PAGE_SIZE, "%u\n", config->ul_max_pkts);
+}
+
+static ssize_t rndis_ul_max_pkts_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct android_usb_function *f = dev_get_drvdata(dev);
+	struct rndis_function_config *config = f->config;
+	int value;
+
+	/* takes effect on the next bind */
+	if (sscanf(buf, "%d", &value) == 1 && value >= 1 &&
+	    value <= RNDIS_MAX_PKTS_PER_XFER) {
+		config->ul_max_pkts = value;
+		return size;
+	}
+	return -EINVAL;
+}
+
+static DEVICE_ATTR(ul_max_pkts_per_xfer, S_IRUGO | S_IWUSR,
+		   rndis_ul_max_pkts_show, rndis_ul_max_pkts_store);
+
+static ssize_t rndis_dl_max_pkts_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct android_usb_function *f = dev_get_drvdata(dev);
+	struct rndis_function_config *config = f->config;
+	return snprintf(buf, PAGE_SIZE, "%u\n", config->dl_max_pkts);
+}
+
+static ssize_t rndis_dl_max_pkts_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct android_usb_function *f = dev_get_drvdata(dev);
+	struct rndis_function_config *config = f->config;
+	int value;
+
+	if (sscanf(buf, "%d", &value) == 1 && value >= 1 &&
+	    value <= RNDIS_MAX_PKTS_PER_XFER) {
+		config->dl_max_pkts = value;
+		return size;
+	}
+	return -EINVAL;
+}
+
+static DEVICE_ATTR(dl_max_pkts_per_xfer, S_IRUGO | S_IWUSR,
+		   rndis_dl_max_pkts_show, rndis_dl_max_pkts_store);
+
+static ssize_t rndis_aggr_stats_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	return gether_aggr_stats(buf, PAGE_SIZE);
+}
+
+static ssize_t rndis_aggr_stats_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	/* any write clears them */
+	gether_aggr_stats_clear();
+	return size;
+}
+
+static DEVICE_ATTR(aggr_stats, S_IRUGO | S_IWUSR, rndis_aggr_stats_show,
+						  rndis_aggr_stats_store);
+
 static struct device_attribute *rndis_function_attributes[] = {
 	&dev_attr_manufacturer,
 	&dev_attr_wceis,
 	&dev_attr_ethaddr,
 	&dev_attr_vendorID,
+	&dev_attr_ul_max_pkts_per_xfer,
+	&dev_attr_dl_max_pkts_per_xfer,
+	&dev_attr_aggr_stats,
 	NULL
 };
 
@@ -26,6 +26,7 @@
 #include <linux/types.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
+#include <linux/uio.h>
 
 #include <mach/board_htc.h>
 
@@ -33,10 +34,14 @@
 #define ADB_ERR_PAYLOAD_STUCK       _IOW(ADB_IOCTL_MAGIC, 0, unsigned)
 #define ADB_ATS_ENABLE              _IOR(ADB_IOCTL_MAGIC, 1, unsigned)
 
-#define ADB_BULK_BUFFER_SIZE           4096
+/* largest request the udc takes */
+#define ADB_BULK_BUFFER_SIZE           16384
 
-/* number of tx requests to allocate */
-#define TX_REQ_MAX 4
+/* number of tx and rx requests to allocate, tunable up to the max */
+#define ADB_TX_REQ_DEFAULT 8
+#define ADB_RX_REQ_DEFAULT 4
+#define ADB_TX_REQ_MAX 16
+#define ADB_RX_REQ_MAX 8
 
 static const char adb_shortname[] = "android_adb";
 
@@ -59,8 +64,31 @@ struct adb_dev {
 
 	wait_queue_head_t read_wq;
 	wait_queue_head_t write_wq;
-	struct usb_request *rx_req;
-	int rx_done;
+	struct usb_request *rx_req[ADB_RX_REQ_MAX];
+	/*
+	 * OUT requests queued or holding unread data: rx_pending of them,
+	 * in queue order from rx_head, the first rx_done of them completed
+	 */
+	unsigned rx_head;
+	unsigned rx_pending;
+	unsigned rx_done;
+	unsigned rx_offset;	/* bytes already read from the oldest one */
+
+	/* queue depths for the next bind, and what was allocated */
+	unsigned tx_reqs;
+	unsigned rx_reqs;
+	unsigned rx_count;
+
+	/* transfer totals, cleared through xfer_stats */
+	struct adb_xfer_stats {
+		unsigned long reads;
+		unsigned long writes;
+		u64 read_bytes;
+		u64 write_bytes;
+		unsigned long rx_reqs;		/* completed */
+		unsigned long tx_reqs;		/* queued */
+		unsigned long tx_waits;		/* no idle request to write */
+	} stats;
 };
 
 static struct usb_interface_descriptor adb_interface_desc = {
@@ -212,9 +240,14 @@ static void adb_complete_in(struct usb_ep *ep, struct usb_request *req)
 static void adb_complete_out(struct usb_ep *ep, struct usb_request *req)
 {
 	struct adb_dev *dev = _adb_dev;
+	unsigned long flags;
 
-	dev->rx_done = 1;
-	if (req->status != 0) {
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->rx_done++;
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	/* -ECONNRESET is adb_rx_flush() taking the request back */
+	if (req->status != 0 && req->status != -ECONNRESET) {
 		if (req->status != -ESHUTDOWN)
 			printk(KERN_INFO "[USB] %s: warning (%d)\n", __func__, req->status);
 		atomic_set(&dev->error, 1);
@@ -251,17 +284,28 @@ static int adb_create_bulk_endpoints(struct adb_dev *dev,
 	ep->driver_data = dev;		/* claim the endpoint */
 	dev->ep_out = ep;
 
-	/* now allocate requests for our endpoints */
-	req = adb_request_new(dev->ep_out, ADB_BULK_BUFFER_SIZE);
-	if (!req)
-		goto fail;
-	req->complete = adb_complete_out;
-	dev->rx_req = req;
+	/* now allocate requests for our endpoints, making do with
+	 * shallower queues if memory is short
+	 */
+	for (i = 0; i < dev->rx_reqs; i++) {
+		req = adb_request_new(dev->ep_out, ADB_BULK_BUFFER_SIZE);
+		if (!req) {
+			if (!i)
+				goto fail;
+			break;
+		}
+		req->complete = adb_complete_out;
+		dev->rx_req[i] = req;
+	}
+	dev->rx_count = i;
 
-	for (i = 0; i < TX_REQ_MAX; i++) {
+	for (i = 0; i < dev->tx_reqs; i++) {
 		req = adb_request_new(dev->ep_in, ADB_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+		if (!req) {
+			if (!i)
+				goto fail;
+			break;
+		}
 		req->complete = adb_complete_in;
 		adb_req_put(dev, &dev->tx_idle, req);
 	}
@@ -273,21 +317,138 @@ fail:
 	return -1;
 }
 
-static ssize_t adb_read(struct file *fp, char __user *buf,
-				size_t count, loff_t *pos)
+/* the i-th OUT request in queue order */
+static inline struct usb_request *adb_rx_req(struct adb_dev *dev, unsigned i)
+{
+	return dev->rx_req[(dev->rx_head + i) % dev->rx_count];
+}
+
+/* take back every OUT request after an error, dropping their data */
+static void adb_rx_flush(struct adb_dev *dev)
+{
+	unsigned i;
+
+	for (i = 0; i < dev->rx_pending; i++)
+		usb_ep_dequeue(dev->ep_out, adb_rx_req(dev, i));
+
+	spin_lock_irq(&dev->lock);
+	dev->rx_head = 0;
+	dev->rx_pending = 0;
+	dev->rx_done = 0;
+	dev->rx_offset = 0;
+	spin_unlock_irq(&dev->lock);
+}
+
+/*
+ * A read larger than one request keeps several OUT requests queued, sized
+ * to add up to the read, so the host can stream a whole message while the
+ * first requests are copied out.  A short packet ends the read.  Requests
+ * still queued, or holding more data than the caller asked for, stay
+ * where they are and feed the next read, so nothing the host sent is lost.
+ * An error after some data was copied returns the data; the error is
+ * reported by the next call.
+ */
+static ssize_t adb_read_one(struct adb_dev *dev, char __user *buf,
+			    size_t count)
 {
-	struct adb_dev *dev = fp->private_data;
 	struct usb_request *req;
-	int r = count, xfer;
-	int ret;
+	size_t queued, n;
+	ssize_t r = 0;
+	unsigned i;
+	int ret, reqs = 0;
+	bool error = false;
+
+	if (!dev->rx_count)
+		return -EIO;
+
+	while (r < count) {
+		/* queue enough requests to cover the rest of the read */
+		for (queued = 0, i = 0; i < dev->rx_pending; i++)
+			queued += adb_rx_req(dev, i)->length;
+		queued -= dev->rx_offset;
+
+		while (dev->rx_pending < dev->rx_count && queued < count - r) {
+			req = adb_rx_req(dev, dev->rx_pending);
+			req->length = min_t(size_t, count - r - queued,
+					    ADB_BULK_BUFFER_SIZE);
+			ret = usb_ep_queue(dev->ep_out, req, GFP_ATOMIC);
+			if (ret < 0) {
+				pr_debug("adb_read: failed to queue req %p "
+					 "(%d)\n", req, ret);
+				atomic_set(&dev->error, 1);
+				break;
+			}
+			pr_debug("rx %p queue\n", req);
+			dev->rx_pending++;
+			queued += req->length;
+		}
+
+		/* wait for the oldest one to complete */
+		ret = wait_event_interruptible(dev->read_wq,
+			dev->rx_done || atomic_read(&dev->error));
+		if (ret < 0) {
+			if (!r)
+				r = ret;
+			break;
+		}
+		req = adb_rx_req(dev, 0);
+		if (atomic_read(&dev->error) || req->status) {
+			atomic_set(&dev->error, 1);
+			error = true;
+			break;
+		}
+
+		pr_debug("rx %p %d\n", req, req->actual);
+		n = min_t(size_t, req->actual - dev->rx_offset, count - r);
+		if (copy_to_user(buf + r, req->buf + dev->rx_offset, n)) {
+			if (!r)
+				r = -EFAULT;
+			break;
+		}
+		r += n;
+		dev->rx_offset += n;
+		if (dev->rx_offset < req->actual)
+			continue;
+
+		/* used up, it goes to the back of the line */
+		spin_lock_irq(&dev->lock);
+		dev->rx_done--;
+		spin_unlock_irq(&dev->lock);
+		dev->rx_head = (dev->rx_head + 1) % dev->rx_count;
+		dev->rx_pending--;
+		dev->rx_offset = 0;
+		reqs++;
+
+		/* a 0-len packet before any data is thrown back */
+		if (req->actual < req->length && r)
+			break;
+	}
+
+	if (error && !r) {
+		adb_rx_flush(dev);
+		r = -EIO;
+	}
+
+	spin_lock_irq(&dev->lock);
+	dev->stats.reads++;
+	dev->stats.rx_reqs += reqs;
+	if (r > 0)
+		dev->stats.read_bytes += r;
+	spin_unlock_irq(&dev->lock);
+
+	return r;
+}
+
+/* each segment is read as if on its own, until one comes back short */
+static ssize_t adb_readv(struct adb_dev *dev, const struct iovec *iov,
+			 unsigned long nr_segs)
+{
+	ssize_t r = 0, ret;
+	unsigned long seg;
 
-	pr_debug("adb_read(%d)\n", count);
 	if (!_adb_dev)
 		return -ENODEV;
 
-	if (count > ADB_BULK_BUFFER_SIZE)
-		return -EINVAL;
-
 	if (adb_lock(&dev->read_excl))
 		return -EBUSY;
 
@@ -307,62 +468,47 @@ static ssize_t adb_read(struct file *fp, char __user *buf,
 		goto done;
 	}
 
-requeue_req:
-	/* queue a request */
-	req = dev->rx_req;
-	req->length = count;
-	dev->rx_done = 0;
-	ret = usb_ep_queue(dev->ep_out, req, GFP_ATOMIC);
-	if (ret < 0) {
-		pr_debug("adb_read: failed to queue req %p (%d)\n", req, ret);
-		r = -EIO;
-		atomic_set(&dev->error, 1);
-		goto done;
-	} else {
-		pr_debug("rx %p queue\n", req);
-	}
-
-	/* wait for a request to complete */
-	ret = wait_event_interruptible(dev->read_wq, dev->rx_done);
-	if (ret < 0) {
-		atomic_set(&dev->error, 1);
-		r = ret;
-		usb_ep_dequeue(dev->ep_out, req);
-		goto done;
+	for (seg = 0; seg < nr_segs; seg++) {
+		if (!iov[seg].iov_len)
+			continue;
+		ret = adb_read_one(dev, iov[seg].iov_base, iov[seg].iov_len);
+		if (ret < 0) {
+			if (!r)
+				r = ret;
+			break;
+		}
+		r += ret;
+		if (ret < iov[seg].iov_len)
+			break;
 	}
-	if (!atomic_read(&dev->error)) {
-		/* If we got a 0-len packet, throw it back and try again. */
-		if (req->actual == 0)
-			goto requeue_req;
-
-		pr_debug("rx %p %d\n", req, req->actual);
-		xfer = (req->actual < count) ? req->actual : count;
-		if (copy_to_user(buf, req->buf, xfer))
-			r = -EFAULT;
-
-	} else
-		r = -EIO;
 
 done:
 	adb_unlock(&dev->read_excl);
-	pr_debug("adb_read returning %d\n", r);
+	pr_debug("adb_read returning %zd\n", r);
 	return r;
 }
 
-static ssize_t adb_write(struct file *fp, const char __user *buf,
-				 size_t count, loff_t *pos)
+static ssize_t adb_read(struct file *fp, char __user *buf,
+				size_t count, loff_t *pos)
 {
-	struct adb_dev *dev = fp->private_data;
-	struct usb_request *req = 0;
-	int r = count, xfer;
-	int ret;
+	struct iovec iov = { .iov_base = buf, .iov_len = count };
 
-	if (!_adb_dev)
-		return -ENODEV;
-	pr_debug("adb_write(%d)\n", count);
+	pr_debug("adb_read(%d)\n", count);
+	return adb_readv(fp->private_data, &iov, 1);
+}
 
-	if (adb_lock(&dev->write_excl))
-		return -EBUSY;
+static ssize_t adb_aio_read(struct kiocb *iocb, const struct iovec *iov,
+			    unsigned long nr_segs, loff_t pos)
+{
+	return adb_readv(iocb->ki_filp->private_data, iov, nr_segs);
+}
+
+static ssize_t adb_write_one(struct adb_dev *dev, const char __user *buf,
+			     size_t count)
+{
+	struct usb_request *req = 0;
+	int r = count, xfer, queued = 0, waits = 0;
+	int ret;
 
 	while (count > 0) {
 		if (atomic_read(&dev->error)) {
@@ -372,14 +518,16 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 		}
 
 		/* get an idle tx request to use */
-		req = 0;
-		ret = wait_event_interruptible(dev->write_wq,
-			((req = adb_req_get(dev, &dev->tx_idle)) ||
-			 atomic_read(&dev->error)));
-
-		if (ret < 0) {
-			r = ret;
-			break;
+		req = adb_req_get(dev, &dev->tx_idle);
+		if (!req) {
+			waits++;
+			ret = wait_event_interruptible(dev->write_wq,
+				((req = adb_req_get(dev, &dev->tx_idle)) ||
+				 atomic_read(&dev->error)));
+			if (ret < 0) {
+				r = ret;
+				break;
+			}
 		}
 
 		if (req != 0) {
@@ -403,6 +551,7 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 
 			buf += xfer;
 			count -= xfer;
+			queued++;
 
 			/* zero this so we don't try to free it on error exit */
 			req = 0;
@@ -412,11 +561,62 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 	if (req)
 		adb_req_put(dev, &dev->tx_idle, req);
 
+	spin_lock_irq(&dev->lock);
+	dev->stats.writes++;
+	dev->stats.tx_reqs += queued;
+	dev->stats.tx_waits += waits;
+	if (r > 0)
+		dev->stats.write_bytes += r;
+	spin_unlock_irq(&dev->lock);
+
+	return r;
+}
+
+/* each segment goes out as its own transfer, keeping message boundaries */
+static ssize_t adb_writev(struct adb_dev *dev, const struct iovec *iov,
+			  unsigned long nr_segs)
+{
+	ssize_t r = 0, ret;
+	unsigned long seg;
+
+	if (!_adb_dev)
+		return -ENODEV;
+
+	if (adb_lock(&dev->write_excl))
+		return -EBUSY;
+
+	for (seg = 0; seg < nr_segs; seg++) {
+		if (!iov[seg].iov_len)
+			continue;
+		ret = adb_write_one(dev, iov[seg].iov_base, iov[seg].iov_len);
+		if (ret < 0) {
+			if (!r)
+				r = ret;
+			break;
+		}
+		r += ret;
+	}
+
 	adb_unlock(&dev->write_excl);
-	pr_debug("adb_write returning %d\n", r);
+	pr_debug("adb_write returning %zd\n", r);
 	return r;
 }
 
+static ssize_t adb_write(struct file *fp, const char __user *buf,
+				 size_t count, loff_t *pos)
+{
+	struct iovec iov = { .iov_base = (void __user *)buf, .iov_len = count };
+
+	pr_debug("adb_write(%d)\n", count);
+	return adb_writev(fp->private_data, &iov, 1);
+}
+
+static ssize_t adb_aio_write(struct kiocb *iocb, const struct iovec *iov,
+			     unsigned long nr_segs, loff_t pos)
+{
+	return adb_writev(iocb->ki_filp->private_data, iov, nr_segs);
+}
+
 static int adb_open(struct inode *ip, struct file *fp)
 {
 	printk(KERN_INFO "[USB] adb_open: %s(parent:%s): tgid=%d\n",
@@ -429,6 +629,9 @@ static int adb_open(struct inode *ip, struct file *fp)
 
 	fp->private_data = _adb_dev;
 
+	/* a new reader doesn't get what was left for the last one */
+	adb_rx_flush(_adb_dev);
+
 	/* clear the error latch */
 	atomic_set(&_adb_dev->error, 0);
 
@@ -448,6 +651,8 @@ static struct file_operations adb_fops = {
 	.owner = THIS_MODULE,
 	.read = adb_read,
 	.write = adb_write,
+	.aio_read = adb_aio_read,
+	.aio_write = adb_aio_write,
 	.open = adb_open,
 	.release = adb_release,
 };
@@ -553,6 +758,7 @@ adb_function_unbind(struct usb_configuration *c, struct usb_function *f)
 {
 	struct adb_dev	*dev = func_to_adb(f);
 	struct usb_request *req;
+	int i;
 
 
 	atomic_set(&dev->online, 0);
@@ -560,7 +766,15 @@ adb_function_unbind(struct usb_configuration *c, struct usb_function *f)
 
 	wake_up(&dev->read_wq);
 
-	adb_request_free(dev->rx_req, dev->ep_out);
+	for (i = 0; i < dev->rx_count; i++) {
+		adb_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
+	dev->rx_count = 0;
+	dev->rx_head = 0;
+	dev->rx_pending = 0;
+	dev->rx_done = 0;
+	dev->rx_offset = 0;
 	while ((req = adb_req_get(dev, &dev->tx_idle)))
 		adb_request_free(req, dev->ep_in);
 }
@@ -664,6 +878,8 @@ static int adb_setup(void)
 	atomic_set(&dev->write_excl, 0);
 
 	INIT_LIST_HEAD(&dev->tx_idle);
+	dev->tx_reqs = ADB_TX_REQ_DEFAULT;
+	dev->rx_reqs = ADB_RX_REQ_DEFAULT;
 
 	_adb_dev = dev;
 
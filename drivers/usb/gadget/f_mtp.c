@@ -25,6 +25,7 @@
 #include <linux/wait.h>
 #include <linux/err.h>
 #include <linux/interrupt.h>
+#include <linux/ktime.h>
 
 #include <linux/types.h>
 #include <linux/file.h>
@@ -49,9 +50,11 @@
 #define STATE_CANCELED              3   /* transaction canceled by host */
 #define STATE_ERROR                 4   /* error from completion routine */
 
-/* number of tx and rx requests to allocate */
-#define TX_REQ_MAX 4
-#define RX_REQ_MAX 2
+/* number of tx and rx requests to allocate, tunable up to the max */
+#define TX_REQ_DEFAULT 8
+#define RX_REQ_DEFAULT 4
+#define TX_REQ_MAX 16
+#define RX_REQ_MAX 8
 #define INTR_REQ_MAX 5
 
 /* ID for Microsoft MTP OS String */
@@ -92,7 +95,19 @@ struct mtp_dev {
 	wait_queue_head_t write_wq;
 	wait_queue_head_t intr_wq;
 	struct usb_request *rx_req[RX_REQ_MAX];
-	int rx_done;
+	int rx_done;		/* completed rx requests since last cleared */
+
+	/* queue depths for the next bind, and what was allocated */
+	unsigned tx_reqs;
+	unsigned rx_reqs;
+	unsigned rx_count;
+
+	/* file transfer totals, for measuring throughput */
+	struct mtp_xfer_stats {
+		unsigned files;
+		u64 bytes;
+		u64 time_us;
+	} send_stats, receive_stats;
 
 	/* for processing MTP_SEND_FILE, MTP_RECEIVE_FILE and
 	 * MTP_SEND_FILE_WITH_HEADER ioctls on a work queue
@@ -366,7 +381,7 @@ static void mtp_complete_out(struct usb_ep *ep, struct usb_request *req)
 {
 	struct mtp_dev *dev = _mtp_dev;
 
-	dev->rx_done = 1;
+	dev->rx_done++;
 	if (req->status != 0)
 		dev->state = STATE_ERROR;
 
@@ -424,21 +439,30 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	ep->driver_data = dev;		/* claim the endpoint */
 	dev->ep_intr = ep;
 
-	/* now allocate requests for our endpoints */
-	for (i = 0; i < TX_REQ_MAX; i++) {
+	/* now allocate requests for our endpoints, making do with
+	 * shallower queues if memory is short
+	 */
+	for (i = 0; i < dev->tx_reqs; i++) {
 		req = mtp_request_new(dev->ep_in, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+		if (!req) {
+			if (!i)
+				goto fail;
+			break;
+		}
 		req->complete = mtp_complete_in;
 		mtp_req_put(dev, &dev->tx_idle, req);
 	}
-	for (i = 0; i < RX_REQ_MAX; i++) {
+	for (i = 0; i < dev->rx_reqs; i++) {
 		req = mtp_request_new(dev->ep_out, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+		if (!req) {
+			if (!i)
+				goto fail;
+			break;
+		}
 		req->complete = mtp_complete_out;
 		dev->rx_req[i] = req;
 	}
+	dev->rx_count = i;
 	for (i = 0; i < INTR_REQ_MAX; i++) {
 		req = mtp_request_new(dev->ep_intr, INTR_BUFFER_SIZE);
 		if (!req)
@@ -633,6 +657,16 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 	return r;
 }
 
+static void mtp_account_xfer(struct mtp_dev *dev, struct mtp_xfer_stats *st,
+			     int64_t bytes, ktime_t start)
+{
+	spin_lock_irq(&dev->lock);
+	st->files++;
+	st->bytes += bytes;
+	st->time_us += ktime_to_us(ktime_sub(ktime_get(), start));
+	spin_unlock_irq(&dev->lock);
+}
+
 /* read from a local file and write to USB */
 static void send_file_work(struct work_struct *data) {
 	struct mtp_dev	*dev = container_of(data, struct mtp_dev, send_file_work);
@@ -641,10 +675,11 @@ static void send_file_work(struct work_struct *data) {
 	struct mtp_data_header *header;
 	struct file *filp;
 	loff_t offset;
-	int64_t count;
+	int64_t count, sent = 0;
 	int xfer, ret, hdr_size;
 	int r = 0;
 	int sendZLP = 0;
+	ktime_t start = ktime_get();
 
 	/* read our parameters */
 	smp_rmb();
@@ -720,6 +755,7 @@ static void send_file_work(struct work_struct *data) {
 		}
 
 		count -= xfer;
+		sent += xfer;
 
 		/* zero this so we don't try to free it on error exit */
 		req = 0;
@@ -728,23 +764,33 @@ static void send_file_work(struct work_struct *data) {
 	if (req)
 		mtp_req_put(dev, &dev->tx_idle, req);
 
+	if (!r)
+		mtp_account_xfer(dev, &dev->send_stats, sent, start);
+
 	DBG(cdev, "send_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
 	smp_wmb();
 }
 
-/* read from USB and write to a local file */
+/* read from USB and write to a local file
+ *
+ * All rx requests are kept queued on the out endpoint, so the host keeps
+ * streaming while vfs_write() runs.  Requests complete in the order they
+ * were queued; only as many bytes as the file holds are ever asked for,
+ * so nothing of the next MTP transaction can be read here.
+ */
 static void receive_file_work(struct work_struct *data)
 {
 	struct mtp_dev	*dev = container_of(data, struct mtp_dev, receive_file_work);
 	struct usb_composite_dev *cdev = dev->cdev;
-	struct usb_request *read_req = NULL, *write_req = NULL;
+	struct usb_request *req;
 	struct file *filp;
 	loff_t offset;
-	int64_t count;
-	int ret, cur_buf = 0;
+	int64_t count, received = 0;
+	int ret, head = 0, tail = 0, queued = 0, done = 0, depth;
 	int r = 0;
+	ktime_t start = ktime_get();
 
 	/* read our parameters */
 	smp_rmb();
@@ -754,64 +800,72 @@ static void receive_file_work(struct work_struct *data)
 
 	DBG(cdev, "receive_file_work(%lld)\n", count);
 
-	while (count > 0 || write_req) {
-		if (count > 0) {
-			/* queue a request */
-			read_req = dev->rx_req[cur_buf];
-			cur_buf = (cur_buf + 1) % RX_REQ_MAX;
+	/* if xfer_file_length is 0xFFFFFFFF, then we read until
+	 * we get a short packet, one request at a time
+	 */
+	depth = (count == 0xFFFFFFFF) ? 1 : dev->rx_count;
+	dev->rx_done = 0;
 
-			read_req->length = (count > MTP_BULK_BUFFER_SIZE
+	while (count > 0 || queued) {
+		while (count > 0 && queued < depth) {
+			req = dev->rx_req[head];
+			req->length = (count > MTP_BULK_BUFFER_SIZE
 					? MTP_BULK_BUFFER_SIZE : count);
-			dev->rx_done = 0;
-			ret = usb_ep_queue(dev->ep_out, read_req, GFP_KERNEL);
+			ret = usb_ep_queue(dev->ep_out, req, GFP_KERNEL);
 			if (ret < 0) {
 				r = -EIO;
 				if (dev->state != STATE_OFFLINE)
 					dev->state = STATE_ERROR;
-				break;
+				goto out;
 			}
+			if (count != 0xFFFFFFFF)
+				count -= req->length;
+			head = (head + 1) % dev->rx_count;
+			queued++;
 		}
 
-		if (write_req) {
-			DBG(cdev, "rx %p %d\n", write_req, write_req->actual);
-			ret = vfs_write(filp, write_req->buf, write_req->actual,
-				&offset);
-			DBG(cdev, "vfs_write %d\n", ret);
-			if (ret != write_req->actual) {
-				r = -EIO;
-				if (dev->state != STATE_OFFLINE)
-					dev->state = STATE_ERROR;
-				break;
-			}
-			write_req = NULL;
+		/* wait for the oldest read to complete */
+		req = dev->rx_req[tail];
+		ret = wait_event_interruptible(dev->read_wq,
+			dev->rx_done > done || dev->state != STATE_BUSY);
+		if (dev->state == STATE_CANCELED) {
+			r = -ECANCELED;
+			goto out;
 		}
+		if (dev->rx_done <= done || req->status) {
+			r = ret ? ret : -EIO;
+			goto out;
+		}
+		done++;
+		tail = (tail + 1) % dev->rx_count;
+		queued--;
 
-		if (read_req) {
-			/* wait for our last read to complete */
-			ret = wait_event_interruptible(dev->read_wq,
-				dev->rx_done || dev->state != STATE_BUSY);
-			if (dev->state == STATE_CANCELED) {
-				r = -ECANCELED;
-				if (!dev->rx_done)
-					usb_ep_dequeue(dev->ep_out, read_req);
-				break;
-			}
-			/* if xfer_file_length is 0xFFFFFFFF, then we read until
-			 * we get a zero length packet
-			 */
-			if (count != 0xFFFFFFFF)
-				count -= read_req->actual;
-			if (read_req->actual < read_req->length) {
-				/* short packet is used to signal EOF for sizes > 4 gig */
-				DBG(cdev, "got short packet\n");
-				count = 0;
-			}
+		DBG(cdev, "rx %p %d\n", req, req->actual);
+		ret = vfs_write(filp, req->buf, req->actual, &offset);
+		DBG(cdev, "vfs_write %d\n", ret);
+		if (ret != req->actual) {
+			r = -EIO;
+			if (dev->state != STATE_OFFLINE)
+				dev->state = STATE_ERROR;
+			goto out;
+		}
+		received += ret;
 
-			write_req = read_req;
-			read_req = NULL;
+		if (req->actual < req->length) {
+			/* short packet is used to signal EOF for sizes > 4 gig */
+			DBG(cdev, "got short packet\n");
+			break;
 		}
 	}
 
+	mtp_account_xfer(dev, &dev->receive_stats, received, start);
+out:
+	/* take back whatever is still queued */
+	while (queued--) {
+		usb_ep_dequeue(dev->ep_out, dev->rx_req[tail]);
+		tail = (tail + 1) % dev->rx_count;
+	}
+
 	DBG(cdev, "receive_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
@@ -1126,8 +1180,11 @@ mtp_function_unbind(struct usb_configuration *c, struct usb_function *f)
 
 	while ((req = mtp_req_get(dev, &dev->tx_idle)))
 		mtp_request_free(req, dev->ep_in);
-	for (i = 0; i < RX_REQ_MAX; i++)
+	for (i = 0; i < dev->rx_count; i++) {
 		mtp_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
+	dev->rx_count = 0;
 	while ((req = mtp_req_get(dev, &dev->intr_idle)))
 		mtp_request_free(req, dev->ep_intr);
 	dev->state = STATE_OFFLINE;
@@ -1254,6 +1311,8 @@ static int mtp_setup(void)
 	atomic_set(&dev->ioctl_excl, 0);
 	INIT_LIST_HEAD(&dev->tx_idle);
 	INIT_LIST_HEAD(&dev->intr_idle);
+	dev->tx_reqs = TX_REQ_DEFAULT;
+	dev->rx_reqs = RX_REQ_DEFAULT;
 
 	dev->wq = create_singlethread_workqueue("f_mtp");
 	if (!dev->wq) {
@@ -399,6 +399,7 @@ static void rndis_command_complete(struct usb_ep *ep, struct usb_request *req)
 	if (status < 0)
 		ERROR(cdev, "RNDIS command error %d, %d/%d\n",
 			status, req->actual, req->length);
+	rndis->port.dl_max_xfer_size = rndis_get_dl_max_xfer_size(rndis->config);
 //	spin_unlock(&dev->lock);
 }
 
@@ -706,6 +707,7 @@ rndis_bind(struct usb_configuration *c, struct usb_function *f)
 		goto fail;
 	rndis->config = status;
 
+	rndis_set_max_pkt_xfer(rndis->config, rndis->port.ul_max_pkts_per_xfer);
 	rndis_set_param_medium(rndis->config, NDIS_MEDIUM_802_3, 0);
 	rndis_set_host_mac(rndis->config, rndis->ethaddr);
 
@@ -788,6 +790,22 @@ static inline bool can_support_rndis(struct usb_configuration *c)
 int
 rndis_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN],
 				u32 vendorID, const char *manufacturer)
+{
+	return rndis_bind_config_multi(c, ethaddr, vendorID, manufacturer, 1, 1);
+}
+
+/**
+ * rndis_bind_config_multi - add RNDIS link carrying several packets per
+ *	transfer
+ * @ul_max_pkts: packets the host may put in one OUT transfer
+ * @dl_max_pkts: packets we put in one IN transfer
+ *
+ * As rndis_bind_config() otherwise; one packet each way is the same.
+ */
+int
+rndis_bind_config_multi(struct usb_configuration *c, u8 ethaddr[ETH_ALEN],
+				u32 vendorID, const char *manufacturer,
+				unsigned ul_max_pkts, unsigned dl_max_pkts)
 {
 	struct f_rndis	*rndis;
 	int		status;
@@ -842,6 +860,8 @@ rndis_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN],
 	rndis->port.header_len = sizeof(struct rndis_packet_msg_type);
 	rndis->port.wrap = rndis_add_header;
 	rndis->port.unwrap = rndis_rm_hdr;
+	rndis->port.ul_max_pkts_per_xfer = ul_max_pkts;
+	rndis->port.dl_max_pkts_per_xfer = dl_max_pkts;
 
 	rndis->port.func.name = "rndis";
 	rndis->port.func.strings = rndis_strings;
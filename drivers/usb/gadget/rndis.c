@@ -41,6 +41,7 @@
 #undef	VERBOSE_DEBUG
 
 #include "rndis.h"
+#include "u_ether.h"
 
 
 /* The driver for your USB chip needs to support ep0 OUT to work with
@@ -569,6 +570,7 @@ static int rndis_init_response(int configNr, rndis_init_msg_type *buf)
 	rndis_init_cmplt_type *resp;
 	rndis_resp_t *r;
 	struct rndis_params *params = rndis_per_dev_params + configNr;
+	u32 max_xfer;
 
 	if (!params->dev)
 		return -ENOTSUPP;
@@ -586,12 +588,15 @@ static int rndis_init_response(int configNr, rndis_init_msg_type *buf)
 	resp->MinorVersion = cpu_to_le32(RNDIS_MINOR_VERSION);
 	resp->DeviceFlags = cpu_to_le32(RNDIS_DF_CONNECTIONLESS);
 	resp->Medium = cpu_to_le32(RNDIS_MEDIUM_802_3);
-	resp->MaxPacketsPerTransfer = cpu_to_le32(1);
-	resp->MaxTransferSize = cpu_to_le32(
-		  params->dev->mtu
+	resp->MaxPacketsPerTransfer = cpu_to_le32(params->max_pkt_per_xfer);
+	max_xfer = params->max_pkt_per_xfer * (params->dev->mtu
 		+ sizeof(struct ethhdr)
 		+ sizeof(struct rndis_packet_msg_type)
 		+ 22);
+	/* what u_ether sizes its OUT requests to */
+	if (params->max_pkt_per_xfer > 1)
+		max_xfer = min_t(u32, max_xfer, GETHER_MAX_OUT_XFER_SIZE);
+	resp->MaxTransferSize = cpu_to_le32(max_xfer);
 	resp->PacketAlignmentFactor = cpu_to_le32(0);
 	resp->AFListOffset = cpu_to_le32(0);
 	resp->AFListSize = cpu_to_le32(0);
@@ -822,6 +827,10 @@ int rndis_msg_parser(u8 configNr, u8 *buf)
 		pr_debug("%s: REMOTE_NDIS_INITIALIZE_MSG\n",
 			__func__);
 		params->state = RNDIS_INITIALIZED;
+		/* bounds how many packets we may send in one transfer */
+		params->host_max_xfer_size =
+			get_unaligned_le32(&((rndis_init_msg_type *)buf)
+					   ->MaxTransferSize);
 		return rndis_init_response(configNr,
 					(rndis_init_msg_type *)buf);
 
@@ -903,6 +912,8 @@ int rndis_register(void (*resp_avail)(void *v), void *v)
 			rndis_per_dev_params[i].used = 1;
 			rndis_per_dev_params[i].resp_avail = resp_avail;
 			rndis_per_dev_params[i].v = v;
+			rndis_per_dev_params[i].max_pkt_per_xfer = 1;
+			rndis_per_dev_params[i].host_max_xfer_size = 0;
 			pr_debug("%s: configNr = %d\n", __func__, i);
 			return i;
 		}
@@ -956,6 +967,26 @@ int rndis_set_param_medium(u8 configNr, u32 medium, u32 speed)
 	return 0;
 }
 
+/* packets the host may send in one transfer, 1 unless aggregating */
+int rndis_set_max_pkt_xfer(u8 configNr, u32 max_pkt_per_xfer)
+{
+	pr_debug("%s: %u\n", __func__, max_pkt_per_xfer);
+	if (configNr >= RNDIS_MAX_CONFIGS) return -1;
+
+	rndis_per_dev_params[configNr].max_pkt_per_xfer =
+		max_pkt_per_xfer ? max_pkt_per_xfer : 1;
+
+	return 0;
+}
+
+/* longest transfer the host takes, 0 until it has said */
+u32 rndis_get_dl_max_xfer_size(u8 configNr)
+{
+	if (configNr >= RNDIS_MAX_CONFIGS) return 0;
+
+	return rndis_per_dev_params[configNr].host_max_xfer_size;
+}
+
 void rndis_add_hdr(struct sk_buff *skb)
 {
 	struct rndis_packet_msg_type *header;
@@ -1024,30 +1055,64 @@ static rndis_resp_t *rndis_add_response(int configNr, u32 length)
 	return r;
 }
 
+/*
+ * A transfer may carry several packet messages when the host was told it
+ * can (MaxPacketsPerTransfer); all but the last are split off as clones.
+ * Whatever follows the last message is padding.
+ */
 int rndis_rm_hdr(struct gether *port,
 			struct sk_buff *skb,
 			struct sk_buff_head *list)
 {
-	/* tmp points to a struct rndis_packet_msg_type */
-	__le32 *tmp = (void *)skb->data;
+	struct sk_buff *skb2;
+	__le32 *tmp;
+	u32 msg_len, data_offset, data_len;
+	int queued = 0;
+
+	for (;;) {
+		/* tmp points to a struct rndis_packet_msg_type */
+		tmp = (void *)skb->data;
+		if (skb->len < sizeof(struct rndis_packet_msg_type))
+			goto bad;
+
+		/* MessageType, MessageLength */
+		if (cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
+				!= get_unaligned(tmp++))
+			goto bad;
+		msg_len = get_unaligned_le32(tmp++);
+
+		/* DataOffset, DataLength */
+		data_offset = get_unaligned_le32(tmp++) + 8;
+		data_len = get_unaligned_le32(tmp++);
+
+		/* last message: take the rest of the transfer */
+		if (!msg_len || msg_len + sizeof(struct rndis_packet_msg_type)
+				> skb->len) {
+			if (!skb_pull(skb, data_offset)) {
+				dev_kfree_skb_any(skb);
+				return -EOVERFLOW;
+			}
+			skb_trim(skb, data_len);
+			skb_queue_tail(list, skb);
+			return 0;
+		}
 
-	/* MessageType, MessageLength */
-	if (cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
-			!= get_unaligned(tmp++)) {
-		dev_kfree_skb_any(skb);
-		return -EINVAL;
-	}
-	tmp++;
+		if (data_offset + data_len > msg_len)
+			goto bad;
 
-	/* DataOffset, DataLength */
-	if (!skb_pull(skb, get_unaligned_le32(tmp++) + 8)) {
-		dev_kfree_skb_any(skb);
-		return -EOVERFLOW;
+		skb2 = skb_clone(skb, GFP_ATOMIC);
+		if (skb2) {
+			skb_pull(skb2, data_offset);
+			skb_trim(skb2, data_len);
+			skb_queue_tail(list, skb2);
+			queued++;
+		}
+		skb_pull(skb, msg_len);
 	}
-	skb_trim(skb, get_unaligned_le32(tmp++));
 
-	skb_queue_tail(list, skb);
-	return 0;
+bad:
+	dev_kfree_skb_any(skb);
+	return queued ? 0 : -EINVAL;
 }
 
 #ifdef CONFIG_USB_GADGET_DEBUG_FILES
@@ -28,6 +28,7 @@
 #include <linux/ctype.h>
 #include <linux/etherdevice.h>
 #include <linux/ethtool.h>
+#include <linux/slab.h>
 
 #include "u_ether.h"
 
@@ -84,6 +85,21 @@ struct eth_dev {
 
 	bool			zlp;
 	u8			host_mac[ETH_ALEN];
+
+	/* multi-packet tx, see eth_aggr_xmit() */
+	unsigned		dl_max_pkts;
+	size_t			tx_buf_size;	/* 0 when not aggregating */
+	struct usb_request	*tx_aggr_req;	/* being filled */
+	unsigned		tx_aggr_pkts;
+	unsigned		tx_in_flight;
+
+	struct {
+		unsigned long	tx_xfers;
+		unsigned long	tx_pkts;
+		unsigned long	tx_full;	/* sent for lack of room */
+		unsigned long	rx_xfers;
+		unsigned long	rx_pkts;
+	} aggr_stats;
 };
 
 /*-------------------------------------------------------------------------*/
@@ -237,8 +253,12 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 	 */
 	size += sizeof(struct ethhdr) + dev->net->mtu + RX_EXTRA;
 	size += dev->port_usb->header_len;
+	if (dev->port_usb->ul_max_pkts_per_xfer > 1)
+		size *= dev->port_usb->ul_max_pkts_per_xfer;
 	size += out->maxpacket - 1;
 	size -= size % out->maxpacket;
+	if (dev->port_usb->ul_max_pkts_per_xfer > 1)
+		size = min_t(size_t, size, GETHER_MAX_OUT_XFER_SIZE);
 
 	if (dev->port_usb->is_fixed)
 		size = max_t(size_t, size, dev->port_usb->fixed_out_len);
@@ -286,6 +306,7 @@ static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 	/* normal completion */
 	case 0:
 		skb_put(skb, req->actual);
+		dev->aggr_stats.rx_xfers++;
 
 		if (dev->unwrap) {
 			unsigned long	flags;
@@ -318,6 +339,7 @@ static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 			}
 			skb2->protocol = eth_type_trans(skb2, dev->net);
 			dev->net->stats.rx_packets++;
+			dev->aggr_stats.rx_pkts++;
 			dev->net->stats.rx_bytes += skb2->len;
 
 			/* no buffer copies needed, unless hardware can't
@@ -426,6 +448,50 @@ done:
 	return status;
 }
 
+/*
+ * Multi-packet tx copies frames into buffers of its own.  Each request
+ * carries several frames, so fewer of them are kept.  Without memory
+ * for the buffers, frames go one per transfer as usual.
+ */
+static void alloc_tx_buffers(struct eth_dev *dev, struct gether *link)
+{
+	struct usb_request	*req;
+	size_t			size;
+	unsigned		n;
+
+	/* room for the frames and a pad byte */
+	size = dev->dl_max_pkts *
+		(ETH_HLEN + dev->net->mtu + link->header_len) + 1;
+	n = max_t(unsigned, qlen(dev->gadget) / dev->dl_max_pkts,
+		  TX_AGGR_IN_FLIGHT + 2);
+
+	spin_lock(&dev->req_lock);
+	prealloc(&dev->tx_reqs, link->in_ep, n);
+	list_for_each_entry(req, &dev->tx_reqs, list)
+		req->buf = NULL;
+	list_for_each_entry(req, &dev->tx_reqs, list) {
+		req->buf = kmalloc(size, GFP_ATOMIC);
+		if (!req->buf)
+			goto fail;
+		req->length = 0;
+		req->context = NULL;
+		req->complete = tx_complete;
+	}
+	dev->tx_buf_size = size;
+	dev->tx_aggr_req = NULL;
+	dev->tx_in_flight = 0;
+	spin_unlock(&dev->req_lock);
+	return;
+
+fail:
+	list_for_each_entry(req, &dev->tx_reqs, list) {
+		kfree(req->buf);
+		req->buf = NULL;
+	}
+	spin_unlock(&dev->req_lock);
+	DBG(dev, "no memory for multi-packet tx\n");
+}
+
 static void rx_fill(struct eth_dev *dev, gfp_t gfp_flags)
 {
 	struct usb_request	*req;
@@ -462,11 +528,213 @@ static void eth_work(struct work_struct *work)
 		DBG(dev, "work done, flags = 0x%lx\n", dev->todo);
 }
 
+/*
+ * Multi-packet tx, for framings that can carry several packets in one
+ * transfer.  Frames are copied into the request being filled, which is
+ * sent once full, or right away unless TX_AGGR_IN_FLIGHT transfers are
+ * already queued; then the next completion sends it.  An idle link sees
+ * no added latency, a busy one gets fewer and longer transfers.
+ */
+#define TX_AGGR_IN_FLIGHT	2
+
+/* called with req_lock held */
+static struct usb_request *eth_aggr_take(struct eth_dev *dev)
+{
+	struct usb_request *req = dev->tx_aggr_req;
+
+	dev->tx_aggr_req = NULL;
+	dev->tx_in_flight++;
+	dev->aggr_stats.tx_xfers++;
+	dev->aggr_stats.tx_pkts += dev->tx_aggr_pkts;
+	return req;
+}
+
+static void eth_aggr_queue(struct eth_dev *dev, struct usb_ep *in,
+			   struct usb_request *req)
+{
+	unsigned long flags;
+
+	/* the buffer has room for the pad byte */
+	req->zero = 1;
+	if (!dev->zlp && (req->length % in->maxpacket) == 0)
+		req->length++;
+	req->no_interrupt = 0;
+
+	if (usb_ep_queue(in, req, GFP_ATOMIC) == 0) {
+		dev->net->trans_start = jiffies;
+		return;
+	}
+
+	DBG(dev, "tx queue err\n");
+	dev->net->stats.tx_dropped++;
+	spin_lock_irqsave(&dev->req_lock, flags);
+	if (!dev->tx_buf_size) {
+		/* disconnected meanwhile, the request is ours to free */
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+		kfree(req->buf);
+		usb_ep_free_request(in, req);
+		return;
+	}
+	dev->tx_in_flight--;
+	req->length = 0;
+	list_add(&req->list, &dev->tx_reqs);
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+	if (netif_carrier_ok(dev->net))
+		netif_wake_queue(dev->net);
+}
+
+static void eth_aggr_complete(struct eth_dev *dev, struct usb_ep *in,
+			      struct usb_request *req)
+{
+	struct usb_request *send = NULL;
+
+	switch (req->status) {
+	default:
+		dev->net->stats.tx_errors++;
+		VDBG(dev, "tx err %d\n", req->status);
+		break;
+	case -ECONNRESET:		/* unlink */
+	case -ESHUTDOWN:		/* disconnect etc */
+		break;
+	case 0:
+		break;
+	}
+
+	spin_lock(&dev->req_lock);
+	dev->tx_in_flight--;
+	req->length = 0;
+	list_add(&req->list, &dev->tx_reqs);
+	/* send what was held back waiting for this */
+	if (dev->tx_aggr_req && req->status != -ESHUTDOWN)
+		send = eth_aggr_take(dev);
+	spin_unlock(&dev->req_lock);
+
+	if (send)
+		eth_aggr_queue(dev, in, send);
+
+	if (netif_carrier_ok(dev->net))
+		netif_wake_queue(dev->net);
+}
+
+static netdev_tx_t eth_aggr_xmit(struct eth_dev *dev, struct sk_buff *skb,
+				 struct usb_ep *in)
+{
+	struct usb_request	*req, *full = NULL, *send = NULL;
+	unsigned long		flags;
+	size_t			size, limit;
+	u32			host_max = 0;
+
+	spin_lock_irqsave(&dev->req_lock, flags);
+	size = dev->tx_buf_size;
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+
+	/* room for the frames, less the pad byte */
+	limit = size - 1;
+	if (!size || skb->len + dev->header_len > limit) {
+		dev_kfree_skb_any(skb);
+		goto drop;
+	}
+
+	spin_lock_irqsave(&dev->lock, flags);
+	if (dev->port_usb)
+		host_max = dev->port_usb->dl_max_xfer_size;
+	spin_unlock_irqrestore(&dev->lock, flags);
+	if (host_max && host_max < limit)
+		limit = host_max;
+
+	/*
+	 * Make sure there is somewhere to put the frame before wrapping
+	 * it; the stack hands a busy skb back to us unchanged.
+	 */
+	spin_lock_irqsave(&dev->req_lock, flags);
+	req = dev->tx_aggr_req;
+	if ((!req || req->length + skb->len + dev->header_len > limit) &&
+	    list_empty(&dev->tx_reqs)) {
+		netif_stop_queue(dev->net);
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+		return NETDEV_TX_BUSY;
+	}
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+
+	if (dev->wrap) {
+		spin_lock_irqsave(&dev->lock, flags);
+		if (dev->port_usb)
+			skb = dev->wrap(dev->port_usb, skb);
+		spin_unlock_irqrestore(&dev->lock, flags);
+		if (!skb)
+			goto drop;
+	}
+
+	/*
+	 * gether_disconnect() frees the buffers once it has taken the
+	 * requests off the lists; under req_lock, a buffer size still as
+	 * read above means the link and its requests are still there.
+	 */
+	spin_lock_irqsave(&dev->req_lock, flags);
+	if (dev->tx_buf_size != size || !dev->port_usb) {
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+		dev_kfree_skb_any(skb);
+		goto drop;
+	}
+	req = dev->tx_aggr_req;
+	if (req && req->length + skb->len > limit) {
+		/* no room left: send it, the frame starts another */
+		full = eth_aggr_take(dev);
+		dev->aggr_stats.tx_full++;
+		req = NULL;
+	}
+	if (!req) {
+		if (list_empty(&dev->tx_reqs)) {
+			spin_unlock_irqrestore(&dev->req_lock, flags);
+			dev_kfree_skb_any(skb);
+			if (full)
+				eth_aggr_queue(dev, in, full);
+			goto drop;
+		}
+		req = container_of(dev->tx_reqs.next,
+				struct usb_request, list);
+		list_del(&req->list);
+		dev->tx_aggr_req = req;
+		dev->tx_aggr_pkts = 0;
+	}
+
+	memcpy(req->buf + req->length, skb->data, skb->len);
+	req->length += skb->len;
+	dev->tx_aggr_pkts++;
+	dev->net->stats.tx_packets++;
+	dev->net->stats.tx_bytes += skb->len;
+
+	if (dev->tx_aggr_pkts >= dev->dl_max_pkts ||
+	    dev->tx_in_flight < TX_AGGR_IN_FLIGHT)
+		send = eth_aggr_take(dev);
+
+	/* temporarily stop TX queue when nothing is left to fill */
+	if (list_empty(&dev->tx_reqs) && !dev->tx_aggr_req)
+		netif_stop_queue(dev->net);
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+
+	dev_kfree_skb_any(skb);
+	if (full)
+		eth_aggr_queue(dev, in, full);
+	if (send)
+		eth_aggr_queue(dev, in, send);
+	return NETDEV_TX_OK;
+
+drop:
+	dev->net->stats.tx_dropped++;
+	return NETDEV_TX_OK;
+}
+
 static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	struct sk_buff	*skb = req->context;
 	struct eth_dev	*dev = ep->driver_data;
 
+	if (dev->tx_buf_size) {
+		eth_aggr_complete(dev, ep, req);
+		return;
+	}
+
 	switch (req->status) {
 	default:
 		dev->net->stats.tx_errors++;
@@ -543,6 +811,11 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 	}
 
 	spin_lock_irqsave(&dev->req_lock, flags);
+	if (dev->tx_buf_size) {
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+		return eth_aggr_xmit(dev, skb, in);
+	}
+
 	/*
 	 * this freelist can be empty if an interrupt triggered disconnect()
 	 * and reconfigured the gadget (shutting down this queue) after the
@@ -926,6 +1199,10 @@ struct net_device *gether_connect(struct gether *link)
 		dev->unwrap = link->unwrap;
 		dev->wrap = link->wrap;
 
+		dev->dl_max_pkts = link->dl_max_pkts_per_xfer;
+		if (dev->dl_max_pkts > 1)
+			alloc_tx_buffers(dev, link);
+
 		spin_lock(&dev->lock);
 		dev->port_usb = link;
 		link->ioport = dev;
@@ -970,7 +1247,9 @@ fail0:
 void gether_disconnect(struct gether *link)
 {
 	struct eth_dev		*dev = link->ioport;
-	struct usb_request	*req;
+	struct usb_request	*req, *tmp;
+	LIST_HEAD(tx_reqs);
+	bool			tx_bufs;
 
 	if (!dev)
 		return;
@@ -985,17 +1264,25 @@ void gether_disconnect(struct gether *link)
 	 * and forget about the endpoints.
 	 */
 	usb_ep_disable(link->in_ep);
+	/*
+	 * Take every request off the lists before freeing any buffer, so
+	 * a racing eth_aggr_xmit() finds neither them nor a buffer size.
+	 */
 	spin_lock(&dev->req_lock);
-	while (!list_empty(&dev->tx_reqs)) {
-		req = container_of(dev->tx_reqs.next,
-					struct usb_request, list);
+	if (dev->tx_aggr_req) {
+		list_add(&dev->tx_aggr_req->list, &dev->tx_reqs);
+		dev->tx_aggr_req = NULL;
+	}
+	list_splice_init(&dev->tx_reqs, &tx_reqs);
+	tx_bufs = dev->tx_buf_size != 0;
+	dev->tx_buf_size = 0;
+	spin_unlock(&dev->req_lock);
+	list_for_each_entry_safe(req, tmp, &tx_reqs, list) {
 		list_del(&req->list);
-
-		spin_unlock(&dev->req_lock);
+		if (tx_bufs)
+			kfree(req->buf);
 		usb_ep_free_request(link->in_ep, req);
-		spin_lock(&dev->req_lock);
 	}
-	spin_unlock(&dev->req_lock);
 	link->in_ep->driver_data = NULL;
 	link->in_ep->desc = NULL;
 
@@ -1024,3 +1311,31 @@ void gether_disconnect(struct gether *link)
 	link->ioport = NULL;
 	spin_unlock(&dev->lock);
 }
+
+/**
+ * gether_aggr_stats - report multi-packet transfer counts
+ * @buf: where to write them
+ * @size: room in @buf
+ *
+ * Returns the length written.
+ */
+int gether_aggr_stats(char *buf, int size)
+{
+	struct eth_dev	*dev = the_dev;
+
+	if (!dev)
+		return 0;
+
+	return scnprintf(buf, size,
+			 "tx: %lu transfers %lu packets %lu full\n"
+			 "rx: %lu transfers %lu packets\n",
+			 dev->aggr_stats.tx_xfers, dev->aggr_stats.tx_pkts,
+			 dev->aggr_stats.tx_full, dev->aggr_stats.rx_xfers,
+			 dev->aggr_stats.rx_pkts);
+}
+
+void gether_aggr_stats_clear(void)
+{
+	if (the_dev)
+		memset(&the_dev->aggr_stats, 0, sizeof(the_dev->aggr_stats));
+}
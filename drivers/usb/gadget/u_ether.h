@@ -30,6 +30,12 @@
 
 #include "gadget_chips.h"
 
+/*
+ * Longest OUT transfer carrying several packets.  Its rx skb, shared info
+ * included, then still comes from the 16K slab rather than an order-3
+ * atomic allocation.  A multiple of any bulk maxpacket.
+ */
+#define GETHER_MAX_OUT_XFER_SIZE	(SKB_MAX_ORDER(NET_IP_ALIGN, 2) & ~511)
 
 /*
  * This represents the USB side of an "ethernet" link, managed by a USB
@@ -62,6 +68,13 @@ struct gether {
 	bool				is_fixed;
 	u32				fixed_out_len;
 	u32				fixed_in_len;
+
+	/* packets per transfer when the framing allows several, else 0 */
+	unsigned			ul_max_pkts_per_xfer;
+	unsigned			dl_max_pkts_per_xfer;
+	/* longest transfer the host takes, 0 if it sets no limit */
+	u32				dl_max_xfer_size;
+
 	struct sk_buff			*(*wrap)(struct gether *port,
 						struct sk_buff *skb);
 	int				(*unwrap)(struct gether *port,
@@ -90,6 +103,10 @@ int gether_setup_name(struct usb_gadget *g, u8 ethaddr[ETH_ALEN],
 struct net_device *gether_connect(struct gether *);
 void gether_disconnect(struct gether *);
 
+/* multi-packet transfer counts, for sysfs */
+int gether_aggr_stats(char *buf, int size);
+void gether_aggr_stats_clear(void);
+
 /* Some controllers can't support CDC Ethernet (ECM) ... */
 static inline bool can_support_ecm(struct usb_gadget *gadget)
 {
@@ -113,6 +130,10 @@ int eem_bind_config(struct usb_configuration *c);
 
 int rndis_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN],
 				u32 vendorID, const char *manufacturer);
+int rndis_bind_config_multi(struct usb_configuration *c,
+				u8 ethaddr[ETH_ALEN], u32 vendorID,
+				const char *manufacturer,
+				unsigned ul_max_pkts, unsigned dl_max_pkts);
 
 #else
 
@@ -123,6 +144,14 @@ rndis_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN],
 	return 0;
 }
 
+static inline int
+rndis_bind_config_multi(struct usb_configuration *c, u8 ethaddr[ETH_ALEN],
+				u32 vendorID, const char *manufacturer,
+				unsigned ul_max_pkts, unsigned dl_max_pkts)
+{
+	return 0;
+}
+
 #endif
 
 #endif /* __U_ETHER_H */
@@ -1405,6 +1405,7 @@ void mdp_pipe_kickoff(uint32 term, struct msm_fb_data_type *mfd)
 		}
 		/* DMA update timestamp */
 		mdp_dma2_last_update_time = ktime_get_real();
+		mdp_frame_timing_mark(MDP_FRAME_DMA_START);
 		/* let's turn on DMA2 block */
 #ifdef CONFIG_FB_MSM_MDP22
 		outpdw(MDP_CMD_DEBUG_ACCESS_BASE + 0x0044, 0x0);/* start DMA */
@@ -1737,11 +1738,16 @@ irqreturn_t mdp_isr(int irq, void *ptr)
 		if (mdp_interrupt & LCDC_FRAME_START) {
 			dma = &dma2_data;
 			spin_lock_irqsave(&mdp_spin_lock, flag);
-			/* let's disable LCDC interrupt */
-			mdp_intr_mask &= ~LCDC_FRAME_START;
-			outp32(MDP_INTR_ENABLE, mdp_intr_mask);
+			if (mdp_vsync_event_needs_irq()) {
+				mdp_vsync_event(ktime_get());
+			} else {
+				/* let's disable LCDC interrupt */
+				mdp_intr_mask &= ~LCDC_FRAME_START;
+				outp32(MDP_INTR_ENABLE, mdp_intr_mask);
+			}
 			if (dma->waiting) {
 				dma->waiting = FALSE;
+				mdp_frame_timing_mark(MDP_FRAME_DMA_DONE);
 				complete(&dma->comp);
 			}
 			spin_unlock_irqrestore(&mdp_spin_lock, flag);
@@ -1770,6 +1776,8 @@ irqreturn_t mdp_isr(int irq, void *ptr)
 	if (mdp_interrupt & MDP_DMA_P_DONE) {
 		struct timeval now;
 
+		mdp_frame_timing_mark(MDP_FRAME_DMA_DONE);
+
 		mdp_dma2_last_update_time = ktime_sub(ktime_get_real(),
 			mdp_dma2_last_update_time);
 		if (mdp_debug[MDP_DMA2_BLOCK]) {
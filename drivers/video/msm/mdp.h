@@ -182,6 +182,20 @@ struct mdp_dirty_region {
 	__u32 height;		/* number of pixels in the y-axis */
 };
 
+/* Most DMA transfers a single pan is split into */
+#define MDP_MAX_DMA_WINDOWS 4
+
+struct mdp_dma_stat {
+	unsigned long frames;
+	unsigned long partial;		/* Frames sent as partial updates */
+	unsigned long windows;		/* DMA windows sent */
+	unsigned long regions;		/* Dirty regions before merging */
+	u64 bytes;			/* Bytes pushed to the panel */
+	u64 full_bytes;			/* Bytes full updates would have taken */
+	u32 last_bytes;
+	u32 max_bytes;
+};
+
 /*
  * MDP extended data types
  */
@@ -212,6 +226,10 @@ typedef struct mdp_ibuf_s {
 	uint32 dma_h;
 
 	uint32 vsync_enable;
+
+	/* Panel windows making up a partial update, see mdp_dma.c */
+	struct mdp_dirty_region win[MDP_MAX_DMA_WINDOWS];
+	int win_cnt;
 } MDPIBUF;
 
 struct mdp_dma_data {
@@ -288,6 +306,7 @@ extern struct mdp_hist_mgmt *mdp_hist_mgmt_array[];
 #define MDP_HISTOGRAM_TERM_DMA_S 0x200
 #define MDP_HISTOGRAM_TERM_VG_1 0x400
 #define MDP_HISTOGRAM_TERM_VG_2 0x800
+#define MDP_VSYNC_TERM 0x1000
 
 #define ACTIVE_START_X_EN BIT(31)
 #define ACTIVE_START_Y_EN BIT(31)
@@ -714,9 +733,50 @@ void mdp_pipe_ctrl(MDP_BLOCK_TYPE block, MDP_BLOCK_POWER_STATE state,
 		   boolean isr);
 void mdp_set_dma_pan_info(struct fb_info *info, struct mdp_dirty_region *dirty,
 			  boolean sync);
+/* Vsync events and frame timing, see mdp_vsync.c */
+enum {
+	MDP_FRAME_PAN,
+	MDP_FRAME_DMA_START,
+	MDP_FRAME_DMA_DONE,
+	MDP_FRAME_MAX,
+};
+
+struct seq_file;
+void mdp_vsync_event_init(struct msm_fb_data_type *mfd);
+void mdp_vsync_event(ktime_t t);
+int mdp_vsync_event_needs_irq(void);
+void mdp_vsync_event_panel_on(void);
+void mdp_frame_timing_mark(int stage);
+int mdp_frame_timing_show(struct seq_file *s, void *unused);
+
+void mdp_set_dma_pan_regions(struct fb_info *info,
+	struct mdp_dirty_region *dirty, int cnt, boolean sync);
+extern struct mdp_dma_stat mdp_dma_stat;
+extern int mdp_dma_window_cost;
 void mdp_dma_pan_update(struct fb_info *info);
 void mdp_refresh_screen(unsigned long data);
 int mdp_ppp_blit(struct fb_info *info, struct mdp_blit_req *req);
+
+/* Memory backing the source or destination of a blit request */
+struct mdp_blit_img {
+	unsigned long start;	/* Physical address */
+	unsigned long len;
+	void *vstart;		/* Kernel virtual address, NULL if unmapped */
+	struct file *file;	/* pmem file reference, NULL if none held */
+};
+
+int mdp_ppp_get_blit_img(struct fb_info *info, struct mdp_img *img,
+	int gem, struct mdp_blit_img *bimg);
+void mdp_ppp_put_blit_img(struct mdp_blit_img *bimg);
+int mdp_ppp_blit_img(struct fb_info *info, struct mdp_blit_req *req,
+	struct mdp_blit_img *src, struct mdp_blit_img *dst);
+int mdp_blit_resolved(struct fb_info *info, struct mdp_blit_req *req,
+	struct mdp_blit_img *src, struct mdp_blit_img *dst);
+int mdp_ppp_blit_supported(struct fb_info *info, struct mdp_blit_req *req);
+#ifdef CONFIG_FB_MSM_MDP_PPP_SW
+int mdp_ppp_sw_blit(struct fb_info *info, struct mdp_blit_req *req,
+	struct mdp_blit_img *src, struct mdp_blit_img *dst);
+#endif
 void mdp_lcd_update_workqueue_handler(struct work_struct *work);
 void mdp_vsync_resync_workqueue_handler(struct work_struct *work);
 void mdp_dma2_update(struct msm_fb_data_type *mfd);
@@ -23,6 +23,8 @@
 #include <linux/debugfs.h>
 #include <linux/semaphore.h>
 #include <linux/uaccess.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
 #include <asm/system.h>
 #include <asm/mach-types.h>
 #include <mach/hardware.h>
@@ -527,6 +529,91 @@ static const struct file_operations mdp_stat_fops = {
 };
 #endif
 
+static int mdp_dma_stat_open(struct inode *inode, struct file *file)
+{
+	/* non-seekable */
+	file->f_mode &= ~(FMODE_LSEEK | FMODE_PREAD | FMODE_PWRITE);
+	return 0;
+}
+
+static int mdp_dma_stat_release(struct inode *inode, struct file *file)
+{
+	return 0;
+}
+
+static ssize_t mdp_dma_stat_write(
+	struct file *file,
+	const char __user *buff,
+	size_t count,
+	loff_t *ppos)
+{
+	unsigned long flag;
+
+	spin_lock_irqsave(&mdp_spin_lock, flag);
+	memset(&mdp_dma_stat, 0, sizeof(mdp_dma_stat));	/* reset */
+	spin_unlock_irqrestore(&mdp_spin_lock, flag);
+
+	return count;
+}
+
+static ssize_t mdp_dma_stat_read(
+	struct file *file,
+	char __user *buff,
+	size_t count,
+	loff_t *ppos)
+{
+	struct mdp_dma_stat st;
+	unsigned long flag;
+	int tot;
+
+	if (*ppos)
+		return 0;	/* the end */
+
+	spin_lock_irqsave(&mdp_spin_lock, flag);
+	st = mdp_dma_stat;
+	spin_unlock_irqrestore(&mdp_spin_lock, flag);
+
+	tot = snprintf(debug_buf, sizeof(debug_buf),
+		"frames: %lu\tpartial: %lu\n"
+		"regions: %lu\twindows: %lu\twindow_cost: %d\n"
+		"bytes: %llu\tfull_bytes: %llu\n"
+		"last_bytes: %u\tmax_bytes: %u\tavg_bytes: %llu\n",
+		st.frames, st.partial, st.regions, st.windows,
+		mdp_dma_window_cost, st.bytes, st.full_bytes,
+		st.last_bytes, st.max_bytes,
+		st.frames ? div_u64(st.bytes, st.frames) : 0ULL);
+
+	if (tot >= sizeof(debug_buf))
+		tot = sizeof(debug_buf) - 1;
+	if (tot > count)
+		tot = count;
+	if (copy_to_user(buff, debug_buf, tot))
+		return -EFAULT;
+
+	*ppos += tot;	/* increase offset */
+
+	return tot;
+}
+
+static int mdp_frame_timing_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mdp_frame_timing_show, NULL);
+}
+
+static const struct file_operations mdp_frame_timing_fops = {
+	.open = mdp_frame_timing_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static const struct file_operations mdp_dma_stat_fops = {
+	.open = mdp_dma_stat_open,
+	.release = mdp_dma_stat_release,
+	.read = mdp_dma_stat_read,
+	.write = mdp_dma_stat_write,
+};
+
 /*
  * MDDI
  *
@@ -1296,6 +1383,23 @@ int mdp_debugfs_init(void)
 	}
 #endif
 
+	if (debugfs_create_file("dma_stat", 0644, dent, 0, &mdp_dma_stat_fops)
+			== NULL) {
+		printk(KERN_ERR "%s(%d): debugfs_create_file: debug fail\n",
+			__FILE__, __LINE__);
+		return -1;
+	}
+
+	if (debugfs_create_file("frame_timing", 0444, dent, 0,
+			&mdp_frame_timing_fops) == NULL) {
+		printk(KERN_ERR "%s(%d): debugfs_create_file: debug fail\n",
+			__FILE__, __LINE__);
+		return -1;
+	}
+
+	debugfs_create_u32("dma_window_cost", 0644, dent,
+		(u32 *)&mdp_dma_window_cost);
+
 	dent = debugfs_create_dir("mddi", NULL);
 
 	if (IS_ERR(dent)) {
@@ -51,6 +51,14 @@ extern struct workqueue_struct *mdp_dma_wq;
 
 int vsync_start_y_adjust = 4;
 
+/*
+ * Setup cost of an extra DMA window, in pixels.  Two windows are merged
+ * into their bounding box whenever that transfers fewer extra pixels.
+ */
+int mdp_dma_window_cost = 4096;
+
+struct mdp_dma_stat mdp_dma_stat;
+
 static void mdp_dma2_update_lcd(struct msm_fb_data_type *mfd)
 {
 	MDPIBUF *iBuf = &mfd->ibuf;
@@ -542,13 +550,110 @@ void mdp_lcd_update_workqueue_handler(struct work_struct *work)
 		mfd->dma_fnc(mfd);
 }
 
-void mdp_set_dma_pan_info(struct fb_info *info, struct mdp_dirty_region *dirty,
-			  boolean sync)
+static u32 mdp_dirty_area(struct mdp_dirty_region *r)
+{
+	return r->width * r->height;
+}
+
+static void mdp_dirty_union(struct mdp_dirty_region *a,
+	struct mdp_dirty_region *b, struct mdp_dirty_region *u)
+{
+	u32 x0 = min(a->xoffset, b->xoffset);
+	u32 y0 = min(a->yoffset, b->yoffset);
+	u32 x1 = max(a->xoffset + a->width, b->xoffset + b->width);
+	u32 y1 = max(a->yoffset + a->height, b->yoffset + b->height);
+
+	u->xoffset = x0;
+	u->yoffset = y0;
+	u->width = x1 - x0;
+	u->height = y1 - y0;
+}
+
+/*
+ * Greedily merge the pair of regions whose bounding box wastes the least,
+ * until no merge is cheaper than an extra DMA window and the regions fit
+ * in MDP_MAX_DMA_WINDOWS.  Overlapping regions always end up merged.
+ * Returns the new number of regions.
+ */
+static int mdp_dirty_merge(struct mdp_dirty_region *r, int cnt)
+{
+	while (cnt > 1) {
+		struct mdp_dirty_region u;
+		int i, j, bi = 0, bj = 1;
+		s64 best = LLONG_MAX;
+
+		for (i = 0; i < cnt; i++) {
+			for (j = i + 1; j < cnt; j++) {
+				s64 waste;
+
+				mdp_dirty_union(&r[i], &r[j], &u);
+				waste = (s64)mdp_dirty_area(&u) -
+					mdp_dirty_area(&r[i]) -
+					mdp_dirty_area(&r[j]);
+				if (waste < best) {
+					best = waste;
+					bi = i;
+					bj = j;
+				}
+			}
+		}
+
+		if (cnt <= MDP_MAX_DMA_WINDOWS && best > mdp_dma_window_cost)
+			break;
+
+		mdp_dirty_union(&r[bi], &r[bj], &r[bi]);
+		r[bj] = r[--cnt];
+	}
+
+	return cnt;
+}
+
+/*
+ * mdp_set_dma_pan_regions - set up the next pan for a list of dirty regions
+ *
+ * The regions are merged into at most MDP_MAX_DMA_WINDOWS DMA windows.
+ * ibuf.dma_x/y/w/h is left covering all of them for the update paths that
+ * only deal in one window.  A count of zero updates the whole screen.
+ */
+void mdp_set_dma_pan_regions(struct fb_info *info,
+	struct mdp_dirty_region *dirty, int cnt, boolean sync)
 {
 	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
 	struct fb_info *fbi = mfd->fbi;
+	struct mdp_dirty_region r[MSMFB_MAX_DIRTY_REGIONS];
 	MDPIBUF *iBuf;
 	int bpp = info->var.bits_per_pixel / 8;
+	int i;
+
+	if (cnt > MSMFB_MAX_DIRTY_REGIONS)
+		cnt = 0;
+
+	for (i = 0; i < cnt; i++) {
+		/*
+		 * ToDo: dirty region check inside var.xoffset+xres
+		 * <-> var.yoffset+yres
+		 */
+		r[i].xoffset = dirty[i].xoffset % info->var.xres;
+		r[i].yoffset = dirty[i].yoffset % info->var.yres;
+		r[i].width = dirty[i].width;
+		r[i].height = dirty[i].height;
+	}
+
+	if (cnt == 0) {
+		r[0].xoffset = 0;
+		r[0].yoffset = 0;
+		r[0].width = info->var.xres;
+		r[0].height = info->var.yres;
+		cnt = 1;
+	} else {
+		unsigned long flag;
+
+		spin_lock_irqsave(&mdp_spin_lock, flag);
+		mdp_dma_stat.regions += cnt;
+		spin_unlock_irqrestore(&mdp_spin_lock, flag);
+	}
+
+	cnt = mdp_dirty_merge(r, cnt);
 
 	down(&mfd->sem);
 
@@ -566,32 +671,115 @@ void mdp_set_dma_pan_info(struct fb_info *info, struct mdp_dirty_region *dirty,
 
 	iBuf->vsync_enable = sync;
 
-	if (dirty) {
-		/*
-		 * ToDo: dirty region check inside var.xoffset+xres
-		 * <-> var.yoffset+yres
-		 */
-		iBuf->dma_x = dirty->xoffset % info->var.xres;
-		iBuf->dma_y = dirty->yoffset % info->var.yres;
-		iBuf->dma_w = dirty->width;
-		iBuf->dma_h = dirty->height;
-	} else {
-		iBuf->dma_x = 0;
-		iBuf->dma_y = 0;
-		iBuf->dma_w = info->var.xres;
-		iBuf->dma_h = info->var.yres;
-	}
+	memcpy(iBuf->win, r, cnt * sizeof(r[0]));
+	iBuf->win_cnt = cnt;
+
+	for (i = 1; i < cnt; i++)
+		mdp_dirty_union(&r[0], &r[i], &r[0]);
+
+	iBuf->dma_x = r[0].xoffset;
+	iBuf->dma_y = r[0].yoffset;
+	iBuf->dma_w = r[0].width;
+	iBuf->dma_h = r[0].height;
+
 	mfd->ibuf_flushed = FALSE;
 	up(&mfd->sem);
 }
 
+void mdp_set_dma_pan_info(struct fb_info *info, struct mdp_dirty_region *dirty,
+			  boolean sync)
+{
+	mdp_set_dma_pan_regions(info, dirty, dirty ? 1 : 0, sync);
+}
+
+/* Whether the panel is updated through DMA windows smaller than a frame */
+static boolean mdp_dma_partial_capable(struct msm_fb_data_type *mfd)
+{
+	if (mfd->dma_fnc != mdp_dma2_update)
+		return FALSE;
+#ifdef CONFIG_FB_MSM_MDP303
+	/* Command mode DSI always transfers the full panel */
+	if (mfd->panel_info.type == MIPI_CMD_PANEL)
+		return FALSE;
+#endif
+	return TRUE;
+}
+
+static void mdp_dma_account(struct msm_fb_data_type *mfd, u32 pixels,
+	u32 windows)
+{
+	MDPIBUF *iBuf = &mfd->ibuf;
+	u32 full = mfd->panel_info.xres * mfd->panel_info.yres * iBuf->bpp;
+	u32 bytes = pixels * iBuf->bpp;
+	unsigned long flag;
+
+	spin_lock_irqsave(&mdp_spin_lock, flag);
+	mdp_dma_stat.frames++;
+	mdp_dma_stat.windows += windows;
+	if (bytes < full)
+		mdp_dma_stat.partial++;
+	mdp_dma_stat.bytes += bytes;
+	mdp_dma_stat.full_bytes += full;
+	mdp_dma_stat.last_bytes = bytes;
+	if (bytes > mdp_dma_stat.max_bytes)
+		mdp_dma_stat.max_bytes = bytes;
+	spin_unlock_irqrestore(&mdp_spin_lock, flag);
+}
+
 void mdp_dma_pan_update(struct fb_info *info)
 {
 	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
 	MDPIBUF *iBuf;
+	int i;
 
 	iBuf = &mfd->ibuf;
 
+	if (!mdp_dma_partial_capable(mfd)) {
+		mdp_dma_account(mfd, mfd->panel_info.xres *
+			mfd->panel_info.yres, 0);
+	} else if (mfd->sw_currently_refreshing || iBuf->win_cnt <= 1) {
+		mdp_dma_account(mfd, iBuf->dma_w * iBuf->dma_h, 1);
+	} else {
+		u32 pixels = 0;
+		int32 dma_x, dma_y;
+		uint32 dma_w, dma_h, vsync_enable;
+
+		down(&mfd->sem);
+		dma_x = iBuf->dma_x;
+		dma_y = iBuf->dma_y;
+		dma_w = iBuf->dma_w;
+		dma_h = iBuf->dma_h;
+		vsync_enable = iBuf->vsync_enable;
+		up(&mfd->sem);
+
+		/* Push each window in turn, only the first one waits */
+		for (i = 0; i < iBuf->win_cnt; i++) {
+			down(&mfd->sem);
+			iBuf->dma_x = iBuf->win[i].xoffset;
+			iBuf->dma_y = iBuf->win[i].yoffset;
+			iBuf->dma_w = iBuf->win[i].width;
+			iBuf->dma_h = iBuf->win[i].height;
+			if (i)
+				iBuf->vsync_enable = FALSE;
+			up(&mfd->sem);
+
+			mfd->dma_fnc(mfd);
+			pixels += iBuf->win[i].width * iBuf->win[i].height;
+		}
+
+		/* Leave ibuf covering all the windows, as it was set up */
+		down(&mfd->sem);
+		iBuf->dma_x = dma_x;
+		iBuf->dma_y = dma_y;
+		iBuf->dma_w = dma_w;
+		iBuf->dma_h = dma_h;
+		iBuf->vsync_enable = vsync_enable;
+		up(&mfd->sem);
+
+		mdp_dma_account(mfd, pixels, iBuf->win_cnt);
+		return;
+	}
+
 	if (mfd->sw_currently_refreshing) {
 		/* we need to wait for the pending update */
 		mfd->pan_waiting = TRUE;
@@ -211,6 +211,7 @@ int mdp_dsi_video_on(struct platform_device *pdev)
 		MDP_OUTP(MDP_BASE + DSI_VIDEO_BASE, 1);
 		/*Turning on DMA_P block*/
 		mdp_pipe_ctrl(MDP_DMA2_BLOCK, MDP_BLOCK_POWER_ON, FALSE);
+		mdp_vsync_event_panel_on();
 	}
 
 	/* MDP cmd block disable */
@@ -258,6 +259,7 @@ void mdp_dsi_video_update(struct msm_fb_data_type *mfd)
 	/* no need to power on cmd block since it's dsi mode */
 	/* starting address */
 	MDP_OUTP(MDP_BASE + DMA_P_BASE + 0x8, (uint32) buf);
+	mdp_frame_timing_mark(MDP_FRAME_DMA_START);
 	/* enable  irq */
 	spin_lock_irqsave(&mdp_spin_lock, flag);
 	mdp_enable_irq(irq_block);
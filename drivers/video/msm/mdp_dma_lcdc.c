@@ -285,6 +285,7 @@ int mdp_lcdc_on(struct platform_device *pdev)
 		/* enable LCDC block */
 		MDP_OUTP(MDP_BASE + timer_base, 1);
 		mdp_pipe_ctrl(block, MDP_BLOCK_POWER_ON, FALSE);
+		mdp_vsync_event_panel_on();
 	}
 	/* MDP cmd block disable */
 	mdp_pipe_ctrl(MDP_CMD_BLOCK, MDP_BLOCK_POWER_OFF, FALSE);
@@ -364,6 +365,7 @@ void mdp_lcdc_update(struct msm_fb_data_type *mfd)
 
 	/* starting address */
 	MDP_OUTP(MDP_BASE + dma_base + 0x8, (uint32) buf);
+	mdp_frame_timing_mark(MDP_FRAME_DMA_START);
 
 	/* enable LCDC irq */
 	spin_lock_irqsave(&mdp_spin_lock, flag);
@@ -1172,20 +1172,26 @@ struct mdp_blit_req *req, struct file *p_src_file, struct file *p_dst_file)
 	mdp_pipe_kickoff(MDP_PPP_TERM, mfd);
 }
 
-static int mdp_ppp_verify_req(struct mdp_blit_req *req)
+/* The probe from the blit queue checks requests quietly */
+#define mdp_ppp_verify_err(verbose)					\
+	do {								\
+		if (verbose)						\
+			printk(KERN_ERR "\n%s(): Error in Line %u",	\
+				__func__, __LINE__);			\
+	} while (0)
+
+static int __mdp_ppp_verify_req(struct mdp_blit_req *req, int verbose)
 {
 	u32 src_width, src_height, dst_width, dst_height;
 
 	if (req == NULL) {
-		printk(KERN_ERR "\n%s(): Error in Line %u", __func__,
-			__LINE__);
+		mdp_ppp_verify_err(verbose);
 		return -1;
 	}
 
 	if (MDP_IS_IMGTYPE_BAD(req->src.format) ||
 	    MDP_IS_IMGTYPE_BAD(req->dst.format)) {
-		printk(KERN_ERR "\n%s(): Error in Line %u", __func__,
-			__LINE__);
+		mdp_ppp_verify_err(verbose);
 		return -1;
 	}
 
@@ -1193,23 +1199,19 @@ static int mdp_ppp_verify_req(struct mdp_blit_req *req)
 	    (req->src_rect.w == 0) || (req->src_rect.h == 0) ||
 	    (req->dst.width == 0) || (req->dst.height == 0) ||
 	    (req->dst_rect.w == 0) || (req->dst_rect.h == 0)) {
-		printk(KERN_ERR "\n%s(): Error in Line %u", __func__,
-			__LINE__);
-
+		mdp_ppp_verify_err(verbose);
 		return -1;
 	}
 
 	if (((req->src_rect.x + req->src_rect.w) > req->src.width) ||
 	    ((req->src_rect.y + req->src_rect.h) > req->src.height)) {
-		printk(KERN_ERR "\n%s(): Error in Line %u", __func__,
-			__LINE__);
+		mdp_ppp_verify_err(verbose);
 		return -1;
 	}
 
 	if (((req->dst_rect.x + req->dst_rect.w) > req->dst.width) ||
 	    ((req->dst_rect.y + req->dst_rect.h) > req->dst.height)) {
-		printk(KERN_ERR "\n%s(): Error in Line %u", __func__,
-			__LINE__);
+		mdp_ppp_verify_err(verbose);
 		return -1;
 	}
 
@@ -1251,8 +1253,7 @@ static int mdp_ppp_verify_req(struct mdp_blit_req *req)
 	     MDP_MAX_X_SCALE_FACTOR)
 	    || ((MDP_SCALE_Q_FACTOR * dst_width) / src_width <
 		MDP_MIN_X_SCALE_FACTOR)) {
-		printk(KERN_ERR "\n%s(): Error in Line %u", __func__,
-			__LINE__);
+		mdp_ppp_verify_err(verbose);
 		return -1;
 	}
 
@@ -1260,13 +1261,17 @@ static int mdp_ppp_verify_req(struct mdp_blit_req *req)
 	     MDP_MAX_Y_SCALE_FACTOR)
 	    || ((MDP_SCALE_Q_FACTOR * dst_height) / src_height <
 		MDP_MIN_Y_SCALE_FACTOR)) {
-		printk(KERN_ERR "\n%s(): Error in Line %u", __func__,
-			__LINE__);
+		mdp_ppp_verify_err(verbose);
 		return -1;
 	}
 	return 0;
 }
 
+static int mdp_ppp_verify_req(struct mdp_blit_req *req)
+{
+	return __mdp_ppp_verify_req(req, 1);
+}
+
 int get_gem_img(struct mdp_img *img, unsigned long *start, unsigned long *len)
 {
 	/* Set len to zero to appropriately error out if
@@ -1314,7 +1319,7 @@ void put_img(struct file *p_src_file)
 }
 
 
-static int mdp_ppp_blit_addr(struct fb_info *info, struct mdp_blit_req *req,
+static int mdp_ppp_do_blit(struct fb_info *info, struct mdp_blit_req *req,
 	unsigned long srcp0_start, unsigned long srcp0_len,
 	unsigned long srcp1_start, unsigned long srcp1_len,
 	unsigned long dst_start, unsigned long dst_len,
@@ -1331,8 +1336,6 @@ static int mdp_ppp_blit_addr(struct fb_info *info, struct mdp_blit_req *req,
 
 	if (mdp_ppp_verify_req(req)) {
 		printk(KERN_ERR "mdp_ppp: invalid image!\n");
-		put_img(p_src_file);
-		put_img(p_dst_file);
 		return -1;
 	}
 
@@ -1402,8 +1405,6 @@ static int mdp_ppp_blit_addr(struct fb_info *info, struct mdp_blit_req *req,
 #if defined(CONFIG_FB_MSM_MDP31) || defined(CONFIG_FB_MSM_MDP303)
 		iBuf.mdpImg.mdpOp |= MDPOP_FG_PM_ALPHA;
 #else
-		put_img(p_src_file);
-		put_img(p_dst_file);
 		return -EINVAL;
 #endif
 	}
@@ -1413,8 +1414,6 @@ static int mdp_ppp_blit_addr(struct fb_info *info, struct mdp_blit_req *req,
 		if ((req->src.format != MDP_Y_CBCR_H2V2) &&
 			(req->src.format != MDP_Y_CRCB_H2V2)) {
 #endif
-			put_img(p_src_file);
-			put_img(p_dst_file);
 			return -EINVAL;
 #ifdef CONFIG_FB_MSM_MDP31
 		}
@@ -1453,16 +1452,12 @@ static int mdp_ppp_blit_addr(struct fb_info *info, struct mdp_blit_req *req,
 			printk(KERN_ERR
 				"%s: sharpening strength out of range\n",
 				__func__);
-			put_img(p_src_file);
-			put_img(p_dst_file);
 			return -EINVAL;
 		}
 
 		iBuf.mdpImg.mdpOp |= MDPOP_ASCALE | MDPOP_SHARPENING;
 		iBuf.mdpImg.sp_value = req->sharpening_strength & 0xff;
 #else
-		put_img(p_src_file);
-		put_img(p_dst_file);
 		return -EINVAL;
 #endif
 	}
@@ -1567,9 +1562,24 @@ static int mdp_ppp_blit_addr(struct fb_info *info, struct mdp_blit_req *req,
 	mdp_pipe_ctrl(MDP_CMD_BLOCK, MDP_BLOCK_POWER_OFF, FALSE);
 	up(&mdp_ppp_mutex);
 
+	return 0;
+}
+
+/* As mdp_ppp_do_blit, dropping the image references when done */
+static int mdp_ppp_blit_addr(struct fb_info *info, struct mdp_blit_req *req,
+	unsigned long srcp0_start, unsigned long srcp0_len,
+	unsigned long srcp1_start, unsigned long srcp1_len,
+	unsigned long dst_start, unsigned long dst_len,
+	struct file *p_src_file, struct file *p_dst_file)
+{
+	int ret;
+
+	ret = mdp_ppp_do_blit(info, req, srcp0_start, srcp0_len, srcp1_start,
+		srcp1_len, dst_start, dst_len, p_src_file, p_dst_file);
+
 	put_img(p_src_file);
 	put_img(p_dst_file);
-	return 0;
+	return ret;
 }
 
 int mdp_ppp_blit(struct fb_info *info, struct mdp_blit_req *req)
@@ -1603,6 +1613,75 @@ int mdp_ppp_blit(struct fb_info *info, struct mdp_blit_req *req)
 		dst_len, p_src_file, p_dst_file);
 }
 
+/*
+ * Resolve the memory behind a blit image while still in the context of the
+ * process that owns the file descriptor, so the request can be executed
+ * later from another context.  Any pmem file reference taken here is held
+ * until mdp_ppp_put_blit_img() drops it.
+ */
+int mdp_ppp_get_blit_img(struct fb_info *info, struct mdp_img *img,
+	int gem, struct mdp_blit_img *bimg)
+{
+	memset(bimg, 0, sizeof(*bimg));
+
+	if (gem) {
+		get_gem_img(img, &bimg->start, &bimg->len);
+		return bimg->len ? 0 : -EINVAL;
+	}
+
+#ifdef CONFIG_ANDROID_PMEM
+	{
+		unsigned long vstart;
+
+		if (!get_pmem_file(img->memory_id, &bimg->start, &vstart,
+				&bimg->len, &bimg->file)) {
+			bimg->vstart = (void *) vstart;
+			return 0;
+		}
+	}
+#endif
+
+	if (get_img(img, info, &bimg->start, &bimg->len, &bimg->file))
+		return -EINVAL;
+
+	/* Only the framebuffer itself gets this far - no reference held */
+	bimg->file = NULL;
+	bimg->vstart = info->screen_base;
+
+	return bimg->len ? 0 : -EINVAL;
+}
+
+void mdp_ppp_put_blit_img(struct mdp_blit_img *bimg)
+{
+	put_img(bimg->file);
+	bimg->file = NULL;
+}
+
+/*
+ * One PPP pass using images resolved by mdp_ppp_get_blit_img.  The
+ * references are kept, a split request makes several passes over them.
+ */
+int mdp_ppp_blit_img(struct fb_info *info, struct mdp_blit_req *req,
+	struct mdp_blit_img *src, struct mdp_blit_img *dst)
+{
+	return mdp_ppp_do_blit(info, req, src->start, src->len, 0, 0,
+		dst->start, dst->len, src->file, dst->file);
+}
+
+/* Check whether the PPP can take a request without touching the hardware */
+int mdp_ppp_blit_supported(struct fb_info *info, struct mdp_blit_req *req)
+{
+	struct msm_fb_data_type *mfd = info->par;
+	struct mdp_blit_req r = *req;
+
+	if (r.src.format == MDP_FB_FORMAT)
+		r.src.format = mfd->fb_imgType;
+	if (r.dst.format == MDP_FB_FORMAT)
+		r.dst.format = mfd->fb_imgType;
+
+	return __mdp_ppp_verify_req(&r, 0) == 0;
+}
+
 static struct mdp_blit_req overlay_req;
 static bool mdp_overlay_req_set;
 
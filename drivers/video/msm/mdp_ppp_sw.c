@@ -0,0 +1,1129 @@
+/* Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * CPU implementation of the PPP blit.  Follows the mdp_blit_req semantics:
+ * packed RGB and pseudo planar YCbCr sources, packed RGB destinations,
+ * MDP_ROT_90 and flips, scaling through the same 4 tap polyphase filters
+ * the PPP is loaded with (mdp_scale_tables.c), constant and per pixel alpha
+ * blending and colour keying.
+ *
+ * The kernel can't use NEON on this tree, so the work is organised to keep
+ * the scalar code cheap instead: whole lines are converted to a common
+ * ARGB8888 form with per-format loops (RGB565 two pixels per load), the
+ * horizontal filter positions are computed once per blit, horizontally
+ * scaled lines are cached in a four line ring so each source line is
+ * filtered once, and unscaled blits skip the filters entirely.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/fb.h>
+#include <linux/msm_mdp.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+#include "msm_fb.h"
+#include "mdp.h"
+#include "mdp_scale_tables.h"
+
+#define SW_MAX_WIDTH		4096
+#define SW_MAX_HEIGHT		4096
+#define SW_PHASES		32
+#define SW_TAPS			4
+
+/* Decoded filter: coefficients in Q9 for pixels -1, 0, +1, +2 */
+struct sw_filter {
+	s16 c[SW_PHASES][SW_TAPS];
+};
+
+enum {
+	SW_FILTER_UP,
+	SW_FILTER_PT2TOPT4,
+	SW_FILTER_PT4TOPT6,
+	SW_FILTER_PT6TOPT8,
+	SW_FILTER_PT8TO1,
+	SW_FILTER_BLUR,
+	SW_FILTER_MAX,
+};
+
+static struct sw_filter sw_filters_x[SW_FILTER_MAX];
+static struct sw_filter sw_filters_y[SW_FILTER_MAX];
+static int sw_filters_ready;
+
+struct sw_fmt {
+	int bpp;	/* Bytes per pixel of the (luma) plane */
+	int yuv;	/* Pseudo planar YCbCr */
+	int vshift;	/* Vertical chroma subsampling */
+	int crcb;	/* Chroma pairs are stored Cr first */
+	int alpha;	/* Format carries per pixel alpha */
+};
+
+struct sw_img {
+	uint32_t format;
+	struct sw_fmt fmt;
+	u8 *base;	/* First pixel of the image */
+	u8 *chroma;	/* Chroma plane for YCbCr images */
+	int width;
+	int stride;	/* Bytes per line of the (luma) plane */
+};
+
+struct sw_csc {
+	int m[9];
+	int bv[3];
+};
+
+struct sw_ctx {
+	struct sw_img src;
+	struct sw_img dst;
+	struct mdp_rect src_rect;
+	struct mdp_rect dst_rect;
+	struct sw_csc csc;
+
+	int rot90, flip_lr, flip_ud;
+	int vw, vh;		/* Source size after rotation */
+
+	int blend;		/* Destination has to be read back */
+	int premult;
+	int alpha;		/* Constant alpha, 255 for none */
+	int transp;
+	u32 transp_key;		/* Colour key in ARGB8888 */
+
+	const struct sw_filter *fx, *fy;
+	int hscale, vscale;
+};
+
+static int sw_get_fmt(uint32_t format, struct sw_fmt *fmt)
+{
+	memset(fmt, 0, sizeof(*fmt));
+
+	switch (format) {
+	case MDP_RGB_565:
+	case MDP_BGR_565:
+		fmt->bpp = 2;
+		break;
+	case MDP_RGB_888:
+		fmt->bpp = 3;
+		break;
+	case MDP_ARGB_8888:
+	case MDP_RGBA_8888:
+	case MDP_BGRA_8888:
+		fmt->alpha = 1;
+		/* fall through */
+	case MDP_XRGB_8888:
+	case MDP_RGBX_8888:
+		fmt->bpp = 4;
+		break;
+	case MDP_Y_CRCB_H2V2:
+		fmt->crcb = 1;
+		/* fall through */
+	case MDP_Y_CBCR_H2V2:
+		fmt->bpp = 1;
+		fmt->yuv = 1;
+		fmt->vshift = 1;
+		break;
+	case MDP_Y_CRCB_H2V1:
+		fmt->crcb = 1;
+		/* fall through */
+	case MDP_Y_CBCR_H2V1:
+		fmt->bpp = 1;
+		fmt->yuv = 1;
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	return 0;
+}
+
+/* The PPP tables store each phase as a staging/register pair of writes */
+static void sw_decode_filter(struct sw_filter *f, struct mdp_table_entry *t)
+{
+	int i;
+
+	for (i = 0; i < SW_PHASES; i++) {
+		u32 stg = t[i * 2].val;
+		u32 val = t[i * 2 + 1].val;
+
+		f->c[i][0] = sign_extend32(val & 0x3ff, 9);
+		f->c[i][1] = sign_extend32(val >> 22, 9);
+		f->c[i][2] = sign_extend32(stg & 0x3ff, 9);
+		f->c[i][3] = sign_extend32(stg >> 22, 9);
+	}
+}
+
+static void sw_init_filters(void)
+{
+	int i;
+
+	if (sw_filters_ready)
+		return;
+
+	sw_decode_filter(&sw_filters_x[SW_FILTER_UP], mdp_upscale_table);
+	sw_decode_filter(&sw_filters_y[SW_FILTER_UP], mdp_upscale_table);
+
+	for (i = 0; i < MDP_DOWNSCALE_MAX; i++) {
+		sw_decode_filter(&sw_filters_x[SW_FILTER_PT2TOPT4 + i],
+			mdp_downscale_x_table[i]);
+		sw_decode_filter(&sw_filters_y[SW_FILTER_PT2TOPT4 + i],
+			mdp_downscale_y_table[i]);
+	}
+
+	sw_decode_filter(&sw_filters_x[SW_FILTER_BLUR],
+		mdp_gaussian_blur_table);
+	sw_decode_filter(&sw_filters_y[SW_FILTER_BLUR],
+		mdp_gaussian_blur_table + SW_PHASES * 2);
+
+	sw_filters_ready = 1;
+}
+
+/* Pick the table the PPP would use for a src -> dst ratio */
+static const struct sw_filter *sw_pick_filter(struct sw_filter *tables,
+	int src, int dst, int blur)
+{
+	int ratio = (dst * MDP_SCALE_Q_FACTOR) / src;
+
+	if (blur)
+		return &tables[SW_FILTER_BLUR];
+	if (ratio >= MDP_SCALE_Q_FACTOR)
+		return &tables[SW_FILTER_UP];
+	if (ratio > (MDP_SCALE_Q_FACTOR * 8) / 10)
+		return &tables[SW_FILTER_PT8TO1];
+	if (ratio > (MDP_SCALE_Q_FACTOR * 6) / 10)
+		return &tables[SW_FILTER_PT6TOPT8];
+	if (ratio > (MDP_SCALE_Q_FACTOR * 4) / 10)
+		return &tables[SW_FILTER_PT4TOPT6];
+
+	return &tables[SW_FILTER_PT2TOPT4];
+}
+
+static inline int sw_clamp(int v)
+{
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static inline u32 sw_filter4(u32 p0, u32 p1, u32 p2, u32 p3, const s16 *c)
+{
+	int a, r, g, b;
+
+#define SW_TAP(_s) \
+	((c[0] * (int) ((p0 >> (_s)) & 0xff) + \
+	  c[1] * (int) ((p1 >> (_s)) & 0xff) + \
+	  c[2] * (int) ((p2 >> (_s)) & 0xff) + \
+	  c[3] * (int) ((p3 >> (_s)) & 0xff) + 256) >> 9)
+
+	a = sw_clamp(SW_TAP(24));
+	r = sw_clamp(SW_TAP(16));
+	g = sw_clamp(SW_TAP(8));
+	b = sw_clamp(SW_TAP(0));
+
+#undef SW_TAP
+
+	return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+/* Fixed point (Q16) position of the centre of output pixel i in the source */
+static inline int sw_src_pos(int i, int src, int dst)
+{
+	int step = (src << 16) / dst;
+
+	return step * i + step / 2 - (1 << 15);
+}
+
+static inline int sw_clamp_idx(int i, int n)
+{
+	return i < 0 ? 0 : (i >= n ? n - 1 : i);
+}
+
+static inline u32 sw_yuv2rgb(const struct sw_csc *csc, int y, int cb, int cr)
+{
+	int r, g, b;
+
+	y -= csc->bv[0];
+	cb -= csc->bv[1];
+	cr -= csc->bv[2];
+
+	r = (csc->m[0] * y + csc->m[1] * cb + csc->m[2] * cr + 256) >> 9;
+	g = (csc->m[3] * y + csc->m[4] * cb + csc->m[5] * cr + 256) >> 9;
+	b = (csc->m[6] * y + csc->m[7] * cb + csc->m[8] * cr + 256) >> 9;
+
+	return 0xff000000 | (sw_clamp(r) << 16) | (sw_clamp(g) << 8) |
+		sw_clamp(b);
+}
+
+static inline u32 sw_565_to_argb(u32 v, int bgr)
+{
+	u32 r = (v >> 11) & 0x1f, g = (v >> 5) & 0x3f, b = v & 0x1f;
+
+	r = (r << 3) | (r >> 2);
+	g = (g << 2) | (g >> 4);
+	b = (b << 3) | (b >> 2);
+
+	if (bgr)
+		swap(r, b);
+
+	return 0xff000000 | (r << 16) | (g << 8) | b;
+}
+
+static inline u32 sw_argb_to_565(u32 p, int bgr)
+{
+	u32 r = (p >> 19) & 0x1f, g = (p >> 10) & 0x3f, b = (p >> 3) & 0x1f;
+
+	if (bgr)
+		swap(r, b);
+
+	return (r << 11) | (g << 5) | b;
+}
+
+/* Swap the red and blue bytes - RGBA in memory <-> ARGB in a register */
+static inline u32 sw_swap_rb(u32 v)
+{
+	return (v & 0xff00ff00) | ((v & 0xff) << 16) | ((v >> 16) & 0xff);
+}
+
+/* Read a single pixel of an image as ARGB8888 */
+static u32 sw_read_px(const struct sw_ctx *ctx, const struct sw_img *img,
+	int x, int y)
+{
+	u8 *p = img->base + y * img->stride + x * img->fmt.bpp;
+	u8 *c;
+
+	switch (img->format) {
+	case MDP_RGB_565:
+		return sw_565_to_argb(*(u16 *) p, 0);
+	case MDP_BGR_565:
+		return sw_565_to_argb(*(u16 *) p, 1);
+	case MDP_RGB_888:
+		return 0xff000000 | (p[2] << 16) | (p[1] << 8) | p[0];
+	case MDP_ARGB_8888:
+	case MDP_BGRA_8888:
+		return *(u32 *) p;
+	case MDP_XRGB_8888:
+		return *(u32 *) p | 0xff000000;
+	case MDP_RGBA_8888:
+		return sw_swap_rb(*(u32 *) p);
+	case MDP_RGBX_8888:
+		return sw_swap_rb(*(u32 *) p) | 0xff000000;
+	}
+
+	/* Pseudo planar YCbCr */
+	c = img->chroma + (y >> img->fmt.vshift) * img->width + (x & ~1);
+
+	if (img->fmt.crcb)
+		return sw_yuv2rgb(&ctx->csc, *p, c[1], c[0]);
+
+	return sw_yuv2rgb(&ctx->csc, *p, c[0], c[1]);
+}
+
+static void sw_write_px(struct sw_img *img, int x, int y, u32 v)
+{
+	u8 *p = img->base + y * img->stride + x * img->fmt.bpp;
+
+	switch (img->format) {
+	case MDP_RGB_565:
+		*(u16 *) p = sw_argb_to_565(v, 0);
+		break;
+	case MDP_BGR_565:
+		*(u16 *) p = sw_argb_to_565(v, 1);
+		break;
+	case MDP_RGB_888:
+		p[0] = v;
+		p[1] = v >> 8;
+		p[2] = v >> 16;
+		break;
+	case MDP_ARGB_8888:
+	case MDP_BGRA_8888:
+	case MDP_XRGB_8888:
+		*(u32 *) p = v;
+		break;
+	case MDP_RGBA_8888:
+	case MDP_RGBX_8888:
+		*(u32 *) p = sw_swap_rb(v);
+		break;
+	}
+}
+
+/* Read n pixels of a source line starting at (x, y) */
+static void sw_read_row(const struct sw_ctx *ctx, const struct sw_img *img,
+	int x, int y, int n, u32 *out)
+{
+	u8 *p = img->base + y * img->stride + x * img->fmt.bpp;
+	int i = 0;
+
+	switch (img->format) {
+	case MDP_RGB_565:
+	case MDP_BGR_565: {
+		int bgr = (img->format == MDP_BGR_565);
+		u16 *s = (u16 *) p;
+
+		/* Two pixels per load once the pointer is word aligned */
+		if (((unsigned long) s & 2) && n)
+			out[i++] = sw_565_to_argb(*s++, bgr);
+		for (; i + 1 < n; i += 2, s += 2) {
+			u32 v = *(u32 *) s;
+
+			out[i] = sw_565_to_argb(v & 0xffff, bgr);
+			out[i + 1] = sw_565_to_argb(v >> 16, bgr);
+		}
+		if (i < n)
+			out[i] = sw_565_to_argb(*s, bgr);
+		break;
+	}
+	case MDP_ARGB_8888:
+	case MDP_BGRA_8888:
+		memcpy(out, p, n * 4);
+		break;
+	case MDP_XRGB_8888: {
+		u32 *s = (u32 *) p;
+
+		for (; i < n; i++)
+			out[i] = s[i] | 0xff000000;
+		break;
+	}
+	case MDP_RGBA_8888:
+	case MDP_RGBX_8888: {
+		u32 *s = (u32 *) p;
+		u32 fill = (img->format == MDP_RGBX_8888) ? 0xff000000 : 0;
+
+		for (; i < n; i++)
+			out[i] = sw_swap_rb(s[i]) | fill;
+		break;
+	}
+	case MDP_RGB_888:
+		for (; i < n; i++, p += 3)
+			out[i] = 0xff000000 | (p[2] << 16) | (p[1] << 8) | p[0];
+		break;
+	default: {
+		/* Pseudo planar YCbCr - each chroma pair covers two pixels */
+		u8 *c = img->chroma + (y >> img->fmt.vshift) * img->width;
+		int cbi = img->fmt.crcb ? 1 : 0;
+
+		for (; i < n; i++) {
+			int px = x + i;
+			u8 *cp = c + (px & ~1);
+
+			out[i] = sw_yuv2rgb(&ctx->csc, p[i], cp[cbi],
+				cp[cbi ^ 1]);
+		}
+		break;
+	}
+	}
+}
+
+/* Write n ARGB8888 pixels to a destination line starting at (x, y) */
+static void sw_write_row(struct sw_img *img, int x, int y, int n,
+	const u32 *in)
+{
+	u8 *p = img->base + y * img->stride + x * img->fmt.bpp;
+	int i = 0;
+
+	switch (img->format) {
+	case MDP_RGB_565:
+	case MDP_BGR_565: {
+		int bgr = (img->format == MDP_BGR_565);
+		u16 *d = (u16 *) p;
+
+		if (((unsigned long) d & 2) && n) {
+			d[0] = sw_argb_to_565(in[0], bgr);
+			i++;
+		}
+		for (; i + 1 < n; i += 2)
+			*(u32 *) &d[i] = sw_argb_to_565(in[i], bgr) |
+				(sw_argb_to_565(in[i + 1], bgr) << 16);
+		if (i < n)
+			d[i] = sw_argb_to_565(in[i], bgr);
+		break;
+	}
+	case MDP_ARGB_8888:
+	case MDP_BGRA_8888:
+	case MDP_XRGB_8888:
+		memcpy(p, in, n * 4);
+		break;
+	case MDP_RGBA_8888:
+	case MDP_RGBX_8888: {
+		u32 *d = (u32 *) p;
+
+		for (; i < n; i++)
+			d[i] = sw_swap_rb(in[i]);
+		break;
+	}
+	case MDP_RGB_888:
+		for (; i < n; i++, p += 3) {
+			p[0] = in[i];
+			p[1] = in[i] >> 8;
+			p[2] = in[i] >> 16;
+		}
+		break;
+	}
+}
+
+/*
+ * The rotated/flipped source is addressed as a virtual image of vw x vh.
+ * Rotation is 90 degrees clockwise and the flips are applied afterwards in
+ * destination space, which makes MDP_ROT_180 and MDP_ROT_270 come out right.
+ */
+static void sw_virt_to_src(const struct sw_ctx *ctx, int u, int v,
+	int *x, int *y)
+{
+	if (ctx->flip_lr)
+		u = ctx->vw - 1 - u;
+	if (ctx->flip_ud)
+		v = ctx->vh - 1 - v;
+
+	if (ctx->rot90) {
+		*x = ctx->src_rect.x + v;
+		*y = ctx->src_rect.y + ctx->src_rect.h - 1 - u;
+	} else {
+		*x = ctx->src_rect.x + u;
+		*y = ctx->src_rect.y + v;
+	}
+}
+
+static inline u32 sw_key(const struct sw_ctx *ctx, u32 p)
+{
+	/* Colour keyed pixels become fully transparent */
+	if (ctx->transp && (p & 0xffffff) == ctx->transp_key)
+		return 0;
+
+	return p;
+}
+
+static u32 sw_virt_read_px(const struct sw_ctx *ctx, int u, int v)
+{
+	int x, y;
+
+	sw_virt_to_src(ctx, u, v, &x, &y);
+
+	return sw_key(ctx, sw_read_px(ctx, &ctx->src, x, y));
+}
+
+/* Fetch line v of the virtual source */
+static void sw_fetch_line(const struct sw_ctx *ctx, int v, u32 *out)
+{
+	int u, x, y;
+
+	if (ctx->rot90) {
+		/* Source columns - no way around reading pixel by pixel */
+		for (u = 0; u < ctx->vw; u++)
+			out[u] = sw_virt_read_px(ctx, u, v);
+		return;
+	}
+
+	sw_virt_to_src(ctx, 0, v, &x, &y);
+	sw_read_row(ctx, &ctx->src, ctx->src_rect.x, y, ctx->vw, out);
+
+	if (ctx->flip_lr) {
+		for (u = 0; u < ctx->vw / 2; u++)
+			swap(out[u], out[ctx->vw - 1 - u]);
+	}
+
+	if (ctx->transp) {
+		for (u = 0; u < ctx->vw; u++)
+			out[u] = sw_key(ctx, out[u]);
+	}
+}
+
+static inline u32 sw_div255(u32 v)
+{
+	return (v + 1 + (v >> 8)) >> 8;
+}
+
+static u32 sw_blend_px(const struct sw_ctx *ctx, u32 s, u32 d)
+{
+	u32 a = s >> 24, ia, out = 0;
+	int shift;
+
+	if (ctx->alpha != 255)
+		a = sw_div255(a * ctx->alpha);
+
+	if (a == 255 && ctx->alpha == 255)
+		return s;
+
+	ia = 255 - a;
+
+	for (shift = 0; shift < 24; shift += 8) {
+		u32 sc = (s >> shift) & 0xff;
+		u32 dc = (d >> shift) & 0xff;
+		u32 c;
+
+		if (ctx->premult)
+			c = sw_div255(sc * ctx->alpha) + sw_div255(dc * ia);
+		else
+			c = sw_div255(sc * a + dc * ia);
+
+		out |= (c > 255 ? 255 : c) << shift;
+	}
+
+	/* Destination alpha accumulates the coverage */
+	out |= (a + sw_div255(((d >> 24) & 0xff) * ia)) << 24;
+
+	return out;
+}
+
+static void sw_store_line(struct sw_ctx *ctx, int y, u32 *line, u32 *tmp)
+{
+	int n = ctx->dst_rect.w, i;
+
+	if (ctx->blend) {
+		sw_read_row(ctx, &ctx->dst, ctx->dst_rect.x,
+			ctx->dst_rect.y + y, n, tmp);
+
+		for (i = 0; i < n; i++)
+			line[i] = sw_blend_px(ctx, line[i], tmp[i]);
+	}
+
+	sw_write_row(&ctx->dst, ctx->dst_rect.x, ctx->dst_rect.y + y, n, line);
+}
+
+struct sw_lines {
+	int *xidx;		/* First tap for each output column */
+	u8 *xphase;
+	u32 *fetch;		/* One line of the virtual source */
+	u32 *ring[SW_TAPS];	/* Horizontally scaled lines */
+	int tag[SW_TAPS];
+	u32 *out;
+	u32 *tmp;
+};
+
+static void sw_hscale(const struct sw_ctx *ctx, struct sw_lines *l,
+	const u32 *in, u32 *out)
+{
+	int i;
+
+	for (i = 0; i < ctx->dst_rect.w; i++) {
+		int x = l->xidx[i];
+
+		out[i] = sw_filter4(in[sw_clamp_idx(x - 1, ctx->vw)],
+			in[sw_clamp_idx(x, ctx->vw)],
+			in[sw_clamp_idx(x + 1, ctx->vw)],
+			in[sw_clamp_idx(x + 2, ctx->vw)],
+			ctx->fx->c[l->xphase[i]]);
+	}
+}
+
+/* Get the horizontally scaled copy of virtual line v */
+static u32 *sw_get_line(const struct sw_ctx *ctx, struct sw_lines *l, int v)
+{
+	int slot;
+
+	v = sw_clamp_idx(v, ctx->vh);
+	slot = v & (SW_TAPS - 1);
+
+	if (l->tag[slot] != v) {
+		if (ctx->hscale) {
+			sw_fetch_line(ctx, v, l->fetch);
+			sw_hscale(ctx, l, l->fetch, l->ring[slot]);
+		} else {
+			sw_fetch_line(ctx, v, l->ring[slot]);
+		}
+		l->tag[slot] = v;
+	}
+
+	return l->ring[slot];
+}
+
+static int sw_run(struct sw_ctx *ctx)
+{
+	struct sw_lines l;
+	int w = ctx->dst_rect.w, y, i;
+	size_t size;
+	u8 *mem;
+
+	/* ring + out + tmp + fetch lines, then the column tables */
+	size = (SW_TAPS + 2) * w * sizeof(u32) + ctx->vw * sizeof(u32) +
+		w * (sizeof(int) + sizeof(u8));
+
+	mem = kmalloc(size, GFP_KERNEL);
+	if (mem == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < SW_TAPS; i++) {
+		l.ring[i] = (u32 *) mem + i * w;
+		l.tag[i] = -1;
+	}
+	l.out = (u32 *) mem + SW_TAPS * w;
+	l.tmp = l.out + w;
+	l.fetch = l.tmp + w;
+	l.xidx = (int *) (l.fetch + ctx->vw);
+	l.xphase = (u8 *) (l.xidx + w);
+
+	for (i = 0; i < w; i++) {
+		int pos = sw_src_pos(i, ctx->vw, w);
+
+		l.xidx[i] = pos >> 16;
+		l.xphase[i] = (pos >> 11) & (SW_PHASES - 1);
+	}
+
+	for (y = 0; y < ctx->dst_rect.h; y++) {
+		u32 *line;
+
+		if (ctx->vscale) {
+			int pos = sw_src_pos(y, ctx->vh, ctx->dst_rect.h);
+			int v = pos >> 16;
+			const s16 *c = ctx->fy->c[(pos >> 11) & (SW_PHASES - 1)];
+			u32 *l0 = sw_get_line(ctx, &l, v - 1);
+			u32 *l1 = sw_get_line(ctx, &l, v);
+			u32 *l2 = sw_get_line(ctx, &l, v + 1);
+			u32 *l3 = sw_get_line(ctx, &l, v + 2);
+
+			for (i = 0; i < w; i++)
+				l.out[i] = sw_filter4(l0[i], l1[i], l2[i],
+					l3[i], c);
+			line = l.out;
+		} else {
+			/* Copy, the ring line may be reused for the blend */
+			memcpy(l.out, sw_get_line(ctx, &l, y), w * sizeof(u32));
+			line = l.out;
+		}
+
+		sw_store_line(ctx, y, line, l.tmp);
+	}
+
+	kfree(mem);
+	return 0;
+}
+
+/*
+ * Straightforward per pixel implementation of the same pipeline, used by
+ * the self test to check the line based code above.
+ */
+static u32 sw_ref_hpx(const struct sw_ctx *ctx, int x, int v)
+{
+	u32 p[SW_TAPS];
+	int pos, u, i;
+
+	v = sw_clamp_idx(v, ctx->vh);
+
+	pos = sw_src_pos(x, ctx->vw, ctx->dst_rect.w);
+	u = pos >> 16;
+
+	for (i = 0; i < SW_TAPS; i++)
+		p[i] = sw_virt_read_px(ctx,
+			sw_clamp_idx(u - 1 + i, ctx->vw), v);
+
+	return sw_filter4(p[0], p[1], p[2], p[3],
+		ctx->fx->c[(pos >> 11) & (SW_PHASES - 1)]);
+}
+
+static void sw_ref_run(struct sw_ctx *ctx)
+{
+	int x, y, i;
+
+	for (y = 0; y < ctx->dst_rect.h; y++) {
+		int pos = sw_src_pos(y, ctx->vh, ctx->dst_rect.h);
+		int v = pos >> 16;
+		const s16 *c = ctx->fy->c[(pos >> 11) & (SW_PHASES - 1)];
+
+		for (x = 0; x < ctx->dst_rect.w; x++) {
+			u32 p[SW_TAPS], s;
+			int dx = ctx->dst_rect.x + x, dy = ctx->dst_rect.y + y;
+
+			for (i = 0; i < SW_TAPS; i++)
+				p[i] = sw_ref_hpx(ctx, x, v - 1 + i);
+
+			s = sw_filter4(p[0], p[1], p[2], p[3], c);
+
+			if (ctx->blend)
+				s = sw_blend_px(ctx, s,
+					sw_read_px(ctx, &ctx->dst, dx, dy));
+
+			sw_write_px(&ctx->dst, dx, dy, s);
+		}
+	}
+}
+
+/* Check that the rectangle of an image fits in the memory backing it */
+static int sw_setup_img(struct sw_img *img, struct mdp_img *mimg,
+	struct mdp_rect *rect, void *vstart, unsigned long len)
+{
+	u64 end, coff;
+
+	if (sw_get_fmt(mimg->format, &img->fmt))
+		return -EOPNOTSUPP;
+
+	/* Written so that none of the user supplied values can wrap */
+	if (mimg->width == 0 || mimg->width > SW_MAX_WIDTH ||
+		mimg->height == 0 || mimg->height > SW_MAX_HEIGHT ||
+		rect->w == 0 || rect->w > mimg->width ||
+		rect->x > mimg->width - rect->w ||
+		rect->h == 0 || rect->h > mimg->height ||
+		rect->y > mimg->height - rect->h)
+		return -EINVAL;
+
+	img->format = mimg->format;
+	img->width = mimg->width;
+	img->stride = mimg->width * img->fmt.bpp;
+	img->base = vstart + mimg->offset;
+	img->chroma = NULL;
+
+	end = (u64) mimg->offset + (u64) (rect->y + rect->h - 1) *
+		img->stride + (rect->x + rect->w) * img->fmt.bpp;
+	if (end > len)
+		return -EINVAL;
+
+	if (img->fmt.yuv) {
+		coff = (u64) mimg->offset + mimg->width * mimg->height;
+
+		end = coff + ((rect->y + rect->h - 1) >> img->fmt.vshift) *
+			img->width + ((rect->x + rect->w + 1) & ~1);
+		if (end > len)
+			return -EINVAL;
+
+		img->chroma = vstart + coff;
+	}
+
+	return 0;
+}
+
+static int sw_setup(struct sw_ctx *ctx, struct mdp_blit_req *req,
+	void *src, unsigned long src_len, void *dst, unsigned long dst_len)
+{
+	int i, ret;
+
+	memset(ctx, 0, sizeof(*ctx));
+
+	if (req->flags & MDP_DEINTERLACE)
+		return -EOPNOTSUPP;
+
+	ret = sw_setup_img(&ctx->src, &req->src, &req->src_rect, src,
+		src_len);
+	if (ret)
+		return ret;
+
+	ret = sw_setup_img(&ctx->dst, &req->dst, &req->dst_rect, dst,
+		dst_len);
+	if (ret)
+		return ret;
+
+	/* Only packed RGB destinations */
+	if (ctx->dst.fmt.yuv)
+		return -EOPNOTSUPP;
+
+	ctx->src_rect = req->src_rect;
+	ctx->dst_rect = req->dst_rect;
+
+	ctx->rot90 = !!(req->flags & MDP_ROT_90);
+	ctx->flip_lr = !!(req->flags & MDP_FLIP_LR);
+	ctx->flip_ud = !!(req->flags & MDP_FLIP_UD);
+
+	ctx->vw = ctx->rot90 ? ctx->src_rect.h : ctx->src_rect.w;
+	ctx->vh = ctx->rot90 ? ctx->src_rect.w : ctx->src_rect.h;
+
+	ctx->alpha = (req->alpha == MDP_ALPHA_NOP) ? 255 : req->alpha & 0xff;
+	ctx->premult = !!(req->flags & MDP_BLEND_FG_PREMULT);
+
+	if (req->transp_mask != MDP_TRANSP_NOP) {
+		ctx->transp = 1;
+		/* 16 bit formats key on the raw pixel value */
+		if (ctx->src.fmt.bpp == 2)
+			ctx->transp_key = sw_565_to_argb(req->transp_mask,
+				ctx->src.format == MDP_BGR_565) & 0xffffff;
+		else
+			ctx->transp_key = req->transp_mask & 0xffffff;
+	}
+
+	ctx->blend = ctx->src.fmt.alpha || ctx->alpha != 255 || ctx->transp;
+
+	for (i = 0; i < 9; i++)
+		ctx->csc.m[i] = sign_extend32(mdp_ccs_yuv2rgb.ccs[i], 11);
+	for (i = 0; i < 3; i++)
+		ctx->csc.bv[i] = mdp_ccs_yuv2rgb.bv[i] & 0xff;
+
+	sw_init_filters();
+
+	ctx->hscale = (ctx->vw != ctx->dst_rect.w) ||
+		(req->flags & MDP_BLUR);
+	ctx->vscale = (ctx->vh != ctx->dst_rect.h) ||
+		(req->flags & MDP_BLUR);
+
+	ctx->fx = sw_pick_filter(sw_filters_x, ctx->vw, ctx->dst_rect.w,
+		req->flags & MDP_BLUR);
+	ctx->fy = sw_pick_filter(sw_filters_y, ctx->vh, ctx->dst_rect.h,
+		req->flags & MDP_BLUR);
+
+	return 0;
+}
+
+static int sw_blit(struct mdp_blit_req *req, void *src,
+	unsigned long src_len, void *dst, unsigned long dst_len)
+{
+	struct sw_ctx ctx;
+	int ret, y;
+
+	ret = sw_setup(&ctx, req, src, src_len, dst, dst_len);
+	if (ret)
+		return ret;
+
+	/* Plain copy: same format, no scaling, rotation or blending */
+	if (ctx.src.format == ctx.dst.format && !ctx.src.fmt.yuv &&
+		!ctx.hscale && !ctx.vscale && !ctx.blend &&
+		!(req->flags & (MDP_ROT_90 | MDP_FLIP_LR | MDP_FLIP_UD))) {
+		int len = ctx.dst_rect.w * ctx.dst.fmt.bpp;
+		u8 *s = ctx.src.base + ctx.src_rect.y * ctx.src.stride +
+			ctx.src_rect.x * ctx.src.fmt.bpp;
+		u8 *d = ctx.dst.base + ctx.dst_rect.y * ctx.dst.stride +
+			ctx.dst_rect.x * ctx.dst.fmt.bpp;
+
+		for (y = 0; y < ctx.dst_rect.h; y++) {
+			memcpy(d, s, len);
+			s += ctx.src.stride;
+			d += ctx.dst.stride;
+		}
+
+		return 0;
+	}
+
+	return sw_run(&ctx);
+}
+
+/*
+ * mdp_ppp_sw_blit - execute a blit request on the CPU
+ * @info - framebuffer the request was made on
+ * @req - the request
+ * @src - memory behind the source image
+ * @dst - memory behind the destination image
+ *
+ * Drops the image references like mdp_blit_resolved().  Returns -EOPNOTSUPP
+ * for requests the software path can't handle (YCbCr destinations,
+ * deinterlacing, memory with no kernel mapping).
+ */
+int mdp_ppp_sw_blit(struct fb_info *info, struct mdp_blit_req *req,
+	struct mdp_blit_img *src, struct mdp_blit_img *dst)
+{
+	struct msm_fb_data_type *mfd = info->par;
+	int ret = -EOPNOTSUPP;
+
+	if (req->src.format == MDP_FB_FORMAT)
+		req->src.format = mfd->fb_imgType;
+	if (req->dst.format == MDP_FB_FORMAT)
+		req->dst.format = mfd->fb_imgType;
+
+	if (src->vstart && dst->vstart)
+		ret = sw_blit(req, src->vstart, src->len, dst->vstart,
+			dst->len);
+
+	mdp_ppp_put_blit_img(src);
+	mdp_ppp_put_blit_img(dst);
+
+	return ret;
+}
+
+#ifdef CONFIG_FB_MSM_MDP_PPP_SW_SELFTEST
+
+struct sw_test {
+	const char *name;
+	uint32_t src_format;
+	int src_w, src_h;
+	uint32_t dst_format;
+	int dst_w, dst_h;
+	uint32_t flags;
+	uint32_t alpha;
+	uint32_t transp;
+};
+
+static const struct sw_test sw_tests[] = {
+	{ "copy_565", MDP_RGB_565, 64, 48, MDP_RGB_565, 64, 48,
+		0, MDP_ALPHA_NOP, MDP_TRANSP_NOP },
+	{ "rgba_blend_565", MDP_RGBA_8888, 61, 47, MDP_RGB_565, 61, 47,
+		0, 0x80, MDP_TRANSP_NOP },
+	{ "nv21_up_rgba", MDP_Y_CRCB_H2V2, 64, 48, MDP_RGBA_8888, 96, 72,
+		0, MDP_ALPHA_NOP, MDP_TRANSP_NOP },
+	{ "nv12_h2v1_xrgb", MDP_Y_CBCR_H2V1, 32, 32, MDP_XRGB_8888, 40, 24,
+		MDP_FLIP_UD, MDP_ALPHA_NOP, MDP_TRANSP_NOP },
+	{ "565_rot90_down", MDP_RGB_565, 80, 64, MDP_XRGB_8888, 48, 60,
+		MDP_ROT_90, MDP_ALPHA_NOP, MDP_TRANSP_NOP },
+	{ "argb_rot270_premult", MDP_ARGB_8888, 40, 30, MDP_RGB_888, 30, 40,
+		MDP_ROT_270 | MDP_BLEND_FG_PREMULT, 0xc0, MDP_TRANSP_NOP },
+	{ "bgr565_key_blur", MDP_BGR_565, 50, 50, MDP_RGBX_8888, 50, 50,
+		MDP_FLIP_LR | MDP_BLUR, MDP_ALPHA_NOP, 0x0000 },
+};
+
+/* Throughput is measured on a WVGA sized scaled blit */
+#define SW_PERF_W 800
+#define SW_PERF_H 480
+#define SW_PERF_PIXELS ((SW_PERF_W * 3 / 4) * (SW_PERF_H * 3 / 4))
+
+static void sw_test_pattern(u8 *buf, size_t len, u32 seed)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = seed >> 16;
+	}
+}
+
+static size_t sw_test_size(uint32_t format, int w, int h)
+{
+	struct sw_fmt fmt;
+
+	sw_get_fmt(format, &fmt);
+
+	if (fmt.yuv)
+		return w * h + (w * h >> fmt.vshift);
+
+	return w * h * fmt.bpp;
+}
+
+static void sw_test_req(struct mdp_blit_req *req, uint32_t sfmt, int sw,
+	int sh, uint32_t dfmt, int dw, int dh, uint32_t flags, uint32_t alpha,
+	uint32_t transp)
+{
+	memset(req, 0, sizeof(*req));
+
+	req->src.format = sfmt;
+	req->src.width = sw;
+	req->src.height = sh;
+	req->src_rect.w = sw;
+	req->src_rect.h = sh;
+
+	req->dst.format = dfmt;
+	req->dst.width = dw;
+	req->dst.height = dh;
+	req->dst_rect.w = dw;
+	req->dst_rect.h = dh;
+
+	req->flags = flags;
+	req->alpha = alpha;
+	req->transp_mask = transp;
+}
+
+static int sw_selftest_show(struct seq_file *s, void *unused)
+{
+	struct mdp_blit_req req;
+	struct sw_ctx ctx;
+	u8 *src, *dst, *ref;
+	size_t slen, dlen;
+	ktime_t start;
+	s64 opt_us, ref_us;
+	int i, ret, failed = 0;
+
+	for (i = 0; i < ARRAY_SIZE(sw_tests); i++) {
+		const struct sw_test *t = &sw_tests[i];
+		size_t j, mismatch = 0;
+
+		slen = sw_test_size(t->src_format, t->src_w, t->src_h);
+		dlen = sw_test_size(t->dst_format, t->dst_w, t->dst_h);
+
+		src = vmalloc(slen);
+		dst = vmalloc(dlen);
+		ref = vmalloc(dlen);
+
+		if (!src || !dst || !ref) {
+			seq_printf(s, "%-22s out of memory\n", t->name);
+			failed++;
+			goto next;
+		}
+
+		sw_test_pattern(src, slen, i + 1);
+		sw_test_pattern(dst, dlen, i + 100);
+		memcpy(ref, dst, dlen);
+
+		/* Key on a colour that is actually in the source */
+		sw_test_req(&req, t->src_format, t->src_w, t->src_h,
+			t->dst_format, t->dst_w, t->dst_h, t->flags, t->alpha,
+			t->transp == MDP_TRANSP_NOP ? t->transp :
+			*(u16 *) src);
+
+		ret = sw_blit(&req, src, slen, dst, dlen);
+
+		if (ret == 0)
+			ret = sw_setup(&ctx, &req, src, slen, ref, dlen);
+		if (ret == 0)
+			sw_ref_run(&ctx);
+
+		if (ret) {
+			seq_printf(s, "%-22s error %d\n", t->name, ret);
+			failed++;
+			goto next;
+		}
+
+		for (j = 0; j < dlen; j++)
+			if (dst[j] != ref[j])
+				mismatch++;
+
+		seq_printf(s, "%-22s %s (%zu bytes differ)\n", t->name,
+			mismatch ? "FAIL" : "ok", mismatch);
+		if (mismatch)
+			failed++;
+next:
+		vfree(src);
+		vfree(dst);
+		vfree(ref);
+	}
+
+	/* Throughput: 3/4 downscale of a WVGA RGB565 frame with blending */
+	slen = sw_test_size(MDP_RGB_565, SW_PERF_W, SW_PERF_H);
+	dlen = sw_test_size(MDP_RGB_565, SW_PERF_W * 3 / 4, SW_PERF_H * 3 / 4);
+	src = vmalloc(slen);
+	dst = vmalloc(dlen);
+
+	if (src && dst) {
+		sw_test_pattern(src, slen, 42);
+		sw_test_req(&req, MDP_RGB_565, SW_PERF_W, SW_PERF_H,
+			MDP_RGB_565, SW_PERF_W * 3 / 4, SW_PERF_H * 3 / 4,
+			0, 0xc0, MDP_TRANSP_NOP);
+
+		start = ktime_get();
+		sw_blit(&req, src, slen, dst, dlen);
+		opt_us = ktime_us_delta(ktime_get(), start);
+
+		sw_setup(&ctx, &req, src, slen, dst, dlen);
+		start = ktime_get();
+		sw_ref_run(&ctx);
+		ref_us = ktime_us_delta(ktime_get(), start);
+
+		/* Output pixels per microsecond is MPix/s */
+		seq_printf(s, "perf %dx%d -> %dx%d: %lld us, %lld MPix/s "
+			"(reference %lld us, %lld MPix/s)\n",
+			SW_PERF_W, SW_PERF_H, SW_PERF_W * 3 / 4,
+			SW_PERF_H * 3 / 4, opt_us,
+			div64_s64(SW_PERF_PIXELS, max_t(s64, opt_us, 1)),
+			ref_us,
+			div64_s64(SW_PERF_PIXELS, max_t(s64, ref_us, 1)));
+	}
+
+	vfree(src);
+	vfree(dst);
+
+	seq_printf(s, "%d of %d tests failed\n", failed,
+		(int) ARRAY_SIZE(sw_tests));
+
+	return 0;
+}
+
+static int sw_selftest_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sw_selftest_show, NULL);
+}
+
+static const struct file_operations sw_selftest_fops = {
+	.open = sw_selftest_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init mdp_ppp_sw_selftest_init(void)
+{
+	debugfs_create_file("mdp_ppp_sw_selftest", 0400, NULL, NULL,
+		&sw_selftest_fops);
+	return 0;
+}
+late_initcall(mdp_ppp_sw_selftest_init);
+
+#endif
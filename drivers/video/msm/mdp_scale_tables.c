@@ -633,6 +633,8 @@ struct mdp_table_entry *mdp_downscale_y_table[MDP_DOWNSCALE_MAX] = {
 	[MDP_DOWNSCALE_PT8TO1]  = mdp_downscale_y_table_PT8TO1,
 };
 
+/* mdp_ppp_v20.c carries its own copy */
+#ifdef CONFIG_FB_MSM_MDP31
 struct mdp_table_entry mdp_gaussian_blur_table[] = {
 	/* max variance */
 	{ 0x5fffc, 0x20000080 },
@@ -764,3 +766,4 @@ struct mdp_table_entry mdp_gaussian_blur_table[] = {
 	{ 0x5fffc, 0x20000080 },
 	{ 0x5037c, 0x20000080 },
 };
+#endif
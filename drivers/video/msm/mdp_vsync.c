@@ -29,6 +29,10 @@
 #include <asm/mach-types.h>
 #include <linux/semaphore.h>
 #include <linux/uaccess.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+#include <linux/kobject.h>
+#include <linux/workqueue.h>
 #include <mach/gpio.h>
 
 #include "mdp.h"
@@ -72,6 +76,7 @@ static struct clk *mdp_vsync_clk;
 static struct msm_fb_data_type *vsync_mfd;
 static unsigned char timer_shutdown_flag;
 static uint32 vsync_cnt_cfg;
+static struct msm_fb_data_type *vsync_event_mfd;
 
 void mdp_hw_vsync_clk_enable(struct msm_fb_data_type *mfd)
 {
@@ -191,6 +196,9 @@ static void mdp_vsync_handler(void *data)
 		mfd->last_vsync_timetick = ktime_get_real();
 	}
 
+	if (mfd == vsync_event_mfd)
+		mdp_vsync_event(ktime_get());
+
 	mfd->vsync_handler_pending = FALSE;
 }
 
@@ -489,3 +497,360 @@ uint32 mdp_get_lcd_line_counter(struct msm_fb_data_type *mfd)
 
 	return lcd_line;
 }
+
+/*
+ * Vsync events for userspace
+ *
+ * Each vsync of the primary panel is timestamped (CLOCK_MONOTONIC) and
+ * counted.  Video mode panels report the LCDC frame start interrupt; other
+ * panels report the vsync handler when it runs and otherwise extrapolate
+ * from the last hardware vsync at the panel refresh rate.  Readers of the
+ * vsync_event sysfs file are woken through sysfs_notify(), and with
+ * vsync_ctrl set to 2 a KOBJ_CHANGE uevent carrying VSYNC= is sent too.
+ */
+#define MDP_VSYNC_EVENT_OFF	0
+#define MDP_VSYNC_EVENT_POLL	1
+#define MDP_VSYNC_EVENT_UEVENT	2
+
+static DEFINE_SPINLOCK(vsync_event_lock);
+static DEFINE_MUTEX(vsync_event_ctrl_lock);	/* Starting and stopping */
+static int vsync_event_mode;
+static ktime_t vsync_event_time;
+static ktime_t vsync_event_hw_time;	/* Last vsync seen by hardware */
+static u32 vsync_event_count;
+static int vsync_event_hw;		/* Frame start interrupt in use */
+static struct hrtimer vsync_event_timer;
+static int vsync_event_timer_on;
+static int vsync_event_irq_on;
+static struct work_struct vsync_event_work;
+
+static s64 mdp_vsync_period_ns(struct msm_fb_data_type *mfd)
+{
+	u32 refx100 = mfd->panel_info.lcd.refx100;
+
+	if (!refx100 && mfd->panel_info.mipi.frame_rate)
+		refx100 = mfd->panel_info.mipi.frame_rate * 100;
+	if (!refx100)
+		refx100 = 6000;
+
+	return div_s64(100LL * NSEC_PER_SEC, refx100);
+}
+
+static void mdp_vsync_event_work(struct work_struct *work)
+{
+	struct msm_fb_data_type *mfd = vsync_event_mfd;
+	char buf[64];
+	char *envp[] = { buf, NULL };
+	unsigned long flag;
+	ktime_t t;
+
+	if (!mfd)
+		return;
+
+	sysfs_notify(&mfd->fbi->dev->kobj, NULL, "vsync_event");
+
+	if (vsync_event_mode != MDP_VSYNC_EVENT_UEVENT)
+		return;
+
+	spin_lock_irqsave(&vsync_event_lock, flag);
+	t = vsync_event_time;
+	spin_unlock_irqrestore(&vsync_event_lock, flag);
+
+	snprintf(buf, sizeof(buf), "VSYNC=%llu", ktime_to_ns(t));
+	kobject_uevent_env(&mfd->fbi->dev->kobj, KOBJ_CHANGE, envp);
+}
+
+static void mdp_vsync_event_report(ktime_t t, int hw)
+{
+	unsigned long flag;
+
+	spin_lock_irqsave(&vsync_event_lock, flag);
+	if (hw)
+		vsync_event_hw_time = t;
+	vsync_event_time = t;
+	vsync_event_count++;
+	spin_unlock_irqrestore(&vsync_event_lock, flag);
+
+	if (vsync_event_mode != MDP_VSYNC_EVENT_OFF)
+		schedule_work(&vsync_event_work);
+}
+
+/*
+ * mdp_vsync_event - hardware vsync of the primary panel
+ *
+ * Called from interrupt context.
+ */
+void mdp_vsync_event(ktime_t t)
+{
+	mdp_vsync_event_report(t, TRUE);
+}
+
+/* Keeps the vsync events going for panels without a vsync interrupt */
+static enum hrtimer_restart mdp_vsync_event_timer_fn(struct hrtimer *timer)
+{
+	struct msm_fb_data_type *mfd = vsync_event_mfd;
+	s64 period = mdp_vsync_period_ns(mfd);
+	ktime_t now = ktime_get();
+	ktime_t hw;
+	unsigned long flag;
+	s32 phase;
+
+	if (!mfd->panel_power_on || vsync_event_mode == MDP_VSYNC_EVENT_OFF) {
+		vsync_event_timer_on = FALSE;
+		return HRTIMER_NORESTART;
+	}
+
+	spin_lock_irqsave(&vsync_event_lock, flag);
+	hw = vsync_event_hw_time;
+	spin_unlock_irqrestore(&vsync_event_lock, flag);
+
+	/* Stay in phase with the last vsync the hardware reported */
+	if (hw.tv64) {
+		div_s64_rem(ktime_to_ns(ktime_sub(now, hw)), period, &phase);
+		now = ktime_sub_ns(now, phase);
+	}
+
+	mdp_vsync_event_report(now, FALSE);
+
+	hrtimer_set_expires(timer, ktime_add_ns(now, period));
+	return HRTIMER_RESTART;
+}
+
+/* Unmask the frame start irq, the MDP clock must be on */
+static void mdp_vsync_event_irq_enable(void)
+{
+	unsigned long flag;
+
+	spin_lock_irqsave(&mdp_spin_lock, flag);
+	outp32(MDP_INTR_CLEAR, LCDC_FRAME_START);
+	mdp_intr_mask |= LCDC_FRAME_START;
+	outp32(MDP_INTR_ENABLE, mdp_intr_mask);
+	spin_unlock_irqrestore(&mdp_spin_lock, flag);
+}
+
+/* Called with vsync_event_ctrl_lock held */
+static void mdp_vsync_event_start(void)
+{
+	struct msm_fb_data_type *mfd = vsync_event_mfd;
+
+	if (vsync_event_hw) {
+		if (!vsync_event_irq_on) {
+			mdp_enable_irq(MDP_VSYNC_TERM);
+			vsync_event_irq_on = TRUE;
+		}
+
+		/*
+		 * With the panel off the MDP may be unclocked, leave it to
+		 * mdp_vsync_event_panel_on()
+		 */
+		if (!mfd->panel_power_on)
+			return;
+
+		mdp_pipe_ctrl(MDP_CMD_BLOCK, MDP_BLOCK_POWER_ON, FALSE);
+		mdp_vsync_event_irq_enable();
+		mdp_pipe_ctrl(MDP_CMD_BLOCK, MDP_BLOCK_POWER_OFF, FALSE);
+		return;
+	}
+
+	if (!vsync_event_timer_on && mfd->panel_power_on) {
+		vsync_event_timer_on = TRUE;
+		hrtimer_start(&vsync_event_timer,
+			ns_to_ktime(mdp_vsync_period_ns(mfd)),
+			HRTIMER_MODE_REL);
+	}
+}
+
+/*
+ * mdp_vsync_event_panel_on - the video panel timing generator was started
+ *
+ * Called with the MDP clock on.  Brings back the vsync events requested
+ * while the panel was off.
+ */
+void mdp_vsync_event_panel_on(void)
+{
+	if (mdp_vsync_event_needs_irq())
+		mdp_vsync_event_irq_enable();
+}
+
+/* Whether the frame start interrupt has to stay enabled for vsync events */
+int mdp_vsync_event_needs_irq(void)
+{
+	return vsync_event_hw && vsync_event_mode != MDP_VSYNC_EVENT_OFF;
+}
+
+static ssize_t mdp_vsync_event_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	unsigned long flag;
+	ktime_t t;
+	u32 count;
+
+	spin_lock_irqsave(&vsync_event_lock, flag);
+	t = vsync_event_time;
+	count = vsync_event_count;
+	spin_unlock_irqrestore(&vsync_event_lock, flag);
+
+	return snprintf(buf, PAGE_SIZE, "VSYNC=%llu COUNT=%u SRC=%s\n",
+		ktime_to_ns(t), count, vsync_event_hw ? "hw" : "sw");
+}
+
+static ssize_t mdp_vsync_ctrl_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%d\n", vsync_event_mode);
+}
+
+static ssize_t mdp_vsync_ctrl_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	unsigned long mode;
+
+	if (strict_strtoul(buf, 10, &mode) || mode > MDP_VSYNC_EVENT_UEVENT)
+		return -EINVAL;
+
+	mutex_lock(&vsync_event_ctrl_lock);
+	vsync_event_mode = mode;
+
+	if (mode == MDP_VSYNC_EVENT_OFF) {
+		/* The frame start irq gets dropped by the isr on its own */
+		hrtimer_cancel(&vsync_event_timer);
+		vsync_event_timer_on = FALSE;
+		if (vsync_event_irq_on) {
+			mdp_disable_irq(MDP_VSYNC_TERM);
+			vsync_event_irq_on = FALSE;
+		}
+	} else {
+		mdp_vsync_event_start();
+	}
+	mutex_unlock(&vsync_event_ctrl_lock);
+
+	return count;
+}
+
+static DEVICE_ATTR(vsync_event, S_IRUGO, mdp_vsync_event_show, NULL);
+static DEVICE_ATTR(vsync_ctrl, S_IRUGO | S_IWUSR, mdp_vsync_ctrl_show,
+	mdp_vsync_ctrl_store);
+
+static struct attribute *mdp_vsync_attrs[] = {
+	&dev_attr_vsync_event.attr,
+	&dev_attr_vsync_ctrl.attr,
+	NULL,
+};
+
+static struct attribute_group mdp_vsync_attr_group = {
+	.attrs = mdp_vsync_attrs,
+};
+
+void mdp_vsync_event_init(struct msm_fb_data_type *mfd)
+{
+	if (vsync_event_mfd)
+		return;
+
+	vsync_event_mfd = mfd;
+	vsync_event_hw = (mfd->panel_info.type == MIPI_VIDEO_PANEL) ||
+		(mfd->panel_info.type == LCDC_PANEL);
+
+	INIT_WORK(&vsync_event_work, mdp_vsync_event_work);
+	hrtimer_init(&vsync_event_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	vsync_event_timer.function = mdp_vsync_event_timer_fn;
+
+	if (sysfs_create_group(&mfd->fbi->dev->kobj, &mdp_vsync_attr_group))
+		printk(KERN_ERR "%s: sysfs group creation failed\n", __func__);
+}
+
+/*
+ * Frame timing
+ *
+ * Every pan of the primary panel gets a slot in a ring recording when the
+ * pan was requested and when the DMA feeding the panel started and
+ * finished, together with the vsync count at the time of the pan.
+ */
+#define MDP_FRAME_TIMING_SIZE	128	/* Power of two */
+
+struct mdp_frame_timing {
+	u32 frame;
+	u32 vsync;
+	ktime_t t[MDP_FRAME_MAX];
+};
+
+static struct mdp_frame_timing mdp_frame_ring[MDP_FRAME_TIMING_SIZE];
+static u32 mdp_frame_next;
+static DEFINE_SPINLOCK(mdp_frame_lock);
+
+void mdp_frame_timing_mark(int stage)
+{
+	struct mdp_frame_timing *ft;
+	unsigned long flag;
+	ktime_t now = ktime_get();
+
+	spin_lock_irqsave(&mdp_frame_lock, flag);
+
+	if (stage == MDP_FRAME_PAN) {
+		ft = &mdp_frame_ring[mdp_frame_next &
+			(MDP_FRAME_TIMING_SIZE - 1)];
+		memset(ft, 0, sizeof(*ft));
+		ft->frame = mdp_frame_next++;
+		ft->vsync = vsync_event_count;
+		ft->t[MDP_FRAME_PAN] = now;
+	} else if (mdp_frame_next) {
+		ft = &mdp_frame_ring[(mdp_frame_next - 1) &
+			(MDP_FRAME_TIMING_SIZE - 1)];
+		/* A pan split into several DMAs: first start, last done */
+		if (stage == MDP_FRAME_DMA_DONE ||
+			!ft->t[MDP_FRAME_DMA_START].tv64)
+			ft->t[stage] = now;
+	}
+
+	spin_unlock_irqrestore(&mdp_frame_lock, flag);
+
+	/* Software vsync stops with the panel, pans start it again */
+	if (stage == MDP_FRAME_PAN && vsync_event_mfd && !vsync_event_hw) {
+		mutex_lock(&vsync_event_ctrl_lock);
+		if (vsync_event_mode != MDP_VSYNC_EVENT_OFF)
+			mdp_vsync_event_start();
+		mutex_unlock(&vsync_event_ctrl_lock);
+	}
+}
+
+/*
+ * One line per frame, oldest first: frame number, vsync count, pan time
+ * (ns), then pan to DMA start and DMA start to DMA done in us (-1 when the
+ * stage wasn't seen).
+ */
+int mdp_frame_timing_show(struct seq_file *s, void *unused)
+{
+	struct mdp_frame_timing *ring, *ft;
+	unsigned long flag;
+	u32 next, n, i;
+	s64 start, done;
+
+	ring = vmalloc(sizeof(mdp_frame_ring));
+	if (!ring)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&mdp_frame_lock, flag);
+	memcpy(ring, mdp_frame_ring, sizeof(mdp_frame_ring));
+	next = mdp_frame_next;
+	spin_unlock_irqrestore(&mdp_frame_lock, flag);
+
+	n = min_t(u32, next, MDP_FRAME_TIMING_SIZE);
+
+	seq_printf(s, "frame vsync pan_ns start_us done_us\n");
+	for (i = next - n; i != next; i++) {
+		ft = &ring[i & (MDP_FRAME_TIMING_SIZE - 1)];
+
+		start = ft->t[MDP_FRAME_DMA_START].tv64 ?
+			ktime_us_delta(ft->t[MDP_FRAME_DMA_START],
+				ft->t[MDP_FRAME_PAN]) : -1;
+		done = (ft->t[MDP_FRAME_DMA_DONE].tv64 &&
+			ft->t[MDP_FRAME_DMA_START].tv64) ?
+			ktime_us_delta(ft->t[MDP_FRAME_DMA_DONE],
+				ft->t[MDP_FRAME_DMA_START]) : -1;
+
+		seq_printf(s, "%u %u %lld %lld %lld\n", ft->frame, ft->vsync,
+			ktime_to_ns(ft->t[MDP_FRAME_PAN]), start, done);
+	}
+
+	vfree(ring);
+	return 0;
+}
@@ -50,6 +50,7 @@
 #include "mdp.h"
 #include "mdp4.h"
 #include "mipi_dsi.h"
+#include "msm_fb_blitq.h"
 
 #define LCD_INIT_MIPI	1
 #define LCD_INIT_MDDI	2
@@ -502,6 +503,11 @@ static int msm_fb_probe(struct platform_device *pdev)
 
 	pdev_list[pdev_list_cnt++] = pdev;
 	msm_fb_create_sysfs(pdev);
+	if (mfd->index == 0)
+		mdp_vsync_event_init(mfd);
+
+	if (msmfb_blitq_init(mfd))
+		printk(KERN_ERR "msm_fb_probe: can't create blit queue\n");
 
 /* EMC workaround for LCM hang after ESD test */
 #ifdef PROTOU_ESD_WORKAROUND
@@ -543,6 +549,8 @@ static int msm_fb_remove(struct platform_device *pdev)
 	if (!mfd)
 		return -ENODEV;
 
+	msmfb_blitq_destroy(mfd);
+
 	pm_runtime_disable(mfd->fbi->dev);
 
 	if (mfd->key != MFD_KEY)
@@ -644,6 +652,9 @@ static int msm_fb_suspend_sub(struct msm_fb_data_type *mfd)
 		del_timer(&mfd->msmfb_no_update_notify_timer);
 	complete(&mfd->msmfb_no_update_notify);
 
+	/* Let any queued blits finish before the hardware goes away */
+	msmfb_blitq_flush(mfd);
+
 	/*
 	 * suspend this channel
 	 */
@@ -1856,6 +1867,7 @@ static int msm_fb_release(struct fb_info *info, int user)
 	mfd->ref_cnt--;
 
 	if (!mfd->ref_cnt) {
+		msmfb_blitq_flush(mfd);
 		pr_info("[DISP] %s: blank!\n", __func__);
 		ret = msm_fb_blank_sub(FB_BLANK_POWERDOWN, info, mfd->op_enable);
 		if (ret) {
@@ -1961,8 +1973,16 @@ static int msm_fb_pan_display(struct fb_var_screeninfo *var,
 				return -EINVAL;
 			}
 		}
-		mdp_set_dma_pan_info(info, dirtyPtr,
+		if (info->node == 0)
+			mdp_frame_timing_mark(MDP_FRAME_PAN);
+		if (dirtyPtr == NULL && mfd->dirty_cnt)
+			mdp_set_dma_pan_regions(info, mfd->dirty_list,
+				mfd->dirty_cnt,
+				(var->activate == FB_ACTIVATE_VBL));
+		else
+			mdp_set_dma_pan_info(info, dirtyPtr,
 				     (var->activate == FB_ACTIVATE_VBL));
+		mfd->dirty_cnt = 0;
 		mdp_dma_pan_update(info);
 		up(&msm_fb_pan_sem);
 
@@ -1985,6 +2005,46 @@ static int msm_fb_pan_display(struct fb_var_screeninfo *var,
 	return 0;
 }
 
+static int msm_fb_set_dirty_regions(struct fb_info *info, void __user *p)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	struct msmfb_dirty_regions regions;
+	struct mdp_rect *r;
+	int i;
+
+	if (copy_from_user(&regions, p, sizeof(regions)))
+		return -EFAULT;
+
+	if (regions.count > MSMFB_MAX_DIRTY_REGIONS)
+		return -EINVAL;
+
+	for (i = 0; i < regions.count; i++) {
+		r = &regions.rect[i];
+
+		if ((r->w == 0) || (r->h == 0))
+			return -EINVAL;
+		if ((r->x + r->w) > info->var.xres ||
+			(r->x + r->w) < r->x)
+			return -EINVAL;
+		if ((r->y + r->h) > info->var.yres ||
+			(r->y + r->h) < r->y)
+			return -EINVAL;
+	}
+
+	down(&msm_fb_pan_sem);
+	for (i = 0; i < regions.count; i++) {
+		r = &regions.rect[i];
+		mfd->dirty_list[i].xoffset = r->x;
+		mfd->dirty_list[i].yoffset = r->y;
+		mfd->dirty_list[i].width = r->w;
+		mfd->dirty_list[i].height = r->h;
+	}
+	mfd->dirty_cnt = regions.count;
+	up(&msm_fb_pan_sem);
+
+	return 0;
+}
+
 static int msm_fb_check_var(struct fb_var_screeninfo *var, struct fb_info *info)
 {
 	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
@@ -2190,6 +2250,16 @@ int msm_fb_resume_sw_refresher(struct msm_fb_data_type *mfd)
 	return 0;
 }
 
+/* One PPP pass of a request, possibly a piece of a split one */
+static int mdp_blit_part(struct fb_info *info, struct mdp_blit_req *req,
+	struct mdp_blit_img *src, struct mdp_blit_img *dst)
+{
+	if (src)
+		return mdp_ppp_blit_img(info, req, src, dst);
+
+	return mdp_ppp_blit(info, req);
+}
+
 #if defined CONFIG_FB_MSM_MDP31
 static int mdp_blit_split_height(struct fb_info *info,
 				struct mdp_blit_req *req)
@@ -2318,7 +2388,12 @@ static int mdp_blit_split_height(struct fb_info *info,
 }
 #endif
 
-int mdp_blit(struct fb_info *info, struct mdp_blit_req *req)
+/*
+ * Blits come from the ioctl, which resolves the memory behind the images
+ * at every PPP pass, or from the blit queue, which resolved it up front
+ */
+static int __mdp_blit(struct fb_info *info, struct mdp_blit_req *req,
+	struct mdp_blit_img *src, struct mdp_blit_img *dst)
 {
 	int ret;
 #if defined CONFIG_FB_MSM_MDP31 || defined CONFIG_FB_MSM_MDP30
@@ -2621,7 +2696,7 @@ int mdp_blit(struct fb_info *info, struct mdp_blit_req *req)
 		}
 
 		/* No need to split in height */
-		ret = mdp_ppp_blit(info, &splitreq);
+		ret = mdp_blit_part(info, &splitreq, src, dst);
 
 		if (ret)
 			return ret;
@@ -2651,20 +2726,43 @@ int mdp_blit(struct fb_info *info, struct mdp_blit_req *req)
 		}
 
 		/* No need to split in height ... just width */
-		ret = mdp_ppp_blit(info, &splitreq);
+		ret = mdp_blit_part(info, &splitreq, src, dst);
 
 		if (ret)
 			return ret;
 
 	} else
-		ret = mdp_ppp_blit(info, req);
+		ret = mdp_blit_part(info, req, src, dst);
 	return ret;
 #else
-	ret = mdp_ppp_blit(info, req);
+	ret = mdp_blit_part(info, req, src, dst);
 	return ret;
 #endif
 }
 
+int mdp_blit(struct fb_info *info, struct mdp_blit_req *req)
+{
+	return __mdp_blit(info, req, NULL, NULL);
+}
+
+#ifdef CONFIG_FB_MSM_BLIT_QUEUE
+/*
+ * Blit using images resolved by mdp_ppp_get_blit_img(), with the same
+ * checks and split workarounds as MSMFB_BLIT; drops the references.
+ */
+int mdp_blit_resolved(struct fb_info *info, struct mdp_blit_req *req,
+	struct mdp_blit_img *src, struct mdp_blit_img *dst)
+{
+	int ret;
+
+	ret = __mdp_blit(info, req, src, dst);
+
+	mdp_ppp_put_blit_img(src);
+	mdp_ppp_put_blit_img(dst);
+	return ret;
+}
+#endif
+
 typedef void (*msm_dma_barrier_function_pointer) (void *, size_t);
 
 static inline void msm_fb_dma_barrier_for_rect(struct fb_info *info,
@@ -2741,7 +2839,7 @@ static inline void msm_dma_fromdevice_wb_post(void *start, size_t size)
  *       included in the address range rather than
  *       doing multiple calls for each row.
 */
-static void msm_fb_ensure_memory_coherency_before_dma(struct fb_info *info,
+void msm_fb_ensure_memory_coherency_before_dma(struct fb_info *info,
 		struct mdp_blit_req *req_list,
 		int req_list_count)
 {
@@ -2824,7 +2922,7 @@ static void msm_fb_ensure_memory_coherency_before_dma(struct fb_info *info,
  *       included in the address range rather than
  *       doing multiple calls for each row.
 */
-static void msm_fb_ensure_memory_coherency_after_dma(struct fb_info *info,
+void msm_fb_ensure_memory_coherency_after_dma(struct fb_info *info,
 		struct mdp_blit_req *req_list,
 		int req_list_count)
 {
@@ -3533,12 +3631,32 @@ static int msm_fb_ioctl(struct fb_info *info, unsigned int cmd,
 		break;
 #endif
 	case MSMFB_BLIT:
+		/* Keep ordering with any blits that are still queued */
+		msmfb_blitq_flush(mfd);
 		down(&msm_fb_ioctl_ppp_sem);
 		ret = msmfb_blit(info, argp);
 		up(&msm_fb_ioctl_ppp_sem);
 
 		break;
 
+	case MSMFB_ASYNC_BLIT:
+		/* Same restriction as MSMFB_BLIT */
+		if (bf_supported && (info->node == 1 || info->node == 2)) {
+			pr_err("%s: no blit for fb%d.", __func__, info->node);
+			ret = -EPERM;
+			break;
+		}
+		ret = msmfb_async_blit(info, argp);
+		break;
+
+	case MSMFB_BLIT_WAIT:
+		ret = msmfb_blit_wait(info, argp);
+		break;
+
+	case MSMFB_SET_DIRTY_REGIONS:
+		ret = msm_fb_set_dirty_regions(info, argp);
+		break;
+
 	/* Ioctl for setting ccs matrix from user space */
 	case MSMFB_SET_CCS_MATRIX:
 #ifndef CONFIG_FB_MSM_MDP40
@@ -198,6 +198,12 @@ struct msm_fb_data_type {
 	u32 writeback_state;
 	bool writeback_active_cnt;
 	int cont_splash_done;
+	/* Set by MSMFB_SET_DIRTY_REGIONS, used up by the next pan */
+	struct mdp_dirty_region dirty_list[MSMFB_MAX_DIRTY_REGIONS];
+	int dirty_cnt;
+#ifdef CONFIG_FB_MSM_BLIT_QUEUE
+	struct msmfb_blitq *blitq;
+#endif
 };
 
 struct dentry *msm_fb_get_debugfs_root(void);
@@ -217,6 +223,11 @@ int msm_fb_writeback_stop(struct fb_info *info);
 int msm_fb_writeback_terminate(struct fb_info *info);
 int msm_fb_detect_client(const char *name);
 int calc_fb_offset(struct msm_fb_data_type *mfd, struct fb_info *fbi, int bpp);
+void msm_fb_ensure_memory_coherency_before_dma(struct fb_info *info,
+		struct mdp_blit_req *req_list, int req_list_count);
+void msm_fb_ensure_memory_coherency_after_dma(struct fb_info *info,
+		struct mdp_blit_req *req_list, int req_list_count);
+extern struct semaphore msm_fb_ioctl_ppp_sem;
 
 #ifdef CONFIG_FB_BACKLIGHT
 void msm_fb_config_backlight(struct msm_fb_data_type *mfd);
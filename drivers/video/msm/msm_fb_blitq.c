@@ -0,0 +1,511 @@
+/* Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * Queued MSMFB blits.  MSMFB_ASYNC_BLIT validates a request list, resolves
+ * the memory behind every image in the caller's context and hands the list
+ * to a worker that feeds it to the blit backend.  The caller gets a fence
+ * back straight away and can wait for it with MSMFB_BLIT_WAIT.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/fb.h>
+#include <linux/msm_mdp.h>
+#include <linux/uaccess.h>
+#include <linux/sched.h>
+#include <linux/device.h>
+#include <linux/math64.h>
+
+#include "msm_fb.h"
+#include "mdp.h"
+#include "msm_fb_blitq.h"
+
+#define MSMFB_BLITQ_MAX_REQ 256
+
+struct msmfb_blitq_item {
+	struct mdp_blit_req req;
+	struct mdp_blit_img src;
+	struct mdp_blit_img dst;
+};
+
+struct msmfb_blitq_list {
+	struct list_head node;
+	u32 fence;
+	int count;
+	ktime_t queued;
+	struct msmfb_blitq_item items[];
+};
+
+/* Fences are free running, so compare them with wraparound in mind */
+static inline int msmfb_fence_passed(u32 current_fence, u32 fence)
+{
+	return (s32) (current_fence - fence) >= 0;
+}
+
+static struct msmfb_blitq_status *msmfb_blitq_status(struct msmfb_blitq *q,
+	u32 fence)
+{
+	return &q->status[fence % MSMFB_BLITQ_STATUS_HISTORY];
+}
+
+static int msmfb_blitq_retired(struct msmfb_blitq *q, u32 fence)
+{
+	int ret;
+
+	spin_lock(&q->lock);
+	ret = msmfb_fence_passed(q->retired, fence);
+	spin_unlock(&q->lock);
+
+	return ret;
+}
+
+static const struct msmfb_blitq_ops msmfb_blitq_ppp_ops = {
+	.name = "ppp",
+	.blit = mdp_blit_resolved,
+};
+
+static const struct msmfb_blitq_ops msmfb_blitq_sw_ops = {
+	.name = "sw",
+	.blit = mdp_ppp_sw_blit,
+};
+
+/* PPP for everything it accepts, the CPU for the rest */
+static int msmfb_blitq_auto_blit(struct fb_info *info,
+	struct mdp_blit_req *req, struct mdp_blit_img *src,
+	struct mdp_blit_img *dst)
+{
+	if (mdp_ppp_blit_supported(info, req))
+		return mdp_blit_resolved(info, req, src, dst);
+
+	return mdp_ppp_sw_blit(info, req, src, dst);
+}
+
+static const struct msmfb_blitq_ops msmfb_blitq_auto_ops = {
+	.name = "auto",
+	.blit = msmfb_blitq_auto_blit,
+};
+
+static const struct msmfb_blitq_ops *msmfb_blitq_backends[] = {
+	&msmfb_blitq_ppp_ops,
+	&msmfb_blitq_sw_ops,
+	&msmfb_blitq_auto_ops,
+};
+
+static void msmfb_blitq_release_list(struct msmfb_blitq_list *list)
+{
+	int i;
+
+	for (i = 0; i < list->count; i++) {
+		mdp_ppp_put_blit_img(&list->items[i].src);
+		mdp_ppp_put_blit_img(&list->items[i].dst);
+	}
+
+	kfree(list);
+}
+
+/* Execute one request list.  Called from the worker only. */
+static int msmfb_blitq_run(struct msmfb_blitq *q,
+	struct msmfb_blitq_list *list)
+{
+	struct fb_info *info = q->mfd->fbi;
+	struct msmfb_blitq_stats *stats = &q->stats;
+	ktime_t start;
+	u32 wait_us, exec_us;
+	int i, ret = 0;
+
+	down(&msm_fb_ioctl_ppp_sem);
+
+	start = ktime_get();
+
+	for (i = 0; i < list->count; i++) {
+		struct msmfb_blitq_item *item = &list->items[i];
+
+		if (item->req.flags & MDP_NO_BLIT)
+			continue;
+
+		/* Like MSMFB_BLIT, stop at the first failure */
+		if (ret) {
+			mdp_ppp_put_blit_img(&item->src);
+			mdp_ppp_put_blit_img(&item->dst);
+			continue;
+		}
+
+		msm_fb_ensure_memory_coherency_before_dma(info,
+				&item->req, 1);
+
+		/* The backend drops the image references */
+		ret = q->ops->blit(info, &item->req, &item->src, &item->dst);
+
+		msm_fb_ensure_memory_coherency_after_dma(info,
+				&item->req, 1);
+
+		stats->blits++;
+		if (ret)
+			stats->errors++;
+	}
+
+	up(&msm_fb_ioctl_ppp_sem);
+
+	wait_us = (u32) ktime_us_delta(start, list->queued);
+	exec_us = (u32) ktime_us_delta(ktime_get(), start);
+
+	stats->lists++;
+	stats->wait_us += wait_us;
+	stats->exec_us += exec_us;
+	if (wait_us > stats->wait_max_us)
+		stats->wait_max_us = wait_us;
+	if (exec_us > stats->exec_max_us)
+		stats->exec_max_us = exec_us;
+
+	return ret;
+}
+
+static void msmfb_blitq_work(struct work_struct *work)
+{
+	struct msmfb_blitq *q = container_of(work, struct msmfb_blitq, work);
+	struct msmfb_blitq_list *list;
+	struct msmfb_blitq_status *status;
+	int ret;
+
+	for (;;) {
+		spin_lock(&q->lock);
+		if (list_empty(&q->pending)) {
+			spin_unlock(&q->lock);
+			break;
+		}
+		/* Leave the list queued so it still counts as pending */
+		list = list_first_entry(&q->pending, struct msmfb_blitq_list,
+			node);
+		spin_unlock(&q->lock);
+
+		ret = msmfb_blitq_run(q, list);
+
+		spin_lock(&q->lock);
+		list_del(&list->node);
+		q->npending--;
+		q->retired = list->fence;
+		status = msmfb_blitq_status(q, list->fence);
+		status->fence = list->fence;
+		status->err = ret;
+		spin_unlock(&q->lock);
+
+		wake_up_all(&q->wait);
+		kfree(list);
+	}
+}
+
+int msmfb_async_blit(struct fb_info *info, void __user *p)
+{
+	struct msm_fb_data_type *mfd = info->par;
+	struct msmfb_blitq *q = mfd->blitq;
+	struct msmfb_async_blit_list header;
+	struct msmfb_async_blit_list __user *ulist = p;
+	struct msmfb_blitq_list *list;
+	u32 fence;
+	int i, ret;
+
+	if (q == NULL)
+		return -ENODEV;
+
+	if (copy_from_user(&header, p, sizeof(header)))
+		return -EFAULT;
+
+	if (header.count == 0 || header.count >= MSMFB_BLITQ_MAX_REQ)
+		return -EINVAL;
+
+	list = kzalloc(sizeof(*list) +
+		header.count * sizeof(struct msmfb_blitq_item), GFP_KERNEL);
+	if (list == NULL)
+		return -ENOMEM;
+
+	INIT_LIST_HEAD(&list->node);
+
+	/*
+	 * Validate every request and resolve the memory behind it now -
+	 * the file descriptors mean nothing once we are in the worker
+	 */
+	for (i = 0; i < header.count; i++) {
+		struct msmfb_blitq_item *item = &list->items[i];
+		struct mdp_blit_req *req = &item->req;
+
+		if (copy_from_user(req, &ulist->req[i], sizeof(*req))) {
+			ret = -EFAULT;
+			goto err;
+		}
+
+		/* count only covers the items filled in so far */
+		list->count = i + 1;
+
+		if (req->flags & MDP_NO_BLIT)
+			continue;
+
+		if (unlikely(req->src_rect.h == 0 || req->src_rect.w == 0)) {
+			pr_err("%s: src img of zero size!\n", __func__);
+			ret = -EINVAL;
+			goto err;
+		}
+
+		/* Nothing to do for an empty destination */
+		if (unlikely(req->dst_rect.h == 0 || req->dst_rect.w == 0)) {
+			req->flags |= MDP_NO_BLIT;
+			continue;
+		}
+
+		ret = mdp_ppp_get_blit_img(info, &req->src,
+			req->flags & MDP_BLIT_SRC_GEM, &item->src);
+		if (ret == 0)
+			ret = mdp_ppp_get_blit_img(info, &req->dst,
+				req->flags & MDP_BLIT_DST_GEM, &item->dst);
+		if (ret) {
+			pr_err("%s: could not retrieve image from memory\n",
+				__func__);
+			goto err;
+		}
+	}
+
+	/* Only submitters move next_fence, one at a time */
+	ret = mutex_lock_interruptible(&q->submit_lock);
+	if (ret)
+		goto err;
+
+	spin_lock(&q->lock);
+	while (q->npending >= MSMFB_BLITQ_MAX_PENDING) {
+		spin_unlock(&q->lock);
+
+		ret = wait_event_interruptible(q->wait,
+			q->npending < MSMFB_BLITQ_MAX_PENDING);
+		if (ret)
+			goto err_unlock;
+
+		spin_lock(&q->lock);
+	}
+	fence = q->next_fence + 1;
+	spin_unlock(&q->lock);
+
+	/* Hand out the fence while the list can still be dropped */
+	if (put_user(fence, &ulist->fence)) {
+		ret = -EFAULT;
+		goto err_unlock;
+	}
+
+	spin_lock(&q->lock);
+	q->next_fence = fence;
+	list->fence = fence;
+	list->queued = ktime_get();
+	list_add_tail(&list->node, &q->pending);
+
+	if (++q->npending > q->stats.max_pending)
+		q->stats.max_pending = q->npending;
+	spin_unlock(&q->lock);
+	mutex_unlock(&q->submit_lock);
+
+	/* The list belongs to the worker now, don't touch it again */
+	queue_work(q->wq, &q->work);
+
+	return 0;
+err_unlock:
+	mutex_unlock(&q->submit_lock);
+err:
+	msmfb_blitq_release_list(list);
+	return ret;
+}
+
+int msmfb_blit_wait(struct fb_info *info, void __user *p)
+{
+	struct msm_fb_data_type *mfd = info->par;
+	struct msmfb_blitq *q = mfd->blitq;
+	struct msmfb_blit_fence req;
+	struct msmfb_blitq_status *status;
+	long ret;
+
+	if (q == NULL)
+		return -ENODEV;
+
+	if (copy_from_user(&req, p, sizeof(req)))
+		return -EFAULT;
+
+	spin_lock(&q->lock);
+	ret = msmfb_fence_passed(q->next_fence, req.fence);
+	spin_unlock(&q->lock);
+
+	/* Don't wait on a fence that hasn't been handed out yet */
+	if (!ret)
+		return -EINVAL;
+
+	if (req.timeout_ms == 0) {
+		if (!msmfb_blitq_retired(q, req.fence))
+			return -EBUSY;
+	} else {
+		ret = wait_event_interruptible_timeout(q->wait,
+			msmfb_blitq_retired(q, req.fence),
+			msecs_to_jiffies(req.timeout_ms));
+		if (ret == 0)
+			return -ETIMEDOUT;
+		if (ret < 0)
+			return ret;
+	}
+
+	/* Every list keeps its own result until its slot is reused */
+	spin_lock(&q->lock);
+	status = msmfb_blitq_status(q, req.fence);
+	if (status->fence == req.fence)
+		req.status = status->err;
+	else
+		ret = -ENOENT;
+	spin_unlock(&q->lock);
+
+	if (ret == -ENOENT)
+		return ret;
+
+	if (copy_to_user(p, &req, sizeof(req)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/* Wait for everything queued so far to be executed */
+void msmfb_blitq_flush(struct msm_fb_data_type *mfd)
+{
+	if (mfd->blitq)
+		flush_workqueue(mfd->blitq->wq);
+}
+
+static ssize_t msmfb_blitq_backend_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct fb_info *fbi = dev_get_drvdata(dev);
+	struct msm_fb_data_type *mfd = fbi->par;
+
+	return snprintf(buf, PAGE_SIZE, "%s\n", mfd->blitq->ops->name);
+}
+
+static ssize_t msmfb_blitq_backend_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct fb_info *fbi = dev_get_drvdata(dev);
+	struct msm_fb_data_type *mfd = fbi->par;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(msmfb_blitq_backends); i++) {
+		if (sysfs_streq(buf, msmfb_blitq_backends[i]->name)) {
+			/* Switch between lists, never in the middle of one */
+			msmfb_blitq_flush(mfd);
+			down(&msm_fb_ioctl_ppp_sem);
+			mfd->blitq->ops = msmfb_blitq_backends[i];
+			up(&msm_fb_ioctl_ppp_sem);
+			return count;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static ssize_t msmfb_blitq_stats_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct fb_info *fbi = dev_get_drvdata(dev);
+	struct msm_fb_data_type *mfd = fbi->par;
+	struct msmfb_blitq_stats stats = mfd->blitq->stats;
+	u32 lists = stats.lists ? stats.lists : 1;
+
+	return snprintf(buf, PAGE_SIZE,
+		"lists: %u\nblits: %u\nerrors: %u\nmax_pending: %u\n"
+		"wait_avg_us: %llu\nwait_max_us: %u\n"
+		"exec_avg_us: %llu\nexec_max_us: %u\n",
+		stats.lists, stats.blits, stats.errors, stats.max_pending,
+		div_u64(stats.wait_us, lists), stats.wait_max_us,
+		div_u64(stats.exec_us, lists), stats.exec_max_us);
+}
+
+/* Any write resets the statistics */
+static ssize_t msmfb_blitq_stats_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct fb_info *fbi = dev_get_drvdata(dev);
+	struct msm_fb_data_type *mfd = fbi->par;
+
+	down(&msm_fb_ioctl_ppp_sem);
+	memset(&mfd->blitq->stats, 0, sizeof(mfd->blitq->stats));
+	up(&msm_fb_ioctl_ppp_sem);
+
+	return count;
+}
+
+static DEVICE_ATTR(blit_backend, S_IRUGO | S_IWUSR,
+	msmfb_blitq_backend_show, msmfb_blitq_backend_store);
+static DEVICE_ATTR(blit_stats, S_IRUGO | S_IWUSR,
+	msmfb_blitq_stats_show, msmfb_blitq_stats_store);
+
+static struct attribute *msmfb_blitq_attrs[] = {
+	&dev_attr_blit_backend.attr,
+	&dev_attr_blit_stats.attr,
+	NULL,
+};
+
+static struct attribute_group msmfb_blitq_attr_group = {
+	.attrs = msmfb_blitq_attrs,
+};
+
+int msmfb_blitq_init(struct msm_fb_data_type *mfd)
+{
+	struct msmfb_blitq *q;
+	char name[16];
+	int ret;
+
+	q = kzalloc(sizeof(*q), GFP_KERNEL);
+	if (q == NULL)
+		return -ENOMEM;
+
+	snprintf(name, sizeof(name), "msm_fb_blitq%d", mfd->index);
+	q->wq = create_singlethread_workqueue(name);
+	if (q->wq == NULL) {
+		kfree(q);
+		return -ENOMEM;
+	}
+
+	q->mfd = mfd;
+	q->ops = &msmfb_blitq_ppp_ops;
+	spin_lock_init(&q->lock);
+	mutex_init(&q->submit_lock);
+	INIT_LIST_HEAD(&q->pending);
+	init_waitqueue_head(&q->wait);
+	INIT_WORK(&q->work, msmfb_blitq_work);
+
+	mfd->blitq = q;
+
+	ret = sysfs_create_group(&mfd->fbi->dev->kobj,
+		&msmfb_blitq_attr_group);
+	if (ret)
+		MSM_FB_ERR("%s: sysfs group creation failed, rc=%d\n",
+			__func__, ret);
+
+	return 0;
+}
+
+void msmfb_blitq_destroy(struct msm_fb_data_type *mfd)
+{
+	struct msmfb_blitq *q = mfd->blitq;
+
+	if (q == NULL)
+		return;
+
+	sysfs_remove_group(&mfd->fbi->dev->kobj, &msmfb_blitq_attr_group);
+
+	flush_workqueue(q->wq);
+	destroy_workqueue(q->wq);
+
+	mfd->blitq = NULL;
+	kfree(q);
+}
@@ -0,0 +1,98 @@
+/* Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef MSM_FB_BLITQ_H
+#define MSM_FB_BLITQ_H
+
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+
+struct msm_fb_data_type;
+
+/* Number of request lists that can be pending before the ioctl blocks */
+#define MSMFB_BLITQ_MAX_PENDING 8
+
+/* Number of retired lists whose status MSMFB_BLIT_WAIT can still report */
+#define MSMFB_BLITQ_STATUS_HISTORY 32
+
+/* Backend that executes queued blit requests */
+struct msmfb_blitq_ops {
+	const char *name;
+	int (*blit)(struct fb_info *info, struct mdp_blit_req *req,
+		    struct mdp_blit_img *src, struct mdp_blit_img *dst);
+};
+
+struct msmfb_blitq_stats {
+	u32 lists;		/* Request lists retired */
+	u32 blits;		/* Individual blits executed */
+	u32 errors;		/* Blits that returned an error */
+	u32 max_pending;	/* Deepest the queue has been */
+	u64 wait_us;		/* Total time lists spent queued */
+	u32 wait_max_us;
+	u64 exec_us;		/* Total time spent executing lists */
+	u32 exec_max_us;
+};
+
+struct msmfb_blitq_status {
+	u32 fence;
+	int err;
+};
+
+struct msmfb_blitq {
+	struct msm_fb_data_type *mfd;
+	struct workqueue_struct *wq;
+	struct work_struct work;
+
+	spinlock_t lock;		/* Protects the pending list */
+	struct list_head pending;
+	int npending;
+
+	struct mutex submit_lock;	/* Orders fence hand out and queueing */
+	u32 next_fence;			/* Fence handed to the last list */
+	u32 retired;			/* Fence of the last retired list */
+	/* Result of the latest retired lists, indexed by fence */
+	struct msmfb_blitq_status status[MSMFB_BLITQ_STATUS_HISTORY];
+	wait_queue_head_t wait;
+
+	const struct msmfb_blitq_ops *ops;
+	struct msmfb_blitq_stats stats;
+};
+
+#ifdef CONFIG_FB_MSM_BLIT_QUEUE
+int msmfb_blitq_init(struct msm_fb_data_type *mfd);
+void msmfb_blitq_destroy(struct msm_fb_data_type *mfd);
+void msmfb_blitq_flush(struct msm_fb_data_type *mfd);
+int msmfb_async_blit(struct fb_info *info, void __user *p);
+int msmfb_blit_wait(struct fb_info *info, void __user *p);
+#else
+static inline int msmfb_blitq_init(struct msm_fb_data_type *mfd)
+{
+	return 0;
+}
+static inline void msmfb_blitq_destroy(struct msm_fb_data_type *mfd) { }
+static inline void msmfb_blitq_flush(struct msm_fb_data_type *mfd) { }
+static inline int msmfb_async_blit(struct fb_info *info, void __user *p)
+{
+	return -ENOSYS;
+}
+static inline int msmfb_blit_wait(struct fb_info *info, void __user *p)
+{
+	return -ENOSYS;
+}
+#endif
+
+#endif /* MSM_FB_BLITQ_H */
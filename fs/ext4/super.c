@@ -70,6 +70,7 @@ static void ext4_mark_recovery_complete(struct super_block *sb,
 static void ext4_clear_journal_err(struct super_block *sb,
 				   struct ext4_super_block *es);
 static int ext4_sync_fs(struct super_block *sb, int wait);
+static int ext4_sync_pending(struct super_block *sb);
 static const char *ext4_decode_error(struct super_block *sb, int errno,
 				     char nbuf[16]);
 static int ext4_remount(struct super_block *sb, int *flags, char *data);
@@ -1279,6 +1280,7 @@ static const struct super_operations ext4_sops = {
 	.evict_inode	= ext4_evict_inode,
 	.put_super	= ext4_put_super,
 	.sync_fs	= ext4_sync_fs,
+	.sync_pending	= ext4_sync_pending,
 	.freeze_fs	= ext4_freeze,
 	.unfreeze_fs	= ext4_unfreeze,
 	.statfs		= ext4_statfs,
@@ -4247,6 +4249,22 @@ static int ext4_sync_fs(struct super_block *sb, int wait)
 	return ret;
 }
 
+/*
+ * Only the running or committing transaction needs ext4_sync_fs(); once
+ * committed, its buffers are dirty in the block device mapping.
+ */
+static int ext4_sync_pending(struct super_block *sb)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	int ret;
+
+	read_lock(&journal->j_state_lock);
+	ret = journal->j_running_transaction != NULL ||
+	      journal->j_committing_transaction != NULL;
+	read_unlock(&journal->j_state_lock);
+	return ret;
+}
+
 /*
  * LVM calls this function before a (read-only) snapshot is created.  This
  * gives us a chance to flush the journal completely and mark the fs clean.
@@ -92,6 +92,100 @@ static void sync_filesystems(int wait)
 	iterate_supers(sync_one_sb, &wait);
 }
 
+/*
+ * Does @sb have anything for sync to write or wait on?  Dirty inodes sit
+ * on the per-bdi lists, which every partition of a device shares, so look
+ * for one that belongs to @sb; metadata lives in the block device mapping.
+ * An inode whose pages are still under writeback has left those lists, so
+ * pages in flight on the bdi count too.  A journalling filesystem can
+ * hold metadata none of this sees until its transaction commits, so it
+ * says so through ->sync_pending.
+ */
+static bool sb_has_dirty_data(struct super_block *sb)
+{
+	struct bdi_writeback *wb = &sb->s_bdi->wb;
+	struct list_head *lists[] = { &wb->b_dirty, &wb->b_io, &wb->b_more_io };
+	struct inode *inode;
+	bool dirty = false;
+	int i;
+
+	if (sb->s_dirt)
+		return true;
+
+	if (sb->s_op->sync_pending && sb->s_op->sync_pending(sb))
+		return true;
+
+	if (bdi_stat_sum(sb->s_bdi, BDI_WRITEBACK) > 0)
+		return true;
+
+	if (sb->s_bdev) {
+		struct address_space *mapping = sb->s_bdev->bd_inode->i_mapping;
+
+		if (mapping_tagged(mapping, PAGECACHE_TAG_DIRTY) ||
+		    mapping_tagged(mapping, PAGECACHE_TAG_WRITEBACK))
+			return true;
+	}
+
+	spin_lock(&inode_wb_list_lock);
+	for (i = 0; i < ARRAY_SIZE(lists) && !dirty; i++) {
+		list_for_each_entry(inode, lists[i], i_wb_list) {
+			if (inode->i_sb == sb) {
+				dirty = true;
+				break;
+			}
+		}
+	}
+	spin_unlock(&inode_wb_list_lock);
+
+	return dirty;
+}
+
+struct sync_dirty_arg {
+	bool (*abort)(void);
+	int synced;
+	bool aborted;
+};
+
+static void sync_dirty_sb(struct super_block *sb, void *p)
+{
+	struct sync_dirty_arg *arg = p;
+
+	if (arg->aborted || (sb->s_flags & MS_RDONLY) ||
+	    sb->s_bdi == &noop_backing_dev_info || !sb_has_dirty_data(sb))
+		return;
+
+	if (arg->abort && arg->abort()) {
+		arg->aborted = true;
+		return;
+	}
+
+	__sync_filesystem(sb, 0);
+	__sync_filesystem(sb, 1);
+	arg->synced++;
+}
+
+/**
+ * sync_dirty_filesystems - sync only the filesystems with dirty data
+ * @abort: checked before each filesystem, stop early if it returns true
+ *
+ * Unlike sys_sync() this neither kicks the flusher threads for every bdi
+ * nor walks and waits on clean filesystems, so a sync that finds little
+ * to write is cheap.  Data written before an abort stays written and is
+ * not looked at again by the next call.
+ *
+ * Returns the number of filesystems synced, or -EINTR if aborted.
+ */
+int sync_dirty_filesystems(bool (*abort)(void))
+{
+	struct sync_dirty_arg arg = { .abort = abort };
+
+	iterate_supers(sync_dirty_sb, &arg);
+	if (unlikely(laptop_mode) && !arg.aborted)
+		laptop_sync_completion();
+
+	return arg.aborted ? -EINTR : arg.synced;
+}
+
 /*
  * sync everything.  Start out by waking pdflush, because that writes back
  * all queues in parallel.
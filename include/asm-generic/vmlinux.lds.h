@@ -632,8 +632,12 @@
   	*(.initcall5.init)						\
   	*(.initcall5s.init)						\
 	*(.initcallrootfs.init)						\
+	VMLINUX_SYMBOL(__initcall_async_start) = .;			\
+	*(.initcall6a.init)						\
+	VMLINUX_SYMBOL(__initcall_async_end) = .;			\
   	*(.initcall6.init)						\
   	*(.initcall6s.init)						\
+	VMLINUX_SYMBOL(__initcall_late_start) = .;			\
   	*(.initcall7.init)						\
   	*(.initcall7s.init)
 
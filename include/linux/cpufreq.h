@@ -367,6 +367,16 @@ extern struct cpufreq_governor cpufreq_gov_interactive;
 #define CPUFREQ_DEFAULT_GOVERNOR	(&cpufreq_gov_interactive)
 #endif
 
+struct task_struct;
+
+#ifdef CONFIG_CPU_FREQ_GOV_INTERACTIVE
+void cpufreq_interactive_binder_boost(struct task_struct *task);
+#else
+static inline void cpufreq_interactive_binder_boost(struct task_struct *task)
+{
+}
+#endif
+
 
 /*********************************************************************
  *                     FREQUENCY TABLE HELPERS                       *
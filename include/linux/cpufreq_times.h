@@ -0,0 +1,38 @@
+/*
+ * include/linux/cpufreq_times.h - per task and per uid time in state
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _LINUX_CPUFREQ_TIMES_H
+#define _LINUX_CPUFREQ_TIMES_H
+
+#include <linux/sched.h>
+#include <linux/string.h>
+
+struct seq_file;
+struct pid_namespace;
+struct pid;
+
+#ifdef CONFIG_CPU_FREQ_TIMES
+void cpufreq_task_times_switch(struct task_struct *prev);
+void cpufreq_task_times_exit(struct task_struct *p);
+int proc_time_in_state_show(struct seq_file *m, struct pid_namespace *ns,
+			    struct pid *pid, struct task_struct *p);
+int proc_tgid_time_in_state_show(struct seq_file *m,
+				 struct pid_namespace *ns, struct pid *pid,
+				 struct task_struct *p);
+
+static inline void cpufreq_task_times_init(struct task_struct *p)
+{
+	memset(p->time_in_state, 0, sizeof(p->time_in_state));
+}
+#else
+static inline void cpufreq_task_times_switch(struct task_struct *prev) {}
+static inline void cpufreq_task_times_exit(struct task_struct *p) {}
+static inline void cpufreq_task_times_init(struct task_struct *p) {}
+#endif /* CONFIG_CPU_FREQ_TIMES */
+
+#endif /* _LINUX_CPUFREQ_TIMES_H */
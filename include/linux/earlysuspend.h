@@ -29,18 +29,33 @@
  * the suspend handlers have already been called without a matching call to the
  * resume handlers, the suspend handler will be called directly from
  * register_early_suspend. This direct call can violate the normal level order.
+ *
+ * Handlers flagged EARLY_SUSPEND_ASYNC may run concurrently with the other
+ * handlers between the same two named levels below (e.g. 100 to 149).  All
+ * of them have finished before any handler past the next named level runs.
  */
 enum {
 	EARLY_SUSPEND_LEVEL_BLANK_SCREEN = 50,
 	EARLY_SUSPEND_LEVEL_STOP_DRAWING = 100,
 	EARLY_SUSPEND_LEVEL_DISABLE_FB = 150,
 };
+#define EARLY_SUSPEND_LEVEL_STEP	50
+
+#define EARLY_SUSPEND_ASYNC	(1U << 0)
+
 struct early_suspend {
 #ifdef CONFIG_HAS_EARLYSUSPEND
 	struct list_head link;
 	int level;
+	unsigned int flags;
 	void (*suspend)(struct early_suspend *h);
 	void (*resume)(struct early_suspend *h);
+	struct {
+		unsigned int suspend_us;	/* Last call */
+		unsigned int resume_us;
+		unsigned int max_suspend_us;
+		unsigned int max_resume_us;
+	} stat;
 #endif
 };
 
@@ -205,6 +205,15 @@ extern int initcall_debug;
 #define fs_initcall_sync(fn)		__define_initcall("5s",fn,5s)
 #define rootfs_initcall(fn)		__define_initcall("rootfs",fn,rootfs)
 #define device_initcall(fn)		__define_initcall("6",fn,6)
+
+/*
+ * An async device initcall depends on nothing past the fs level and
+ * nothing depends on it before the late level.  Booted with
+ * initcall_async, these run on the async pool alongside the other
+ * device initcalls and are waited for before late initcalls; otherwise
+ * they run first thing in the device level.
+ */
+#define device_initcall_async(fn)	__define_initcall("6a",fn,6a)
 #define device_initcall_sync(fn)	__define_initcall("6s",fn,6s)
 #define late_initcall(fn)		__define_initcall("7",fn,7)
 #define late_initcall_sync(fn)		__define_initcall("7s",fn,7s)
@@ -287,6 +296,7 @@ void __init parse_early_options(char *cmdline);
 #define subsys_initcall(fn)		module_init(fn)
 #define fs_initcall(fn)			module_init(fn)
 #define device_initcall(fn)		module_init(fn)
+#define device_initcall_async(fn)	module_init(fn)
 #define late_initcall(fn)		module_init(fn)
 
 #define security_initcall(fn)		module_init(fn)
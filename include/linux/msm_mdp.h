@@ -74,6 +74,11 @@
 /* HTC: Define custom ioctl started from 200 */
 #define MSMFB_OVERLAY_CHANGE_ZORDER_VG_PIPES    _IOW(MSMFB_IOCTL_MAGIC, 200, unsigned int)
 #define MSMFB_GET_GAMMA_CURVY _IOWR(MSMFB_IOCTL_MAGIC, 201, struct gamma_curvy)
+#define MSMFB_ASYNC_BLIT _IOWR(MSMFB_IOCTL_MAGIC, 202, \
+						struct msmfb_async_blit_list)
+#define MSMFB_BLIT_WAIT _IOWR(MSMFB_IOCTL_MAGIC, 203, struct msmfb_blit_fence)
+#define MSMFB_SET_DIRTY_REGIONS _IOW(MSMFB_IOCTL_MAGIC, 204, \
+						struct msmfb_dirty_regions)
 
 
 #define FB_TYPE_3D_PANEL 0x10101010
@@ -241,6 +246,39 @@ struct mdp_blit_req_list {
 	struct mdp_blit_req req[];
 };
 
+/*
+ * Queued blit request list.  The requests are validated and queued and the
+ * ioctl returns straight away with a fence that is signalled once every
+ * request in the list has been executed.
+ */
+struct msmfb_async_blit_list {
+	uint32_t fence;		/* out: fence for this list */
+	uint32_t count;
+	struct mdp_blit_req req[];
+};
+
+/*
+ * The status of a list is kept until 32 more lists have retired, after that
+ * MSMFB_BLIT_WAIT fails with ENOENT.
+ */
+struct msmfb_blit_fence {
+	uint32_t fence;		/* fence returned by MSMFB_ASYNC_BLIT */
+	uint32_t timeout_ms;	/* 0 to poll */
+	int32_t status;		/* out: 0 or error of the list */
+};
+
+#define MSMFB_MAX_DIRTY_REGIONS 16
+
+/*
+ * Areas of the screen changed by the next FBIOPAN_DISPLAY.  The regions
+ * are merged into as few panel updates as is worthwhile; a count of zero
+ * goes back to updating the whole screen.
+ */
+struct msmfb_dirty_regions {
+	uint32_t count;
+	struct mdp_rect rect[MSMFB_MAX_DIRTY_REGIONS];
+};
+
 #define MSMFB_DATA_VERSION 2
 
 struct msmfb_data {
@@ -19,14 +19,18 @@
 #define RMNET_MODE_LLP_ETH  (0x01)
 #define RMNET_MODE_LLP_IP   (0x02)
 #define RMNET_MODE_QOS      (0x04)
+#define RMNET_MODE_AGGR     (0x08)
 #define RMNET_MODE_MASK     (RMNET_MODE_LLP_ETH | \
 			     RMNET_MODE_LLP_IP  | \
-			     RMNET_MODE_QOS)
+			     RMNET_MODE_QOS     | \
+			     RMNET_MODE_AGGR)
 
 #define RMNET_IS_MODE_QOS(mode)  \
 	((mode & RMNET_MODE_QOS) == RMNET_MODE_QOS)
 #define RMNET_IS_MODE_IP(mode)   \
 	((mode & RMNET_MODE_LLP_IP) == RMNET_MODE_LLP_IP)
+#define RMNET_IS_MODE_AGGR(mode) \
+	((mode & RMNET_MODE_AGGR) == RMNET_MODE_AGGR)
 
 /* IOCTL command enum
  * Values chosen to not conflict with other drivers in the ecosystem */
@@ -40,6 +44,9 @@ enum rmnet_ioctl_cmds_e {
 	RMNET_IOCTL_GET_OPMODE       = 0x000089F7, /* Get operation mode     */
 	RMNET_IOCTL_OPEN             = 0x000089F8, /* Open transport port    */
 	RMNET_IOCTL_CLOSE            = 0x000089F9, /* Close transport port   */
+	RMNET_IOCTL_SET_AGGR_ENABLE  = 0x000089FA, /* Set aggregation enabled*/
+	RMNET_IOCTL_SET_AGGR_DISABLE = 0x000089FB, /* Set aggregation disabled*/
+	RMNET_IOCTL_GET_AGGR         = 0x000089FC, /* Get aggregation state  */
 	RMNET_IOCTL_MAX
 };
 
@@ -51,4 +58,13 @@ struct QMI_QOS_HDR_S {
 	unsigned long    flow_id;
 };
 
+/* Aggregation header definition: in aggregation mode each SMD packet
+ * carries one or more packets, each preceded by this header giving its
+ * length (QoS header included), little endian, no padding */
+#define RMNET_AGGR_HDR_S  __attribute((__packed__)) rmnet_aggr_hdr_s
+struct RMNET_AGGR_HDR_S {
+	unsigned short   len;
+	unsigned short   reserved;
+};
+
 #endif /* _MSM_RMNET_H_ */
@@ -11,6 +11,21 @@
  *
  */
 
+#include <linux/percpu.h>
+#include <linux/jiffies.h>
+
+/*
+ * Per cpu run queue average, decayed by 1/2^avg_shift each tick and kept
+ * in 1/2^RQ_AVG_FSHIFT tasks.
+ */
+#define RQ_AVG_FSHIFT	10
+#define RQ_AVG_SHIFT_MAX 4
+
+struct rq_cpu_avg {
+	unsigned int avg;
+	unsigned long last_jiffy;
+};
+
 struct rq_data {
 	unsigned int rq_avg;
 	unsigned long rq_poll_jiffies;
@@ -24,8 +39,43 @@ struct rq_data {
 	struct kobject *kobj;
 	struct work_struct def_timer_work;
 	int init;
+
+	unsigned int avg_shift;
+	unsigned int total_avg;		/* Sum over cpus, in tenths */
+	unsigned int up_thresh;		/* In tenths of a task */
+	unsigned int down_thresh;
+	unsigned long up_delay_jiffies;
+	unsigned long down_delay_jiffies;
+	unsigned long state_jiffy;	/* Last tick the state held */
+	int state;			/* Above up_thresh, until below down */
+	int64_t state_time;		/* ns, last state change */
+	struct work_struct state_work;
+	int hotplug_enabled;
 };
 
 extern spinlock_t rq_lock;
 extern struct rq_data rq_info;
 extern struct workqueue_struct *rq_wq;
+DECLARE_PER_CPU(struct rq_cpu_avg, rq_cpu_avg);
+
+/* avg after n ticks with an empty run queue */
+static inline unsigned int rq_avg_decay(unsigned int avg, unsigned long n,
+					unsigned int shift)
+{
+	if (n >= (16UL << shift))
+		return 0;
+
+	while (n-- && avg)
+		avg -= (avg + (1 << shift) - 1) >> shift;
+
+	return avg;
+}
+
+/* Average of @cpu, decayed over any ticks stopped while it idled */
+static inline unsigned int rq_cpu_avg_read(int cpu)
+{
+	struct rq_cpu_avg *ra = &per_cpu(rq_cpu_avg, cpu);
+
+	return rq_avg_decay(ra->avg, jiffies - ra->last_jiffy,
+			    rq_info.avg_shift);
+}
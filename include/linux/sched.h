@@ -140,6 +140,7 @@ extern unsigned long nr_running(void);
 extern unsigned long nr_uninterruptible(void);
 extern unsigned long nr_iowait(void);
 extern unsigned long nr_iowait_cpu(int cpu);
+extern unsigned long nr_running_cpu(int cpu);
 extern unsigned long this_cpu_load(void);
 
 
@@ -245,6 +246,9 @@ extern char ___assert_task_state[1 - 2*!!(
 /* Task command name length */
 #define TASK_COMM_LEN 16
 
+/* Frequencies past this many share the last time_in_state slot */
+#define CPUFREQ_TIMES_MAX_STATES 16
+
 #include <linux/spinlock.h>
 
 /*
@@ -1349,6 +1353,9 @@ struct task_struct {
 	cputime_t prev_utime, prev_stime;
 #endif
 	unsigned long nvcsw, nivcsw; /* context switch counts */
+#ifdef CONFIG_CPU_FREQ_TIMES
+	u64 time_in_state[CPUFREQ_TIMES_MAX_STATES];	/* ns at each freq */
+#endif
 	struct timespec start_time; 		/* monotonic time */
 	struct timespec real_start_time;	/* boot based time */
 /* mm fault and swap info: this can arguably be seen as either mm-specific or thread-specific */
@@ -6,6 +6,7 @@
 #include <linux/init.h>
 #include <linux/pm.h>
 #include <linux/mm.h>
+#include <linux/ktime.h>
 #include <asm/errno.h>
 
 #if defined(CONFIG_PM_SLEEP) && defined(CONFIG_VT) && defined(CONFIG_VT_CONSOLE)
@@ -151,6 +152,37 @@ static inline void suspend_set_ops(const struct platform_suspend_ops *ops) {}
 static inline int pm_suspend(suspend_state_t state) { return -ENOSYS; }
 #endif /* !CONFIG_SUSPEND */
 
+/* Phases of a suspend cycle timed by the suspend profiler */
+enum {
+	SUSPEND_PROF_SYNC,		/* Waiting for the pre-suspend sync */
+	SUSPEND_PROF_FREEZE,
+	SUSPEND_PROF_DPM_SUSPEND,
+	SUSPEND_PROF_DPM_SUSPEND_NOIRQ,
+	SUSPEND_PROF_ENTER,		/* Cpus, syscore, platform enter/exit */
+	SUSPEND_PROF_DPM_RESUME_NOIRQ,
+	SUSPEND_PROF_DPM_RESUME,
+	SUSPEND_PROF_THAW,
+	SUSPEND_PROF_PHASES,
+};
+
+struct device;
+
+#ifdef CONFIG_PM_SUSPEND_PROFILE
+extern void suspend_prof_begin(void);
+extern void suspend_prof_end(int error);
+extern void suspend_prof_start(int phase);
+extern void suspend_prof_stop(int phase);
+extern void suspend_prof_device(struct device *dev, int phase,
+				ktime_t start);
+#else
+static inline void suspend_prof_begin(void) {}
+static inline void suspend_prof_end(int error) {}
+static inline void suspend_prof_start(int phase) {}
+static inline void suspend_prof_stop(int phase) {}
+static inline void suspend_prof_device(struct device *dev, int phase,
+				       ktime_t start) {}
+#endif
+
 /* struct pbe is used for creating lists of pages that should be restored
  * atomically during the resume from disk, because the page frames they have
  * occupied before the suspend are in use.
@@ -18,6 +18,7 @@
 
 #include <linux/list.h>
 #include <linux/ktime.h>
+#include <linux/timerqueue.h>
 
 /* A wake_lock prevents the system from entering suspend or other low power
  * states when active. If the type is set to WAKE_LOCK_SUSPEND, the wake_lock
@@ -34,11 +35,13 @@ enum {
 
 struct wake_lock {
 	struct list_head    link;
+	struct timerqueue_node node;	/* On the expire queue, by jiffies */
 	int                 flags;
 	const char         *name;
 	unsigned long       expires;
 #ifdef CONFIG_WAKELOCK_STAT
 	struct {
+		uid_t           uid;	/* Of the task that last took it */
 		int             count;
 		int             expire_count;
 		int             wakeup_count;
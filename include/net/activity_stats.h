@@ -16,10 +16,34 @@
 #ifndef __activity_stats_h
 #define __activity_stats_h
 
+#include <linux/skbuff.h>
+#include <net/sock.h>
+
+#define ACTIVITY_RX	0
+#define ACTIVITY_TX	1
+
 #ifdef CONFIG_NET_ACTIVITY_STATS
 void activity_stats_update(void);
+void activity_stats_account(struct sock *sk, struct sk_buff *skb, int dir);
+
+/* Packets queued to a device, charged to the sending socket's owner */
+static inline void activity_stats_xmit(struct sk_buff *skb)
+{
+	if (skb->sk)
+		activity_stats_account(skb->sk, skb, ACTIVITY_TX);
+}
+
+/* Packets reaching a socket, while skb->dev is still the input device */
+static inline void activity_stats_receive(struct sock *sk,
+					  struct sk_buff *skb)
+{
+	activity_stats_account(sk, skb, ACTIVITY_RX);
+}
 #else
 #define activity_stats_update(void) {}
+static inline void activity_stats_xmit(struct sk_buff *skb) {}
+static inline void activity_stats_receive(struct sock *sk,
+					  struct sk_buff *skb) {}
 #endif
 
 #endif /* _NET_ACTIVITY_STATS_H */
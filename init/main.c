@@ -68,6 +68,8 @@
 #include <linux/shmem_fs.h>
 #include <linux/slab.h>
 #include <linux/perf_event.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/io.h>
 #include <asm/bugs.h>
@@ -643,7 +645,48 @@ static void __init do_ctors(void)
 int initcall_debug;
 core_param(initcall_debug, initcall_debug, bool, 0644);
 
-static char msgbuf[64];
+static int initcall_async;
+core_param(initcall_async, initcall_async, bool, 0444);
+
+/*
+ * With initcall_debug, every initcall is also logged here as it returns,
+ * so the log stays ordered by end time.  A NULL fn marks do_initcalls()
+ * waiting for the async initcalls.  Read back through debugfs in the
+ * same format as the console, for scripts/bootgraph.pl.
+ */
+struct initcall_chart_entry {
+	initcall_t fn;
+	s64 start_us;
+	u32 usecs;
+	pid_t pid;
+	int ret;
+};
+
+#define INITCALL_CHART_MAX	1024
+
+static struct initcall_chart_entry *initcall_chart;
+static atomic_t initcall_chart_len = ATOMIC_INIT(0);
+
+static void initcall_chart_add(initcall_t fn, ktime_t calltime,
+			       ktime_t rettime, int ret)
+{
+	struct initcall_chart_entry *e;
+	int i;
+
+	if (!initcall_chart)
+		return;
+
+	i = atomic_inc_return(&initcall_chart_len) - 1;
+	if (i >= INITCALL_CHART_MAX)
+		return;
+
+	e = &initcall_chart[i];
+	e->fn = fn;
+	e->start_us = ktime_to_us(calltime);
+	e->usecs = ktime_to_us(ktime_sub(rettime, calltime));
+	e->pid = task_pid_nr(current);
+	e->ret = ret;
+}
 
 static int __init_or_module do_one_initcall_debug(initcall_t fn)
 {
@@ -659,6 +702,7 @@ static int __init_or_module do_one_initcall_debug(initcall_t fn)
 	duration = (unsigned long long) ktime_to_ns(delta) >> 10;
 	printk(KERN_DEBUG "initcall %pF returned %d after %lld usecs\n", fn,
 		ret, duration);
+	initcall_chart_add(fn, calltime, rettime, ret);
 
 	return ret;
 }
@@ -666,6 +710,7 @@ static int __init_or_module do_one_initcall_debug(initcall_t fn)
 int __init_or_module do_one_initcall(initcall_t fn)
 {
 	int count = preempt_count();
+	char msgbuf[64];
 	int ret;
 
 	if (initcall_debug)
@@ -695,15 +740,101 @@ int __init_or_module do_one_initcall(initcall_t fn)
 
 
 extern initcall_t __initcall_start[], __initcall_end[], __early_initcall_end[];
+extern initcall_t __initcall_async_start[], __initcall_async_end[];
+extern initcall_t __initcall_late_start[];
+
+static LIST_HEAD(initcall_async_domain);
+
+static void __init do_one_initcall_async(void *data, async_cookie_t cookie)
+{
+	do_one_initcall((initcall_t)data);
+}
 
 static void __init do_initcalls(void)
 {
 	initcall_t *fn;
+	ktime_t calltime;
 
-	for (fn = __early_initcall_end; fn < __initcall_end; fn++)
-		do_one_initcall(*fn);
+	if (initcall_debug)
+		initcall_chart = kcalloc(INITCALL_CHART_MAX,
+					 sizeof(*initcall_chart), GFP_KERNEL);
+
+	for (fn = __early_initcall_end; fn < __initcall_end; fn++) {
+		if (fn == __initcall_late_start && initcall_async) {
+			calltime = ktime_get();
+			async_synchronize_full_domain(&initcall_async_domain);
+			initcall_chart_add(NULL, calltime, ktime_get(), 0);
+		}
+
+		if (fn >= __initcall_async_start && fn < __initcall_async_end &&
+		    initcall_async)
+			async_schedule_domain(do_one_initcall_async, (void *)*fn,
+					      &initcall_async_domain);
+		else
+			do_one_initcall(*fn);
+	}
+
+	/* Nothing async may outlive the initcalls, whatever the link order */
+	async_synchronize_full_domain(&initcall_async_domain);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static void initcall_chart_stamp(struct seq_file *m, s64 us)
+{
+	u64 sec = us;
+	unsigned long usec = do_div(sec, USEC_PER_SEC);
+
+	seq_printf(m, "[%5lu.%06lu] ", (unsigned long)sec, usec);
 }
 
+static int initcall_chart_show(struct seq_file *m, void *unused)
+{
+	struct initcall_chart_entry *e;
+	int i, n;
+
+	n = min(atomic_read(&initcall_chart_len), INITCALL_CHART_MAX);
+	for (i = 0; i < n; i++) {
+		e = &initcall_chart[i];
+
+		initcall_chart_stamp(m, e->start_us);
+		if (e->fn)
+			seq_printf(m, "calling  %pF @ %i\n", e->fn, e->pid);
+		else
+			seq_printf(m, "async_waiting @ %i\n", e->pid);
+
+		initcall_chart_stamp(m, e->start_us + e->usecs);
+		if (e->fn)
+			seq_printf(m, "initcall %pF returned %d after %u usecs\n",
+				   e->fn, e->ret, e->usecs);
+		else
+			seq_printf(m, "async_continuing @ %i\n", e->pid);
+	}
+
+	return 0;
+}
+
+static int initcall_chart_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, initcall_chart_show, NULL);
+}
+
+static const struct file_operations initcall_chart_fops = {
+	.open = initcall_chart_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init initcall_chart_init(void)
+{
+	if (initcall_chart)
+		debugfs_create_file("initcall_chart", S_IRUGO, NULL, NULL,
+				    &initcall_chart_fops);
+	return 0;
+}
+late_initcall(initcall_chart_init);
+#endif
+
 /*
  * Ok, the machine is now initialized. None of the devices
  * have been touched yet, but the CPU subsystem is up and
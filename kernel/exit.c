@@ -51,6 +51,7 @@
 #include <trace/events/sched.h>
 #include <linux/hw_breakpoint.h>
 #include <linux/oom.h>
+#include <linux/cpufreq_times.h>
 
 #include <asm/uaccess.h>
 #include <asm/unistd.h>
@@ -211,6 +212,7 @@ repeat:
 	}
 
 	write_unlock_irq(&tasklist_lock);
+	cpufreq_task_times_exit(p);
 	release_thread(p);
 	call_rcu(&p->rcu, delayed_put_task_struct);
 
@@ -491,6 +491,7 @@ static int __init coredump_filter_setup(char *s)
 __setup("coredump_filter=", coredump_filter_setup);
 
 #include <linux/init_task.h>
+#include <linux/cpufreq_times.h>
 
 static void mm_init_aio(struct mm_struct *mm)
 {
@@ -1163,6 +1164,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	p->prev_utime = cputime_zero;
 	p->prev_stime = cputime_zero;
 #endif
+	cpufreq_task_times_init(p);
 #if defined(SPLIT_RSS_COUNTING)
 	memset(&p->rss_stat, 0, sizeof(p->rss_stat));
 #endif
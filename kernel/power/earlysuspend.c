@@ -13,8 +13,12 @@
  *
  */
 
+#include <linux/async.h>
+#include <linux/debugfs.h>
 #include <linux/earlysuspend.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
+#include <linux/seq_file.h>
 #include <linux/mutex.h>
 #include <linux/rtc.h>
 #include <linux/wakelock.h>
@@ -51,6 +55,14 @@ enum {
 };
 static int state;
 
+/* EARLY_SUSPEND_ASYNC handlers run here; 0 calls them all in order */
+static int async_handlers = 1;
+module_param_named(async_handlers, async_handlers, int,
+		   S_IRUGO | S_IWUSR | S_IWGRP);
+static LIST_HEAD(early_suspend_domain);
+static unsigned int early_suspend_us;	/* Last pass over the handlers */
+static unsigned int late_resume_us;
+
 #ifdef CONFIG_HTC_ONMODE_CHARGING
 static LIST_HEAD(onchg_suspend_handlers);
 static void onchg_suspend(struct work_struct *work);
@@ -101,6 +113,85 @@ static void earlysuspend_state_notify(uint32_t state, void *data)
 }
 #endif
 
+static void early_suspend_call(struct early_suspend *h, int resume)
+{
+	ktime_t start = ktime_get();
+	unsigned int us;
+
+	if (debug_mask & DEBUG_VERBOSE)
+		pr_info("%s: calling %pf\n",
+			resume ? "late_resume" : "early_suspend",
+			resume ? h->resume : h->suspend);
+
+	if (resume)
+		h->resume(h);
+	else
+		h->suspend(h);
+
+	us = ktime_to_us(ktime_sub(ktime_get(), start));
+	if (resume) {
+		h->stat.resume_us = us;
+		if (us > h->stat.max_resume_us)
+			h->stat.max_resume_us = us;
+	} else {
+		h->stat.suspend_us = us;
+		if (us > h->stat.max_suspend_us)
+			h->stat.max_suspend_us = us;
+	}
+}
+
+static void early_suspend_async(void *data, async_cookie_t cookie)
+{
+	early_suspend_call(data, 0);
+}
+
+static void late_resume_async(void *data, async_cookie_t cookie)
+{
+	early_suspend_call(data, 1);
+}
+
+/*
+ * Call the suspend handlers in level order, or the resume handlers in
+ * reverse.  Async handlers are only waited for when the walk crosses a
+ * named level, and at the end.  Called with early_suspend_lock held.
+ */
+static void early_suspend_run(int resume)
+{
+	struct list_head *p;
+	struct early_suspend *pos;
+	ktime_t start = ktime_get();
+	int group = -1;
+	int g;
+
+	for (p = resume ? early_suspend_handlers.prev :
+			  early_suspend_handlers.next;
+	     p != &early_suspend_handlers;
+	     p = resume ? p->prev : p->next) {
+		pos = list_entry(p, struct early_suspend, link);
+		if (!(resume ? pos->resume : pos->suspend))
+			continue;
+
+		g = pos->level / EARLY_SUSPEND_LEVEL_STEP;
+		if (g != group) {
+			async_synchronize_full_domain(&early_suspend_domain);
+			group = g;
+		}
+
+		if (async_handlers && (pos->flags & EARLY_SUSPEND_ASYNC))
+			async_schedule_domain(resume ? late_resume_async :
+					      early_suspend_async, pos,
+					      &early_suspend_domain);
+		else
+			early_suspend_call(pos, resume);
+	}
+	async_synchronize_full_domain(&early_suspend_domain);
+
+	if (resume)
+		late_resume_us = ktime_to_us(ktime_sub(ktime_get(), start));
+	else
+		early_suspend_us = ktime_to_us(ktime_sub(ktime_get(), start));
+}
+
 void register_early_suspend(struct early_suspend *handler)
 {
 	struct list_head *pos;
@@ -129,7 +220,6 @@ EXPORT_SYMBOL(unregister_early_suspend);
 
 static void early_suspend(struct work_struct *work)
 {
-	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
 
@@ -158,13 +248,7 @@ static void early_suspend(struct work_struct *work)
 #endif
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("early_suspend: call handlers\n");
-	list_for_each_entry(pos, &early_suspend_handlers, link) {
-		if (pos->suspend != NULL) {
-			if (debug_mask & DEBUG_VERBOSE)
-				pr_info("early_suspend: calling %pf\n", pos->suspend);
-			pos->suspend(pos);
-		}
-	}
+	early_suspend_run(0);
 	mutex_unlock(&early_suspend_lock);
 #ifdef CONFIG_EARLYSUSPEND_BOOST_CPU_SPEED
 	earlysuspend_state_notify(EARLY_SUSPEND_HANDLE_END, NULL);
@@ -187,7 +271,6 @@ abort:
 
 static void late_resume(struct work_struct *work)
 {
-	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
 
@@ -215,14 +298,7 @@ static void late_resume(struct work_struct *work)
 #endif
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("late_resume: call handlers\n");
-	list_for_each_entry_reverse(pos, &early_suspend_handlers, link) {
-		if (pos->resume != NULL) {
-			if (debug_mask & DEBUG_VERBOSE)
-				pr_info("late_resume: calling %pf\n", pos->resume);
-
-			pos->resume(pos);
-		}
-	}
+	early_suspend_run(1);
 #ifdef CONFIG_EARLYSUSPEND_BOOST_CPU_SPEED
 	earlysuspend_state_notify(LATE_RESUME_HANDLE_END, NULL);
 #endif
@@ -404,3 +480,45 @@ suspend_state_t get_suspend_state(void)
 {
 	return requested_suspend_state;
 }
+
+#ifdef CONFIG_DEBUG_FS
+static int early_suspend_stats_show(struct seq_file *m, void *unused)
+{
+	struct early_suspend *pos;
+
+	mutex_lock(&early_suspend_lock);
+	seq_printf(m, "early_suspend %u us, late_resume %u us\n",
+		   early_suspend_us, late_resume_us);
+	seq_puts(m, "level\tasync\tsuspend_us\tmax\tresume_us\tmax\thandler\n");
+	list_for_each_entry(pos, &early_suspend_handlers, link) {
+		seq_printf(m, "%d\t%d\t%u\t%u\t%u\t%u\t%pf\n",
+			   pos->level, !!(pos->flags & EARLY_SUSPEND_ASYNC),
+			   pos->stat.suspend_us, pos->stat.max_suspend_us,
+			   pos->stat.resume_us, pos->stat.max_resume_us,
+			   pos->suspend ? (void *)pos->suspend :
+					  (void *)pos->resume);
+	}
+	mutex_unlock(&early_suspend_lock);
+	return 0;
+}
+
+static int early_suspend_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, early_suspend_stats_show, NULL);
+}
+
+static const struct file_operations early_suspend_stats_fops = {
+	.open = early_suspend_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init early_suspend_debugfs_init(void)
+{
+	debugfs_create_file("early_suspend", S_IRUGO, NULL, NULL,
+			    &early_suspend_stats_fops);
+	return 0;
+}
+late_initcall(early_suspend_debugfs_init);
+#endif
@@ -481,6 +481,57 @@ cpufreq_ceiling_store(struct kobject *kobj, struct kobj_attribute *attr,
 	return -EINVAL;
 }
 power_attr(cpufreq_ceiling);
+
+/*
+ * Bounded boosts: "<level> <ms>" holds a perf lock at <level> for at most
+ * PERFLOCK_BOOST_MAX_MS, with no wake lock needed to release it.  A zero
+ * <ms> drops the boost at <level>.
+ */
+#define PERFLOCK_BOOST_MAX_MS	5000
+static struct perf_lock user_perf_boost[PERF_LOCK_INVALID];
+
+static ssize_t
+perflock_boost_show(struct kobject *kobj, struct kobj_attribute *attr,
+		    char *buf)
+{
+	char *s = buf;
+	long left;
+	int i;
+
+	for (i = 0; i < PERF_LOCK_INVALID; i++) {
+		left = perf_lock_time_left(&user_perf_boost[i]);
+		if (left < 0)
+			continue;
+		s += sprintf(s, "%d:%u ", i, jiffies_to_msecs(left));
+	}
+
+	if (s != buf)
+		/* convert the last space to a newline */
+		*(s-1) = '\n';
+
+	return (s - buf);
+}
+
+static ssize_t
+perflock_boost_store(struct kobject *kobj, struct kobj_attribute *attr,
+		     const char *buf, size_t n)
+{
+	unsigned int level, ms;
+
+	if (sscanf(buf, "%u %u", &level, &ms) != 2 ||
+	    level >= PERF_LOCK_INVALID)
+		return -EINVAL;
+
+	if (!ms) {
+		perf_unlock_if_active(&user_perf_boost[level]);
+		return n;
+	}
+
+	ms = min_t(unsigned int, ms, PERFLOCK_BOOST_MAX_MS);
+	perf_lock_timeout(&user_perf_boost[level], msecs_to_jiffies(ms));
+	return n;
+}
+power_attr(perflock_boost);
 #endif
 
 #ifdef CONFIG_HTC_ONMODE_CHARGING
@@ -548,6 +599,7 @@ static struct attribute *g[] = {
 #ifdef CONFIG_PERFLOCK
 	&perflock_attr.attr,
 	&cpufreq_ceiling_attr.attr,
+	&perflock_boost_attr.attr,
 #endif
 	NULL,
 };
@@ -575,7 +627,8 @@ static int __init pm_init(void)
 	int error = pm_start_workqueue();
 #ifdef CONFIG_PERFLOCK
 	int i;
-	static char buf[38];
+	static char buf[CEILING_LEVEL_INVALID][38];
+	static char boost_name[PERF_LOCK_INVALID][24];
 #endif
 	if (error)
 		return error;
@@ -593,9 +646,14 @@ static int __init pm_init(void)
 #ifdef CONFIG_PERFLOCK
 	perf_lock_init(&user_perf_lock, PERF_LOCK_HIGHEST, "User Perflock");
 	for (i = 0; i < CEILING_LEVEL_INVALID; i++) {
-		snprintf(buf, 37, "User cpufreq_ceiling lock level(%d)", i);
-		buf[37] = '\0';
-		perf_lock_init_v2(&user_cpufreq_ceiling[i], i, buf);
+		snprintf(buf[i], 37, "User cpufreq_ceiling lock level(%d)", i);
+		buf[i][37] = '\0';
+		perf_lock_init_v2(&user_cpufreq_ceiling[i], i, buf[i]);
+	}
+	for (i = 0; i < PERF_LOCK_INVALID; i++) {
+		snprintf(boost_name[i], sizeof(boost_name[i]),
+			 "User boost level(%d)", i);
+		perf_lock_init(&user_perf_boost[i], i, boost_name[i]);
 	}
 #endif
 	return sysfs_create_group(power_kobj, &attr_group);
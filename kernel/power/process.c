@@ -154,17 +154,23 @@ int freeze_processes(void)
 	int error;
 
 	printk("Freezing user space processes ... ");
+	suspend_prof_start(SUSPEND_PROF_FREEZE);
 	error = try_to_freeze_tasks(true);
+	suspend_prof_stop(SUSPEND_PROF_FREEZE);
 	if (error)
 		goto Exit;
 	printk("done.\n");
 
+	suspend_prof_start(SUSPEND_PROF_SYNC);
 	error = suspend_sys_sync_wait();
+	suspend_prof_stop(SUSPEND_PROF_SYNC);
 	if (error)
 		goto Exit;
 
 	printk("Freezing remaining freezable tasks ... ");
+	suspend_prof_start(SUSPEND_PROF_FREEZE);
 	error = try_to_freeze_tasks(false);
+	suspend_prof_stop(SUSPEND_PROF_FREEZE);
 	if (error)
 		goto Exit;
 	printk("done.");
@@ -144,7 +144,9 @@ static int suspend_enter(suspend_state_t state)
 			goto Platform_finish;
 	}
 
+	suspend_prof_start(SUSPEND_PROF_DPM_SUSPEND_NOIRQ);
 	error = dpm_suspend_noirq(PMSG_SUSPEND);
+	suspend_prof_stop(SUSPEND_PROF_DPM_SUSPEND_NOIRQ);
 	if (error) {
 		printk(KERN_ERR "[K] PM: Some devices failed to power down\n");
 		goto Platform_finish;
@@ -159,6 +161,7 @@ static int suspend_enter(suspend_state_t state)
 	if (suspend_test(TEST_PLATFORM))
 		goto Platform_wake;
 
+	suspend_prof_start(SUSPEND_PROF_ENTER);
 	error = disable_nonboot_cpus();
 	if (error || suspend_test(TEST_CPUS))
 		goto Enable_cpus;
@@ -180,12 +183,15 @@ static int suspend_enter(suspend_state_t state)
 
  Enable_cpus:
 	enable_nonboot_cpus();
+	suspend_prof_stop(SUSPEND_PROF_ENTER);
 
  Platform_wake:
 	if (suspend_ops->wake)
 		suspend_ops->wake();
 
+	suspend_prof_start(SUSPEND_PROF_DPM_RESUME_NOIRQ);
 	dpm_resume_noirq(PMSG_RESUME);
+	suspend_prof_stop(SUSPEND_PROF_DPM_RESUME_NOIRQ);
 
  Platform_finish:
 	if (suspend_ops->finish)
@@ -214,7 +220,9 @@ int suspend_devices_and_enter(suspend_state_t state)
 	}
 	suspend_console();
 	suspend_test_start();
+	suspend_prof_start(SUSPEND_PROF_DPM_SUSPEND);
 	error = dpm_suspend_start(PMSG_SUSPEND);
+	suspend_prof_stop(SUSPEND_PROF_DPM_SUSPEND);
 	if (error) {
 		printk(KERN_ERR "[K] PM: Some devices failed to suspend\n");
 		goto Recover_platform;
@@ -227,7 +235,9 @@ int suspend_devices_and_enter(suspend_state_t state)
 
  Resume_devices:
 	suspend_test_start();
+	suspend_prof_start(SUSPEND_PROF_DPM_RESUME);
 	dpm_resume_end(PMSG_RESUME);
+	suspend_prof_stop(SUSPEND_PROF_DPM_RESUME);
 	suspend_test_finish("resume devices");
 	resume_console();
  Close:
@@ -250,7 +260,9 @@ int suspend_devices_and_enter(suspend_state_t state)
  */
 static void suspend_finish(void)
 {
+	suspend_prof_start(SUSPEND_PROF_THAW);
 	suspend_thaw_processes();
+	suspend_prof_stop(SUSPEND_PROF_THAW);
 	usermodehelper_enable();
 	pm_notifier_call_chain(PM_POST_SUSPEND);
 	pm_restore_console();
@@ -276,6 +288,7 @@ int enter_state(suspend_state_t state)
 	if (!mutex_trylock(&pm_mutex))
 		return -EBUSY;
 
+	suspend_prof_begin();
 	suspend_sys_sync_queue();
 
 	pr_debug("PM: Preparing system for %s sleep\n", pm_states[state]);
@@ -295,6 +308,7 @@ int enter_state(suspend_state_t state)
 	pr_debug("PM: Finishing wakeup.\n");
 	suspend_finish();
  Unlock:
+	suspend_prof_end(error);
 	mutex_unlock(&pm_mutex);
 	return error;
 }
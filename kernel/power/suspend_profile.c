@@ -0,0 +1,286 @@
+/* kernel/power/suspend_profile.c
+ *
+ * Suspend/resume latency profiler
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * Every pass through enter_state() fills one record of a ring: the time
+ * spent in each phase, the time actually asleep, the result, and the
+ * slowest device callbacks of the cycle.  Phase times also go into log2
+ * histograms kept across all cycles, so a resume latency regression shows
+ * up as a shifted bucket rather than one slow cycle.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/device.h>
+#include <linux/hrtimer.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/suspend.h>
+#include <linux/time.h>
+
+#define SUSPEND_PROF_CYCLES	16	/* Power of two */
+#define SUSPEND_PROF_SLOWEST	8
+#define SUSPEND_PROF_BUCKETS	12	/* <1ms, <2ms, ... >=1024ms */
+
+static const char * const phase_names[SUSPEND_PROF_PHASES] = {
+	[SUSPEND_PROF_SYNC]		= "sync",
+	[SUSPEND_PROF_FREEZE]		= "freeze",
+	[SUSPEND_PROF_DPM_SUSPEND]	= "dpm_suspend",
+	[SUSPEND_PROF_DPM_SUSPEND_NOIRQ] = "dpm_suspend_noirq",
+	[SUSPEND_PROF_ENTER]		= "enter",
+	[SUSPEND_PROF_DPM_RESUME_NOIRQ]	= "dpm_resume_noirq",
+	[SUSPEND_PROF_DPM_RESUME]	= "dpm_resume",
+	[SUSPEND_PROF_THAW]		= "thaw",
+};
+
+struct suspend_prof_dev {
+	char name[24];
+	u8 phase;
+	u32 us;
+};
+
+struct suspend_prof_cycle {
+	struct timespec ts;		/* Wall time the cycle started */
+	int error;
+	u32 sleep_ms;			/* Time actually asleep */
+	u32 phase_us[SUSPEND_PROF_PHASES];
+	struct suspend_prof_dev slow[SUSPEND_PROF_SLOWEST];
+};
+
+static struct suspend_prof_cycle cycles[SUSPEND_PROF_CYCLES];
+static unsigned int cycle_next;
+static struct suspend_prof_cycle *cur;
+static ktime_t phase_start[SUSPEND_PROF_PHASES];
+static ktime_t enter_boottime;
+static u32 hist[SUSPEND_PROF_PHASES][SUSPEND_PROF_BUCKETS];
+static u32 hist_resume[SUSPEND_PROF_BUCKETS];
+/* Device callbacks may run from async threads */
+static DEFINE_SPINLOCK(prof_lock);
+
+static int prof_bucket(u32 us)
+{
+	u32 ms = us / USEC_PER_MSEC;
+
+	if (!ms)
+		return 0;
+	return min(fls(ms), SUSPEND_PROF_BUCKETS - 1);
+}
+
+/* Called with pm_mutex held for the whole cycle */
+void suspend_prof_begin(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&prof_lock, flags);
+	cur = &cycles[cycle_next & (SUSPEND_PROF_CYCLES - 1)];
+	memset(cur, 0, sizeof(*cur));
+	getnstimeofday(&cur->ts);
+	spin_unlock_irqrestore(&prof_lock, flags);
+}
+
+void suspend_prof_end(int error)
+{
+	unsigned long flags;
+	u32 resume_us;
+	int i;
+
+	spin_lock_irqsave(&prof_lock, flags);
+	if (!cur)
+		goto out;
+
+	cur->error = error;
+	for (i = 0; i < SUSPEND_PROF_PHASES; i++)
+		if (cur->phase_us[i])
+			hist[i][prof_bucket(cur->phase_us[i])]++;
+
+	if (!error) {
+		resume_us = cur->phase_us[SUSPEND_PROF_DPM_RESUME_NOIRQ] +
+			    cur->phase_us[SUSPEND_PROF_DPM_RESUME] +
+			    cur->phase_us[SUSPEND_PROF_THAW];
+		hist_resume[prof_bucket(resume_us)]++;
+	}
+
+	cycle_next++;
+	cur = NULL;
+out:
+	spin_unlock_irqrestore(&prof_lock, flags);
+}
+
+void suspend_prof_start(int phase)
+{
+	if (!cur)
+		return;
+
+	phase_start[phase] = ktime_get();
+	if (phase == SUSPEND_PROF_ENTER)
+		enter_boottime = ktime_get_boottime();
+}
+
+/*
+ * Phases may be started and stopped more than once per cycle, the time
+ * adds up.  Monotonic time stops while suspended, so "enter" only covers
+ * the way down and back up; boot time gives the time asleep.
+ */
+void suspend_prof_stop(int phase)
+{
+	ktime_t now;
+
+	if (!cur)
+		return;
+
+	now = ktime_get();
+	cur->phase_us[phase] += ktime_to_us(ktime_sub(now, phase_start[phase]));
+
+	if (phase == SUSPEND_PROF_ENTER)
+		cur->sleep_ms = ktime_to_ms(ktime_sub(ktime_get_boottime(),
+			enter_boottime)) -
+			ktime_to_ms(ktime_sub(now, phase_start[phase]));
+}
+
+/* Keep @dev among the slowest callbacks of the cycle */
+void suspend_prof_device(struct device *dev, int phase, ktime_t start)
+{
+	struct suspend_prof_dev *d, *min;
+	unsigned long flags;
+	u32 us;
+	int i;
+
+	if (!cur)
+		return;
+
+	us = ktime_to_us(ktime_sub(ktime_get(), start));
+
+	spin_lock_irqsave(&prof_lock, flags);
+	if (!cur)
+		goto out;
+
+	min = &cur->slow[0];
+	for (i = 1; i < SUSPEND_PROF_SLOWEST; i++) {
+		d = &cur->slow[i];
+		if (d->us < min->us)
+			min = d;
+	}
+
+	if (us > min->us) {
+		strlcpy(min->name, dev_name(dev), sizeof(min->name));
+		min->phase = phase;
+		min->us = us;
+	}
+out:
+	spin_unlock_irqrestore(&prof_lock, flags);
+}
+
+static int suspend_prof_cycles_show(struct seq_file *m, void *unused)
+{
+	struct suspend_prof_cycle *c;
+	struct suspend_prof_dev *d;
+	unsigned int i, n;
+	int p, j;
+
+	mutex_lock(&pm_mutex);
+	n = min_t(unsigned int, cycle_next, SUSPEND_PROF_CYCLES);
+	for (i = cycle_next - n; i != cycle_next; i++) {
+		c = &cycles[i & (SUSPEND_PROF_CYCLES - 1)];
+
+		seq_printf(m, "cycle %u at %lu.%09lu: error %d, asleep %u ms\n",
+			   i, c->ts.tv_sec, c->ts.tv_nsec, c->error,
+			   c->sleep_ms);
+		for (p = 0; p < SUSPEND_PROF_PHASES; p++)
+			seq_printf(m, "  %-18s %10u us\n", phase_names[p],
+				   c->phase_us[p]);
+
+		for (j = 0; j < SUSPEND_PROF_SLOWEST; j++) {
+			d = &c->slow[j];
+			if (!d->us)
+				continue;
+			seq_printf(m, "  %-18s %10u us  %s\n",
+				   phase_names[d->phase], d->us, d->name);
+		}
+	}
+	mutex_unlock(&pm_mutex);
+
+	return 0;
+}
+
+static void suspend_prof_hist_line(struct seq_file *m, const char *name,
+				   u32 *buckets)
+{
+	int b;
+
+	seq_printf(m, "%-18s", name);
+	for (b = 0; b < SUSPEND_PROF_BUCKETS; b++)
+		seq_printf(m, " %6u", buckets[b]);
+	seq_putc(m, '\n');
+}
+
+static int suspend_prof_hist_show(struct seq_file *m, void *unused)
+{
+	int b, p;
+
+	mutex_lock(&pm_mutex);
+	seq_printf(m, "%-18s", "ms <");
+	for (b = 0; b < SUSPEND_PROF_BUCKETS - 1; b++)
+		seq_printf(m, " %6u", 1 << b);
+	seq_printf(m, " %6s\n", "inf");
+
+	for (p = 0; p < SUSPEND_PROF_PHASES; p++)
+		suspend_prof_hist_line(m, phase_names[p], hist[p]);
+	suspend_prof_hist_line(m, "resume", hist_resume);
+	mutex_unlock(&pm_mutex);
+
+	return 0;
+}
+
+static int suspend_prof_cycles_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, suspend_prof_cycles_show, NULL);
+}
+
+static int suspend_prof_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, suspend_prof_hist_show, NULL);
+}
+
+static const struct file_operations suspend_prof_cycles_fops = {
+	.open = suspend_prof_cycles_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static const struct file_operations suspend_prof_hist_fops = {
+	.open = suspend_prof_hist_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init suspend_prof_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("suspend_profile", NULL);
+	if (IS_ERR_OR_NULL(dir))
+		return 0;
+
+	debugfs_create_file("cycles", S_IRUGO, dir, NULL,
+			    &suspend_prof_cycles_fops);
+	debugfs_create_file("histogram", S_IRUGO, dir, NULL,
+			    &suspend_prof_hist_fops);
+	return 0;
+}
+late_initcall(suspend_prof_init);
@@ -17,11 +17,15 @@
 #include <linux/platform_device.h>
 #include <linux/rtc.h>
 #include <linux/suspend.h>
-#include <linux/syscalls.h> /* sys_sync */
+#include <linux/fs.h> /* sync_dirty_filesystems */
+#include <linux/vmstat.h>
 #include <linux/wakelock.h>
 #include <linux/syscore_ops.h>
+#include <linux/timerqueue.h>
 #ifdef CONFIG_WAKELOCK_STAT
 #include <linux/proc_fs.h>
+#include <linux/cred.h>
+#include <linux/hash.h>
 #endif
 #include "power.h"
 
@@ -44,6 +48,13 @@ module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 static DEFINE_SPINLOCK(list_lock);
 static LIST_HEAD(inactive_locks);
 static struct list_head active_wake_locks[WAKE_LOCK_TYPE_COUNT];
+/*
+ * Active locks without a timeout are only counted; those with one sit on
+ * a queue sorted by expiry, keyed in 64 bit jiffies.  Between them
+ * has_wake_lock() needs no walk of the active list.
+ */
+static int active_untimed_count[WAKE_LOCK_TYPE_COUNT];
+static struct timerqueue_head expire_queue[WAKE_LOCK_TYPE_COUNT];
 static int current_event_num;
 static int suspend_sys_sync_count;
 static DEFINE_SPINLOCK(suspend_sys_sync_lock);
@@ -66,6 +77,56 @@ static struct wake_lock deleted_wake_locks;
 static ktime_t last_sleep_time_update;
 static int wait_for_wakeup;
 
+/*
+ * Wake lock time summed per uid of the task taking each lock.  Uids past
+ * the table size share the last slot, reported as uid -1.
+ */
+#define WAKELOCK_UID_BITS	6
+#define WAKELOCK_UID_SLOTS	(1 << WAKELOCK_UID_BITS)
+
+struct wakelock_uid_stat {
+	uid_t uid;
+	int used;
+	int count;
+	int expire_count;
+	ktime_t total_time;
+	ktime_t max_time;
+};
+
+static struct wakelock_uid_stat uid_stats[WAKELOCK_UID_SLOTS + 1];
+
+static struct wakelock_uid_stat *uid_stat_lookup_locked(uid_t uid)
+{
+	struct wakelock_uid_stat *st;
+	unsigned int i, n;
+
+	i = hash_32(uid, WAKELOCK_UID_BITS);
+	for (n = 0; n < WAKELOCK_UID_SLOTS; n++) {
+		st = &uid_stats[(i + n) & (WAKELOCK_UID_SLOTS - 1)];
+		if (!st->used) {
+			st->used = 1;
+			st->uid = uid;
+			return st;
+		}
+		if (st->uid == uid)
+			return st;
+	}
+	return &uid_stats[WAKELOCK_UID_SLOTS];
+}
+
+static void uid_stat_add_locked(struct wake_lock *lock, ktime_t duration,
+				int expired)
+{
+	struct wakelock_uid_stat *st = uid_stat_lookup_locked(lock->stat.uid);
+
+	st->count++;
+	if (expired)
+		st->expire_count++;
+	st->total_time = ktime_add(st->total_time, duration);
+	if (ktime_to_ns(duration) > ktime_to_ns(st->max_time))
+		st->max_time = duration;
+}
+
 int get_expired_time(struct wake_lock *lock, ktime_t *expire_time)
 {
 	struct timespec ts;
@@ -147,6 +208,29 @@ static int wakelock_stats_show(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static int wakelock_uid_stats_show(struct seq_file *m, void *unused)
+{
+	unsigned long irqflags;
+	struct wakelock_uid_stat *st;
+	int i;
+
+	seq_puts(m, "uid\tcount\texpire_count\ttotal_time\tmax_time\n");
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	for (i = 0; i <= WAKELOCK_UID_SLOTS; i++) {
+		st = &uid_stats[i];
+		if (!st->count)
+			continue;
+		seq_printf(m, "%d\t%d\t%d\t%lld\t%lld\n",
+			   i < WAKELOCK_UID_SLOTS ? (int)st->uid : -1,
+			   st->count, st->expire_count,
+			   ktime_to_ns(st->total_time),
+			   ktime_to_ns(st->max_time));
+	}
+	spin_unlock_irqrestore(&list_lock, irqflags);
+	return 0;
+}
+
 static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 {
 	ktime_t duration;
@@ -164,6 +248,7 @@ static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 	lock->stat.total_time = ktime_add(lock->stat.total_time, duration);
 	if (ktime_to_ns(duration) > ktime_to_ns(lock->stat.max_time))
 		lock->stat.max_time = duration;
+	uid_stat_add_locked(lock, duration, expired);
 	lock->stat.last_time = ktime_get();
 	if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
 		duration = ktime_sub(now, last_sleep_time_update);
@@ -201,11 +286,26 @@ static void update_sleep_wait_stats_locked(int done)
 #endif
 
 
+/* Take an active @lock off the untimed count or the expire queue */
+static void wake_lock_dequeue_locked(struct wake_lock *lock)
+{
+	int type = lock->flags & WAKE_LOCK_TYPE_MASK;
+
+	if (!(lock->flags & WAKE_LOCK_ACTIVE))
+		return;
+
+	if (lock->flags & WAKE_LOCK_AUTO_EXPIRE)
+		timerqueue_del(&expire_queue[type], &lock->node);
+	else
+		active_untimed_count[type]--;
+}
+
 static void expire_wake_lock(struct wake_lock *lock)
 {
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_unlock_stat_locked(lock, 1);
 #endif
+	wake_lock_dequeue_locked(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -263,21 +363,27 @@ void htc_print_active_wake_locks(int type)
 
 static long has_wake_lock_locked(int type)
 {
-	struct wake_lock *lock, *n;
-	long max_timeout = 0;
+	struct timerqueue_node *node;
+	struct rb_node *last;
+	u64 now;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
-	list_for_each_entry_safe(lock, n, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout <= 0)
-				expire_wake_lock(lock);
-			else if (timeout > max_timeout)
-				max_timeout = timeout;
-		} else
-			return -1;
+	if (active_untimed_count[type])
+		return -1;
+
+	/* Expire from the head of the queue until a lock is still live */
+	now = get_jiffies_64();
+	while ((node = timerqueue_getnext(&expire_queue[type]))) {
+		if ((s64)(node->expires.tv64 - now) > 0)
+			break;
+		expire_wake_lock(container_of(node, struct wake_lock, node));
 	}
-	return max_timeout;
+	if (!node)
+		return 0;
+
+	last = rb_last(&expire_queue[type].head);
+	node = rb_entry(last, struct timerqueue_node, node);
+	return node->expires.tv64 - now;
 }
 
 long has_wake_lock(int type)
@@ -292,17 +398,59 @@ long has_wake_lock(int type)
 	return ret;
 }
 
+static bool suspend_sys_sync_abort;
+
+/*
+ * Only filesystems with dirty data are synced, and the sync stops between
+ * filesystems once suspend_sys_sync_wait() has given up on it because a
+ * wake lock was taken.  What was written stays written, so an aborted
+ * attempt still makes the next one cheaper.
+ */
+static struct {
+	unsigned int count;
+	unsigned int clean;		/* Nothing was dirty */
+	unsigned int aborted;
+	u64 system_written;		/* By anyone while syncing, in bytes */
+	u64 time_us;
+	u32 max_us;
+} suspend_sys_sync_stats;
+
+static bool suspend_sys_sync_should_abort(void)
+{
+	return ACCESS_ONCE(suspend_sys_sync_abort);
+}
+
 static void suspend_sys_sync(struct work_struct *work)
 {
+	unsigned long written;
+	ktime_t start;
+	u32 us;
+	int ret;
+
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("PM: Syncing filesystems...\n");
 
-	sys_sync();
+	start = ktime_get();
+	written = global_page_state(NR_WRITTEN);
+	ret = sync_dirty_filesystems(suspend_sys_sync_should_abort);
+	written = global_page_state(NR_WRITTEN) - written;
+	us = ktime_to_us(ktime_sub(ktime_get(), start));
 
 	if (debug_mask & DEBUG_SUSPEND)
-		pr_info("sync done.\n");
+		pr_info("sync %s: %d fs in %u us, %lu kB written system wide\n",
+			ret < 0 ? "aborted" : "done", ret,
+			us, written << (PAGE_SHIFT - 10));
 
 	spin_lock(&suspend_sys_sync_lock);
+	suspend_sys_sync_stats.count++;
+	if (ret < 0)
+		suspend_sys_sync_stats.aborted++;
+	else if (ret == 0)
+		suspend_sys_sync_stats.clean++;
+	suspend_sys_sync_stats.system_written += (u64)written << PAGE_SHIFT;
+	suspend_sys_sync_stats.time_us += us;
+	if (us > suspend_sys_sync_stats.max_us)
+		suspend_sys_sync_stats.max_us = us;
 	suspend_sys_sync_count--;
 	spin_unlock(&suspend_sys_sync_lock);
 }
@@ -313,13 +461,13 @@ void suspend_sys_sync_queue(void)
 	int ret;
 
 	spin_lock(&suspend_sys_sync_lock);
+	suspend_sys_sync_abort = false;
 	ret = queue_work(suspend_sys_sync_work_queue, &suspend_sys_sync_work);
 	if (ret)
 		suspend_sys_sync_count++;
 	spin_unlock(&suspend_sys_sync_lock);
 }
 
-static bool suspend_sys_sync_abort;
 static void suspend_sys_sync_handler(unsigned long);
 static DEFINE_TIMER(suspend_sys_sync_timer, suspend_sys_sync_handler, 0, 0);
 /* value should be less then half of input event wake lock timeout value
@@ -467,6 +615,7 @@ void wake_lock_init(struct wake_lock *lock, int type, const char *name)
 #endif
 	lock->flags = (type & WAKE_LOCK_TYPE_MASK) | WAKE_LOCK_INITIALIZED;
 
+	timerqueue_init(&lock->node);
 	INIT_LIST_HEAD(&lock->link);
 	spin_lock_irqsave(&list_lock, irqflags);
 	list_add(&lock->link, &inactive_locks);
@@ -480,7 +629,9 @@ void wake_lock_destroy(struct wake_lock *lock)
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_lock_destroy name=%s\n", lock->name);
 	spin_lock_irqsave(&list_lock, irqflags);
-	lock->flags &= ~WAKE_LOCK_INITIALIZED;
+	wake_lock_dequeue_locked(lock);
+	lock->flags &= ~(WAKE_LOCK_INITIALIZED | WAKE_LOCK_ACTIVE |
+			 WAKE_LOCK_AUTO_EXPIRE);
 #ifdef CONFIG_WAKELOCK_STAT
 	if (lock->stat.count) {
 		deleted_wake_locks.stat.count += lock->stat.count;
@@ -507,6 +658,7 @@ static void wake_lock_internal(
 	int type;
 	unsigned long irqflags;
 	long expire_in;
+	u64 now;
 
 	spin_lock_irqsave(&list_lock, irqflags);
 	type = lock->flags & WAKE_LOCK_TYPE_MASK;
@@ -525,10 +677,12 @@ static void wake_lock_internal(
 		lock->stat.last_time = ktime_get();
 	}
 #endif
+	wake_lock_dequeue_locked(lock);
 	if (!(lock->flags & WAKE_LOCK_ACTIVE)) {
 		lock->flags |= WAKE_LOCK_ACTIVE;
 #ifdef CONFIG_WAKELOCK_STAT
 		lock->stat.last_time = ktime_get();
+		lock->stat.uid = in_interrupt() ? 0 : current_uid();
 #endif
 	}
 	list_del(&lock->link);
@@ -537,14 +691,18 @@ static void wake_lock_internal(
 			pr_info("wake_lock: %s, type %d, timeout %ld.%03lu\n",
 				lock->name, type, timeout / HZ,
 				(timeout % HZ) * MSEC_PER_SEC / HZ);
-		lock->expires = jiffies + timeout;
+		now = get_jiffies_64();
+		lock->expires = (unsigned long)(now + timeout);
+		lock->node.expires.tv64 = now + timeout;
 		lock->flags |= WAKE_LOCK_AUTO_EXPIRE;
+		timerqueue_add(&expire_queue[type], &lock->node);
 		list_add_tail(&lock->link, &active_wake_locks[type]);
 	} else {
 		if (debug_mask & DEBUG_WAKE_LOCK)
 			pr_info("wake_lock: %s, type %d\n", lock->name, type);
 		lock->expires = LONG_MAX;
 		lock->flags &= ~WAKE_LOCK_AUTO_EXPIRE;
+		active_untimed_count[type]++;
 		list_add(&lock->link, &active_wake_locks[type]);
 	}
 	if (type == WAKE_LOCK_SUSPEND) {
@@ -599,6 +757,7 @@ void wake_unlock(struct wake_lock *lock)
 #endif
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_unlock: %s\n", lock->name);
+	wake_lock_dequeue_locked(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -648,13 +807,59 @@ static const struct file_operations wakelock_stats_fops = {
 	.release = single_release,
 };
 
+#ifdef CONFIG_WAKELOCK_STAT
+static int wakelock_uid_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wakelock_uid_stats_show, NULL);
+}
+
+static const struct file_operations wakelock_uid_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = wakelock_uid_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int suspend_sync_stats_show(struct seq_file *m, void *unused)
+{
+	typeof(suspend_sys_sync_stats) stats;
+
+	spin_lock(&suspend_sys_sync_lock);
+	stats = suspend_sys_sync_stats;
+	spin_unlock(&suspend_sys_sync_lock);
+
+	seq_printf(m, "count\tclean\taborted\tsystem_written\ttime_us\t"
+		   "max_us\n");
+	seq_printf(m, "%u\t%u\t%u\t%llu\t%llu\t%u\n", stats.count,
+		   stats.clean, stats.aborted, stats.system_written,
+		   stats.time_us, stats.max_us);
+	return 0;
+}
+
+static int suspend_sync_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, suspend_sync_stats_show, NULL);
+}
+
+static const struct file_operations suspend_sync_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = suspend_sync_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+#endif
+
 static int __init wakelocks_init(void)
 {
 	int ret;
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++)
+	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++) {
 		INIT_LIST_HEAD(&active_wake_locks[i]);
+		timerqueue_init_head(&expire_queue[i]);
+	}
 
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_lock_init(&deleted_wake_locks, WAKE_LOCK_SUSPEND,
@@ -685,6 +890,8 @@ static int __init wakelocks_init(void)
 
 #ifdef CONFIG_WAKELOCK_STAT
 	proc_create("wakelocks", S_IRUGO, NULL, &wakelock_stats_fops);
+	proc_create("wakelocks_uid", S_IRUGO, NULL, &wakelock_uid_stats_fops);
+	proc_create("suspend_sync", S_IRUGO, NULL, &suspend_sync_stats_fops);
 #endif
 
 	return 0;
@@ -706,6 +913,8 @@ err_suspend_sys_sync_work_queue:
 static void  __exit wakelocks_exit(void)
 {
 #ifdef CONFIG_WAKELOCK_STAT
+	remove_proc_entry("suspend_sync", NULL);
+	remove_proc_entry("wakelocks_uid", NULL);
 	remove_proc_entry("wakelocks", NULL);
 #endif
 	destroy_workqueue(suspend_work_queue);
@@ -30,6 +30,7 @@
 struct rq_data rq_info;
 struct workqueue_struct *rq_wq;
 spinlock_t rq_lock;
+DEFINE_PER_CPU(struct rq_cpu_avg, rq_cpu_avg);
 
 /*
  * Per cpu nohz control structure
@@ -748,6 +749,67 @@ static void update_rq_stats(void)
 	}
 }
 
+static void update_rq_cpu_avg(int cpu)
+{
+	struct rq_cpu_avg *ra = &per_cpu(rq_cpu_avg, cpu);
+	unsigned long gap = jiffies - ra->last_jiffy;
+	unsigned int shift = rq_info.avg_shift;
+	unsigned int round = (1 << shift) - 1;
+	unsigned int sample;
+	unsigned int avg;
+
+	if (!gap)
+		return;
+
+	/* The tick was stopped for all but the last jiffy, so we idled */
+	avg = rq_avg_decay(ra->avg, gap - 1, shift);
+
+	sample = nr_running_cpu(cpu) << RQ_AVG_FSHIFT;
+	if (sample > avg)
+		avg += (sample - avg + round) >> shift;
+	else
+		avg -= (avg - sample + round) >> shift;
+
+	ra->avg = avg;
+	ra->last_jiffy = jiffies;
+}
+
+/*
+ * Move rq_info.state once the total average has stayed past the up or
+ * down threshold for the matching delay, and tell the rq-stats worker.
+ */
+static void update_rq_state(void)
+{
+	unsigned int total = 0;
+	unsigned long delay;
+	int cpu;
+	int state;
+
+	for_each_online_cpu(cpu)
+		total += rq_cpu_avg_read(cpu);
+	total = (total * 10) >> RQ_AVG_FSHIFT;
+	rq_info.total_avg = total;
+
+	if (!rq_info.state && total >= rq_info.up_thresh) {
+		state = 1;
+		delay = rq_info.up_delay_jiffies;
+	} else if (rq_info.state && total < rq_info.down_thresh) {
+		state = 0;
+		delay = rq_info.down_delay_jiffies;
+	} else {
+		rq_info.state_jiffy = jiffies;
+		return;
+	}
+
+	if (time_before(jiffies, rq_info.state_jiffy + delay))
+		return;
+
+	rq_info.state = state;
+	rq_info.state_jiffy = jiffies;
+	rq_info.state_time = ktime_to_ns(ktime_get());
+	queue_work(rq_wq, &rq_info.state_work);
+}
+
 static void wakeup_user(void)
 {
 	unsigned long jiffy_gap;
@@ -807,12 +869,16 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
 
+		if (rq_info.init == 1)
+			update_rq_cpu_avg(cpu);
+
 		if ((rq_info.init == 1) && (tick_do_timer_cpu == cpu)) {
 
 			/*
 			 * update run queue statistics
 			 */
 			update_rq_stats();
+			update_rq_state();
 
 			/*
 			 * wakeup user if needed
@@ -14,8 +14,15 @@
  * Author: Mike Chan (mike@android.com)
  */
 
+#include <linux/hash.h>
+#include <linux/netdevice.h>
 #include <linux/proc_fs.h>
+#include <linux/rculist.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
 #include <linux/suspend.h>
+#include <linux/u64_stats_sync.h>
+#include <net/activity_stats.h>
 #include <net/net_namespace.h>
 
 /*
@@ -100,14 +107,213 @@ static int activity_stats_notifier(struct notifier_block *nb,
 	return 0;
 }
 
+/*
+ * Bytes and packets per uid and interface, charged to the socket owner
+ * when a packet is queued to a device and when it reaches a socket.
+ * Only IPv4 and IPv6 sockets are counted: on other families skb->dev
+ * need not be a net_device (Bluetooth puts its hci_dev there).  Each cpu
+ * counts into its own slot of an entry; entries are looked up under RCU
+ * and only freed when their interface goes away, so once a (uid,
+ * interface) pair has been seen the packet path takes no lock.
+ */
+#define UID_HASH_BITS	6
+
+struct activity_uid_cpu {
+	u64 bytes[2];		/* ACTIVITY_RX, ACTIVITY_TX */
+	u64 packets[2];
+	struct u64_stats_sync syncp;
+} ____cacheline_aligned_in_smp;
+
+struct activity_uid {
+	struct hlist_node hash;
+	uid_t uid;
+	int ifindex;
+	char ifname[IFNAMSIZ];	/* As it was when first seen */
+	struct rcu_head rcu;
+	struct activity_uid_cpu cpu[0];
+};
+
+static struct hlist_head uid_hash[1 << UID_HASH_BITS];
+static DEFINE_SPINLOCK(uid_lock);
+
+static inline struct hlist_head *uid_head(uid_t uid, int ifindex)
+{
+	return &uid_hash[hash_32(uid * 31 + ifindex, UID_HASH_BITS)];
+}
+
+/* rcu_read_lock and BH off */
+static struct activity_uid *find_uid(uid_t uid, struct net_device *dev)
+{
+	struct hlist_head *head = uid_head(uid, dev->ifindex);
+	struct hlist_node *node;
+	struct activity_uid *e;
+
+	hlist_for_each_entry_rcu(e, node, head, hash)
+		if (e->uid == uid && e->ifindex == dev->ifindex)
+			return e;
+
+	spin_lock(&uid_lock);
+	/* Another cpu may have added it meanwhile */
+	hlist_for_each_entry(e, node, head, hash)
+		if (e->uid == uid && e->ifindex == dev->ifindex)
+			goto out;
+
+	e = kzalloc(sizeof(*e) + nr_cpu_ids * sizeof(e->cpu[0]), GFP_ATOMIC);
+	if (e) {
+		e->uid = uid;
+		e->ifindex = dev->ifindex;
+		memcpy(e->ifname, dev->name, IFNAMSIZ);
+		hlist_add_head_rcu(&e->hash, head);
+	}
+out:
+	spin_unlock(&uid_lock);
+	return e;
+}
+
+/* Network layer length, so it does not depend on the link header */
+static unsigned int skb_bytes(const struct sk_buff *skb)
+{
+	int off = skb_network_offset(skb);
+
+	if (off > (int)skb->len || -off > (int)skb_headroom(skb))
+		return skb->len;
+	return skb->len - off;
+}
+
+void activity_stats_account(struct sock *sk, struct sk_buff *skb, int dir)
+{
+	struct activity_uid *e;
+	struct activity_uid_cpu *c;
+	uid_t uid;
+
+	if (sk->sk_family != AF_INET && sk->sk_family != AF_INET6)
+		return;
+
+	if (!skb->dev || !net_eq(sock_net(sk), &init_net))
+		return;
+
+	/* Receive can come from the socket backlog, in process context */
+	local_bh_disable();
+
+	read_lock(&sk->sk_callback_lock);
+	uid = sk->sk_socket ? SOCK_INODE(sk->sk_socket)->i_uid : 0;
+	read_unlock(&sk->sk_callback_lock);
+
+	rcu_read_lock();
+	e = find_uid(uid, skb->dev);
+	if (e) {
+		c = &e->cpu[smp_processor_id()];
+		u64_stats_update_begin(&c->syncp);
+		c->bytes[dir] += skb_bytes(skb);
+		c->packets[dir]++;
+		u64_stats_update_end(&c->syncp);
+	}
+	rcu_read_unlock();
+
+	local_bh_enable();
+}
+
+/* All entries in one read, so a poll costs one syscall */
+static int activity_uid_show(struct seq_file *m, void *v)
+{
+	struct activity_uid *e;
+	struct activity_uid_cpu *c;
+	struct hlist_node *node;
+	u64 bytes[2], packets[2];
+	unsigned int start;
+	int b, cpu, dir;
+
+	seq_puts(m, "uid iface rx_bytes rx_packets tx_bytes tx_packets\n");
+
+	rcu_read_lock();
+	for (b = 0; b < ARRAY_SIZE(uid_hash); b++) {
+		hlist_for_each_entry_rcu(e, node, &uid_hash[b], hash) {
+			memset(bytes, 0, sizeof(bytes));
+			memset(packets, 0, sizeof(packets));
+			for_each_possible_cpu(cpu) {
+				u64 cb[2], cp[2];
+
+				c = &e->cpu[cpu];
+				do {
+					start = u64_stats_fetch_begin_bh(
+							&c->syncp);
+					for (dir = 0; dir < 2; dir++) {
+						cb[dir] = c->bytes[dir];
+						cp[dir] = c->packets[dir];
+					}
+				} while (u64_stats_fetch_retry_bh(&c->syncp,
+								  start));
+				for (dir = 0; dir < 2; dir++) {
+					bytes[dir] += cb[dir];
+					packets[dir] += cp[dir];
+				}
+			}
+			seq_printf(m, "%u %s %llu %llu %llu %llu\n",
+				   e->uid, e->ifname,
+				   (unsigned long long)bytes[ACTIVITY_RX],
+				   (unsigned long long)packets[ACTIVITY_RX],
+				   (unsigned long long)bytes[ACTIVITY_TX],
+				   (unsigned long long)packets[ACTIVITY_TX]);
+		}
+	}
+	rcu_read_unlock();
+
+	return 0;
+}
+
+static int activity_uid_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, activity_uid_show, NULL);
+}
+
+static const struct file_operations activity_uid_fops = {
+	.open = activity_uid_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* Drop the entries of an interface that is going away */
+static int activity_uid_netdev_event(struct notifier_block *nb,
+				     unsigned long event, void *ptr)
+{
+	struct net_device *dev = ptr;
+	struct activity_uid *e;
+	struct hlist_node *node, *tmp;
+	int b;
+
+	if (event != NETDEV_UNREGISTER || !net_eq(dev_net(dev), &init_net))
+		return NOTIFY_DONE;
+
+	spin_lock_bh(&uid_lock);
+	for (b = 0; b < ARRAY_SIZE(uid_hash); b++) {
+		hlist_for_each_entry_safe(e, node, tmp, &uid_hash[b], hash) {
+			if (e->ifindex != dev->ifindex)
+				continue;
+			hlist_del_rcu(&e->hash);
+			kfree_rcu(e, rcu);
+		}
+	}
+	spin_unlock_bh(&uid_lock);
+
+	return NOTIFY_DONE;
+}
+
 static struct notifier_block activity_stats_notifier_block = {
 	.notifier_call = activity_stats_notifier,
 };
 
+static struct notifier_block activity_uid_netdev_notifier = {
+	.notifier_call = activity_uid_netdev_event,
+};
+
 static int  __init activity_stats_init(void)
 {
 	create_proc_read_entry("activity", S_IRUGO,
 			init_net.proc_net_stat, activity_stats_read_proc, NULL);
+	proc_create("activity_uid", S_IRUGO, init_net.proc_net_stat,
+			&activity_uid_fops);
+	register_netdevice_notifier(&activity_uid_netdev_notifier);
 	return register_pm_notifier(&activity_stats_notifier_block);
 }
 
@@ -125,6 +125,7 @@
 #include <net/xfrm.h>
 #include <linux/ipsec.h>
 #include <net/cls_cgroup.h>
+#include <net/activity_stats.h>
 
 #include <linux/filter.h>
 
@@ -304,6 +305,7 @@ int sock_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 		return -ENOBUFS;
 	}
 
+	activity_stats_receive(sk, skb);
 	skb->dev = NULL;
 	skb_set_owner_r(skb, sk);
 
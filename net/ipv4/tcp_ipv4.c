@@ -73,6 +73,7 @@
 #include <net/xfrm.h>
 #include <net/netdma.h>
 #include <net/secure_seq.h>
+#include <net/activity_stats.h>
 
 #include <linux/inet.h>
 #include <linux/ipv6.h>
@@ -1696,6 +1697,7 @@ process:
 	if (sk_filter(sk, skb))
 		goto discard_and_relse;
 
+	activity_stats_receive(sk, skb);
 	skb->dev = NULL;
 
 	bh_lock_sock_nested(sk);
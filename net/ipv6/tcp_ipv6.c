@@ -62,6 +62,7 @@
 #include <net/netdma.h>
 #include <net/inet_common.h>
 #include <net/secure_seq.h>
+#include <net/activity_stats.h>
 
 #include <asm/uaccess.h>
 
@@ -1764,6 +1765,7 @@ process:
 	if (sk_filter(sk, skb))
 		goto discard_and_relse;
 
+	activity_stats_receive(sk, skb);
 	skb->dev = NULL;
 
 	bh_lock_sock_nested(sk);
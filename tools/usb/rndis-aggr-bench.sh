@@ -0,0 +1,144 @@
+#!/bin/sh
+#
+# Measure RNDIS throughput of the android gadget with and without
+# multi-packet transfers, host and gadget running in one kernel over
+# dummy_hcd.  Needs:
+#
+# - USB_G_ANDROID with USB_ANDROID_RNDIS, and USB_DUMMY_HCD as the
+#   peripheral controller
+# - USB_NET_RNDIS_HOST on the host side
+# - NET_PKTGEN, which sends the traffic
+#
+# usage:  rndis-aggr-bench.sh [packets per transfer ...]
+#
+# Each setting is used both ways: dl_max_pkts_per_xfer for gadget to
+# host, ul_max_pkts_per_xfer for host to gadget.  1 is the plain one
+# frame per transfer case to compare against.
+#
+
+COUNT=${COUNT:-200000}
+PKT_SIZE=${PKT_SIZE:-1514}
+
+ANDROID=/sys/class/android_usb/android0
+RNDIS=$ANDROID/f_rndis
+PGDEV=/proc/net/pktgen
+
+ARGS="$*"
+if [ "$ARGS" = "" ]; then
+	ARGS="1 3 5 10"
+fi
+
+die ()
+{
+	echo "$*" >&2
+	exit 1
+}
+
+pgset ()
+{
+	echo "$2" > $1 || die "pktgen: $1: $2 failed"
+}
+
+# the gadget side netdev sits under the gadget device, the host side
+# one is bound to rndis_host
+find_ifaces ()
+{
+	GADGET_IF=''
+	HOST_IF=''
+	for n in /sys/class/net/*; do
+		[ -e $n/device ] || continue
+		case $(readlink -f $n/device) in
+		*/gadget)
+			GADGET_IF=${n##*/}
+			;;
+		esac
+		if [ -e $n/device/driver ] &&
+		   [ "$(basename $(readlink -f $n/device/driver))" = rndis_host ]
+		then
+			HOST_IF=${n##*/}
+		fi
+	done
+}
+
+gadget_start ()
+{
+	echo 0 > $ANDROID/enable
+	echo 18d1 > $ANDROID/idVendor
+	echo 4e23 > $ANDROID/idProduct
+	echo rndis > $ANDROID/functions
+	echo $1 > $RNDIS/ul_max_pkts_per_xfer
+	echo $1 > $RNDIS/dl_max_pkts_per_xfer
+	echo 1 > $ANDROID/enable
+
+	for i in 1 2 3 4 5 6 7 8 9 10; do
+		find_ifaces
+		[ -n "$GADGET_IF" ] && [ -n "$HOST_IF" ] && break
+		sleep 1
+	done
+	[ -n "$GADGET_IF" ] || die "no gadget side rndis interface"
+	[ -n "$HOST_IF" ] || die "no rndis_host interface"
+
+	ip link set $GADGET_IF up
+	ip link set $HOST_IF up
+	# let rndis_host finish setting the packet filter
+	sleep 2
+}
+
+if_stat ()
+{
+	cat /sys/class/net/$1/statistics/$2
+}
+
+# run_pktgen <from> <to>: blast COUNT frames, report what arrived
+run_pktgen ()
+{
+	pgset $PGDEV/kpktgend_0 "rem_device_all"
+	pgset $PGDEV/kpktgend_0 "add_device $1"
+	pgset $PGDEV/$1 "count $COUNT"
+	pgset $PGDEV/$1 "pkt_size $PKT_SIZE"
+	pgset $PGDEV/$1 "clone_skb 0"
+	pgset $PGDEV/$1 "delay 0"
+	pgset $PGDEV/$1 "dst 10.0.0.2"
+	pgset $PGDEV/$1 "dst_mac $(cat /sys/class/net/$2/address)"
+
+	RX_PKTS=$(if_stat $2 rx_packets)
+	RX_BYTES=$(if_stat $2 rx_bytes)
+	START=$(date +%s.%N)
+	pgset $PGDEV/pgctrl "start"
+	# let what is still queued land; the wait is not timed
+	sleep 1
+	END=$(date +%s.%N)
+	RX_PKTS=$(($(if_stat $2 rx_packets) - RX_PKTS))
+	RX_BYTES=$(($(if_stat $2 rx_bytes) - RX_BYTES))
+
+	echo "$START $END $RX_PKTS $RX_BYTES" | awk '{
+		t = $2 - $1 - 1
+		printf "  %d packets in %.2fs, %.0f pkt/s, %.1f Mbit/s\n",
+			$3, t, $3 / t, $4 * 8 / t / 1000000
+	}'
+	grep -h "Result:" $PGDEV/$1 | sed 's/^/  pktgen: /'
+}
+
+[ -d $ANDROID ] || die "no android gadget"
+[ -d $RNDIS ] || die "android gadget without rndis"
+modprobe pktgen 2>/dev/null
+[ -d $PGDEV ] || die "no pktgen"
+
+for N in $ARGS; do
+	echo "** $N packet(s) per transfer"
+	gadget_start $N
+
+	echo 0 > $RNDIS/aggr_stats
+	echo "gadget to host ($GADGET_IF -> $HOST_IF):"
+	run_pktgen $GADGET_IF $HOST_IF
+
+	echo "host to gadget ($HOST_IF -> $GADGET_IF):"
+	run_pktgen $HOST_IF $GADGET_IF
+
+	sed 's/^/  /' $RNDIS/aggr_stats
+	echo ''
+done
+
+echo 0 > $ANDROID/enable
+
+# vim: sw=8